@@ -7,7 +7,10 @@ struct VertexBufferAttribute
 {
 	u8 location;
 	u8 componentCount;
-	u8 offset;
+	u32 offset;
+	GLenum type = GL_FLOAT;           // component type as stored in the buffer
+	GLboolean normalized = GL_FALSE;  // for integer (quantized) types
+	u32 stride = 0;                   // 0 means the stride of the layout
 };
 
 struct VertexBufferLayout
@@ -40,6 +43,12 @@ struct Submesh
 	std::vector<u32> indices;
 	u32 vertexOffset;
 	u32 indexOffset;
+	u32 indexCount;
+	GLenum indexType = GL_UNSIGNED_INT;
+
+	// Object space bounding box
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
 
 	std::vector<Vao> vaos;
 };
@@ -49,6 +58,17 @@ struct Mesh
 	std::vector<Submesh> submeshes;
 	GLuint vertexBufferHandle;
 	GLuint indexBufferHandle;
+
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+
+	// Residency (see residency.h)
+	std::string sourcePath;        // model file the mesh was loaded from
+	bool reloadable = false;       // its cooked file can give the geometry back
+	u32 residencyPolicy = 0;       // ResidencyPolicy
+	u64 gpuBytes = 0;
+	u64 lastDrawnFrame = 0;
+	u64 lastCpuUseFrame = 0;
 };
 
 struct Material
@@ -57,15 +77,41 @@ struct Material
 	glm::vec3 albedo;
 	glm::vec3 emissive;
 	f32 smoothness;
-	u32 albedoTextureIdx;
-	u32 emissiveTextureIdx;
-	u32 specularTextureIdx;
-	u32 normalsTextureIdx;
-	u32 bumpTextureIdx;
+
+	// UINT32_MAX when the material has no such texture
+	u32 albedoTextureIdx = UINT32_MAX;
+	u32 emissiveTextureIdx = UINT32_MAX;
+	u32 specularTextureIdx = UINT32_MAX;
+	u32 normalsTextureIdx = UINT32_MAX;
+	u32 bumpTextureIdx = UINT32_MAX;
+
+	// Normal and bump maps packed in one texture (TextureUsage_NormalHeight).
+	// Set by AddMaterial, the shaders sample it in place of both when loaded
+	u32 normalHeightTextureIdx = UINT32_MAX;
 };
 
-struct Model
+// A submesh living in the buffers of any loaded mesh. Used to share identical
+// geometry between nodes and model files instead of duplicating it.
+struct SubmeshRef
 {
 	u32 meshIdx;
+	u32 submeshIdx;
+};
+
+// A node of an imported hierarchy drawing a (possibly shared) submesh.
+struct MeshInstance
+{
+	SubmeshRef submesh;
+	u32 materialIdx;
+	glm::mat4 transform; // relative to the model root
+};
+
+struct Model
+{
+	u32 meshIdx = UINT32_MAX; // until loaded, see model_loading.h
 	std::vector<u32> materialIdx;
+
+	// Only filled for models imported with ModelImport_KeepHierarchy. In that
+	// case the submeshes are drawn through these instances instead of meshIdx.
+	std::vector<MeshInstance> instances;
 };
@@ -0,0 +1,925 @@
+#ifdef _WIN32
+#define VC_EXTRALEAN
+#define WIN32_LEAN_AND_MEAN
+#define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define ASSET_PACK_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
+#include "asset_pack.h"
+#include "engine.h"
+#include "hash.h"
+#include "job_system.h"
+#include <imgui.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+
+#define ASSET_PACK_MAGIC   0x4B434150 // "PACK"
+#define ASSET_PACK_VERSION 1
+
+// Reads in flight at once
+#define ASSET_PACK_QUEUE_DEPTH 64
+
+// LZ4 keeps sizes in 32 bits, bigger entries are stored
+#define LZ4_MAX_INPUT_SIZE 0x7E000000
+
+struct AssetPackHeader
+{
+    u32 magic;
+    u32 version;
+    u32 entryCount;
+    u32 tableSize;   // power of two, slots with a pathHash of 0 are empty
+    u64 tableOffset;
+    u64 namesOffset;
+    u64 namesSize;
+};
+
+struct AssetPackEntry
+{
+    u64 pathHash;    // of the normalized path, never 0
+    u64 offset;
+    u64 storedSize;
+    u64 size;
+    u32 nameOffset;  // in the names, zero terminated
+    u32 compression; // AssetCompression
+};
+
+struct AssetPack
+{
+    std::string           path;
+    MappedFile            mapping;
+    const AssetPackEntry* table;
+    const char*           names;
+    u32                   tableSize;
+    u32                   entryCount;
+
+#ifdef _WIN32
+    HANDLE                readHandle; // opened for overlapped reads
+#else
+    int                   readFd;
+#endif
+
+    // Loose files opened, to know what a pack of them would hold
+    std::mutex            looseMutex;
+    std::set<std::string> looseFiles;
+
+    // since startup
+    std::atomic<u64>      packedOpens;
+    std::atomic<u64>      looseOpens;
+    std::atomic<u64>      bytesRead;
+    std::atomic<u64>      bytesDecompressed;
+    std::atomic<u32>      readBatches;
+    std::atomic<bool>     ioUring;
+};
+
+static AssetPack GlobalAssetPack;
+
+// LZ4 block format ---------------------------------------------------------------
+
+static u32 Read32(const u8* p)
+{
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static u8* WriteLz4Length(u8* op, u32 length)
+{
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = (u8)length;
+    return op;
+}
+
+static u8* WriteLz4Sequence(u8* op, const u8* literals, u32 literalCount, u32 offset, u32 matchLength)
+{
+    u8* token = op++;
+    *token = (u8)(glm::min(literalCount, 15u) << 4);
+    if (literalCount >= 15)
+        op = WriteLz4Length(op, literalCount - 15);
+    memcpy(op, literals, literalCount);
+    op += literalCount;
+
+    // the last sequence only has literals
+    if (matchLength == 0)
+        return op;
+
+    *op++ = (u8)offset;
+    *op++ = (u8)(offset >> 8);
+    u32 length = matchLength - 4;
+    *token |= (u8)glm::min(length, 15u);
+    if (length >= 15)
+        op = WriteLz4Length(op, length - 15);
+    return op;
+}
+
+static u64 Lz4CompressBound(u64 size)
+{
+    return size + size / 255 + 16;
+}
+
+// Greedy, one candidate per hash. Returns the compressed size, dst holds at
+// least Lz4CompressBound(size) bytes
+static u64 Lz4Compress(const u8* src, u32 size, u8* dst)
+{
+    // The format wants the last 5 bytes as literals, and no match starting in the last 12
+    const u32 lastLiterals = 5;
+    const u32 matchStartLimit = 12;
+    const u32 hashBits = 16;
+
+    u8* op = dst;
+    u32 anchor = 0;
+
+    if (size > matchStartLimit)
+    {
+        std::vector<u32> table(1 << hashBits, UINT32_MAX);
+        const u32 matchLimit = size - lastLiterals;
+
+        for (u32 ip = 0; ip + matchStartLimit < size; )
+        {
+            u32 sequence = Read32(src + ip);
+            u32 hash = (sequence * 2654435761u) >> (32 - hashBits);
+            u32 candidate = table[hash];
+            table[hash] = ip;
+
+            if (candidate == UINT32_MAX || ip - candidate > 65535 || Read32(src + candidate) != sequence)
+            {
+                ip++;
+                continue;
+            }
+
+            u32 length = 4;
+            while (ip + length < matchLimit && src[candidate + length] == src[ip + length])
+                length++;
+
+            op = WriteLz4Sequence(op, src + anchor, ip - anchor, ip - candidate, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    op = WriteLz4Sequence(op, src + anchor, size - anchor, 0, 0);
+    return (u64)(op - dst);
+}
+
+static bool ReadLz4Length(const u8*& ip, const u8* end, u64& length)
+{
+    u8 byte;
+    do
+    {
+        if (ip == end)
+            return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Checks every length and offset, a damaged pack fails instead of overflowing
+static bool Lz4Decompress(const u8* src, u64 srcSize, u8* dst, u64 dstSize)
+{
+    const u8* ip = src;
+    const u8* end = src + srcSize;
+    u64 op = 0;
+
+    while (ip < end)
+    {
+        u8 token = *ip++;
+
+        u64 literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLz4Length(ip, end, literalCount))
+            return false;
+        if (literalCount > (u64)(end - ip) || literalCount > dstSize - op)
+            return false;
+        memcpy(dst + op, ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        u64 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        u64 matchLength = token & 15;
+        if (matchLength == 15 && !ReadLz4Length(ip, end, matchLength))
+            return false;
+        matchLength += 4;
+
+        if (offset == 0 || offset > op || matchLength > dstSize - op)
+            return false;
+
+        // byte by byte when the match overlaps what it writes
+        const u8* match = dst + op - offset;
+        if (offset >= matchLength)
+            memcpy(dst + op, match, matchLength);
+        else
+            for (u64 i = 0; i < matchLength; ++i)
+                dst[op + i] = match[i];
+        op += matchLength;
+    }
+
+    return op == dstSize;
+}
+
+// Reads --------------------------------------------------------------------------
+
+struct PackRead
+{
+    u64  offset;
+    u64  size;
+    u8*  dst;
+    bool succeeded;
+};
+
+static bool ReadAt(AssetPack& pack, u64 offset, u8* dst, u64 size)
+{
+#ifdef _WIN32
+    while (size > 0)
+    {
+        DWORD chunk = (DWORD)glm::min<u64>(size, GB(1));
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+        DWORD bytesRead = 0;
+        bool issued = ReadFile(pack.readHandle, dst, chunk, NULL, &overlapped) || GetLastError() == ERROR_IO_PENDING;
+        bool completed = issued && GetOverlappedResult(pack.readHandle, &overlapped, &bytesRead, TRUE);
+        CloseHandle(overlapped.hEvent);
+        if (!completed || bytesRead == 0)
+            return false;
+
+        offset += bytesRead;
+        dst += bytesRead;
+        size -= bytesRead;
+    }
+    return true;
+#else
+    while (size > 0)
+    {
+        ssize_t bytesRead = pread(pack.readFd, dst, (size_t)glm::min<u64>(size, GB(1)), (off_t)offset);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+
+        offset += (u64)bytesRead;
+        dst += bytesRead;
+        size -= (u64)bytesRead;
+    }
+    return true;
+#endif
+}
+
+#if ASSET_PACK_IO_URING
+// A ring per thread, loaders read from several workers at once
+struct IoUring
+{
+    int           fd = -1;
+    bool          initialized = false;
+    u32           entries;
+    u32*          sqHead;
+    u32*          sqTail;
+    u32*          sqMask;
+    u32*          sqArray;
+    io_uring_sqe* sqes;
+    u32*          cqHead;
+    u32*          cqTail;
+    u32*          cqMask;
+    io_uring_cqe* cqes;
+    void*         sqRing;
+    void*         cqRing;
+    size_t        sqRingSize;
+    size_t        cqRingSize;
+    size_t        sqesSize;
+
+    ~IoUring()
+    {
+        if (fd < 0)
+            return;
+        munmap(sqes, sqesSize);
+        if (cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        munmap(sqRing, sqRingSize);
+        close(fd);
+    }
+};
+
+static bool InitIoUring(IoUring& ring, u32 entries)
+{
+    io_uring_params params = {};
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return false; // old kernel, or disabled (containers)
+
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap)
+        ring.sqRingSize = ring.cqRingSize = glm::max(ring.sqRingSize, ring.cqRingSize);
+    ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    ring.sqRing = mmap(NULL, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring.cqRing = singleMap ? ring.sqRing : mmap(NULL, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void* sqes = mmap(NULL, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring.sqRing == MAP_FAILED || ring.cqRing == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, ring.sqesSize);
+        if (ring.cqRing != MAP_FAILED && ring.cqRing != ring.sqRing)
+            munmap(ring.cqRing, ring.cqRingSize);
+        if (ring.sqRing != MAP_FAILED)
+            munmap(ring.sqRing, ring.sqRingSize);
+        close(fd);
+        return false;
+    }
+
+    u8* sq = (u8*)ring.sqRing;
+    u8* cq = (u8*)ring.cqRing;
+    ring.sqHead = (u32*)(sq + params.sq_off.head);
+    ring.sqTail = (u32*)(sq + params.sq_off.tail);
+    ring.sqMask = (u32*)(sq + params.sq_off.ring_mask);
+    ring.sqArray = (u32*)(sq + params.sq_off.array);
+    ring.sqes = (io_uring_sqe*)sqes;
+    ring.cqHead = (u32*)(cq + params.cq_off.head);
+    ring.cqTail = (u32*)(cq + params.cq_off.tail);
+    ring.cqMask = (u32*)(cq + params.cq_off.ring_mask);
+    ring.cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring.entries = params.sq_entries;
+    ring.fd = fd;
+    return true;
+}
+
+// Returns false if io_uring is not available. Reads it could not complete are
+// left as failed, the caller retries them
+static bool ReadWithIoUring(AssetPack& pack, PackRead* reads, u32 count)
+{
+    static thread_local IoUring ring;
+    if (!ring.initialized)
+    {
+        ring.initialized = true;
+        InitIoUring(ring, ASSET_PACK_QUEUE_DEPTH);
+    }
+    if (ring.fd < 0)
+        return false;
+
+    u32 next = 0;
+    u32 inFlight = 0;
+    while (next < count || inFlight > 0)
+    {
+        // Queue as many reads as fit
+        u32 tail = *ring.sqTail;
+        u32 head = __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+        u32 queued = 0;
+        for (; next < count && inFlight < ring.entries && tail - head < ring.entries; ++next)
+        {
+            PackRead& read = reads[next];
+            if (read.size > UINT32_MAX)
+                continue; // compressed entries never are, see LZ4_MAX_INPUT_SIZE
+
+            u32 idx = tail & *ring.sqMask;
+            io_uring_sqe* sqe = &ring.sqes[idx];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = pack.readFd;
+            sqe->off = read.offset;
+            sqe->addr = (u64)read.dst;
+            sqe->len = (u32)read.size;
+            sqe->user_data = next;
+            ring.sqArray[idx] = idx;
+
+            tail++;
+            queued++;
+            inFlight++;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+
+        if (inFlight == 0)
+            break;
+
+        int result = (int)syscall(__NR_io_uring_enter, ring.fd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (result < 0 && errno != EINTR)
+            return true; // what was not completed is retried with pread
+
+        u32 cqHead = *ring.cqHead;
+        u32 cqTail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; cqHead != cqTail; ++cqHead)
+        {
+            const io_uring_cqe& cqe = ring.cqes[cqHead & *ring.cqMask];
+            PackRead& read = reads[cqe.user_data];
+            read.succeeded = cqe.res >= 0 && (u64)cqe.res == read.size; // short reads are retried
+            inFlight--;
+        }
+        __atomic_store_n(ring.cqHead, cqHead, __ATOMIC_RELEASE);
+    }
+
+    return true;
+}
+#endif
+
+#ifdef _WIN32
+// Issues up to ASSET_PACK_QUEUE_DEPTH overlapped reads, then waits for them
+static void ReadOverlapped(AssetPack& pack, PackRead* reads, u32 count)
+{
+    OVERLAPPED overlapped[ASSET_PACK_QUEUE_DEPTH];
+    bool issued[ASSET_PACK_QUEUE_DEPTH];
+
+    for (u32 first = 0; first < count; first += ASSET_PACK_QUEUE_DEPTH)
+    {
+        u32 batchCount = glm::min(count - first, (u32)ASSET_PACK_QUEUE_DEPTH);
+        for (u32 i = 0; i < batchCount; ++i)
+        {
+            PackRead& read = reads[first + i];
+            overlapped[i] = OVERLAPPED{};
+            overlapped[i].Offset = (DWORD)read.offset;
+            overlapped[i].OffsetHigh = (DWORD)(read.offset >> 32);
+            overlapped[i].hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+            issued[i] = read.size <= UINT32_MAX &&
+                        (ReadFile(pack.readHandle, read.dst, (DWORD)read.size, NULL, &overlapped[i]) || GetLastError() == ERROR_IO_PENDING);
+        }
+
+        for (u32 i = 0; i < batchCount; ++i)
+        {
+            PackRead& read = reads[first + i];
+            DWORD bytesRead = 0;
+            read.succeeded = issued[i] && GetOverlappedResult(pack.readHandle, &overlapped[i], &bytesRead, TRUE) && bytesRead == read.size;
+            CloseHandle(overlapped[i].hEvent);
+        }
+    }
+}
+#endif
+
+static void ReadPackBatch(AssetPack& pack, PackRead* reads, u32 count)
+{
+    if (count == 0)
+        return;
+
+    pack.readBatches++;
+
+#if defined(_WIN32)
+    ReadOverlapped(pack, reads, count);
+#elif ASSET_PACK_IO_URING
+    pack.ioUring = ReadWithIoUring(pack, reads, count);
+#endif
+
+    // pread from the job threads, for what is left
+    ParallelFor(count, [&pack, reads](u32 i)
+    {
+        PackRead& read = reads[i];
+        if (!read.succeeded)
+            read.succeeded = ReadAt(pack, read.offset, read.dst, read.size);
+    });
+}
+
+// Pack ---------------------------------------------------------------------------
+
+std::string NormalizeAssetPath(const char* filepath)
+{
+    std::string path(filepath);
+    for (char& c : path)
+    {
+        if (c == '\\')
+            c = '/';
+#ifdef _WIN32
+        else if (c >= 'A' && c <= 'Z')
+            c = c - 'A' + 'a';
+#endif
+    }
+
+    // Rebuild it segment by segment, resolving "." and ".."
+    std::vector<std::string> segments;
+    size_t begin = 0;
+    while (begin <= path.size())
+    {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos)
+            end = path.size();
+
+        std::string segment = path.substr(begin, end - begin);
+        if (segment == ".." && !segments.empty() && segments.back() != ".." && !segments.back().empty())
+            segments.pop_back();
+        else if (segment != "." && (!segment.empty() || begin == 0))
+            segments.push_back(segment); // an empty first segment keeps absolute paths absolute
+
+        begin = end + 1;
+    }
+
+    std::string normalized;
+    for (u32 i = 0; i < segments.size(); ++i)
+    {
+        if (i > 0)
+            normalized += '/';
+        normalized += segments[i];
+    }
+    return normalized;
+}
+
+static u64 HashAssetPath(const std::string& normalizedPath)
+{
+    u64 hash = HashBytes(normalizedPath.data(), normalizedPath.size());
+    return hash != 0 ? hash : 1;
+}
+
+static const AssetPackEntry* FindPackEntry(const AssetPack& pack, const char* filepath)
+{
+    if (pack.table == NULL)
+        return NULL;
+
+    std::string path = NormalizeAssetPath(filepath);
+    u64 hash = HashAssetPath(path);
+
+    for (u32 slot = (u32)hash & (pack.tableSize - 1); ; slot = (slot + 1) & (pack.tableSize - 1))
+    {
+        const AssetPackEntry& entry = pack.table[slot];
+        if (entry.pathHash == 0)
+            return NULL;
+        if (entry.pathHash == hash && path == pack.names + entry.nameOffset)
+            return &entry;
+    }
+}
+
+bool MountAssetPack(const char* packPath)
+{
+    AssetPack& pack = GlobalAssetPack;
+    UnmountAssetPack();
+
+    MappedFile mapping = MapFile(packPath);
+    if (mapping.data == NULL)
+        return false;
+
+    const AssetPackHeader* header = (const AssetPackHeader*)mapping.data;
+    bool valid = mapping.size >= sizeof(AssetPackHeader) &&
+                 header->magic == ASSET_PACK_MAGIC &&
+                 header->version == ASSET_PACK_VERSION &&
+                 header->tableSize != 0 && (header->tableSize & (header->tableSize - 1)) == 0 &&
+                 header->entryCount < header->tableSize &&
+                 header->tableOffset + (u64)header->tableSize * sizeof(AssetPackEntry) <= mapping.size &&
+                 header->namesOffset + header->namesSize <= mapping.size;
+
+    if (valid)
+    {
+        // Every entry has to be in the file and have a terminated name
+        const AssetPackEntry* table = (const AssetPackEntry*)(mapping.data + header->tableOffset);
+        for (u32 i = 0; i < header->tableSize && valid; ++i)
+            valid = table[i].pathHash == 0 ||
+                    (table[i].offset + table[i].storedSize <= mapping.size && table[i].nameOffset < header->namesSize &&
+                     memchr(mapping.data + header->namesOffset + table[i].nameOffset, 0, header->namesSize - table[i].nameOffset) != NULL);
+    }
+
+    if (!valid)
+    {
+        ELOG("%s is not an asset pack of version %u", packPath, ASSET_PACK_VERSION);
+        UnmapFile(mapping);
+        return false;
+    }
+
+#ifdef _WIN32
+    pack.readHandle = CreateFileA(packPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    bool opened = pack.readHandle != INVALID_HANDLE_VALUE;
+#else
+    pack.readFd = open(packPath, O_RDONLY);
+    bool opened = pack.readFd >= 0;
+#endif
+    if (!opened)
+    {
+        ELOG("Could not open %s for reading", packPath);
+        UnmapFile(mapping);
+        return false;
+    }
+
+    pack.path = packPath;
+    pack.mapping = mapping;
+    pack.table = (const AssetPackEntry*)(mapping.data + header->tableOffset);
+    pack.names = (const char*)(mapping.data + header->namesOffset);
+    pack.tableSize = header->tableSize;
+    pack.entryCount = header->entryCount;
+
+    ILOG("Mounted %s: %u assets", packPath, pack.entryCount);
+    return true;
+}
+
+void UnmountAssetPack()
+{
+    AssetPack& pack = GlobalAssetPack;
+    if (pack.table == NULL)
+        return;
+
+#ifdef _WIN32
+    CloseHandle(pack.readHandle);
+#else
+    close(pack.readFd);
+#endif
+    UnmapFile(pack.mapping);
+    pack.path.clear();
+    pack.table = NULL;
+    pack.names = NULL;
+    pack.tableSize = 0;
+    pack.entryCount = 0;
+}
+
+bool IsAssetPacked(const char* filepath)
+{
+    return FindPackEntry(GlobalAssetPack, filepath) != NULL;
+}
+
+AssetFile OpenAsset(const char* filepath)
+{
+    AssetFile file;
+    OpenAssets(&filepath, 1, &file);
+    return file;
+}
+
+void OpenAssets(const char* const* filepaths, u32 count, AssetFile* files)
+{
+    AssetPack& pack = GlobalAssetPack;
+
+    std::vector<PackRead> reads;
+    std::vector<u32> readFiles;
+    std::vector<const AssetPackEntry*> readEntries;
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        AssetFile& file = files[i];
+        file = AssetFile{};
+
+        const AssetPackEntry* entry = FindPackEntry(pack, filepaths[i]);
+        if (!entry)
+        {
+            file.mapping = MapFile(filepaths[i]);
+            file.data = file.mapping.data;
+            file.size = file.mapping.size;
+            pack.looseOpens++;
+
+            if (file.data)
+            {
+                std::lock_guard<std::mutex> lock(pack.looseMutex);
+                pack.looseFiles.insert(NormalizeAssetPath(filepaths[i]));
+            }
+            continue;
+        }
+
+        pack.packedOpens++;
+        if (entry->compression == AssetCompression_None)
+        {
+            file.data = pack.mapping.data + entry->offset;
+            file.size = entry->size;
+            continue;
+        }
+
+        PackRead read = {};
+        read.offset = entry->offset;
+        read.size = entry->storedSize;
+        read.dst = (u8*)malloc(entry->storedSize);
+        reads.push_back(read);
+        readFiles.push_back(i);
+        readEntries.push_back(entry);
+    }
+
+    ReadPackBatch(pack, reads.data(), (u32)reads.size());
+
+    ParallelFor((u32)reads.size(), [&](u32 i)
+    {
+        const PackRead& read = reads[i];
+        const AssetPackEntry& entry = *readEntries[i];
+        AssetFile& file = files[readFiles[i]];
+
+        u8* buffer = (u8*)malloc(entry.size);
+        if (read.succeeded && buffer && Lz4Decompress(read.dst, read.size, buffer, entry.size))
+        {
+            file.buffer = buffer;
+            file.data = buffer;
+            file.size = entry.size;
+            pack.bytesRead += read.size;
+            pack.bytesDecompressed += entry.size;
+        }
+        else
+        {
+            ELOG("Could not read %s from %s", pack.names + entry.nameOffset, pack.path.c_str());
+            free(buffer);
+        }
+        free(read.dst);
+    });
+}
+
+void CloseAsset(AssetFile& file)
+{
+    if (file.mapping.data)
+        UnmapFile(file.mapping);
+    free(file.buffer);
+    file = AssetFile{};
+}
+
+// Writing ------------------------------------------------------------------------
+
+struct PackedAsset
+{
+    std::string     path; // normalized
+    MappedFile      source;
+    std::vector<u8> compressed;
+    u32             compression;
+};
+
+// Cooked textures are streamed a few mips at a time straight from the pack
+// mapping, and their blocks barely compress anyway
+static bool ShouldCompressAsset(const std::string& path, u64 size)
+{
+    const char* streamedExtension = ".ktx2";
+    size_t extensionLength = strlen(streamedExtension);
+    bool streamed = path.size() >= extensionLength && path.compare(path.size() - extensionLength, extensionLength, streamedExtension) == 0;
+    return !streamed && size <= LZ4_MAX_INPUT_SIZE;
+}
+
+static void WritePadding(FILE* file, u64& offset, u64 alignment)
+{
+    static const u8 zeros[ASSET_PACK_ALIGNMENT] = {};
+    u64 padding = (alignment - offset % alignment) % alignment;
+    fwrite(zeros, 1, (size_t)padding, file);
+    offset += padding;
+}
+
+bool WriteAssetPack(const char* packPath, const std::vector<std::string>& filepaths)
+{
+    std::vector<PackedAsset> assets;
+    std::set<std::string> added;
+    for (const std::string& filepath : filepaths)
+    {
+        std::string path = NormalizeAssetPath(filepath.c_str());
+        if (added.insert(path).second)
+        {
+            assets.push_back(PackedAsset{});
+            assets.back().path = path;
+        }
+    }
+
+    // Compressed on the job threads, kept only if it saves an eighth
+    ParallelFor((u32)assets.size(), [&assets](u32 i)
+    {
+        PackedAsset& asset = assets[i];
+        asset.source = MapFile(asset.path.c_str());
+        asset.compression = AssetCompression_None;
+        if (asset.source.data == NULL || !ShouldCompressAsset(asset.path, asset.source.size))
+            return;
+
+        asset.compressed.resize(Lz4CompressBound(asset.source.size));
+        u64 compressedSize = Lz4Compress(asset.source.data, (u32)asset.source.size, asset.compressed.data());
+        if (compressedSize < asset.source.size - asset.source.size / 8)
+        {
+            asset.compressed.resize(compressedSize);
+            asset.compression = AssetCompression_LZ4;
+        }
+        else
+        {
+            asset.compressed = std::vector<u8>();
+        }
+    });
+
+    bool sourcesFound = true;
+    for (const PackedAsset& asset : assets)
+    {
+        if (asset.source.data == NULL)
+        {
+            ELOG("WriteAssetPack() - Could not open %s", asset.path.c_str());
+            sourcesFound = false;
+        }
+    }
+
+    FILE* file = sourcesFound ? fopen(packPath, "wb") : NULL;
+    if (!file)
+    {
+        if (sourcesFound)
+        {
+            ELOG("fopen() failed writing file %s", packPath);
+        }
+        for (PackedAsset& asset : assets)
+            UnmapFile(asset.source);
+        return false;
+    }
+
+    u32 tableSize = 16;
+    while (tableSize < assets.size() * 2)
+        tableSize *= 2;
+
+    AssetPackHeader header = {};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = (u32)assets.size();
+    header.tableSize = tableSize;
+    fwrite(&header, sizeof(header), 1, file);
+
+    std::vector<AssetPackEntry> table(tableSize, AssetPackEntry{});
+    std::string names;
+    u64 offset = sizeof(header);
+    u64 sourceBytes = 0;
+
+    for (PackedAsset& asset : assets)
+    {
+        WritePadding(file, offset, ASSET_PACK_ALIGNMENT);
+
+        AssetPackEntry entry = {};
+        entry.pathHash = HashAssetPath(asset.path);
+        entry.offset = offset;
+        entry.size = asset.source.size;
+        entry.nameOffset = (u32)names.size();
+        entry.compression = asset.compression;
+
+        if (asset.compression == AssetCompression_None)
+        {
+            entry.storedSize = asset.source.size;
+            fwrite(asset.source.data, 1, (size_t)asset.source.size, file);
+        }
+        else
+        {
+            entry.storedSize = asset.compressed.size();
+            fwrite(asset.compressed.data(), 1, asset.compressed.size(), file);
+        }
+        offset += entry.storedSize;
+        sourceBytes += asset.source.size;
+
+        names += asset.path;
+        names += '\0';
+
+        u32 slot = (u32)entry.pathHash & (tableSize - 1);
+        while (table[slot].pathHash != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        table[slot] = entry;
+
+        UnmapFile(asset.source);
+        asset.compressed = std::vector<u8>();
+    }
+
+    WritePadding(file, offset, sizeof(u64));
+    header.tableOffset = offset;
+    fwrite(table.data(), sizeof(AssetPackEntry), table.size(), file);
+    offset += table.size() * sizeof(AssetPackEntry);
+
+    header.namesOffset = offset;
+    header.namesSize = names.size();
+    fwrite(names.data(), 1, names.size(), file);
+    offset += names.size();
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    bool written = ferror(file) == 0;
+    fclose(file);
+
+    if (written)
+    {
+        ILOG("Wrote %s: %u assets, %.2f MB from %.2f MB", packPath, header.entryCount, offset / (f32)MB(1), sourceBytes / (f32)MB(1));
+    }
+    else
+    {
+        ELOG("WriteAssetPack() - Could not write %s", packPath);
+    }
+    return written;
+}
+
+void AssetPackGui()
+{
+    if (!ImGui::CollapsingHeader("Asset pack"))
+        return;
+
+    AssetPack& pack = GlobalAssetPack;
+
+    if (pack.table)
+        ImGui::Text("Mounted: %s (%u assets)", pack.path.c_str(), pack.entryCount);
+    else
+        ImGui::Text("No pack mounted, assets are read from loose files");
+
+    ImGui::Text("Opened from the pack: %llu   Loose: %llu", (unsigned long long)pack.packedOpens, (unsigned long long)pack.looseOpens);
+    ImGui::Text("Read: %.2f MB   Decompressed: %.2f MB   Batches: %u", pack.bytesRead / (f32)MB(1), pack.bytesDecompressed / (f32)MB(1), (u32)pack.readBatches);
+#if ASSET_PACK_IO_URING
+    ImGui::Text("io_uring: %s", pack.ioUring.load() ? "yes" : "no (pread)");
+#endif
+
+    std::vector<std::string> looseFiles;
+    {
+        std::lock_guard<std::mutex> lock(pack.looseMutex);
+        looseFiles.assign(pack.looseFiles.begin(), pack.looseFiles.end());
+    }
+
+    // The mounted pack can not be rewritten while it is mapped
+    if (!pack.table && !looseFiles.empty())
+    {
+        char label[64];
+        sprintf(label, "Pack the %u files read", (u32)looseFiles.size());
+        if (ImGui::Button(label))
+            WriteAssetPack("assets.pack", looseFiles);
+    }
+}
@@ -0,0 +1,79 @@
+//
+// asset_pack.h: Assets can be read from a single pack file instead of the loose
+// files under WorkingDir. The pack starts with a header, the entries follow
+// aligned to ASSET_PACK_ALIGNMENT, each one compressed on its own (LZ4 block
+// format) or stored as is, and a hashed table of contents closes it.
+//
+// Loaders open assets by path with OpenAsset, which looks in the mounted pack
+// first and falls back to the loose file. Stored entries are views into a
+// mapping of the pack, so cooked textures keep streaming their mips from it.
+// Compressed entries are read with batched asynchronous reads (io_uring on
+// Linux, overlapped reads on Windows, pread on the job threads otherwise) and
+// decompressed on the job threads.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <string>
+#include <vector>
+
+#define ASSET_PACK_ALIGNMENT 4096
+
+enum AssetCompression
+{
+    AssetCompression_None,
+    AssetCompression_LZ4,
+};
+
+/**
+ * Contents of an asset, from the pack or from the loose file. On failure the
+ * data pointer is NULL.
+ */
+struct AssetFile
+{
+    const u8*  data;
+    u64        size;
+    MappedFile mapping; // loose files
+    u8*        buffer;  // decompressed pack entries
+};
+
+/**
+ * Makes paths that point to the same file compare equal: forward slashes, no
+ * "." or ".." segments and, on Windows, lower case.
+ */
+std::string NormalizeAssetPath(const char* filepath);
+
+/**
+ * Mounts a pack, assets found in it are read from it from then on. Returns false
+ * if the file is missing or is not a pack.
+ */
+bool MountAssetPack(const char* packPath);
+
+/**
+ * Unmounts the pack. No asset opened from it may be open anymore.
+ */
+void UnmountAssetPack();
+
+bool IsAssetPacked(const char* filepath);
+
+/**
+ * Opens an asset for reading. Thread safe, loaders call it from the workers.
+ */
+AssetFile OpenAsset(const char* filepath);
+
+/**
+ * Opens several assets at once, so that the reads of the packed ones are issued
+ * together.
+ */
+void OpenAssets(const char* const* filepaths, u32 count, AssetFile* files);
+
+void CloseAsset(AssetFile& file);
+
+/**
+ * Writes a pack with the given files, read from disk. Their paths are stored
+ * normalized, as they are looked up.
+ */
+bool WriteAssetPack(const char* packPath, const std::vector<std::string>& filepaths);
+
+void AssetPackGui();
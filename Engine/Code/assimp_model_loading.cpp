@@ -5,65 +5,17 @@
 #include <assimp/postprocess.h>
 #include "assimp_model_loading.h"
 #include "engine.h"
-
-void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Mesh *myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+#include "job_system.h"
+#include "hash.h"
+#include "mesh_cache.h"
+#include "gltf_loading.h"
+#include "model_loading.h"
+#include "obj_loading.h"
+
+void ProcessAssimpMesh(const aiMesh *mesh, Submesh& submesh)
 {
-    std::vector<float> vertices;
-    std::vector<u32> indices;
-
-    bool hasTexCoords = false;
-    bool hasTangentSpace = false;
-
-    // process vertices
-    for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-    {
-        vertices.push_back(mesh->mVertices[i].x);
-        vertices.push_back(mesh->mVertices[i].y);
-        vertices.push_back(mesh->mVertices[i].z);
-        vertices.push_back(mesh->mNormals[i].x);
-        vertices.push_back(mesh->mNormals[i].y);
-        vertices.push_back(mesh->mNormals[i].z);
-
-        if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-        {
-            hasTexCoords = true;
-            vertices.push_back(mesh->mTextureCoords[0][i].x);
-            vertices.push_back(mesh->mTextureCoords[0][i].y);
-        }
-
-        if(mesh->mTangents != nullptr && mesh->mBitangents)
-        {
-            hasTangentSpace = true;
-            vertices.push_back(mesh->mTangents[i].x);
-            vertices.push_back(mesh->mTangents[i].y);
-            vertices.push_back(mesh->mTangents[i].z);
-
-            // For some reason ASSIMP gives me the bitangents flipped.
-            // Maybe it's my fault, but when I generate my own geometry
-            // in other files (see the generation of standard assets)
-            // and all the bitangents have the orientation I expect,
-            // everything works ok.
-            // I think that (even if the documentation says the opposite)
-            // it returns a left-handed tangent space matrix.
-            // SOLUTION: I invert the components of the bitangent here.
-            vertices.push_back(-mesh->mBitangents[i].x);
-            vertices.push_back(-mesh->mBitangents[i].y);
-            vertices.push_back(-mesh->mBitangents[i].z);
-        }
-    }
-
-    // process indices
-    for(unsigned int i = 0; i < mesh->mNumFaces; i++)
-    {
-        aiFace face = mesh->mFaces[i];
-        for(unsigned int j = 0; j < face.mNumIndices; j++)
-        {
-            indices.push_back(face.mIndices[j]);
-        }
-    }
-
-    // store the proper (previously proceessed) material for this mesh
-    submeshMaterialIndices.push_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
+    const bool hasTexCoords = mesh->mTextureCoords[0] != nullptr;
+    const bool hasTangentSpace = mesh->mTangents != nullptr && mesh->mBitangents != nullptr;
 
     // create the vertex format
     VertexBufferLayout vertexBufferLayout = {};
@@ -84,15 +36,87 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Mesh *myMesh, u32 bas
         vertexBufferLayout.stride += 3 * sizeof(float);
     }
 
-    // add the submesh into the mesh
-    Submesh submesh = {};
+    // size the buffers once, then fill them attribute stream by attribute stream
+    const u32 vertexCount = mesh->mNumVertices;
+    const u32 floatsPerVertex = vertexBufferLayout.stride / sizeof(float);
+
+    u32 indexCount = 0;
+    for (u32 i = 0; i < mesh->mNumFaces; ++i)
+        indexCount += mesh->mFaces[i].mNumIndices;
+
     submesh.vertexBufferLayout = vertexBufferLayout;
-    submesh.vertices.swap(vertices);
-    submesh.indices.swap(indices);
-    myMesh->submeshes.push_back( submesh );
+    submesh.vertices.resize(vertexCount * floatsPerVertex);
+    submesh.indices.resize(indexCount);
+
+    // process vertices
+    const aiVector3D* positions = mesh->mVertices;
+    const aiVector3D* normals   = mesh->mNormals;
+    submesh.boundsMin = vec3( FLT_MAX);
+    submesh.boundsMax = vec3(-FLT_MAX);
+    float* dst = submesh.vertices.data();
+    for (u32 i = 0; i < vertexCount; ++i, dst += floatsPerVertex)
+    {
+        vec3 position(positions[i].x, positions[i].y, positions[i].z);
+        submesh.boundsMin = glm::min(submesh.boundsMin, position);
+        submesh.boundsMax = glm::max(submesh.boundsMax, position);
+
+        dst[0] = positions[i].x;
+        dst[1] = positions[i].y;
+        dst[2] = positions[i].z;
+        dst[3] = normals[i].x;
+        dst[4] = normals[i].y;
+        dst[5] = normals[i].z;
+    }
+
+    u32 attributeOffset = 6;
+
+    if (hasTexCoords) // does the mesh contain texture coordinates?
+    {
+        const aiVector3D* texCoords = mesh->mTextureCoords[0];
+        dst = submesh.vertices.data() + attributeOffset;
+        for (u32 i = 0; i < vertexCount; ++i, dst += floatsPerVertex)
+        {
+            dst[0] = texCoords[i].x;
+            dst[1] = texCoords[i].y;
+        }
+        attributeOffset += 2;
+    }
+
+    if (hasTangentSpace)
+    {
+        // For some reason ASSIMP gives me the bitangents flipped.
+        // Maybe it's my fault, but when I generate my own geometry
+        // in other files (see the generation of standard assets)
+        // and all the bitangents have the orientation I expect,
+        // everything works ok.
+        // I think that (even if the documentation says the opposite)
+        // it returns a left-handed tangent space matrix.
+        // SOLUTION: I invert the components of the bitangent here.
+        const aiVector3D* tangents   = mesh->mTangents;
+        const aiVector3D* bitangents = mesh->mBitangents;
+        dst = submesh.vertices.data() + attributeOffset;
+        for (u32 i = 0; i < vertexCount; ++i, dst += floatsPerVertex)
+        {
+            dst[0] =  tangents[i].x;
+            dst[1] =  tangents[i].y;
+            dst[2] =  tangents[i].z;
+            dst[3] = -bitangents[i].x;
+            dst[4] = -bitangents[i].y;
+            dst[5] = -bitangents[i].z;
+        }
+    }
+
+    // process indices
+    u32* indexDst = submesh.indices.data();
+    for (u32 i = 0; i < mesh->mNumFaces; ++i)
+    {
+        const aiFace& face = mesh->mFaces[i];
+        memcpy(indexDst, face.mIndices, face.mNumIndices * sizeof(u32));
+        indexDst += face.mNumIndices;
+    }
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial *material, Material& myMaterial, String directory)
+void ProcessAssimpMaterial(ModelImport& import, aiMaterial *material, Material& myMaterial, const std::string& directory)
 {
     aiString name;
     aiColor3D diffuseColor;
@@ -114,137 +138,249 @@ void ProcessAssimpMaterial(App* app, aiMaterial *material, Material& myMaterial,
     if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
     {
         material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
+        std::string filepath = MakeModelPath(directory, aiFilename.C_Str());
+        myMaterial.albedoTextureIdx = ImportTexture(import, filepath.c_str());
     }
     if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
     {
         material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
+        std::string filepath = MakeModelPath(directory, aiFilename.C_Str());
+        myMaterial.emissiveTextureIdx = ImportTexture(import, filepath.c_str());
     }
     if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
     {
         material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
+        std::string filepath = MakeModelPath(directory, aiFilename.C_Str());
+        myMaterial.specularTextureIdx = ImportTexture(import, filepath.c_str());
     }
     if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
     {
         material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
+        std::string filepath = MakeModelPath(directory, aiFilename.C_Str());
+        myMaterial.normalsTextureIdx = ImportTexture(import, filepath.c_str(), TextureUsage_Normal);
     }
     if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
     {
         material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
-        String filename = MakeString(aiFilename.C_Str());
-        String filepath = MakePath(directory, filename);
-        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+        std::string filepath = MakeModelPath(directory, aiFilename.C_Str());
+        myMaterial.bumpTextureIdx = ImportTexture(import, filepath.c_str(), TextureUsage_Height);
     }
 
     //myMaterial.createNormalFromBump();
 }
 
-void ProcessAssimpNode(const aiScene* scene, aiNode *node, Mesh *myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+void ProcessAssimpNode(const aiScene* scene, aiNode *node, std::vector<const aiMesh*>& meshes)
 {
-    // process all the node's meshes (if any)
+    // collect all the node's meshes (if any)
     for(unsigned int i = 0; i < node->mNumMeshes; i++)
     {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        ProcessAssimpMesh(scene, mesh, myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 
     // then do the same for each of its children
     for(unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        ProcessAssimpNode(scene, node->mChildren[i], myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        ProcessAssimpNode(scene, node->mChildren[i], meshes);
     }
 }
 
-u32 LoadModel(App* app, const char* filename)
+void ProcessAssimpNodeInstances(const aiScene* scene, aiNode *node, const glm::mat4& parentTransform,
+                                const std::vector<SubmeshRef>& submeshRefs, const std::vector<u32>& materialIndices,
+                                std::vector<MeshInstance>& instances)
 {
-    const aiScene* scene = aiImportFile(filename,
-                                        aiProcess_Triangulate           |
-                                        aiProcess_GenSmoothNormals      |
-                                        aiProcess_CalcTangentSpace      |
-                                        aiProcess_JoinIdenticalVertices |
-                                        aiProcess_PreTransformVertices  |
-                                        aiProcess_ImproveCacheLocality  |
-                                        aiProcess_OptimizeMeshes        |
-                                        aiProcess_SortByPType);
+    // aiMatrix4x4 is row-major while glm stores columns
+    glm::mat4 transform = parentTransform * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
 
-    if (!scene)
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
-        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
-        return UINT32_MAX;
+        u32 assimpMeshIdx = node->mMeshes[i];
+
+        MeshInstance instance = {};
+        instance.submesh = submeshRefs[assimpMeshIdx];
+        instance.materialIdx = materialIndices[scene->mMeshes[assimpMeshIdx]->mMaterialIndex];
+        instance.transform = transform;
+        instances.push_back(instance);
+    }
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        ProcessAssimpNodeInstances(scene, node->mChildren[i], transform, submeshRefs, materialIndices, instances);
     }
+}
+
+static u64 HashSubmeshContents(const Submesh& submesh, u64 seed)
+{
+    u64 hash = HashBytes(submesh.vertices.data(), submesh.vertices.size() * sizeof(float), seed);
+    hash = HashCombine(hash, HashBytes(submesh.indices.data(), submesh.indices.size() * sizeof(u32), seed));
+    hash = HashCombine(hash, submesh.vertexBufferLayout.stride);
+    return hash;
+}
 
-    app->meshes.push_back(Mesh{});
-    Mesh& mesh = app->meshes.back();
-    u32 meshIdx = (u32)app->meshes.size() - 1u;
+// Two xxHash64 with unrelated seeds, 128 bits of the whole contents
+static SubmeshHash HashSubmesh(const Submesh& submesh)
+{
+    SubmeshHash hash;
+    hash.key = HashSubmeshContents(submesh, 0);
+    hash.check = HashSubmeshContents(submesh, 0x9E3779B97F4A7C15ull);
+    return hash;
+}
 
-    app->models.push_back(Model{});
-    Model& model = app->models.back();
-    model.meshIdx = meshIdx;
-    u32 modelIdx = (u32)app->models.size() - 1u;
+void UploadMesh(App* app, Mesh& mesh)
+{
+    std::vector<BufferRange> vertexRanges;
+    std::vector<BufferRange> indexRanges;
+    u64 vertexBufferSize = 0;
+    u64 indexBufferSize = 0;
 
-    String directory = GetDirectoryPart(MakeString(filename));
+    mesh.boundsMin = vec3( FLT_MAX);
+    mesh.boundsMax = vec3(-FLT_MAX);
 
-    // Create a list of materials
-    u32 baseMeshMaterialIndex = (u32)app->materials.size();
-    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        app->materials.push_back(Material{});
-        Material& material = app->materials.back();
-        ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+        Submesh& submesh = mesh.submeshes[i];
+
+        const u64 verticesSize = submesh.vertices.size() * sizeof(float);
+        vertexRanges.push_back(BufferRange{ submesh.vertices.data(), verticesSize, vertexBufferSize });
+        submesh.vertexOffset = (u32)vertexBufferSize;
+        vertexBufferSize += verticesSize;
+
+        const u64 indicesSize = submesh.indices.size() * sizeof(u32);
+        indexRanges.push_back(BufferRange{ submesh.indices.data(), indicesSize, indexBufferSize });
+        submesh.indexOffset = (u32)indexBufferSize;
+        indexBufferSize += indicesSize;
+
+        submesh.indexCount = submesh.indices.size();
+        mesh.boundsMin = glm::min(mesh.boundsMin, submesh.boundsMin);
+        mesh.boundsMax = glm::max(mesh.boundsMax, submesh.boundsMax);
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
+    mesh.vertexBufferHandle = CreateStaticBuffer(app, vertexBufferSize, vertexRanges.data(), (u32)vertexRanges.size());
+    mesh.indexBufferHandle = CreateStaticBuffer(app, indexBufferSize, indexRanges.data(), (u32)indexRanges.size());
+}
 
-    aiReleaseImport(scene);
+static bool HasExtension(const char* filename, const char* extension)
+{
+    const char* dot = strrchr(filename, '.');
+    if (dot == NULL || strlen(dot) != strlen(extension))
+        return false;
+    for (u32 i = 0; dot[i]; ++i)
+        if (tolower(dot[i]) != extension[i])
+            return false;
+    return true;
+}
 
-    u32 vertexBufferSize = 0;
-    u32 indexBufferSize = 0;
+bool ImportModel(const App* app, ModelImport& import)
+{
+    const char* filename = import.filename.c_str();
+    const u32 importFlags = import.importFlags;
+    const bool keepHierarchy = (importFlags & ModelImport_KeepHierarchy) != 0;
 
-    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    // glTF goes through the native loader, which always keeps the node hierarchy
+    if (HasExtension(filename, ".gltf") || HasExtension(filename, ".glb"))
+        return LoadGltfModel(app, import, filename);
+
+    // Shared submeshes depend on what else was loaded, so only flattened models are cooked
+    if (!keepHierarchy && LoadCookedModel(import, filename, importFlags))
+        return true;
+
+    // OBJ files have no hierarchy to keep, the native parser is much faster than Assimp's
+    if (!keepHierarchy && HasExtension(filename, ".obj"))
+    {
+        import.cook = true;
+        return LoadObjModel(import, filename);
+    }
+
+    unsigned int postProcessFlags = aiProcess_Triangulate           |
+                                    aiProcess_GenSmoothNormals      |
+                                    aiProcess_CalcTangentSpace      |
+                                    aiProcess_JoinIdenticalVertices |
+                                    aiProcess_ImproveCacheLocality  |
+                                    aiProcess_SortByPType;
+
+    // Flattening bakes (and duplicates) every instance into the vertex data,
+    // and merging meshes would break the one aiMesh <-> one submesh mapping
+    if (!keepHierarchy)
+        postProcessFlags |= aiProcess_PreTransformVertices | aiProcess_OptimizeMeshes;
+
+    // Packed files are imported from memory, the extension tells assimp the format
+    const aiScene* scene = NULL;
+    if (IsAssetPacked(filename))
+    {
+        AssetFile file = OpenAsset(filename);
+        const char* extension = strrchr(filename, '.');
+        if (file.data)
+            scene = aiImportFileFromMemory((const char*)file.data, (unsigned int)file.size, postProcessFlags, extension ? extension + 1 : "");
+        CloseAsset(file);
+    }
+    else
     {
-        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-        indexBufferSize  += mesh.submeshes[i].indices.size()  * sizeof(u32);
+        scene = aiImportFile(filename, postProcessFlags);
     }
 
-    glGenBuffers(1, &mesh.vertexBufferHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
-    glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, NULL, GL_STATIC_DRAW);
+    if (!scene)
+    {
+        ELOG("Error loading mesh %s: %s", filename, aiGetErrorString());
+        return false;
+    }
 
-    glGenBuffers(1, &mesh.indexBufferHandle);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, NULL, GL_STATIC_DRAW);
+    Mesh& mesh = import.mesh;
+    std::string directory = GetModelDirectory(filename);
 
-    u32 indicesOffset = 0;
-    u32 verticesOffset = 0;
+    // Create a list of materials, identical ones are shared with other models once committed
+    import.materials.resize(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
+        ProcessAssimpMaterial(import, scene->mMaterials[i], import.materials[i], directory);
 
-    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    if (keepHierarchy)
     {
-        const void* verticesData = mesh.submeshes[i].vertices.data();
-        const u32   verticesSize = mesh.submeshes[i].vertices.size() * sizeof(float);
-        glBufferSubData(GL_ARRAY_BUFFER, verticesOffset, verticesSize, verticesData);
-        mesh.submeshes[i].vertexOffset = verticesOffset;
-        verticesOffset += verticesSize;
+        // Every aiMesh is processed once, no matter how many nodes reference it.
+        // Submeshes loaded before by other models are shared when committed
+        mesh.submeshes.resize(scene->mNumMeshes);
+        import.submeshHashes.resize(scene->mNumMeshes);
 
-        const void* indicesData = mesh.submeshes[i].indices.data();
-        const u32   indicesSize = mesh.submeshes[i].indices.size() * sizeof(u32);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indicesOffset, indicesSize, indicesData);
-        mesh.submeshes[i].indexOffset = indicesOffset;
-        indicesOffset += indicesSize;
+        ParallelFor(scene->mNumMeshes, [&](u32 i)
+        {
+            ProcessAssimpMesh(scene->mMeshes[i], mesh.submeshes[i]);
+            import.submeshHashes[i] = HashSubmesh(mesh.submeshes[i]);
+        });
+
+        std::vector<SubmeshRef> submeshRefs(scene->mNumMeshes);
+        std::vector<u32> materialIndices(scene->mNumMaterials);
+        for (u32 i = 0; i < scene->mNumMeshes; ++i)
+            submeshRefs[i] = SubmeshRef{ 0, i };
+        for (u32 i = 0; i < scene->mNumMaterials; ++i)
+            materialIndices[i] = i;
+
+        ProcessAssimpNodeInstances(scene, scene->mRootNode, glm::mat4(1.0f), submeshRefs, materialIndices, import.instances);
     }
+    else
+    {
+        // Gather the meshes in node order and process them in parallel, as each
+        // aiMesh is written into its own (already allocated) submesh
+        std::vector<const aiMesh*> assimpMeshes;
+        ProcessAssimpNode(scene, scene->mRootNode, assimpMeshes);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+        mesh.submeshes.resize(assimpMeshes.size());
+        for (const aiMesh* assimpMesh : assimpMeshes)
+        {
+            // store the proper (previously proceessed) material for this mesh
+            import.materialIdx.push_back(assimpMesh->mMaterialIndex);
+        }
+
+        ParallelFor((u32)assimpMeshes.size(), [&](u32 i)
+        {
+            ProcessAssimpMesh(assimpMeshes[i], mesh.submeshes[i]);
+        });
 
-    return modelIdx;
-}
\ No newline at end of file
+        import.cook = true;
+    }
+
+    aiReleaseImport(scene);
+
+    return true;
+}
+
+u32 LoadModel(App* app, const char* filename, u32 importFlags)
+{
+    return QueueModelLoad(app, filename, importFlags);
+}
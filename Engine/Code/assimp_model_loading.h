@@ -1,7 +1,30 @@
 #pragma once
 
 struct App;
+struct Mesh;
+struct ModelImport;
 typedef unsigned int u32;
 
+enum ModelImportFlags
+{
+    // Bakes every node transform into the vertices (aiProcess_PreTransformVertices)
+    ModelImport_Flatten       = 0,
+    // Keeps the aiNode hierarchy: each unique aiMesh is stored once and the
+    // nodes become instances referencing it. Identical meshes of any model
+    // loaded this way are detected by content hash and shared.
+    ModelImport_KeepHierarchy = 1 << 0,
+};
 
-u32 LoadModel(App* app, const char* filename);
\ No newline at end of file
+
+/**
+ * Returns the index of the model right away, the file is imported in the
+ * background (see model_loading.h). The model is drawn once loaded.
+ */
+u32 LoadModel(App* app, const char* filename, u32 importFlags = ModelImport_Flatten);
+
+// Imports import.filename with import.importFlags, from its cooked file if up
+// to date. Only writes to the import, it runs on the worker threads
+bool ImportModel(const App* app, ModelImport& import);
+
+// Creates the vertex/index buffers of a mesh from the CPU data of its submeshes
+void UploadMesh(App* app, Mesh& mesh);
\ No newline at end of file
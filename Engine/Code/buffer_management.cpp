@@ -11,15 +11,30 @@ u32 Align(u32 value, u32 alignment)
     return (value + alignment - 1) & ~(alignment - 1);
 }
 
+// Immutable storage where the driver has it: the buffers are only ever mapped
+// and written, never reallocated, so usage is left to the map flags
 Buffer CreateBuffer(u32 size, GLenum type, GLenum usage)
 {
+    const GLExtensions& ext = GlobalGLExtensions;
+    const GLbitfield storageFlags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT;
+
     Buffer buffer = {};
     buffer.size = size;
     buffer.type = type;
 
+    if (ext.directStateAccess && ext.bufferStorage)
+    {
+        ext.CreateBuffers(1, &buffer.handle);
+        ext.NamedBufferStorage(buffer.handle, buffer.size, NULL, storageFlags);
+        return buffer;
+    }
+
     glGenBuffers(1, &buffer.handle);
     glBindBuffer(type, buffer.handle);
-    glBufferData(type, buffer.size, NULL, usage);
+    if (ext.bufferStorage)
+        ext.BufferStorage(type, buffer.size, NULL, storageFlags);
+    else
+        glBufferData(type, buffer.size, NULL, usage);
     glBindBuffer(type, 0);
 
     return buffer;
@@ -32,15 +47,37 @@ void BindBuffer(const Buffer& buffer)
 
 void MapBuffer(Buffer& buffer, GLenum access)
 {
-    glBindBuffer(buffer.type, buffer.handle);
-    buffer.data = (u8*)glMapBuffer(buffer.type, access);
+    // Write-only maps discard the previous contents, so the driver can hand out
+    // fresh memory instead of waiting for the GPU to finish reading them
+    GLbitfield flags = access == GL_READ_ONLY ? GL_MAP_READ_BIT
+                     : access == GL_WRITE_ONLY ? GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+                     : GL_MAP_READ_BIT | GL_MAP_WRITE_BIT;
+
+    const GLExtensions& ext = GlobalGLExtensions;
+    if (ext.directStateAccess)
+    {
+        buffer.data = (u8*)ext.MapNamedBufferRange(buffer.handle, 0, buffer.size, flags);
+    }
+    else
+    {
+        glBindBuffer(buffer.type, buffer.handle);
+        buffer.data = (u8*)glMapBufferRange(buffer.type, 0, buffer.size, flags);
+    }
     buffer.head = 0;
 }
 
 void UnmapBuffer(Buffer& buffer)
 {
-    glUnmapBuffer(buffer.type);
-    glBindBuffer(buffer.type, 0);
+    const GLExtensions& ext = GlobalGLExtensions;
+    if (ext.directStateAccess)
+    {
+        ext.UnmapNamedBuffer(buffer.handle);
+    }
+    else
+    {
+        glUnmapBuffer(buffer.type);
+        glBindBuffer(buffer.type, 0);
+    }
 }
 
 void AlignHead(Buffer& buffer, u32 alignment)
@@ -49,10 +86,17 @@ void AlignHead(Buffer& buffer, u32 alignment)
     buffer.head = Align(buffer.head, alignment);
 }
 
-void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
+void* PushAlignedSpace(Buffer& buffer, u32 size, u32 alignment)
 {
     ASSERT(buffer.data != NULL, "The buffer must be mapped first");
     AlignHead(buffer, alignment);
-    memcpy((u8*)buffer.data + buffer.head, data, size);
+    ASSERT(buffer.head + size <= buffer.size, "The buffer is full");
+    void* space = (u8*)buffer.data + buffer.head;
     buffer.head += size;
+    return space;
+}
+
+void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
+{
+    memcpy(PushAlignedSpace(buffer, size, alignment), data, size);
 }
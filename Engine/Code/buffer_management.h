@@ -30,11 +30,17 @@ void UnmapBuffer(Buffer& buffer);
 
 void AlignHead(Buffer& buffer, u32 alignment);
 
+// Reserves size bytes of the mapped buffer, to be written in place
+void* PushAlignedSpace(Buffer& buffer, u32 size, u32 alignment);
+
 void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment);
 
 #define PushData(buffer, data, size) PushAlignedData(buffer, data, size, 1)
-#define PushUInt(buffer, value) { u32 v = value; PushAlignedData(buffer, &v, sizeof(v), 4); }
-#define PushVec3(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushVec4(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushMat3(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushMat4(buffer, value) PushAlignedData(buffer, value_ptr(value), sizeof(value), sizeof(vec4))
+
+// Copies a whole block (see uniform_blocks.h) at once and returns its offset
+template <typename Block>
+u32 PushBlock(Buffer& buffer, const Block& block, u32 alignment)
+{
+    PushAlignedData(buffer, &block, sizeof(block), alignment);
+    return buffer.head - (u32)sizeof(block);
+}
@@ -0,0 +1,663 @@
+//
+// cooker.cpp: Offline asset cooker, the entry point of the Cooker target. It is
+// built from the same sources as the engine with ENGINE_COOKER defined, which
+// leaves the engine's main (and its window) out:
+//
+//   Cooker [directory] [--force] [--cache <directory>] [--pack <file>]
+//
+// Every model and texture under the directory (WorkingDir by default) and the
+// shaders are cooked into the files the engine loads at runtime, on all the job
+// threads, and a per-asset timing report is printed at the end.
+//
+// Models are imported to find the textures they use and how (a normal map is
+// cooked differently from an albedo map) and the other files they read, like
+// the material libraries of an OBJ. This dependency graph is saved in the cache
+// directory, so the next runs know the key of every output without importing
+// anything: the contents of its sources, the cooker version and the settings
+// (import flags, texture usage). Outputs whose key did not change are skipped,
+// and every output cooked is also stored in the cache under its key, so going
+// back to a previous version of a source restores its output with a copy.
+//
+// The sources of the programs the engine draws with (ScenePrograms) are compiled
+// to SPIR-V with glslangValidator and spirv-opt, which have to be on the PATH
+// (see shader_cooker.h), so shader errors show up here. They go in the pack
+// (--pack) along with everything else under the directory, the engine compiles
+// the GLSL if the SPIR-V does not fit its driver.
+//
+
+#ifdef ENGINE_COOKER
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#else
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "engine.h"
+#include "job_system.h"
+#include "hash.h"
+#include "mesh_cache.h"
+#include "shader_cooker.h"
+#include "model_loading.h"
+#include "assimp_model_loading.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+#define COOKER_DEFAULT_DIRECTORY "WorkingDir"
+#define COOKER_DEFAULT_CACHE     "CookCache"
+#define COOKER_GRAPH_FILE        "graph.txt"
+
+enum CookAssetKind
+{
+    CookAsset_Model,
+    CookAsset_Texture,
+    CookAsset_PackedTexture, // normal + height map of a relief mapped material
+    CookAsset_Shaders,       // programs of a GLSL source, to SPIR-V
+};
+
+enum CookStatus
+{
+    CookStatus_UpToDate,
+    CookStatus_FromCache,
+    CookStatus_Cooked,
+    CookStatus_Scanned,      // models that are not cooked (glTF), imported for their dependencies only
+    CookStatus_Failed,
+    CookStatus_Count
+};
+
+static const char* CookStatusNames[CookStatus_Count] = { "up to date", "from cache", "cooked", "scanned", "FAILED" };
+
+struct CookedTextureUse
+{
+    std::string  path;
+    std::string  heightPath; // packed textures
+    TextureUsage usage;
+};
+
+// A node of the dependency graph, as saved in the cache directory
+struct CookGraphNode
+{
+    u64                           key;
+    bool                          cooked;       // has a cooked file (flattened, not glTF)
+    std::vector<std::string>      dependencies; // other files read by the import
+    std::vector<CookedTextureUse> textures;
+};
+
+struct CookAsset
+{
+    CookAssetKind kind;
+    std::string   path;         // source, or normal map of packed textures
+    std::string   heightPath;
+    TextureUsage  usage;
+    CookStatus    status;
+    f64           milliseconds;
+    CookGraphNode node;         // models
+};
+
+struct Cooker
+{
+    std::string cacheDirectory;
+    bool        force;
+    App         app;            // never initialized, the importers only read texture indices from it
+};
+
+static bool HasExtension(const std::string& path, const char* const* extensions, u32 count)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || path.find_first_of('/', dot) != std::string::npos)
+        return false;
+
+    std::string extension = path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower(c); });
+    for (u32 i = 0; i < count; ++i)
+        if (extension == extensions[i])
+            return true;
+    return false;
+}
+
+static bool IsModelFile(const std::string& path)
+{
+    static const char* extensions[] = { ".obj", ".fbx", ".gltf", ".glb", ".dae", ".3ds", ".ply", ".stl" };
+    return HasExtension(path, extensions, ARRAY_COUNT(extensions));
+}
+
+static bool IsTextureFile(const std::string& path)
+{
+    static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".tga", ".bmp", ".psd", ".gif" };
+    return HasExtension(path, extensions, ARRAY_COUNT(extensions));
+}
+
+static bool IsCookerOutput(const std::string& path)
+{
+    static const char* extensions[] = { ".mesh", ".ktx2", ".spv", ".pack" };
+    return HasExtension(path, extensions, ARRAY_COUNT(extensions));
+}
+
+static std::string GetCachePath(const Cooker& cooker, u64 key, const char* extension)
+{
+    char name[32];
+    sprintf(name, "%016llx", (unsigned long long)key);
+    return cooker.cacheDirectory + "/" + name + extension;
+}
+
+static bool CopyFileContents(const char* srcPath, const char* dstPath)
+{
+    MappedFile src = MapFile(srcPath);
+    if (src.data == NULL)
+        return false;
+
+    // Written aside and renamed, so an interrupted copy never looks like a valid output
+    std::string tmpPath = std::string(dstPath) + ".tmp";
+    FILE* dst = fopen(tmpPath.c_str(), "wb");
+    bool copied = dst && fwrite(src.data, 1, (size_t)src.size, dst) == src.size;
+    if (dst)
+        fclose(dst);
+    UnmapFile(src);
+
+    remove(dstPath);
+    if (!copied || rename(tmpPath.c_str(), dstPath) != 0)
+    {
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Key stored in a cooked mesh, 0 if there is none, it is from another version or damaged
+static u64 ReadCookedMeshKey(const char* sourcePath)
+{
+    MappedFile file = MapFile(GetCookedMeshPath(sourcePath).c_str());
+    u64 key = 0;
+    if (IsCookedMeshValid(file.data, file.size))
+        key = ((const CookedMeshHeader*)file.data)->sourceHash;
+    UnmapFile(file);
+    return key;
+}
+
+// Graph ------------------------------------------------------------------------
+
+// One line per fact, tab separated:
+//   M <model> <key> <cooked>   followed by the nodes of the model
+//   D <dependency>
+//   T <usage> <texture>
+//   P <normal map> <height map>
+static std::map<std::string, CookGraphNode> ReadCookGraph(const Cooker& cooker)
+{
+    std::map<std::string, CookGraphNode> graph;
+
+    std::string graphPath = cooker.cacheDirectory + "/" + COOKER_GRAPH_FILE;
+    MappedFile file = MapFile(graphPath.c_str());
+    if (file.data == NULL)
+        return graph;
+
+    CookGraphNode* node = NULL;
+    const char* end = (const char*)file.data + file.size;
+    for (const char* line = (const char*)file.data; line < end; )
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if (!lineEnd)
+            lineEnd = end;
+
+        std::vector<std::string> fields;
+        for (const char* field = line; field <= lineEnd; )
+        {
+            const char* fieldEnd = (const char*)memchr(field, '\t', lineEnd - field);
+            if (!fieldEnd)
+                fieldEnd = lineEnd;
+            fields.push_back(std::string(field, fieldEnd));
+            field = fieldEnd + 1;
+        }
+
+        if (fields.size() == 4 && fields[0] == "M")
+        {
+            node = &graph[fields[1]];
+            node->key = strtoull(fields[2].c_str(), NULL, 16);
+            node->cooked = fields[3] == "1";
+        }
+        else if (node && fields.size() == 2 && fields[0] == "D")
+        {
+            node->dependencies.push_back(fields[1]);
+        }
+        else if (node && fields.size() == 3 && fields[0] == "T")
+        {
+            node->textures.push_back(CookedTextureUse{ fields[2], "", (TextureUsage)atoi(fields[1].c_str()) });
+        }
+        else if (node && fields.size() == 3 && fields[0] == "P")
+        {
+            node->textures.push_back(CookedTextureUse{ fields[1], fields[2], TextureUsage_NormalHeight });
+        }
+
+        line = lineEnd + 1;
+    }
+
+    UnmapFile(file);
+    return graph;
+}
+
+static void WriteCookGraph(const Cooker& cooker, const std::vector<CookAsset>& assets)
+{
+    std::string graphPath = cooker.cacheDirectory + "/" + COOKER_GRAPH_FILE;
+    FILE* file = fopen(graphPath.c_str(), "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing file %s", graphPath.c_str());
+        return;
+    }
+
+    for (const CookAsset& asset : assets)
+    {
+        if (asset.kind != CookAsset_Model || asset.status == CookStatus_Failed)
+            continue;
+
+        const CookGraphNode& node = asset.node;
+        fprintf(file, "M\t%s\t%016llx\t%d\n", asset.path.c_str(), (unsigned long long)node.key, node.cooked ? 1 : 0);
+        for (const std::string& dependency : node.dependencies)
+            fprintf(file, "D\t%s\n", dependency.c_str());
+        for (const CookedTextureUse& texture : node.textures)
+            if (texture.usage == TextureUsage_NormalHeight)
+                fprintf(file, "P\t%s\t%s\n", texture.path.c_str(), texture.heightPath.c_str());
+            else
+                fprintf(file, "T\t%d\t%s\n", (int)texture.usage, texture.path.c_str());
+    }
+
+    fclose(file);
+}
+
+// Models -----------------------------------------------------------------------
+
+// Textures the runtime cooks for the materials of an import: the ones in files,
+// plus the packed normal + height map of relief mapped materials (see AddMaterial)
+static void GatherImportTextures(const ModelImport& import, std::vector<CookedTextureUse>& textures)
+{
+    auto isFile = [&import](u32 texIdx)
+    {
+        return texIdx < import.textures.size() &&
+               import.textures[texIdx].existingTexIdx == UINT32_MAX &&
+               import.textures[texIdx].encodedData.empty();
+    };
+
+    auto add = [&textures](const CookedTextureUse& use)
+    {
+        for (const CookedTextureUse& texture : textures)
+            if (texture.path == use.path && texture.heightPath == use.heightPath && texture.usage == use.usage)
+                return;
+        textures.push_back(use);
+    };
+
+    for (u32 i = 0; i < import.textures.size(); ++i)
+        if (isFile(i))
+            add(CookedTextureUse{ NormalizeAssetPath(import.textures[i].path.c_str()), "", import.textures[i].usage });
+
+    for (const Material& material : import.materials)
+        if (isFile(material.normalsTextureIdx) && isFile(material.bumpTextureIdx))
+            add(CookedTextureUse{ NormalizeAssetPath(import.textures[material.normalsTextureIdx].path.c_str()),
+                                  NormalizeAssetPath(import.textures[material.bumpTextureIdx].path.c_str()),
+                                  TextureUsage_NormalHeight });
+}
+
+static CookStatus CookModelAsset(Cooker& cooker, CookAsset& asset, const CookGraphNode* known)
+{
+    const char* sourcePath = asset.path.c_str();
+    const u32 importFlags = ModelImport_Flatten;
+    CookGraphNode& node = asset.node;
+
+    // The graph of the last run gives the key without importing anything. If
+    // the output is not up to date, one cooked with that key may be in the cache:
+    // it is then imported from it, which is cheap, to know its textures
+    bool restored = false;
+    if (known && !cooker.force)
+    {
+        u64 key = GetCookedModelKey(sourcePath, importFlags, known->dependencies);
+        bool outputMatches = !known->cooked || ReadCookedMeshKey(sourcePath) == key;
+        if (key == known->key && outputMatches)
+        {
+            node = *known;
+            return CookStatus_UpToDate;
+        }
+
+        if (!outputMatches)
+            restored = CopyFileContents(GetCachePath(cooker, key, ".mesh").c_str(), GetCookedMeshPath(sourcePath).c_str());
+    }
+
+    if (cooker.force)
+        remove(GetCookedMeshPath(sourcePath).c_str());
+
+    ModelImport import;
+    import.filename = asset.path;
+    import.importFlags = importFlags;
+    import.vertexDataSize = 0;
+    import.indexData = NULL;
+    import.cook = false;
+    import.boundsKnown = false;
+
+    if (!ImportModel(&cooker.app, import))
+        return CookStatus_Failed;
+
+    CookStatus status = CookStatus_Scanned;
+    if (import.cook)
+    {
+        if (!CookModel(import))
+            return CookStatus_Failed;
+
+        status = CookStatus_Cooked;
+    }
+    else if (!import.files.empty())
+    {
+        status = restored ? CookStatus_FromCache : CookStatus_UpToDate; // imported from its cooked file
+    }
+
+    node = CookGraphNode{};
+    node.key = GetCookedModelKey(sourcePath, importFlags, import.dependencies);
+    node.cooked = status != CookStatus_Scanned;
+    node.dependencies = import.dependencies;
+    GatherImportTextures(import, node.textures);
+
+    for (AssetFile& file : import.files)
+        CloseAsset(file);
+
+    if (status == CookStatus_Cooked)
+        CopyFileContents(GetCookedMeshPath(sourcePath).c_str(), GetCachePath(cooker, node.key, ".mesh").c_str());
+
+    return status;
+}
+
+// Textures ---------------------------------------------------------------------
+
+static CookStatus CookTextureAsset(Cooker& cooker, CookAsset& asset)
+{
+    const bool packed = asset.kind == CookAsset_PackedTexture;
+    const char* sourcePath = asset.path.c_str();
+    const char* heightPath = asset.heightPath.c_str();
+
+    // Packed textures are named after both sources, their cooked file is <name>.ktx2
+    std::string sourceName = packed ? GetPackedTextureName(sourcePath, heightPath) : asset.path;
+    u64 sourceHash = packed ? HashPackedTextureSources(sourcePath, heightPath) : HashFile(sourcePath);
+    if (sourceHash == 0)
+    {
+        ELOG("Missing texture %s", sourceName.c_str());
+        return CookStatus_Failed;
+    }
+
+    u64 key = GetCookedTextureKey(sourceHash, asset.usage);
+    std::string cookedPath = GetCookedTexturePath(sourceName.c_str());
+    std::string cachePath = GetCachePath(cooker, key, ".ktx2");
+
+    if (!cooker.force)
+    {
+        CookedTexture cooked = {};
+        if (ReadCookedTexture(sourceName.c_str(), sourceHash, asset.usage, cooked))
+        {
+            ReleaseCookedTexture(cooked);
+            return CookStatus_UpToDate;
+        }
+
+        if (CopyFileContents(cachePath.c_str(), cookedPath.c_str()))
+            return CookStatus_FromCache;
+    }
+
+    bool cooked = packed ? CookPackedTexture(sourcePath, heightPath) : CookTexture(sourcePath, asset.usage);
+    if (!cooked)
+        return CookStatus_Failed;
+
+    CopyFileContents(cookedPath.c_str(), cachePath.c_str());
+    return CookStatus_Cooked;
+}
+
+// Shaders ----------------------------------------------------------------------
+
+static CookStatus CookShaderAsset(Cooker& cooker, CookAsset& asset)
+{
+    const char* sourcePath = asset.path.c_str();
+    u64 sourceHash = HashFile(sourcePath);
+    if (sourceHash == 0)
+    {
+        ELOG("Missing shader source %s", sourcePath);
+        return CookStatus_Failed;
+    }
+
+    u64 programsHash = GetCookedProgramsHash(ScenePrograms, SceneProgramCount);
+    std::string cookedPath = GetCookedShadersPath(sourcePath);
+    std::string cachePath = GetCachePath(cooker, HashCombine(sourceHash, programsHash), ".spv");
+
+    if (!cooker.force)
+    {
+        if (IsCookedShadersUpToDate(sourcePath, sourceHash, programsHash))
+            return CookStatus_UpToDate;
+
+        if (CopyFileContents(cachePath.c_str(), cookedPath.c_str()))
+            return CookStatus_FromCache;
+    }
+
+    if (!CookShaders(sourcePath, ScenePrograms, SceneProgramCount))
+        return CookStatus_Failed;
+
+    CopyFileContents(cookedPath.c_str(), cachePath.c_str());
+    return CookStatus_Cooked;
+}
+
+// Report -----------------------------------------------------------------------
+
+static const char* GetCookAssetKindName(const CookAsset& asset)
+{
+    if (asset.kind == CookAsset_Model)
+        return "model";
+    if (asset.kind == CookAsset_Shaders)
+        return "shaders";
+
+    switch (asset.usage)
+    {
+        case TextureUsage_Normal:       return "normal";
+        case TextureUsage_Height:       return "height";
+        case TextureUsage_NormalHeight: return "packed";
+        default:                        return "texture";
+    }
+}
+
+static void PrintCookReport(std::vector<CookAsset> assets, f64 totalMilliseconds)
+{
+    std::sort(assets.begin(), assets.end(), [](const CookAsset& a, const CookAsset& b) { return a.milliseconds > b.milliseconds; });
+
+    printf("\n%10s  %-8s  %-10s  %s\n", "ms", "kind", "status", "asset");
+    for (const CookAsset& asset : assets)
+    {
+        std::string name = asset.kind == CookAsset_PackedTexture ? asset.path + " + " + asset.heightPath : asset.path;
+        printf("%10.1f  %-8s  %-10s  %s\n", asset.milliseconds, GetCookAssetKindName(asset), CookStatusNames[asset.status], name.c_str());
+    }
+
+    u32 counts[CookStatus_Count] = {};
+    f64 milliseconds[CookStatus_Count] = {};
+    for (const CookAsset& asset : assets)
+    {
+        counts[asset.status]++;
+        milliseconds[asset.status] += asset.milliseconds;
+    }
+
+    printf("\n%u assets in %.1f ms on %u threads\n", (u32)assets.size(), totalMilliseconds, GetJobThreadCount());
+    for (u32 status = 0; status < CookStatus_Count; ++status)
+        if (counts[status] > 0)
+            printf("  %-10s  %5u  %10.1f ms\n", CookStatusNames[status], counts[status], milliseconds[status]);
+}
+
+// Entry point ------------------------------------------------------------------
+
+template <typename Function>
+static void TimeCookAsset(CookAsset& asset, Function cook)
+{
+    auto start = std::chrono::steady_clock::now();
+    asset.status = cook();
+    asset.milliseconds = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void PrintUsage()
+{
+    printf("Usage: Cooker [directory] [--force] [--cache <directory>] [--pack <file>]\n"
+           "  directory  assets to cook, the paths are relative to it as in the engine (default " COOKER_DEFAULT_DIRECTORY ")\n"
+           "  --force    cooks everything again, ignoring up to date outputs and the cache\n"
+           "  --cache    cooked outputs by key and dependency graph (default <directory>/" COOKER_DEFAULT_CACHE ")\n"
+           "  --pack     writes every file under the directory to a pack once cooked\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* directory = COOKER_DEFAULT_DIRECTORY;
+    const char* cacheDirectory = COOKER_DEFAULT_CACHE;
+    const char* packPath = NULL;
+
+    Cooker* cooker = new Cooker{};
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--force")                        cooker->force = true;
+        else if (arg == "--cache" && i + 1 < argc)   cacheDirectory = argv[++i];
+        else if (arg == "--pack" && i + 1 < argc)    packPath = argv[++i];
+        else if (arg[0] != '-')                      directory = argv[i];
+        else                                         { PrintUsage(); return 1; }
+    }
+
+    // Same relative paths as the engine, which runs from the directory
+    if (chdir(directory) != 0)
+    {
+        fprintf(stderr, "Could not open directory %s\n", directory);
+        return 1;
+    }
+    cooker->cacheDirectory = NormalizeAssetPath(cacheDirectory);
+
+    InitJobSystem();
+    auto start = std::chrono::steady_clock::now();
+
+    // Sources
+    std::vector<std::string> files;
+    ListFiles(".", files);
+
+    std::vector<CookAsset> models;
+    std::vector<std::string> scannedTextures;
+    for (const std::string& file : files)
+    {
+        std::string path = NormalizeAssetPath(file.c_str());
+        if (path.compare(0, cooker->cacheDirectory.size() + 1, cooker->cacheDirectory + "/") == 0 || IsCookerOutput(path))
+            continue;
+
+        if (IsModelFile(path))
+        {
+            models.push_back(CookAsset{});
+            models.back().kind = CookAsset_Model;
+            models.back().path = path;
+        }
+        else if (IsTextureFile(path))
+        {
+            scannedTextures.push_back(path);
+        }
+    }
+
+    // Fails harmlessly if it is already there
+#ifdef _WIN32
+    _mkdir(cooker->cacheDirectory.c_str());
+#else
+    mkdir(cooker->cacheDirectory.c_str(), 0755);
+#endif
+
+    // Models first, they tell how their textures are used
+    std::map<std::string, CookGraphNode> graph = ReadCookGraph(*cooker);
+    ParallelFor((u32)models.size(), [&](u32 i)
+    {
+        auto it = graph.find(models[i].path);
+        const CookGraphNode* known = it != graph.end() ? &it->second : NULL;
+        TimeCookAsset(models[i], [&] { return CookModelAsset(*cooker, models[i], known); });
+    });
+
+    WriteCookGraph(*cooker, models);
+
+    // Textures, once per cooked file. A texture used in two ways (e.g. as color
+    // and as normal map) would need two cooked files, it keeps the first one
+    std::vector<CookAsset> textures;
+    std::map<std::string, u32> textureByName;
+    auto addTexture = [&](const CookedTextureUse& use, const std::string& user)
+    {
+        std::string name = use.usage == TextureUsage_NormalHeight ? GetPackedTextureName(use.path.c_str(), use.heightPath.c_str()) : use.path;
+        auto it = textureByName.find(name);
+        if (it != textureByName.end())
+        {
+            if (textures[it->second].usage != use.usage)
+                printf("Warning: %s uses %s in another way, it is cooked as %s\n", user.c_str(), name.c_str(), GetCookAssetKindName(textures[it->second]));
+            return;
+        }
+
+        textureByName[name] = (u32)textures.size();
+        textures.push_back(CookAsset{});
+        CookAsset& texture = textures.back();
+        texture.kind = use.usage == TextureUsage_NormalHeight ? CookAsset_PackedTexture : CookAsset_Texture;
+        texture.path = use.path;
+        texture.heightPath = use.heightPath;
+        texture.usage = use.usage;
+    };
+
+    for (const CookAsset& model : models)
+        for (const CookedTextureUse& use : model.node.textures)
+            addTexture(use, model.path);
+
+    // Images no model uses are cooked as color, like the textures the engine loads by hand
+    for (const std::string& path : scannedTextures)
+        addTexture(CookedTextureUse{ path, "", TextureUsage_Color }, path);
+
+    ParallelFor((u32)textures.size(), [&](u32 i)
+    {
+        TimeCookAsset(textures[i], [&] { return CookTextureAsset(*cooker, textures[i]); });
+    });
+
+    // Shaders, one source at a time: each one compiles its modules on all the job threads
+    std::vector<CookAsset> shaders;
+    for (u32 i = 0; i < SceneProgramCount; ++i)
+    {
+        std::string path = NormalizeAssetPath(ScenePrograms[i].filepath);
+        auto sameSource = [&path](const CookAsset& shader) { return shader.path == path; };
+        if (std::find_if(shaders.begin(), shaders.end(), sameSource) != shaders.end())
+            continue;
+
+        shaders.push_back(CookAsset{});
+        shaders.back().kind = CookAsset_Shaders;
+        shaders.back().path = path;
+    }
+
+    for (CookAsset& shader : shaders)
+        TimeCookAsset(shader, [&] { return CookShaderAsset(*cooker, shader); });
+
+    // Report
+    std::vector<CookAsset> assets = models;
+    assets.insert(assets.end(), textures.begin(), textures.end());
+    assets.insert(assets.end(), shaders.begin(), shaders.end());
+
+    f64 totalMilliseconds = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    PrintCookReport(assets, totalMilliseconds);
+
+    bool failed = false;
+    for (const CookAsset& asset : assets)
+        failed = failed || asset.status == CookStatus_Failed;
+
+    // Pack, with the sources too: the engine reads shaders and uncooked models from them
+    if (packPath && !failed)
+    {
+        std::string normalizedPackPath = NormalizeAssetPath(packPath);
+        std::vector<std::string> packFiles;
+        files.clear();
+        ListFiles(".", files);
+        for (const std::string& file : files)
+        {
+            std::string path = NormalizeAssetPath(file.c_str());
+            if (path != normalizedPackPath && path.compare(0, cooker->cacheDirectory.size() + 1, cooker->cacheDirectory + "/") != 0)
+                packFiles.push_back(path);
+        }
+
+        failed = !WriteAssetPack(packPath, packFiles);
+        printf("%s %s with %u files\n", failed ? "Could not write" : "Wrote", packPath, (u32)packFiles.size());
+    }
+
+    ShutdownJobSystem();
+    delete cooker;
+
+    return failed ? 1 : 0;
+}
+
+#endif // ENGINE_COOKER
@@ -5,204 +5,206 @@
 // graphics related GUI options, and so on.
 //
 
-#define MIPMAP_BASE_LEVEL 0
 #define MIPMAP_MAX_LEVEL 4
 
 #include "engine.h"
+#include "hash.h"
+#include "uniform_blocks.h"
 #include <imgui.h>
 #include <stb_image.h>
 #include <stb_image_write.h>
 
-GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+GLuint CreateTexture2DFromImage(Image image)
 {
-    GLchar  infoLogBuffer[1024] = {};
-    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
-    GLsizei infoLogSize;
-    GLint   success;
-
-    char versionString[] = "#version 430\n";
-    char shaderNameDefine[128];
-    sprintf(shaderNameDefine, "#define %s\n", shaderName);
-    char vertexShaderDefine[] = "#define VERTEX\n";
-    char fragmentShaderDefine[] = "#define FRAGMENT\n";
-
-    const GLchar* vertexShaderSource[] = {
-        versionString,
-        shaderNameDefine,
-        vertexShaderDefine,
-        programSource.str
-    };
-    const GLint vertexShaderLengths[] = {
-        (GLint) strlen(versionString),
-        (GLint) strlen(shaderNameDefine),
-        (GLint) strlen(vertexShaderDefine),
-        (GLint) programSource.len
-    };
-    const GLchar* fragmentShaderSource[] = {
-        versionString,
-        shaderNameDefine,
-        fragmentShaderDefine,
-        programSource.str
-    };
-    const GLint fragmentShaderLengths[] = {
-        (GLint) strlen(versionString),
-        (GLint) strlen(shaderNameDefine),
-        (GLint) strlen(fragmentShaderDefine),
-        (GLint) programSource.len
-    };
+    GLenum internalFormat = GL_RGB8;
+    GLenum dataFormat     = GL_RGB;
+    GLenum dataType       = GL_UNSIGNED_BYTE;
 
-    GLuint vshader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vshader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
-    glCompileShader(vshader);
-    glGetShaderiv(vshader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    switch (image.nchannels)
     {
-        glGetShaderInfoLog(vshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
+        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
+        default: ELOG("LoadTexture2D() - Unsupported number of channels");
     }
 
-    GLuint fshader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fshader, ARRAY_COUNT(fragmentShaderSource), fragmentShaderSource, fragmentShaderLengths);
-    glCompileShader(fshader);
-    glGetShaderiv(fshader, GL_COMPILE_STATUS, &success);
-    if (!success)
+    // Immutable storage with the full mip chain, sampled through the shared samplers
+    GLsizei levelCount = 1 + (GLsizei)glm::log2((f32)glm::max(image.size.x, image.size.y));
+
+    GLuint texHandle = CreateTextureStorage2D(internalFormat, image.size.x, image.size.y, levelCount);
+
+    const GLExtensions& ext = GlobalGLExtensions;
+    if (ext.directStateAccess)
     {
-        glGetShaderInfoLog(fshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        ext.TextureSubImage2D(texHandle, 0, 0, 0, image.size.x, image.size.y, dataFormat, dataType, image.pixels);
+        ext.GenerateTextureMipmap(texHandle);
     }
-
-    GLuint programHandle = glCreateProgram();
-    glAttachShader(programHandle, vshader);
-    glAttachShader(programHandle, fshader);
-    glLinkProgram(programHandle);
-    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
-    if (!success)
+    else
     {
-        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
-        ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        glBindTexture(GL_TEXTURE_2D, texHandle);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.size.x, image.size.y, dataFormat, dataType, image.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
 
-    glUseProgram(0);
-
-    glDetachShader(programHandle, vshader);
-    glDetachShader(programHandle, fshader);
-    glDeleteShader(vshader);
-    glDeleteShader(fshader);
+    return texHandle;
+}
 
-    return programHandle;
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage)
+{
+    return QueueTexture2D(app, filepath, usage);
 }
 
-u32 LoadProgram(App* app, const char* filepath, const char* programName)
+u32 LoadTexture2DFromMemory(App* app, const char* name, const void* data, u32 size)
 {
-    String programSource = ReadTextFile(filepath);
+    return QueueTexture2DFromMemory(app, name, data, size);
+}
 
-    Program program = {};
-    program.handle = CreateProgramFromSource(programSource, programName);
-    program.filepath = filepath;
-    program.programName = programName;
-    program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+static bool MaterialsMatch(const Material& a, const Material& b)
+{
+    return a.albedo == b.albedo && a.emissive == b.emissive && a.smoothness == b.smoothness &&
+           a.albedoTextureIdx == b.albedoTextureIdx && a.emissiveTextureIdx == b.emissiveTextureIdx &&
+           a.specularTextureIdx == b.specularTextureIdx && a.normalsTextureIdx == b.normalsTextureIdx &&
+           a.bumpTextureIdx == b.bumpTextureIdx;
+}
 
-    int attributeCount;
-    glGetProgramiv(program.handle, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+u32 AddMaterial(App* app, const Material& material)
+{
+    // The name is left out, exporters often name the same material differently
+    u64 hash = HashBytes(&material.albedo, sizeof(material.albedo));
+    hash = HashCombine(hash, HashBytes(&material.emissive, sizeof(material.emissive)));
+    hash = HashCombine(hash, HashBytes(&material.smoothness, sizeof(material.smoothness)));
+    hash = HashCombine(hash, ((u64)material.albedoTextureIdx << 32) | material.emissiveTextureIdx);
+    hash = HashCombine(hash, ((u64)material.specularTextureIdx << 32) | material.normalsTextureIdx);
+    hash = HashCombine(hash, material.bumpTextureIdx);
+
+    auto it = app->sharedMaterials.find(hash);
+    if (it != app->sharedMaterials.end() && MaterialsMatch(app->materials[it->second], material))
+        return it->second;
+
+    u32 materialIdx = (u32)app->materials.size();
+    app->materials.push_back(material);
+    if (it == app->sharedMaterials.end())
+        app->sharedMaterials[hash] = materialIdx;
+
+    // Relief mapped materials read the normal and the height from the same texels
+    Material& addedMaterial = app->materials.back();
+    addedMaterial.normalHeightTextureIdx = UINT32_MAX;
+    if (material.normalsTextureIdx != UINT32_MAX && material.bumpTextureIdx != UINT32_MAX)
+        addedMaterial.normalHeightTextureIdx = QueuePackedTexture2D(app, material.normalsTextureIdx, material.bumpTextureIdx);
+
+    return materialIdx;
+}
 
-    GLchar attributeName[64];
-    GLsizei attributeNameLength;
-    GLint attributeSize;
-    GLenum attributeType;
+// E.g. a normal map the model file does not reference
+void SetModelTexture(App* app, u32 modelIdx, u32 Material::* slot, u32 texIdx)
+{
+    if (modelIdx >= app->models.size())
+        return;
 
-    for (int i = 0; i < attributeCount; ++i)
+    if (!IsModelLoaded(app, modelIdx))
     {
-        glGetActiveAttrib(program.handle,
-            i,
-            64/*ARRAY_COUNT(attributeName)*/,
-            &attributeNameLength,
-            &attributeSize,
-            &attributeType,
-            attributeName
-        );
-
-        program.vertexInputLayout.attributes.push_back(
-            { (u8)glGetAttribLocation(program.handle, attributeName), (u8)attributeSize }); // position
+        DeferModelTexture(app, modelIdx, slot, texIdx);
+        return;
     }
 
-    app->programs.push_back(program);
+    auto setTexture = [app, slot, texIdx](u32& materialIdx)
+    {
+        Material material = app->materials[materialIdx];
+        material.*slot = texIdx;
+        materialIdx = AddMaterial(app, material);
+    };
 
-    return app->programs.size() - 1;
+    Model& model = app->models[modelIdx];
+    for (u32& materialIdx : model.materialIdx)
+        setTexture(materialIdx);
+    for (MeshInstance& instance : model.instances)
+        setTexture(instance.materialIdx);
 }
 
-Image LoadImage(const char* filename)
+static bool HasTexture(const App* app, u32 texIdx)
 {
-    Image img = {};
-    stbi_set_flip_vertically_on_load(true);
-    img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
-    if (img.pixels)
-    {
-        img.stride = img.size.x * img.nchannels;
-    }
-    else
-    {
-        ELOG("Could not open file %s", filename);
-    }
-    return img;
+    return texIdx < app->textures.size() && app->textures[texIdx].arrayTextureIdx != UINT32_MAX;
 }
 
-void FreeImage(Image image)
+// Albedo, normal and bump map sampled for a material. Albedo maps still loading
+// are replaced by white, normal and bump maps stay off until they are loaded
+static void GetMaterialTextures(const App* app, const Material& material, u32 textures[3])
 {
-    stbi_image_free(image.pixels);
+    textures[0] = material.albedoTextureIdx;
+    textures[1] = material.normalsTextureIdx;
+    textures[2] = material.bumpTextureIdx;
+    if (HasTexture(app, material.normalHeightTextureIdx))
+        textures[1] = textures[2] = material.normalHeightTextureIdx;
+
+    if (textures[0] < app->textures.size() && app->textures[textures[0]].loading)
+        textures[0] = app->whiteTexIdx;
 }
 
-GLuint CreateTexture2DFromImage(Image image)
-{
-    GLenum internalFormat = GL_RGB8;
-    GLenum dataFormat     = GL_RGB;
-    GLenum dataType       = GL_UNSIGNED_BYTE;
-
-    switch (image.nchannels)
-    {
-        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
-        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
-        default: ELOG("LoadTexture2D() - Unsupported number of channels");
-    }
-
-    GLuint texHandle;
-    glGenTextures(1, &texHandle);
-    glBindTexture(GL_TEXTURE_2D, texHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
+// Flags and swizzle of MaterialData (see uniform_blocks.h)
+#define MATERIAL_ALBEDO_MAP             1
+#define MATERIAL_NORMAL_MAP             2
+#define MATERIAL_BUMP_MAP               4
+#define MATERIAL_PACKED_NORMAL_HEIGHT   8
 
-    return texHandle;
-}
+// Swizzle: from bit 8, 4 bits per value with the channel that holds it
+#define MATERIAL_SWIZZLE_SHIFT          8
+#define MATERIAL_SWIZZLE(normalX, normalY, height) (((normalX) | ((normalY) << 4) | ((height) << 8)) << MATERIAL_SWIZZLE_SHIFT)
 
-u32 LoadTexture2D(App* app, const char* filepath)
+// Rebuilt when materials are added or textures change layer (streaming)
+static void UpdateMaterialTable(App* app)
 {
-    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
-        if (app->textures[texIdx].filepath == filepath)
-            return texIdx;
-
-    Image image = LoadImage(filepath);
+    if (app->materials.empty() || (app->materialBufferCount == app->materials.size() && app->materialBufferVersion == app->textureArrays.version &&
+                                   app->materialBufferLoads == app->textureRegistry.finishedLoads))
+        return;
 
-    if (image.pixels)
+    std::vector<MaterialData> table(app->materials.size());
+    for (u32 i = 0; i < app->materials.size(); ++i)
     {
-        Texture tex = {};
-        tex.handle = CreateTexture2DFromImage(image);
-        tex.filepath = filepath;
+        const Material& material = app->materials[i];
+        MaterialData& data = table[i];
+        data.albedo = vec4(material.albedo, material.smoothness);
+
+        u32 textures[3];
+        GetMaterialTextures(app, material, textures);
+        const u32 flags[] = { MATERIAL_ALBEDO_MAP, MATERIAL_NORMAL_MAP, MATERIAL_BUMP_MAP };
+        data.layers[3] = 0;
+        for (u32 j = 0; j < ARRAY_COUNT(textures); ++j)
+        {
+            data.layers[j] = 0;
+            data.handles[j] = glm::uvec2(0);
+            if (HasTexture(app, textures[j]))
+            {
+                u32 arrayTextureIdx = app->textures[textures[j]].arrayTextureIdx;
+                data.layers[j] = GetArrayTextureLayer(app, arrayTextureIdx);
+                data.layers[3] |= flags[j];
 
-        u32 texIdx = app->textures.size();
-        app->textures.push_back(tex);
+                GLuint64 handle = GetArrayTextureHandle(app, arrayTextureIdx);
+                data.handles[j] = glm::uvec2((u32)handle, (u32)(handle >> 32));
+            }
+        }
 
-        FreeImage(image);
-        return texIdx;
+        // Separate maps are BC5 (normal XY) and BC4 (height in red), packed ones
+        // BC7 with the height in blue
+        if (HasTexture(app, material.normalHeightTextureIdx))
+            data.layers[3] |= MATERIAL_PACKED_NORMAL_HEIGHT | MATERIAL_SWIZZLE(0, 1, 2);
+        else
+            data.layers[3] |= MATERIAL_SWIZZLE(0, 1, 0);
     }
+
+    if (app->materialBuffer == 0)
+        glGenBuffers(1, &app->materialBuffer);
+
+    // Only reallocated when materials are added, layer changes update it in place
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->materialBuffer);
+    if (app->materialBufferCount != table.size())
+        glBufferData(GL_SHADER_STORAGE_BUFFER, table.size() * sizeof(MaterialData), table.data(), GL_DYNAMIC_DRAW);
     else
-    {
-        return UINT32_MAX;
-    }
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, table.size() * sizeof(MaterialData), table.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    app->materialBufferCount = (u32)app->materials.size();
+    app->materialBufferVersion = app->textureArrays.version;
+    app->materialBufferLoads = app->textureRegistry.finishedLoads;
 }
 
 void OnGLError(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam)
@@ -244,17 +246,9 @@ void OnGLError(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei l
     }
 }
 
-void GenerateFramebufferTexture(GLuint& textureHandle, ivec2 displaySize, GLint type)
+void GenerateFramebufferTexture(GLuint& textureHandle, ivec2 displaySize, GLenum internalFormat)
 {
-    glGenTextures(1, &textureHandle);
-    glBindTexture(GL_TEXTURE_2D, textureHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, displaySize.x, displaySize.y, 0, GL_RGBA, type, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    textureHandle = CreateTextureStorage2D(internalFormat, displaySize.x, displaySize.y, 1);
 }
 
 void CheckFBOStatus()
@@ -277,6 +271,62 @@ void CheckFBOStatus()
     }
 }
 
+// Every program the engine draws with, also compiled by the warmup and cooked
+// to SPIR-V by the Cooker. The geometry programs have a variant per material features (see RenderSubmesh)
+static const u32 GeometryProgramFeatures = ProgramFeature_NormalMap | ProgramFeature_ReliefMap | ProgramFeature_NoTexture;
+
+const ProgramDesc ScenePrograms[] =
+{
+    { "shaders.glsl", "TEXTURED_GEOMETRY",  0 },
+    { "shaders.glsl", "GEOMETRY_PASS",      GeometryProgramFeatures },
+    { "shaders.glsl", "LIGHTING_PASS",      0 },
+    { "shaders.glsl", "BLOOM_BRIGHTEST",    0 },
+    { "shaders.glsl", "BLOOM_BLUR",         0 },
+    { "shaders.glsl", "BLOOM",              0 },
+    { "shaders.glsl", "SHOW_TEXTURED_MESH", GeometryProgramFeatures },
+};
+
+const u32 SceneProgramCount = ARRAY_COUNT(ScenePrograms);
+
+static u32 App::* const SceneProgramIndices[] =
+{
+    &App::texturedGeometryProgramIdx,
+    &App::deferredGeometryProgramIdx,
+    &App::deferredLightingProgramIdx,
+    &App::blitBrightestPixelsProgram,
+    &App::blur,
+    &App::bloomProgram,
+    &App::texturedMeshProgramIdx,
+};
+
+static_assert(ARRAY_COUNT(ScenePrograms) == ARRAY_COUNT(SceneProgramIndices), "One index per scene program");
+
+// Programs, placeholder textures and the scene file, all but the placeholders
+// loading in the background
+static void LoadScene(App* app)
+{
+    // --- Program ---
+    for (u32 i = 0; i < ARRAY_COUNT(ScenePrograms); ++i)
+        app->*SceneProgramIndices[i] = LoadProgram(app, ScenePrograms[i].filepath, ScenePrograms[i].programName);
+
+    // --- Textures ---
+    // The placeholders are loaded before the first frame, everything else in the background
+    app->whiteTexIdx = QueueTexture2D(app, "color_white.png");
+    app->blackTexIdx = QueueTexture2D(app, "color_black.png");
+    app->normalTexIdx = QueueTexture2D(app, "color_normal.png", TextureUsage_Normal);
+    app->magentaTexIdx = QueueTexture2D(app, "color_magenta.png");
+    FlushTextureLoads(app);
+
+    InitModelLoading(app);
+
+    // Kept if the scene has no camera
+    app->cameraReference = vec3(0.0f);
+    app->cameraPosition = vec3(0.0f, 4.0f, 15.0f);
+
+    if (!LoadSceneFile(app, SCENE_PATH))
+        ELOG("Could not load scene %s", SCENE_PATH);
+}
+
 void Init(App* app)
 {
     // TODO: Initialize your resources here!
@@ -286,29 +336,35 @@ void Init(App* app)
     // - programs (and retrieve uniform indices)
     // - textures
 
+    // Assets are read from the pack when there is one
+    MountAssetPack("assets.pack");
+
     // --- Open GL info ---
     app->glInfo.version = (const char*)glGetString(GL_VERSION);
     app->glInfo.renderer = (const char*)glGetString(GL_RENDERER);
     app->glInfo.vendor = (const char*)glGetString(GL_VENDOR);
     app->glInfo.shadingLanguageVersion = (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION);
 
+    GLint num_extensions;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+
+    for (int i = 0; i < num_extensions; ++i)
+    {
+        app->glInfo.extensions.push_back((const char*)glGetStringi(GL_EXTENSIONS, GLuint(i)));
+    }
+
+    // Before any texture or buffer is created
+    InitGLExtensions(app);
+
     // --- Framebuffer ---   
-    GenerateFramebufferTexture(app->modelTextureAttachment, app->displaySize, GL_UNSIGNED_BYTE);
-    GenerateFramebufferTexture(app->normalsTextureAttachment, app->displaySize, GL_UNSIGNED_BYTE);
-    GenerateFramebufferTexture(app->albedoTextureAttachment, app->displaySize, GL_UNSIGNED_BYTE);
-    GenerateFramebufferTexture(app->depthTextureAttachment, app->displaySize, GL_UNSIGNED_BYTE);
-    GenerateFramebufferTexture(app->positionTextureAttachment, app->displaySize, GL_FLOAT);
+    GenerateFramebufferTexture(app->modelTextureAttachment, app->displaySize, GL_RGBA8);
+    GenerateFramebufferTexture(app->normalsTextureAttachment, app->displaySize, GL_RGBA8);
+    GenerateFramebufferTexture(app->albedoTextureAttachment, app->displaySize, GL_RGBA8);
+    GenerateFramebufferTexture(app->depthTextureAttachment, app->displaySize, GL_RGBA8);
+    GenerateFramebufferTexture(app->positionTextureAttachment, app->displaySize, GL_RGBA8);
 
     // Depth
-    glGenTextures(1, &app->depthAttachmentHandle);
-    glBindTexture(GL_TEXTURE_2D, app->depthAttachmentHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GenerateFramebufferTexture(app->depthAttachmentHandle, app->displaySize, GL_DEPTH_COMPONENT24);
 
     // Attach it to bound framebuffer object
     glGenFramebuffers(1, &app->framebufferHandle);
@@ -323,22 +379,27 @@ void Init(App* app)
     CheckFBOStatus();
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    InitSamplers(app);
+    InitVirtualTexturing(app);
+
     // --- Uniform buffers ---
     glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBlockAlignment);
     app->cbuffer = CreateConstantBuffer(app->maxUniformBufferSize);
 
-    GLint num_extensions;
-    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
-
-    for (int i = 0; i < num_extensions; ++i)
+    if (GL_MAJOR_VERSION > 4 || (GL_MAJOR_VERSION == 4 && GL_MINOR_VERSION >= 3))
     {
-        app->glInfo.extensions.push_back((const char*)glGetStringi(GL_EXTENSIONS, GLuint(i)));
+        glDebugMessageCallback(OnGLError, app);
     }
 
-    if (GL_MAJOR_VERSION > 4 || (GL_MAJOR_VERSION == 4 && GL_MINOR_VERSION >= 3))
+    InitTextureArrays(app);
+    InitPrograms(app);
+
+    if (app->warmupPrograms)
     {
-        glDebugMessageCallback(OnGLError, app);
+        WarmUpProgramCache(app, ScenePrograms, ARRAY_COUNT(ScenePrograms));
+        app->isRunning = false;
+        return;
     }
 
     // --- Geometry ---
@@ -363,103 +424,23 @@ void Init(App* app)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, app->embeddedElements);
     glBindVertexArray(0);
 
-    // --- Program ---
-    app->texturedGeometryProgramIdx = LoadProgram(app, "shaders.glsl", "TEXTURED_GEOMETRY");
+    // --- Scene ---
+    // Restored from the snapshot of the previous run if it is up to date,
+    // otherwise loaded from the assets and snapshotted once everything is in
+    if (RestoreSnapshot(app, SNAPSHOT_PATH))
+    {
+        InitModelLoading(app, app->modelLoading.proxyMaterialIdx);
+    }
+    else
+    {
+        LoadScene(app);
+        app->snapshot.writeWhenLoaded = true;
+    }
+    StartProgramWatcher(app);
+
     Program& texturedGeometryProgram = app->programs[app->texturedGeometryProgramIdx];
     app->programUniformTexture = glGetUniformLocation(texturedGeometryProgram.handle, "uTexture");
 
-    app->deferredGeometryProgramIdx = LoadProgram(app, "shaders.glsl", "GEOMETRY_PASS");
-    app->deferredLightingProgramIdx = LoadProgram(app, "shaders.glsl", "LIGHTING_PASS");
-    app->blitBrightestPixelsProgram = LoadProgram(app, "shaders.glsl", "BLOOM_BRIGHTEST");
-    app->blur = LoadProgram(app, "shaders.glsl", "BLOOM_BLUR");
-    app->bloomProgram = LoadProgram(app, "shaders.glsl", "BLOOM");
-    app->texturedMeshProgramIdx = LoadProgram(app, "shaders.glsl", "SHOW_TEXTURED_MESH");  
-
-    // --- Textures ---
-    app->diceTexIdx = LoadTexture2D(app, "dice.png");
-    app->whiteTexIdx = LoadTexture2D(app, "color_white.png");
-    app->blackTexIdx = LoadTexture2D(app, "color_black.png");
-    app->normalTexIdx = LoadTexture2D(app, "color_normal.png");
-    app->magentaTexIdx = LoadTexture2D(app, "color_magenta.png");
-    app->banditNormalMap = LoadTexture2D(app, "models/Bandit_Minion_Normal.png");
-    app->barrelNormalMap = LoadTexture2D(app, "models/Barrel_NormalMap.png");
-    app->test = LoadTexture2D(app, "cube/toy_box_disp.png");
-
-    app->model = LoadModel(app, "Patrick/Patrick.obj");
-    app->barrel = LoadModel(app, "models/Barrel_Prop.fbx");
-    app->bandit = LoadModel(app, "models/Bandit_Minion_Animations.FBX");
-    app->cube = LoadModel(app, "cube/Cube.FBX");
-    app->sphere = LoadModel(app, "models/Sphere.fbx");
-    app->plane = LoadModel(app, "models/Plane.fbx");
-
-
-    // --- Create entities ---
-    Entity ent = Entity(glm::mat4(1.0), app->model, 0, 0);
-    ent.worldMatrix = glm::translate(ent.worldMatrix, vec3(-5.0, 1.0, 5.0));
-    app->entities.push_back(ent);
-
-    Entity ent2 = Entity(glm::mat4(1.0), app->model, 0, 0);
-    ent2.worldMatrix = glm::translate(ent2.worldMatrix, vec3(2.5f, 1.0, 2.0));
-    app->entities.push_back(ent2);
-
-    Entity ent3 = Entity(glm::mat4(1.0), app->model, 0, 0);
-    ent3.worldMatrix = glm::translate(ent3.worldMatrix, vec3(2.0, 2.0, -2.0));
-    app->entities.push_back(ent3);
-
-    Entity ent4 = Entity(glm::mat4(1.0), app->plane, 0, 0);
-    ent4.worldMatrix = glm::translate(ent4.worldMatrix, vec3(0.0, -2.5, 0.0));
-    ent4.worldMatrix = glm::scale(ent4.worldMatrix, vec3(1.0, 1.0, 1.0));
-    app->entities.push_back(ent4);
-
-    Entity ent5 = Entity(glm::mat4(1.0), app->barrel, 0, 0);
-    ent5.worldMatrix = glm::translate(ent5.worldMatrix, vec3(0.0, 5.0, 0.0));
-    app->entities.push_back(ent5);
-
-    Entity ent6 = Entity(glm::mat4(1.0), app->bandit, 0, 0);
-    ent6.worldMatrix = glm::translate(ent6.worldMatrix, vec3(-2.5, 4.0, 3.0));
-    app->entities.push_back(ent6);
-
-    Entity ent7 = Entity(glm::mat4(1.0), app->cube, 0, 0);
-    ent7.worldMatrix = glm::translate(ent7.worldMatrix, vec3(-2.0, 5.0, -10.0));
-    ent7.worldMatrix = glm::scale(ent7.worldMatrix, vec3(0.025, 0.025, 0.025));
-    app->entities.push_back(ent7);
-
-    vec3 lightPos1 = vec3(-1.0, 1.0, -5.0);
-    vec3 lightPos2 = vec3(6.0, 1.0, 0.0);
-    vec3 lightPos3 = vec3(0.0, 1.0, 7.0);
-
-    Entity entlight1 = Entity(glm::mat4(1.0), app->sphere, 0, 0);
-    entlight1.worldMatrix = glm::translate(entlight1.worldMatrix, lightPos1);
-    app->entities.push_back(entlight1);
-
-    Entity entlight2 = Entity(glm::mat4(1.0), app->sphere, 0, 0);
-    entlight2.worldMatrix = glm::translate(entlight2.worldMatrix, lightPos2);
-    app->entities.push_back(entlight2);
-
-    Entity entlight3 = Entity(glm::mat4(1.0), app->sphere, 0, 0);
-    entlight3.worldMatrix = glm::translate(entlight3.worldMatrix, lightPos3);
-    app->entities.push_back(entlight3);
-
-    // --- Create lights
-    Light light0 = Light(LightType::LightType_Directional, vec3(1.0, 1.0, 1.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 0.0)); 
-    app->lights.push_back(light0);
-
- /*   Light light02 = Light(LightType::LightType_Directional, vec3(1.0, 1.0, 1.0), vec3(-1.0, 0.0, 1.0), vec3(0.0, 0.0, 0.0));
-    app->lights.push_back(light02);
-
-    Light light1 = Light(LightType::LightType_Point, vec3(1.0, 1.0, 1.0), vec3(0.0, 0.0, 0.0), lightPos1);
-    app->lights.push_back(light1);
-
-    Light light2 = Light(LightType::LightType_Point, vec3(1.0, 1.0, 1.0), vec3(0.0, 0.0, 0.0), lightPos2);
-    app->lights.push_back(light2);
-
-    Light light3 = Light(LightType::LightType_Point, vec3(1.0, 1.0, 1.0), vec3(0.0, 0.0, 0.0), lightPos3);
-    app->lights.push_back(light3);*/
-
-    // --- Camera ---
-    app->cameraReference = vec3(0.0f);
-    app->cameraPosition = vec3(0.0f, 4.0f, 15.0f);
-
     app->cameraMatrix = glm::lookAt
     (
         app->cameraPosition,        // the position of your camera, in world space
@@ -469,10 +450,10 @@ void Init(App* app)
 
     // Generates a really hard-to-read matrix, but a normal, standard 4x4 matrix nonetheless
     app->projectionMatrix = glm::perspective(
-        glm::radians(60.0f),        // The vertical Field of View, in radians: the amount of "zoom". Think "camera lens". Usually between 90 (extra wide) and 30 (quite zoomed in)
+        glm::radians(app->cameraFieldOfView),        // The vertical Field of View, in radians: the amount of "zoom". Think "camera lens". Usually between 90 (extra wide) and 30 (quite zoomed in)
         4.0f / 3.0f,                // Aspect Ratio. Depends on the size of your window. Notice that 4/3 == 800/600 == 1280/960, sounds familiar ?
-        0.1f,                       // Near clipping plane. Keep as big as possible, or you'll get precision issues.
-        1000.0f                      // Far clipping plane. Keep as little as possible.
+        app->cameraNearPlane,       // Near clipping plane. Keep as big as possible, or you'll get precision issues.
+        app->cameraFarPlane         // Far clipping plane. Keep as little as possible.
     );
 
     // --- BLOOM ---
@@ -482,51 +463,16 @@ void Init(App* app)
     if (app->rtBright != 0) 
         glDeleteTextures(1, &app->rtBright);
 
-    glGenTextures(1, &app->rtBright);
-    glBindTexture(GL_TEXTURE_2D, app->rtBright);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, MIPMAP_BASE_LEVEL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MIPMAP_MAX_LEVEL);
-
     int w = app->displaySize.x;
     int h = app->displaySize.y;
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w / 2, h / 2, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, w / 4, h / 4, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 2, GL_RGBA16F, w / 8, h / 8, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 3, GL_RGBA16F, w / 16, h / 16, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 4, GL_RGBA16F, w / 32, h / 32, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    glBindTexture(GL_TEXTURE_2D, 0);
+    app->rtBright = CreateTextureStorage2D(GL_RGBA16F, w / 2, h / 2, MIPMAP_MAX_LEVEL + 1);
 
     // Bloom mipmap
     if (app->rtBloomH != 0)
         glDeleteTextures(1, &app->rtBloomH);
 
-    glGenTextures(1, &app->rtBloomH);
-    glBindTexture(GL_TEXTURE_2D, app->rtBloomH);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, MIPMAP_BASE_LEVEL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MIPMAP_MAX_LEVEL);
-
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w / 2, h / 2, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, w / 4, h / 4, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 2, GL_RGBA16F, w / 8, h / 8, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 3, GL_RGBA16F, w / 16, h / 16, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexImage2D(GL_TEXTURE_2D, 4, GL_RGBA16F, w / 32, h / 32, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
+    app->rtBloomH = CreateTextureStorage2D(GL_RGBA16F, w / 2, h / 2, MIPMAP_MAX_LEVEL + 1);
 
     // Bloom fbos 
     glGenFramebuffers(1, &app->fboBloom1);
@@ -613,15 +559,14 @@ void Gui(App* app)
     if (app->showInfo)
     {
         ImGui::Begin("Debug window", &app->showInfo);
-        static vec3 entity1 = vec3(-5.0f, 1.0f, 5.0f);
-        static vec3 entity2 = vec3(2.5f, 1.0f, 2.0f);
-        static vec3 entity3 = vec3(2.0f, 2.0f, -2.0f);
 
         ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "RELIEF MAP");
         ImGui::NewLine();
 
         ImGui::Checkbox("Normal Map", &app->normalMap);
         ImGui::Checkbox("Relief Map", &app->reliefMap);
+        ImGui::SliderInt("Relief steps", (int*)&app->reliefSteps, 4, 64);
+        ImGui::Text("Drawn with %u steps", QuantizeReliefSteps(app->reliefSteps));
         ImGui::NewLine();
         ImGui::Text("Cube bumpiness");
         ImGui::DragFloat("##b", (float*)&app->bumpiness, 0.1f);
@@ -647,31 +592,6 @@ void Gui(App* app)
         ImGui::InputInt("LOD 4 Intensity", &app->lodIntensity4);        
         ImGui::NewLine();
 
-        ImGui::NewLine();
-        ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "Entity positions [X / Y / Z]");
-        ImGui::NewLine();
-
-        ImGui::Text("Entity 1");
-        if (ImGui::DragFloat3("##e", (float*)&entity1, 0.1f))
-        {
-            app->entities[0] = Entity(glm::mat4(1.0), app->model, 0, 0);
-            app->entities[0].worldMatrix = glm::translate(app->entities[0].worldMatrix, vec3(entity1.x, entity1.y, entity1.z));
-        }
-
-        ImGui::Text("Entity 2");
-        if (ImGui::DragFloat3("##e2", (float*)&entity2, 0.1f))
-        {
-            app->entities[1] = Entity(glm::mat4(1.0), app->model, 0, 0);
-            app->entities[1].worldMatrix = glm::translate(app->entities[1].worldMatrix, vec3(entity2.x, entity2.y, entity2.z));
-        }
-
-        ImGui::Text("Entity 3");
-        if (ImGui::DragFloat3("##e3", (float*)&entity3, 0.1f))
-        {
-            app->entities[2] = Entity(glm::mat4(1.0), app->model, 0, 0);
-            app->entities[2].worldMatrix = glm::translate(app->entities[2].worldMatrix, vec3(entity3.x, entity3.y, entity3.z));
-        }
-
         ImGui::NewLine();
         ImGui::Separator();
         ImGui::NewLine();
@@ -693,6 +613,17 @@ void Gui(App* app)
                 ImGui::Text("Extension %i: %s", i, app->glInfo.extensions[i].c_str());
         }
 
+        ResidencyGui(app);
+        TextureArraysGui(app);
+        TextureStreamingGui(app);
+        VirtualTexturingGui(app);
+        UploadManagerGui(app);
+        ModelLoadingGui(app);
+        AssetPackGui();
+        SceneGui(app);
+        ProgramsGui(app);
+        SnapshotGui(app);
+
         ImGui::End();
     }
 }
@@ -743,55 +674,71 @@ void HandleUserInput(App* app)
 
 void Update(App* app)
 {
-    for (u64 i = 0; i < app->programs.size(); ++i)
-    {
-        Program& program = app->programs[i];
-        u64 currentTimestamp = GetFileLastWriteTimestamp(program.filepath.c_str());
+    // Before the local params, so the models drawn this frame all have theirs
+    UpdateModelLoads(app);
+    UpdateSnapshot(app);
 
-        if (currentTimestamp > program.lastWriteTimestamp)
-        {
-            glDeleteProgram(program.handle);
-            String programSource = ReadTextFile(program.filepath.c_str());
-            const char* programName = program.programName.c_str();
-            program.handle = CreateProgramFromSource(programSource, programName);
-            program.lastWriteTimestamp = currentTimestamp;
-        }
-    }
+    UpdateProgramReload(app);
 
     HandleUserInput(app);
     
     // --- Global params ---
     MapBuffer(app->cbuffer, GL_WRITE_ONLY);
-    app->globalParamsOffset = app->cbuffer.head;
 
-    PushVec3(app->cbuffer, app->cameraPosition);
-    PushUInt(app->cbuffer, app->lights.size());
+    // Written in place, the lights in one pass. The shaders have room for GLOBAL_PARAMS_MAX_LIGHTS
+    u32 lightCount = std::min((u32)app->lights.size(), (u32)GLOBAL_PARAMS_MAX_LIGHTS);
+    app->globalParamsSize = GetGlobalParamsSize(lightCount);
+    GlobalParamsBlock* globalParams = (GlobalParamsBlock*)PushAlignedSpace(app->cbuffer, app->globalParamsSize, app->uniformBlockAlignment);
+    app->globalParamsOffset = app->cbuffer.head - app->globalParamsSize;
 
-    for (u32 i = 0; i < app->lights.size(); ++i)
+    globalParams->cameraPosition = app->cameraPosition;
+    globalParams->lightCount = lightCount;
+    for (u32 i = 0; i < lightCount; ++i)
     {
-        AlignHead(app->cbuffer, sizeof(vec4));
-
-        Light& light = app->lights[i];
-        PushUInt(app->cbuffer, light.type);
-        PushVec3(app->cbuffer, light.color);
-        PushVec3(app->cbuffer, light.direction);
-        PushVec3(app->cbuffer, light.position);
+        const Light& light = app->lights[i];
+        LightBlock& block = globalParams->lights[i];
+        block.type = light.type;
+        block.color = light.color;
+        block.direction = light.direction;
+        block.position = light.position;
     }
 
-    app->globalParamsSize = app->cbuffer.head - app->globalParamsOffset;
-
     // --- Local params ---
-    for (Entity& ent : app->entities)
+    Entities& entities = app->entities;
+    u32 entityCount = (u32)entities.worldMatrices.size();
+    entities.localParamsOffsets.resize(entityCount);
+    entities.proxyParamsOffsets.resize(entityCount);
+    entities.instanceParamsOffsets.resize(entityCount);
+
+    for (u32 e = 0; e < entityCount; ++e)
     {
-        glm::mat4 worldViewProjectionMatrix = app->projectionMatrix * app->cameraMatrix * ent.worldMatrix;
+        const glm::mat4& worldMatrix = entities.worldMatrices[e];
+        u32 modelIdx = entities.modelIndices[e];
+        glm::mat4 worldViewProjectionMatrix = app->projectionMatrix * app->cameraMatrix * worldMatrix;
+
+        LocalParamsBlock localParams = { worldMatrix, worldViewProjectionMatrix };
+        entities.localParamsOffsets[e] = PushBlock(app->cbuffer, localParams, app->uniformBlockAlignment);
 
-        AlignHead(app->cbuffer, app->uniformBlockAlignment);
-        ent.localParamsOffset = app->cbuffer.head;
+        // Models still loading are drawn as a box, with the same block size
+        glm::mat4 proxyTransform;
+        if (GetModelProxyTransform(app, modelIdx, proxyTransform))
+        {
+            glm::mat4 proxyWorldMatrix = worldMatrix * proxyTransform;
+            LocalParamsBlock proxyParams = { proxyWorldMatrix, app->projectionMatrix * app->cameraMatrix * proxyWorldMatrix };
+            entities.proxyParamsOffsets[e] = PushBlock(app->cbuffer, proxyParams, app->uniformBlockAlignment);
+        }
 
-        PushMat4(app->cbuffer, ent.worldMatrix);
-        PushMat4(app->cbuffer, worldViewProjectionMatrix);
+        // Hierarchical models need one block per node instance
+        const Model& model = app->models[modelIdx];
+        std::vector<u32>& instanceParamsOffsets = entities.instanceParamsOffsets[e];
+        instanceParamsOffsets.resize(model.instances.size());
 
-        ent.localParamsSize = app->cbuffer.head - ent.localParamsOffset;
+        for (u32 i = 0; i < model.instances.size(); ++i)
+        {
+            glm::mat4 instanceWorldMatrix = worldMatrix * model.instances[i].transform;
+            LocalParamsBlock instanceParams = { instanceWorldMatrix, app->projectionMatrix * app->cameraMatrix * instanceWorldMatrix };
+            instanceParamsOffsets[i] = PushBlock(app->cbuffer, instanceParams, app->uniformBlockAlignment);
+        }
     }
 
     UnmapBuffer(app->cbuffer);
@@ -827,11 +774,12 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
         {
             if (program.vertexInputLayout.attributes[i].location == submesh.vertexBufferLayout.attributes[j].location)
             {
-                const u32 index = submesh.vertexBufferLayout.attributes[j].location;
-                const u32 ncomp = submesh.vertexBufferLayout.attributes[j].componentCount;
-                const u32 offset = submesh.vertexBufferLayout.attributes[j].offset + submesh.vertexOffset; // attribute offset + vertex offset
-                const u32 stride = submesh.vertexBufferLayout.stride;
-                glVertexAttribPointer(index, ncomp, GL_FLOAT, GL_FALSE, stride, (void*)(u64)offset);
+                const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+                const u32 index = attribute.location;
+                const u32 ncomp = attribute.componentCount;
+                const u32 offset = attribute.offset + submesh.vertexOffset; // attribute offset + vertex offset
+                const u32 stride = attribute.stride ? attribute.stride : submesh.vertexBufferLayout.stride;
+                glVertexAttribPointer(index, ncomp, attribute.type, attribute.normalized, stride, (void*)(u64)offset);
                 glEnableVertexAttribArray(index);
 
                 attributeWasLinked = true;
@@ -898,6 +846,7 @@ void passBloom(App* app, GLuint fbo, GLenum colorAttachment, GLuint inputTexture
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, inputTexture);
+    BindSampler(app, 0, Sampler_NearestMipLinear);
     glUniform1i(glGetUniformLocation(program.handle, "colorMap"), 0);
     glUniform1i(glGetUniformLocation(program.handle, "maxLod"), maxLod);
     glUniform1i(glGetUniformLocation(program.handle, "lodI0"), app->lodIntensity0);
@@ -929,6 +878,7 @@ void passBlur(App* app, GLuint pfbo, const glm::uvec2& viewportSize, GLenum colo
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, inputTexture);
+    BindSampler(app, 0, Sampler_NearestMipLinear);
     glUniform1i(glGetUniformLocation(program.handle, "colorMap"), 0);
     glUniform1i(glGetUniformLocation(program.handle, "inputLod"), inputLod);
     glUniform1i(glGetUniformLocation(program.handle, "kernelRadius"), app->kernelRadius);
@@ -954,13 +904,12 @@ void passBlitBrightPixels(App* app, GLuint fbo, const glm::uvec2& viewportSize,
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, inputTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    BindSampler(app, 0, Sampler_Linear);
     glUniform1i(glGetUniformLocation(program.handle, "colorTexture"), 0);
     glUniform1f(glGetUniformLocation(program.handle, "threshold"), app->bloomThreshold);
 
     renderQuad(app);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glUseProgram(0);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -1041,8 +990,78 @@ void RenderBloom(App* app)
 #undef LOD
 }
 
+// Features of the geometry program variant a material draws with (see programs.h)
+static u32 GetMaterialProgramFeatures(App* app, const u32 textures[3])
+{
+    u32 features = app->textureArrays.bindless ? ProgramFeature_Bindless : 0;
+    if (!HasTexture(app, textures[0]))
+        features |= ProgramFeature_NoTexture;
+    if (app->normalMap && HasTexture(app, textures[1]))
+        features |= ProgramFeature_NormalMap;
+    if (app->reliefMap && HasTexture(app, textures[2]))
+        features |= ProgramFeature_ReliefMap | PROGRAM_RELIEF_STEPS(QuantizeReliefSteps(app->reliefSteps));
+    return features;
+}
+
+// programIdx is the base program, the variant for the material is bound if
+// boundProgram is another one
+void RenderSubmesh(App* app, u32 programIdx, GLuint& boundProgram, const glm::mat4& worldMatrix, Mesh& mesh, u32 submeshIdx, u32 materialIdx)
+{
+    if (!MakeMeshResident(app, mesh))
+        return;
+
+    Submesh& submesh = mesh.submeshes[submeshIdx];
+    f32 screenCoverage = ComputeScreenCoverage(app, worldMatrix, submesh.boundsMin, submesh.boundsMax);
+
+    // The shaders read the layers from the material table, the arrays holding
+    // them are usually bound already, and never need to be with bindless handles.
+    // Until the variant is compiled the base program draws, with the slots
+    const Material& submeshMaterial = app->materials[materialIdx];
+    u32 textures[3];
+    GetMaterialTextures(app, submeshMaterial, textures);
+    i32 textureSlots[ARRAY_COUNT(textures)] = {};
+
+    u32 features = GetMaterialProgramFeatures(app, textures);
+    const Program& renderProgram = app->programs[GetProgramVariant(app, programIdx, features)];
+    if (renderProgram.handle != boundProgram)
+    {
+        glUseProgram(renderProgram.handle);
+        glUniform1f(renderProgram.uniformBumpiness, app->bumpiness);
+        boundProgram = renderProgram.handle;
+    }
+
+    GLuint vao = FindVAO(mesh, submeshIdx, renderProgram);
+    glBindVertexArray(vao);
+
+    glUniform1ui(renderProgram.uniformMaterialIdx, materialIdx);
+    if (!(renderProgram.features & ProgramFeature_Bindless))
+    {
+        BeginArrayTextureDraw(app);
+        for (u32 i = 0; i < ARRAY_COUNT(textures); ++i)
+            if (HasTexture(app, textures[i]))
+                textureSlots[i] = BindArrayTexture(app, app->textures[textures[i]].arrayTextureIdx);
+
+        glUniform3i(renderProgram.uniformTextureSlots, textureSlots[0], textureSlots[1], textureSlots[2]);
+    }
+
+    // Paged textures only need their mip tail in the regular texture
+    if (!BindVirtualTexture(app, renderProgram, submeshMaterial.albedoTextureIdx))
+        RequestTextureDetail(app, submeshMaterial.albedoTextureIdx, screenCoverage);
+
+    if (features & ProgramFeature_NormalMap)
+        RequestTextureDetail(app, textures[1], screenCoverage);
+
+    if (features & ProgramFeature_ReliefMap)
+        RequestTextureDetail(app, textures[2], screenCoverage);
+
+    glDrawElements(GL_TRIANGLES, submesh.indexCount, submesh.indexType, (void*)(u64)submesh.indexOffset);
+}
+
 void Render(App* app)
 {
+    UpdateTextureLoads(app);
+    UpdateMaterialTable(app);
+
     glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Render");
 
     // --- Framebuffer ---
@@ -1050,6 +1069,7 @@ void Render(App* app)
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     ResetFBOS(app);
+    BeginVirtualTextureFeedback(app);
 
     glBindFramebuffer(GL_FRAMEBUFFER, app->framebufferHandle);
 
@@ -1074,80 +1094,60 @@ void Render(App* app)
 
     // Deferred geometry pass
 
-    Program renderProgram = app->programs[app->deferredGeometryProgramIdx];
+    u32 renderProgramIdx = app->deferredGeometryProgramIdx;
 
     // forward shading
     if (app->mode == Mode::Mode_ForwardRender)
-        renderProgram = app->programs[app->texturedMeshProgramIdx];
+        renderProgramIdx = app->texturedMeshProgramIdx;
 
-    glUseProgram(renderProgram.handle);
+    // Each submesh binds the variant its material needs
+    GLuint boundProgram = 0;
 
     glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(0), app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BINDING(0), app->materialBuffer);
 
-    for (Entity& ent : app->entities)
+    const Entities& entities = app->entities;
+    for (u32 e = 0; e < entities.worldMatrices.size(); ++e)
     {
-        Model& model = app->models[ent.modelIndex];
-        Mesh& mesh = app->meshes[model.meshIdx];
-
-        glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, ent.localParamsOffset, ent.localParamsSize);
+        const glm::mat4& worldMatrix = entities.worldMatrices[e];
+        u32 modelIdx = entities.modelIndices[e];
+        Model& model = app->models[modelIdx];
         glEnable(GL_DEPTH_TEST);
 
-        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+        if (!IsModelLoaded(app, modelIdx))
         {
-            GLuint vao = FindVAO(mesh, i, renderProgram);
-            glBindVertexArray(vao);
-
-            u32 submeshMaterialIdx = model.materialIdx[i];
-            Material& submeshMaterial = app->materials[submeshMaterialIdx];
-
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-
-            //if (ent.modelIndex > 1)
-           //     glUniform1i(glGetUniformLocation(renderProgram.handle, "noTexture"), 1);
-            //else
-                glUniform1i(glGetUniformLocation(renderProgram.handle, "noTexture"), 0);
-            
-            glUniform1i(glGetUniformLocation(renderProgram.handle, "uTexture"), 0);
-
-            // Normal map
-            if (app->normalMap)
+            glm::mat4 proxyTransform;
+            if (GetModelProxyTransform(app, modelIdx, proxyTransform))
             {
-                glActiveTexture(GL_TEXTURE1);
-                if (ent.modelIndex == 2)
-                    glBindTexture(GL_TEXTURE_2D, app->textures[app->banditNormalMap].handle);
-                else if (ent.modelIndex == 1)
-                    glBindTexture(GL_TEXTURE_2D, app->textures[app->barrelNormalMap].handle);
-                else
-                    glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.normalsTextureIdx].handle);
-
-                glUniform1i(glGetUniformLocation(renderProgram.handle, "uNormalMap"), 1);
-
-                if (ent.modelIndex >= 1 && ent.modelIndex <= 3)
-                    glUniform1i(glGetUniformLocation(renderProgram.handle, "noNormal"), 0);
-                else
-                    glUniform1i(glGetUniformLocation(renderProgram.handle, "noNormal"), 1);
+                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, entities.proxyParamsOffsets[e], sizeof(LocalParamsBlock));
+                RenderSubmesh(app, renderProgramIdx, boundProgram, worldMatrix * proxyTransform, app->modelLoading.proxyMesh, 0, app->modelLoading.proxyMaterialIdx);
             }
+            continue;
+        }
 
-            // Relief map
-            if (app->reliefMap)
+        if (model.instances.empty())
+        {
+            Mesh& mesh = app->meshes[model.meshIdx];
+            glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, entities.localParamsOffsets[e], sizeof(LocalParamsBlock));
+
+            for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+                RenderSubmesh(app, renderProgramIdx, boundProgram, worldMatrix, mesh, i, model.materialIdx[i]);
+        }
+        else
+        {
+            for (u32 i = 0; i < model.instances.size(); ++i)
             {
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, app->textures[app->test].handle);
-                glUniform1i(glGetUniformLocation(renderProgram.handle, "uBumpTexture"), 2);
-                glUniform1f(glGetUniformLocation(renderProgram.handle, "uBumpiness"), app->bumpiness);
-
-                if (ent.modelIndex == 3)
-                    glUniform1i(glGetUniformLocation(renderProgram.handle, "noBump"), 0);
-                else
-                    glUniform1i(glGetUniformLocation(renderProgram.handle, "noBump"), 1);
-            }
+                const MeshInstance& instance = model.instances[i];
+                Mesh& mesh = app->meshes[instance.submesh.meshIdx];
+                glBindBufferRange(GL_UNIFORM_BUFFER, BINDING(1), app->cbuffer.handle, entities.instanceParamsOffsets[e][i], sizeof(LocalParamsBlock));
 
-            Submesh& submesh = mesh.submeshes[i];
-            glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+                RenderSubmesh(app, renderProgramIdx, boundProgram, worldMatrix * instance.transform, mesh, instance.submesh.submeshIdx, instance.materialIdx);
+            }
         }
     }
 
+    EndVirtualTextureFeedback(app);
+
     // deferred lighting pass
     if (app->mode != Mode::Mode_ForwardRender)
     {
@@ -1167,6 +1167,8 @@ void Render(App* app)
         glBindTexture(GL_TEXTURE_2D, app->depthTextureAttachment);
         glActiveTexture(GL_TEXTURE3);
         glBindTexture(GL_TEXTURE_2D, app->positionTextureAttachment);
+        for (u32 unit = 0; unit < 4; ++unit)
+            BindSampler(app, unit, Sampler_Nearest);
 
         GLuint drawBuffers[] = { GL_COLOR_ATTACHMENT0 };
         glDrawBuffers(ARRAY_COUNT(drawBuffers), drawBuffers);
@@ -1194,6 +1196,7 @@ void Render(App* app)
 
     glUniform1i(app->programUniformTexture, 0);
     glActiveTexture(GL_TEXTURE0);
+    BindSampler(app, 0, Sampler_Nearest);
 
     switch (app->mode)
     {
@@ -1236,4 +1239,9 @@ void Render(App* app)
     //glBindVertexArray(0);
     glUseProgram(0);
     glPopDebugGroup();
+
+    UpdateResidency(app);
+    UpdateTextureStreaming(app);
+    UpdateVirtualTexturing(app);
+    UpdateUploads(app);
 }
\ No newline at end of file
@@ -8,8 +8,23 @@
 #include "Geometry.h"
 #include "Mesh.h"
 #include <glad/glad.h>
+#include "asset_pack.h"
 #include "assimp_model_loading.h"
 #include "buffer_management.h"
+#include "gl_extensions.h"
+#include "model_loading.h"
+#include "programs.h"
+#include "residency.h"
+#include "samplers.h"
+#include "scene.h"
+#include "snapshot.h"
+#include "texture_arrays.h"
+#include "texture_cooker.h"
+#include "texture_loading.h"
+#include "texture_streaming.h"
+#include "upload_manager.h"
+#include "virtual_texturing.h"
+#include <unordered_map>
 
 #define BINDING(b) b
 
@@ -52,17 +67,12 @@ struct Image
 
 struct Texture
 {
-    GLuint      handle;
+    u32         arrayTextureIdx = UINT32_MAX; // in app->textureArrays, once loaded
     std::string filepath;
-};
-
-struct Program
-{
-    GLuint             handle;
-    std::string        filepath;
-    std::string        programName;
-    u64                lastWriteTimestamp; // What is this for?
-    VertexShaderLayout vertexInputLayout;
+    u32         streamedIdx = UINT32_MAX; // in app->textureStreaming, if streamed
+    u32         virtualIdx = UINT32_MAX;  // in app->virtualTexturing, if it can be paged
+    bool        fromMemory = false;       // embedded image, it has no file to cook or pack
+    bool        loading = false;          // queued, see texture_loading.h
 };
 
 struct OpenGLInfo
@@ -75,20 +85,16 @@ struct OpenGLInfo
     std::vector<std::string> extensions;
 };
 
-struct Entity
+// One array per field, the way scene files store them (see scene.h)
+struct Entities
 {
-    Entity(glm::mat4 world, u32 modelIdx, u32 localParamsOff, u32 localParamsSiz)
-    {
-        worldMatrix = world;
-        modelIndex = modelIdx;
-        localParamsOffset = localParamsOff;
-        localParamsSize = localParamsSiz;
-    }
+    std::vector<glm::mat4> worldMatrices;
+    std::vector<u32>       modelIndices;
 
-    glm::mat4 worldMatrix;
-    u32 modelIndex;
-    u32 localParamsOffset;
-    u32 localParamsSize;
+    // Local params of the current frame (LocalParamsBlock), filled in Update
+    std::vector<u32>              localParamsOffsets;
+    std::vector<u32>              proxyParamsOffsets;    // box drawn while the model loads (see model_loading.h)
+    std::vector<std::vector<u32>> instanceParamsOffsets; // each instance of hierarchical models
 };
 
 enum class Mode
@@ -117,6 +123,9 @@ struct App
     // Camera
     vec3 cameraPosition;
     vec3 cameraReference;
+    f32  cameraFieldOfView = 60.0f; // vertical, in degrees
+    f32  cameraNearPlane = 0.1f;
+    f32  cameraFarPlane = 1000.0f;
     glm::mat4 cameraMatrix;
     glm::mat4 projectionMatrix;
 
@@ -131,12 +140,55 @@ struct App
 
     std::vector<Texture>    textures;
     std::vector<Program>    programs;
+    ProgramReload           programReload;
+    ProgramCache            programCache;
+    std::unordered_map<u64, u32> programVariants; // see GetProgramVariant
+    bool                    warmupPrograms; // --warmup-programs: fill the program cache and quit
     std::vector<Mesh>       meshes;
     std::vector<Model>      models;
     std::vector<Material>   materials;
-    std::vector<Entity>     entities;
+    Entities                entities;
     std::vector<Light>      lights;
 
+    // Path/content lookups of the textures, and the loads in flight
+    TextureRegistry           textureRegistry;
+    std::vector<TextureLoad*> textureLoads;
+
+    // Arrays holding the material textures, and the material table pointing to them
+    TextureArrays textureArrays;
+    Samplers samplers;
+    GLuint        materialBuffer;
+    u32           materialBufferCount;
+    u32           materialBufferVersion;
+    u32           materialBufferLoads;
+
+    // Mips kept on the GPU for the cooked textures
+    TextureStreaming textureStreaming;
+
+    // Page cache and feedback of the virtual textures
+    VirtualTexturing virtualTexturing;
+
+    // Staging memory and fences of the uploads the above stream in
+    UploadManager uploads;
+
+    // Models being imported in the background
+    ModelLoading modelLoading;
+
+    // Content hash -> material, to share identical materials between models
+    std::unordered_map<u64, u32> sharedMaterials;
+
+    // Content hash -> submesh, to share identical geometry between models
+    std::unordered_map<u64, SharedSubmesh> sharedSubmeshes;
+
+    // RAM/VRAM budgets of the mesh geometry
+    Residency residency;
+
+    // Tables of the scene file the entities come from
+    Scene scene;
+
+    // Warm start state, see snapshot.h
+    Snapshot snapshot;
+
     // program indices
     u32 texturedGeometryProgramIdx;
     u32 texturedMeshProgramIdx;
@@ -158,6 +210,7 @@ struct App
     bool renderBloom = true;
     bool normalMap = true;
     bool reliefMap = true;
+    u32  reliefSteps = PROGRAM_DEFAULT_RELIEF_STEPS;
     GLuint rtBright; // for blitting brightest pixels and vertical blur
     GLuint rtBloomH; // For first pass horizontal blur
     GLuint fboBloom1;
@@ -185,21 +238,10 @@ struct App
     GLuint framebufferHandle;
 
     // texture indices
-    u32 diceTexIdx;
     u32 whiteTexIdx;
     u32 blackTexIdx;
     u32 normalTexIdx;
     u32 magentaTexIdx;
-    u32 barrelNormalMap;
-    u32 banditNormalMap;
-    u32 test;
-
-    u32 model;
-    u32 sphere;
-    u32 plane;
-    u32 barrel;
-    u32 bandit;
-    u32 cube;
 
     // Mode
     Mode mode;
@@ -220,7 +262,31 @@ struct App
     GLuint vao;
 };
 
-u32 LoadTexture2D(App* app, const char* filepath);
+// Every program the engine draws with, for the warmup and the Cooker
+extern const ProgramDesc ScenePrograms[];
+extern const u32 SceneProgramCount;
+
+GLuint CreateTexture2DFromImage(Image image);
+
+// Logs why the bound framebuffer is not complete, if it is not
+void CheckFBOStatus();
+
+// Adds a material, or returns the index of an identical one added before
+u32 AddMaterial(App* app, const Material& material);
+
+// Points the materials of a model to another texture, once it is loaded if it
+// is still loading. The materials are copied, other models keep theirs
+void SetModelTexture(App* app, u32 modelIdx, u32 Material::* slot, u32 texIdx);
+
+// Returns the texture right away and loads it in the background (see
+// texture_loading.h). Until then materials sample white in its place, and
+// magenta if it can not be loaded. The usage picks the compression of the
+// cooked texture (see texture_cooker.h)
+u32 LoadTexture2D(App* app, const char* filepath, TextureUsage usage = TextureUsage_Color);
+
+// Same for an image already in memory (e.g. embedded in a model file). The name
+// identifies the texture in place of a file path.
+u32 LoadTexture2DFromMemory(App* app, const char* name, const void* data, u32 size);
 
 void Init(App* app);
 
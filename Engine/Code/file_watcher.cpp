@@ -0,0 +1,436 @@
+#ifdef _WIN32
+#define VC_EXTRALEAN
+#define WIN32_LEAN_AND_MEAN
+#define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "file_watcher.h"
+#include "asset_pack.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#if !defined(_WIN32) && !defined(__linux__)
+#define FILE_WATCHER_POLL_MS 250
+#endif
+
+struct WatchedDirectory
+{
+    std::string path; // normalized, empty for the working directory
+
+#ifdef _WIN32
+    HANDLE     handle;
+    OVERLAPPED overlapped;
+    DWORD      buffer[4096]; // FILE_NOTIFY_INFORMATION records, DWORD aligned
+#elif defined(__linux__)
+    int        watchDescriptor;
+#endif
+};
+
+struct FileWatcher
+{
+    std::vector<std::string>      files;
+    std::vector<std::string>      normalizedFiles;
+    std::vector<WatchedDirectory> directories;
+    std::vector<u64>              timestamps; // polled when there are no notifications
+
+    std::thread                   thread;
+    std::atomic<bool>             stop;
+
+    std::mutex                    mutex;
+    std::vector<FileChange>       changes;
+
+#ifdef _WIN32
+    HANDLE                        stopEvent;
+#elif defined(__linux__)
+    int                           inotifyFd;
+    int                           stopFd;
+#endif
+};
+
+const char* GetFileWatcherBackend()
+{
+#if defined(_WIN32)
+    return "ReadDirectoryChangesW";
+#elif defined(__linux__)
+    return "inotify";
+#else
+    return "polling";
+#endif
+}
+
+static const char* GetDirectoryOpenPath(const WatchedDirectory& directory)
+{
+    return directory.path.empty() ? "." : directory.path.c_str();
+}
+
+// Flags the watched files a notification names. Returns true if there were any.
+static bool MarkChangedFile(FileWatcher* watcher, const WatchedDirectory& directory, const std::string& name, std::vector<bool>& dirty)
+{
+    std::string path = directory.path.empty() ? name : directory.path + "/" + name;
+    path = NormalizeAssetPath(path.c_str());
+
+    bool marked = false;
+    for (u32 i = 0; i < watcher->normalizedFiles.size(); ++i)
+    {
+        if (watcher->normalizedFiles[i] == path)
+        {
+            dirty[i] = true;
+            marked = true;
+        }
+    }
+    return marked;
+}
+
+static bool ReadWholeFile(const char* filepath, std::string& contents)
+{
+    FILE* file = fopen(filepath, "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    contents.resize(size > 0 ? (size_t)size : 0);
+    size_t read = contents.empty() ? 0 : fread(&contents[0], 1, contents.size(), file);
+    fclose(file);
+
+    return read == contents.size();
+}
+
+#if defined(_WIN32)
+
+static bool IssueDirectoryRead(WatchedDirectory& directory)
+{
+    const DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE;
+    return ReadDirectoryChangesW(directory.handle, directory.buffer, sizeof(directory.buffer), FALSE, filter, NULL, &directory.overlapped, NULL) != 0;
+}
+
+static bool OpenWatches(FileWatcher* watcher)
+{
+    watcher->stopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    for (WatchedDirectory& directory : watcher->directories)
+    {
+        directory.overlapped = {};
+        directory.handle = CreateFileA(GetDirectoryOpenPath(directory), FILE_LIST_DIRECTORY,
+                                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                                       FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        if (directory.handle == INVALID_HANDLE_VALUE)
+        {
+            ELOG("Could not watch directory %s", GetDirectoryOpenPath(directory));
+            continue;
+        }
+
+        directory.overlapped.hEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+        if (!IssueDirectoryRead(directory))
+            ELOG("ReadDirectoryChangesW() failed on %s", GetDirectoryOpenPath(directory));
+    }
+    return watcher->stopEvent != NULL;
+}
+
+static void CloseWatches(FileWatcher* watcher)
+{
+    for (WatchedDirectory& directory : watcher->directories)
+    {
+        if (directory.handle == INVALID_HANDLE_VALUE)
+            continue;
+
+        // The read still points into the buffer until the cancellation completes
+        DWORD bytes;
+        CancelIoEx(directory.handle, &directory.overlapped);
+        GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, TRUE);
+        CloseHandle(directory.overlapped.hEvent);
+        CloseHandle(directory.handle);
+    }
+    CloseHandle(watcher->stopEvent);
+}
+
+static void SignalStop(FileWatcher* watcher)
+{
+    SetEvent(watcher->stopEvent);
+}
+
+// Returns true if any watched file changed before the timeout (negative: none)
+static bool WaitForChanges(FileWatcher* watcher, std::vector<bool>& dirty, i32 timeoutMs)
+{
+    HANDLE events[MAXIMUM_WAIT_OBJECTS];
+    u32 directoryIndices[MAXIMUM_WAIT_OBJECTS];
+    u32 eventCount = 0;
+    events[eventCount++] = watcher->stopEvent;
+    for (u32 i = 0; i < watcher->directories.size() && eventCount < MAXIMUM_WAIT_OBJECTS; ++i)
+    {
+        if (watcher->directories[i].handle == INVALID_HANDLE_VALUE)
+            continue;
+        directoryIndices[eventCount] = i;
+        events[eventCount++] = watcher->directories[i].overlapped.hEvent;
+    }
+
+    DWORD result = WaitForMultipleObjects(eventCount, events, FALSE, timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+    if (result <= WAIT_OBJECT_0 || result >= WAIT_OBJECT_0 + eventCount)
+        return false;
+
+    WatchedDirectory& directory = watcher->directories[directoryIndices[result - WAIT_OBJECT_0]];
+
+    bool changed = false;
+    DWORD bytes = 0;
+    if (GetOverlappedResult(directory.handle, &directory.overlapped, &bytes, FALSE))
+    {
+        if (bytes == 0)
+        {
+            // The buffer overflowed, any file of the directory may have changed
+            for (u32 i = 0; i < watcher->normalizedFiles.size(); ++i)
+            {
+                const std::string& file = watcher->normalizedFiles[i];
+                size_t slash = file.find_last_of('/');
+                std::string fileDirectory = slash == std::string::npos ? std::string() : file.substr(0, slash);
+                if (fileDirectory == directory.path)
+                    dirty[i] = changed = true;
+            }
+        }
+
+        const u8* record = (const u8*)directory.buffer;
+        while (bytes > 0)
+        {
+            const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)record;
+            char name[MAX_PATH * 3];
+            int nameLength = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), name, sizeof(name), NULL, NULL);
+            if (nameLength > 0 && info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+                changed |= MarkChangedFile(watcher, directory, std::string(name, nameLength), dirty);
+
+            if (info->NextEntryOffset == 0)
+                break;
+            record += info->NextEntryOffset;
+        }
+    }
+
+    IssueDirectoryRead(directory);
+    return changed;
+}
+
+#elif defined(__linux__)
+
+static bool OpenWatches(FileWatcher* watcher)
+{
+    watcher->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watcher->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (watcher->inotifyFd < 0 || watcher->stopFd < 0)
+    {
+        ELOG("Could not create the inotify instance");
+        return false;
+    }
+
+    // Editors often save to a temporary file and rename it over the original
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE;
+    for (WatchedDirectory& directory : watcher->directories)
+    {
+        directory.watchDescriptor = inotify_add_watch(watcher->inotifyFd, GetDirectoryOpenPath(directory), mask);
+        if (directory.watchDescriptor < 0)
+            ELOG("Could not watch directory %s", GetDirectoryOpenPath(directory));
+    }
+    return true;
+}
+
+static void CloseWatches(FileWatcher* watcher)
+{
+    if (watcher->inotifyFd >= 0)
+        close(watcher->inotifyFd);
+    if (watcher->stopFd >= 0)
+        close(watcher->stopFd);
+}
+
+static void SignalStop(FileWatcher* watcher)
+{
+    uint64_t one = 1;
+    if (write(watcher->stopFd, &one, sizeof(one)) < 0)
+        ELOG("Could not wake the file watcher");
+}
+
+// Returns true if any watched file changed before the timeout (negative: none)
+static bool WaitForChanges(FileWatcher* watcher, std::vector<bool>& dirty, i32 timeoutMs)
+{
+    pollfd fds[2] = {
+        { watcher->inotifyFd, POLLIN, 0 },
+        { watcher->stopFd, POLLIN, 0 },
+    };
+    if (poll(fds, 2, timeoutMs) <= 0 || (fds[1].revents & POLLIN) || !(fds[0].revents & POLLIN))
+        return false;
+
+    bool changed = false;
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(watcher->inotifyFd, buffer, sizeof(buffer))) > 0)
+    {
+        for (const char* cursor = buffer; cursor < buffer + length; )
+        {
+            const inotify_event* event = (const inotify_event*)cursor;
+            cursor += sizeof(inotify_event) + event->len;
+
+            if (event->len == 0)
+                continue;
+
+            for (const WatchedDirectory& directory : watcher->directories)
+                if (directory.watchDescriptor == event->wd)
+                    changed |= MarkChangedFile(watcher, directory, event->name, dirty);
+        }
+    }
+    return changed;
+}
+
+#else
+
+static bool OpenWatches(FileWatcher* watcher)
+{
+    return true;
+}
+
+static void CloseWatches(FileWatcher* watcher)
+{
+}
+
+static void SignalStop(FileWatcher* watcher)
+{
+}
+
+// Returns true if any watched file changed before the timeout (negative: none)
+static bool WaitForChanges(FileWatcher* watcher, std::vector<bool>& dirty, i32 timeoutMs)
+{
+    i32 sleepMs = timeoutMs < 0 || timeoutMs > FILE_WATCHER_POLL_MS ? FILE_WATCHER_POLL_MS : timeoutMs;
+    std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+
+    bool changed = false;
+    for (u32 i = 0; i < watcher->files.size(); ++i)
+    {
+        u64 timestamp = GetFileLastWriteTimestamp(watcher->files[i].c_str());
+        if (timestamp != watcher->timestamps[i])
+        {
+            watcher->timestamps[i] = timestamp;
+            dirty[i] = changed = true;
+        }
+    }
+    return changed;
+}
+
+#endif
+
+static void WatchFiles(FileWatcher* watcher)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<bool> dirty(watcher->files.size(), false);
+    bool anyDirty = false;
+    Clock::time_point lastChange;
+
+    while (!watcher->stop)
+    {
+        // Sleep until something changes, then until the files settle
+        i32 timeoutMs = -1;
+        if (anyDirty)
+        {
+            i64 elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - lastChange).count();
+            timeoutMs = elapsedMs < FILE_WATCHER_SETTLE_MS ? (i32)(FILE_WATCHER_SETTLE_MS - elapsedMs) : 0;
+        }
+
+        if (WaitForChanges(watcher, dirty, timeoutMs))
+        {
+            anyDirty = true;
+            lastChange = Clock::now();
+            continue;
+        }
+
+        if (!anyDirty || Clock::now() - lastChange < std::chrono::milliseconds(FILE_WATCHER_SETTLE_MS))
+            continue;
+
+        // Read outside the lock, a file may be large or on a slow drive
+        std::vector<FileChange> changes;
+        for (u32 i = 0; i < dirty.size(); ++i)
+        {
+            if (!dirty[i])
+                continue;
+
+            FileChange change;
+            change.path = watcher->files[i];
+            if (ReadWholeFile(change.path.c_str(), change.contents))
+                changes.push_back(std::move(change));
+            else
+                ELOG("Could not read changed file %s", change.path.c_str());
+            dirty[i] = false;
+        }
+        anyDirty = false;
+
+        std::lock_guard<std::mutex> lock(watcher->mutex);
+        for (FileChange& change : changes)
+            watcher->changes.push_back(std::move(change));
+    }
+}
+
+FileWatcher* StartFileWatcher(const std::vector<std::string>& filepaths)
+{
+    if (filepaths.empty())
+        return NULL;
+
+    FileWatcher* watcher = new FileWatcher;
+    watcher->stop = false;
+    watcher->files = filepaths;
+
+    for (const std::string& filepath : filepaths)
+    {
+        std::string normalized = NormalizeAssetPath(filepath.c_str());
+        size_t slash = normalized.find_last_of('/');
+        std::string directoryPath = slash == std::string::npos ? std::string() : normalized.substr(0, slash);
+
+        bool known = false;
+        for (const WatchedDirectory& directory : watcher->directories)
+            known |= directory.path == directoryPath;
+        if (!known)
+        {
+            watcher->directories.emplace_back();
+            watcher->directories.back().path = directoryPath;
+        }
+
+        watcher->normalizedFiles.push_back(normalized);
+        watcher->timestamps.push_back(GetFileLastWriteTimestamp(filepath.c_str()));
+    }
+
+    if (!OpenWatches(watcher))
+    {
+        CloseWatches(watcher);
+        delete watcher;
+        return NULL;
+    }
+
+    watcher->thread = std::thread(WatchFiles, watcher);
+    return watcher;
+}
+
+void StopFileWatcher(FileWatcher* watcher)
+{
+    if (!watcher)
+        return;
+
+    watcher->stop = true;
+    SignalStop(watcher);
+    watcher->thread.join();
+
+    CloseWatches(watcher);
+    delete watcher;
+}
+
+void PollFileChanges(FileWatcher* watcher, std::vector<FileChange>& changes)
+{
+    if (!watcher)
+        return;
+
+    std::lock_guard<std::mutex> lock(watcher->mutex);
+    for (FileChange& change : watcher->changes)
+        changes.push_back(std::move(change));
+    watcher->changes.clear();
+}
@@ -0,0 +1,45 @@
+//
+// file_watcher.h: Watches a set of files from a thread of its own, woken by the
+// OS when their directories change (inotify on Linux, ReadDirectoryChangesW on
+// Windows) or polling their write timestamps elsewhere. Editors save in bursts
+// (truncate, write, rename...), so a file is read once it has been quiet for
+// FILE_WATCHER_SETTLE_MS, and its contents are handed to the main thread once
+// however many things use it.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <string>
+#include <vector>
+
+#define FILE_WATCHER_SETTLE_MS 50
+
+struct FileWatcher;
+
+struct FileChange
+{
+    std::string path;     // as it was given to StartFileWatcher
+    std::string contents;
+};
+
+/**
+ * Starts watching the files, which must exist. Returns NULL if there is nothing
+ * to watch.
+ */
+FileWatcher* StartFileWatcher(const std::vector<std::string>& filepaths);
+
+/**
+ * Joins the thread and frees the watcher.
+ */
+void StopFileWatcher(FileWatcher* watcher);
+
+/**
+ * Moves the changes read since the last call to the end of changes.
+ */
+void PollFileChanges(FileWatcher* watcher, std::vector<FileChange>& changes);
+
+/**
+ * Name of the notification mechanism, for the GUI.
+ */
+const char* GetFileWatcherBackend();
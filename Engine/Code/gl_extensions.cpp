@@ -0,0 +1,57 @@
+#include "gl_extensions.h"
+#include "engine.h"
+
+GLExtensions GlobalGLExtensions = {};
+
+template <typename Function>
+static bool LoadGLFunction(Function& function, const char* name)
+{
+    function = (Function)GetGLProcAddress(name);
+    return function != NULL;
+}
+
+void InitGLExtensions(App* app)
+{
+    GLExtensions& ext = GlobalGLExtensions;
+    ext = GLExtensions{};
+
+    if (HasGLExtension(app, "GL_ARB_buffer_storage"))
+        ext.bufferStorage = LoadGLFunction(ext.BufferStorage, "glBufferStorage");
+
+    // Either every entry point of an extension is there or it is not used
+    if (HasGLExtension(app, "GL_ARB_direct_state_access"))
+    {
+        bool loaded = LoadGLFunction(ext.CreateTextures, "glCreateTextures");
+        loaded = LoadGLFunction(ext.TextureStorage2D, "glTextureStorage2D") && loaded;
+        loaded = LoadGLFunction(ext.TextureSubImage2D, "glTextureSubImage2D") && loaded;
+        loaded = LoadGLFunction(ext.CompressedTextureSubImage2D, "glCompressedTextureSubImage2D") && loaded;
+        loaded = LoadGLFunction(ext.GenerateTextureMipmap, "glGenerateTextureMipmap") && loaded;
+        loaded = LoadGLFunction(ext.CreateBuffers, "glCreateBuffers") && loaded;
+        loaded = LoadGLFunction(ext.MapNamedBufferRange, "glMapNamedBufferRange") && loaded;
+        loaded = LoadGLFunction(ext.UnmapNamedBuffer, "glUnmapNamedBuffer") && loaded;
+        if (ext.bufferStorage) // only exported along with ARB_buffer_storage
+            loaded = LoadGLFunction(ext.NamedBufferStorage, "glNamedBufferStorage") && loaded;
+        ext.directStateAccess = loaded;
+    }
+
+    ILOG("Direct state access: %s   Buffer storage: %s", ext.directStateAccess ? "yes" : "no", ext.bufferStorage ? "yes" : "no");
+}
+
+GLuint CreateTextureStorage2D(GLenum internalFormat, GLsizei width, GLsizei height, GLsizei levelCount)
+{
+    const GLExtensions& ext = GlobalGLExtensions;
+
+    GLuint texture;
+    if (ext.directStateAccess)
+    {
+        ext.CreateTextures(GL_TEXTURE_2D, 1, &texture);
+        ext.TextureStorage2D(texture, levelCount, internalFormat, width, height);
+        return texture;
+    }
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, internalFormat, width, height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
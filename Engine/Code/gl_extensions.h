@@ -0,0 +1,67 @@
+//
+// gl_extensions.h: Entry points of the extensions past the GL 4.3 core profile
+// the engine uses for resources: ARB_direct_state_access (core in 4.5), to
+// create and edit textures and buffers without binding them, and
+// ARB_buffer_storage (core in 4.4), for immutable and persistently mapped
+// buffers. glad only loads the 4.3 core functions, so these are loaded with
+// GetGLProcAddress when the driver advertises the extension. Every caller keeps
+// the 4.3 path for drivers that do not.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+struct App;
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT  0x0040
+#define GL_MAP_COHERENT_BIT    0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT  0x0200
+#endif
+
+typedef void  (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void  (APIENTRYP PFNGLCREATETEXTURESPROC)(GLenum target, GLsizei n, GLuint* textures);
+typedef void  (APIENTRYP PFNGLTEXTURESTORAGE2DPROC)(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void  (APIENTRYP PFNGLTEXTURESUBIMAGE2DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                                                     GLenum format, GLenum type, const void* pixels);
+typedef void  (APIENTRYP PFNGLCOMPRESSEDTEXTURESUBIMAGE2DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                                                               GLenum format, GLsizei imageSize, const void* data);
+typedef void  (APIENTRYP PFNGLGENERATETEXTUREMIPMAPPROC)(GLuint texture);
+typedef void  (APIENTRYP PFNGLCREATEBUFFERSPROC)(GLsizei n, GLuint* buffers);
+typedef void  (APIENTRYP PFNGLNAMEDBUFFERSTORAGEPROC)(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void* (APIENTRYP PFNGLMAPNAMEDBUFFERRANGEPROC)(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRYP PFNGLUNMAPNAMEDBUFFERPROC)(GLuint buffer);
+
+struct GLExtensions
+{
+    bool directStateAccess; // ARB_direct_state_access
+    bool bufferStorage;     // ARB_buffer_storage
+
+    PFNGLBUFFERSTORAGEPROC BufferStorage;
+
+    PFNGLCREATETEXTURESPROC              CreateTextures;
+    PFNGLTEXTURESTORAGE2DPROC            TextureStorage2D;
+    PFNGLTEXTURESUBIMAGE2DPROC           TextureSubImage2D;
+    PFNGLCOMPRESSEDTEXTURESUBIMAGE2DPROC CompressedTextureSubImage2D;
+    PFNGLGENERATETEXTUREMIPMAPPROC       GenerateTextureMipmap;
+    PFNGLCREATEBUFFERSPROC               CreateBuffers;
+    PFNGLNAMEDBUFFERSTORAGEPROC          NamedBufferStorage; // needs bufferStorage too
+    PFNGLMAPNAMEDBUFFERRANGEPROC         MapNamedBufferRange;
+    PFNGLUNMAPNAMEDBUFFERPROC            UnmapNamedBuffer;
+};
+
+extern GLExtensions GlobalGLExtensions;
+
+/**
+ * Loads the extensions the driver has. Called from Init once the extension
+ * strings are known, before any resource is created.
+ */
+void InitGLExtensions(App* app);
+
+/**
+ * Immutable GL_TEXTURE_2D storage, without data.
+ */
+GLuint CreateTextureStorage2D(GLenum internalFormat, GLsizei width, GLsizei height, GLsizei levelCount);
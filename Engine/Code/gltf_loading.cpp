@@ -0,0 +1,853 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "gltf_loading.h"
+#include "engine.h"
+#include "json.h"
+#include "model_loading.h"
+#include "tangent_space.h"
+#include <glm/gtc/quaternion.hpp>
+
+#define GLB_MAGIC             0x46546C67 // "glTF"
+#define GLB_CHUNK_JSON        0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN         0x004E4942 // "BIN\0"
+#define GLTF_MODE_TRIANGLES   4
+#define GLTF_BUFFER_ALIGNMENT 16
+#define GLTF_MAX_NODE_DEPTH   64
+
+struct GltfBuffer
+{
+    const u8* data;
+    u64       size;
+    bool      mapped; // in one of the files, not decoded from a data uri
+};
+
+struct GltfBufferView
+{
+    u32 buffer;
+    u64 byteOffset;
+    u64 byteLength;
+    u32 byteStride;
+    u64 gpuOffset; // where it lives in the mesh buffer, UINT64_MAX when no mesh reads it
+};
+
+struct GltfAccessor
+{
+    u32    bufferView;
+    u64    byteOffset;
+    GLenum componentType; // glTF uses the GL enum values
+    u32    componentCount;
+    u32    count;
+    bool   normalized;
+    bool   sparse;
+};
+
+struct GltfContext
+{
+    const char*                  filename;
+    std::string                  directory;
+    JsonDocument                 json;
+    std::vector<AssetFile>       files;
+    std::vector<std::vector<u8>> decodedBuffers;
+    std::vector<GltfBuffer>      buffers;
+    std::vector<GltfBufferView>  bufferViews;
+    std::vector<GltfAccessor>    accessors;
+    std::vector<u8>              extraData; // generated vertex data, placed after the buffer views
+    u64                          extraDataOffset;
+
+    // Textures of the materials missing some, in the import
+    u32 whiteTexIdx;
+    u32 blackTexIdx;
+    u32 normalTexIdx;
+};
+
+static u32 GetComponentSize(GLenum componentType)
+{
+    switch (componentType)
+    {
+        case GL_BYTE: case GL_UNSIGNED_BYTE:   return 1;
+        case GL_SHORT: case GL_UNSIGNED_SHORT: return 2;
+        case GL_UNSIGNED_INT: case GL_FLOAT:   return 4;
+        default:                               return 0;
+    }
+}
+
+static u32 GetComponentCount(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2")   return 2;
+    if (type == "VEC3")   return 3;
+    if (type == "VEC4")   return 4;
+    if (type == "MAT2")   return 4;
+    if (type == "MAT3")   return 9;
+    if (type == "MAT4")   return 16;
+    return 0;
+}
+
+static u32 GetJsonIndex(const JsonDocument& json, u32 node, const char* key)
+{
+    f64 value = JsonFindNumber(json, node, key, -1.0);
+    return value < 0.0 ? UINT32_MAX : (u32)value;
+}
+
+static bool DecodeBase64(const char* text, u32 length, std::vector<u8>& output)
+{
+    static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    u8 table[256];
+    memset(table, 0xFF, sizeof(table));
+    for (u32 i = 0; i < 64; ++i)
+        table[(u8)alphabet[i]] = (u8)i;
+
+    output.clear();
+    output.reserve(length / 4 * 3);
+
+    u32 accumulator = 0;
+    u32 bits = 0;
+    for (u32 i = 0; i < length && text[i] != '='; ++i)
+    {
+        u8 value = table[(u8)text[i]];
+        if (value == 0xFF)
+            return false;
+
+        accumulator = (accumulator << 6) | value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            output.push_back((u8)(accumulator >> bits));
+        }
+    }
+
+    return true;
+}
+
+static std::string DecodeUri(const std::string& uri)
+{
+    std::string result;
+    for (u32 i = 0; i < uri.size(); ++i)
+    {
+        if (uri[i] == '%' && i + 2 < uri.size())
+        {
+            char hex[3] = { uri[i + 1], uri[i + 2], 0 };
+            result.push_back((char)strtol(hex, NULL, 16));
+            i += 2;
+        }
+        else
+        {
+            result.push_back(uri[i]);
+        }
+    }
+    return result;
+}
+
+static bool DecodeDataUri(const std::string& uri, std::vector<u8>& output)
+{
+    size_t comma = uri.find(',');
+    if (uri.compare(0, 5, "data:") != 0 || comma == std::string::npos || uri.find(";base64") > comma)
+        return false;
+    return DecodeBase64(uri.c_str() + comma + 1, (u32)(uri.size() - comma - 1), output);
+}
+
+static bool LoadGltfBuffers(GltfContext& ctx, const u8* glbBinaryChunk, u64 glbBinaryChunkSize)
+{
+    const JsonDocument& json = ctx.json;
+
+    // The external buffers are opened together, so packed ones are read in one batch
+    std::vector<std::string> bufferPaths;
+    for (u32 bufferNode : JsonChildren(json, JsonFind(json, 0, "buffers")))
+    {
+        std::string uri = JsonString(json, JsonFind(json, bufferNode, "uri"), "");
+        if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+            bufferPaths.push_back(MakeModelPath(ctx.directory, DecodeUri(uri).c_str()));
+    }
+
+    std::vector<const char*> bufferPathPointers;
+    for (const std::string& bufferPath : bufferPaths)
+        bufferPathPointers.push_back(bufferPath.c_str());
+
+    u32 firstFile = (u32)ctx.files.size();
+    ctx.files.resize(firstFile + bufferPaths.size());
+    OpenAssets(bufferPathPointers.data(), (u32)bufferPaths.size(), ctx.files.data() + firstFile);
+    u32 nextFile = firstFile;
+
+    for (u32 bufferNode : JsonChildren(json, JsonFind(json, 0, "buffers")))
+    {
+        GltfBuffer buffer = {};
+        u32 uriNode = JsonFind(json, bufferNode, "uri");
+        u64 byteLength = (u64)JsonFindNumber(json, bufferNode, "byteLength", 0.0);
+
+        if (uriNode == JSON_INVALID)
+        {
+            // The first buffer of a .glb without uri is the binary chunk
+            buffer.data = glbBinaryChunk;
+            buffer.size = glbBinaryChunkSize;
+            buffer.mapped = true;
+        }
+        else
+        {
+            std::string uri = JsonString(json, uriNode, "");
+            if (uri.compare(0, 5, "data:") == 0)
+            {
+                ctx.decodedBuffers.push_back(std::vector<u8>());
+                if (!DecodeDataUri(uri, ctx.decodedBuffers.back()))
+                {
+                    ELOG("LoadGltfModel() - Unsupported buffer data uri in %s", ctx.filename);
+                    return false;
+                }
+                buffer.data = ctx.decodedBuffers.back().data();
+                buffer.size = ctx.decodedBuffers.back().size();
+            }
+            else
+            {
+                const AssetFile& file = ctx.files[nextFile];
+                if (file.data == NULL)
+                {
+                    ELOG("LoadGltfModel() - Could not open buffer %s", bufferPaths[nextFile - firstFile].c_str());
+                    return false;
+                }
+                nextFile++;
+                buffer.data = file.data;
+                buffer.size = file.size;
+                buffer.mapped = true;
+            }
+        }
+
+        if (buffer.data == NULL || buffer.size < byteLength)
+        {
+            ELOG("LoadGltfModel() - Buffer %u of %s is missing or too small", (u32)ctx.buffers.size(), ctx.filename);
+            return false;
+        }
+
+        buffer.size = byteLength;
+        ctx.buffers.push_back(buffer);
+    }
+
+    for (u32 viewNode : JsonChildren(json, JsonFind(json, 0, "bufferViews")))
+    {
+        GltfBufferView view = {};
+        view.buffer = GetJsonIndex(json, viewNode, "buffer");
+        view.byteOffset = (u64)JsonFindNumber(json, viewNode, "byteOffset", 0.0);
+        view.byteLength = (u64)JsonFindNumber(json, viewNode, "byteLength", 0.0);
+        view.byteStride = (u32)JsonFindNumber(json, viewNode, "byteStride", 0.0);
+        view.gpuOffset = UINT64_MAX;
+
+        if (view.buffer >= ctx.buffers.size() || view.byteOffset + view.byteLength > ctx.buffers[view.buffer].size)
+        {
+            ELOG("LoadGltfModel() - Buffer view %u of %s is out of bounds", (u32)ctx.bufferViews.size(), ctx.filename);
+            return false;
+        }
+        ctx.bufferViews.push_back(view);
+    }
+
+    for (u32 accessorNode : JsonChildren(json, JsonFind(json, 0, "accessors")))
+    {
+        GltfAccessor accessor = {};
+        accessor.bufferView = GetJsonIndex(json, accessorNode, "bufferView");
+        accessor.byteOffset = (u64)JsonFindNumber(json, accessorNode, "byteOffset", 0.0);
+        accessor.componentType = (GLenum)JsonFindNumber(json, accessorNode, "componentType", 0.0);
+        accessor.componentCount = GetComponentCount(JsonFindString(json, accessorNode, "type", ""));
+        accessor.count = (u32)JsonFindNumber(json, accessorNode, "count", 0.0);
+        accessor.normalized = JsonFindNumber(json, accessorNode, "normalized", 0.0) != 0.0;
+        accessor.sparse = JsonFind(json, accessorNode, "sparse") != JSON_INVALID;
+        ctx.accessors.push_back(accessor);
+    }
+
+    return true;
+}
+
+// Only the buffer views the meshes read vertices and indices from are uploaded, packed
+// one after the other; images, animations and skins stay out of the mesh buffer
+static void PlaceMeshBufferViews(GltfContext& ctx)
+{
+    const JsonDocument& json = ctx.json;
+    static const char* const inPlaceAttributes[] = { "POSITION", "NORMAL", "TANGENT" };
+
+    std::vector<bool> used(ctx.bufferViews.size(), false);
+    for (u32 meshNode : JsonChildren(json, JsonFind(json, 0, "meshes")))
+    {
+        for (u32 primitiveNode : JsonChildren(json, JsonFind(json, meshNode, "primitives")))
+        {
+            std::vector<u32> accessorIndices;
+            accessorIndices.push_back(GetJsonIndex(json, primitiveNode, "indices"));
+            u32 attributesNode = JsonFind(json, primitiveNode, "attributes");
+            for (const char* name : inPlaceAttributes)
+                accessorIndices.push_back(GetJsonIndex(json, attributesNode, name));
+
+            for (u32 accessorIdx : accessorIndices)
+                if (accessorIdx < ctx.accessors.size() && ctx.accessors[accessorIdx].bufferView < ctx.bufferViews.size())
+                    used[ctx.accessors[accessorIdx].bufferView] = true;
+        }
+    }
+
+    u64 gpuOffset = 0;
+    for (u32 i = 0; i < ctx.bufferViews.size(); ++i)
+    {
+        if (!used[i])
+            continue;
+
+        GltfBufferView& view = ctx.bufferViews[i];
+        view.gpuOffset = gpuOffset;
+        gpuOffset = Align((u32)(gpuOffset + view.byteLength), GLTF_BUFFER_ALIGNMENT);
+    }
+
+    ctx.extraDataOffset = gpuOffset;
+}
+
+static u32 GetAccessorStride(const GltfContext& ctx, const GltfAccessor& accessor)
+{
+    const GltfBufferView& view = ctx.bufferViews[accessor.bufferView];
+    return view.byteStride ? view.byteStride : GetComponentSize(accessor.componentType) * accessor.componentCount;
+}
+
+static const GltfAccessor* FindAccessor(const GltfContext& ctx, u32 attributesNode, const char* name)
+{
+    u32 accessorIdx = GetJsonIndex(ctx.json, attributesNode, name);
+    if (accessorIdx >= ctx.accessors.size())
+        return NULL;
+
+    const GltfAccessor& accessor = ctx.accessors[accessorIdx];
+    if (accessor.sparse || accessor.bufferView >= ctx.bufferViews.size() || GetComponentSize(accessor.componentType) == 0)
+    {
+        ELOG("LoadGltfModel() - Accessor %u (%s) of %s is not supported", accessorIdx, name, ctx.filename);
+        return NULL;
+    }
+
+    // make sure the last element is inside the buffer view
+    const GltfBufferView& view = ctx.bufferViews[accessor.bufferView];
+    u64 elementSize = GetComponentSize(accessor.componentType) * accessor.componentCount;
+    if (accessor.count > 0 && accessor.byteOffset + (u64)(accessor.count - 1) * GetAccessorStride(ctx, accessor) + elementSize > view.byteLength)
+    {
+        ELOG("LoadGltfModel() - Accessor %u (%s) of %s is out of bounds", accessorIdx, name, ctx.filename);
+        return NULL;
+    }
+
+    return &accessor;
+}
+
+static const u8* GetAccessorElement(const GltfContext& ctx, const GltfAccessor& accessor, u32 index)
+{
+    const GltfBufferView& view = ctx.bufferViews[accessor.bufferView];
+    const GltfBuffer& buffer = ctx.buffers[view.buffer];
+    return buffer.data + view.byteOffset + accessor.byteOffset + (u64)index * GetAccessorStride(ctx, accessor);
+}
+
+static u32 GetAccessorGpuOffset(const GltfContext& ctx, const GltfAccessor& accessor)
+{
+    const GltfBufferView& view = ctx.bufferViews[accessor.bufferView];
+    return (u32)(view.gpuOffset + accessor.byteOffset);
+}
+
+static void ReadAccessorFloats(const GltfContext& ctx, const GltfAccessor& accessor, u32 index, f32* values)
+{
+    const u8* element = GetAccessorElement(ctx, accessor, index);
+
+    for (u32 i = 0; i < accessor.componentCount && i < 4; ++i)
+    {
+        switch (accessor.componentType)
+        {
+            case GL_FLOAT:          { f32 v; memcpy(&v, element + i * 4, 4); values[i] = v; } break;
+            case GL_UNSIGNED_INT:   { u32 v; memcpy(&v, element + i * 4, 4); values[i] = (f32)v; } break;
+            case GL_UNSIGNED_SHORT: { u16 v; memcpy(&v, element + i * 2, 2); values[i] = accessor.normalized ? v / 65535.0f : (f32)v; } break;
+            case GL_SHORT:          { i16 v; memcpy(&v, element + i * 2, 2); values[i] = accessor.normalized ? glm::max(v / 32767.0f, -1.0f) : (f32)v; } break;
+            case GL_UNSIGNED_BYTE:  { u8 v = element[i]; values[i] = accessor.normalized ? v / 255.0f : (f32)v; } break;
+            case GL_BYTE:           { signed char v = (signed char)element[i]; values[i] = accessor.normalized ? glm::max(v / 127.0f, -1.0f) : (f32)v; } break;
+        }
+    }
+}
+
+static u32 ReadAccessorIndex(const GltfContext& ctx, const GltfAccessor& accessor, u32 index)
+{
+    const u8* element = GetAccessorElement(ctx, accessor, index);
+    switch (accessor.componentType)
+    {
+        case GL_UNSIGNED_BYTE:  return element[0];
+        case GL_UNSIGNED_SHORT: { u16 v; memcpy(&v, element, 2); return v; }
+        default:                { u32 v; memcpy(&v, element, 4); return v; }
+    }
+}
+
+static VertexBufferAttribute MakeAttribute(const GltfContext& ctx, const GltfAccessor& accessor, u8 location, u8 componentCount)
+{
+    VertexBufferAttribute attribute = {};
+    attribute.location = location;
+    attribute.componentCount = componentCount;
+    attribute.offset = GetAccessorGpuOffset(ctx, accessor);
+    attribute.type = accessor.componentType;
+    attribute.normalized = accessor.normalized ? GL_TRUE : GL_FALSE;
+    attribute.stride = GetAccessorStride(ctx, accessor);
+    return attribute;
+}
+
+static VertexBufferAttribute PushExtraAttribute(GltfContext& ctx, const void* data, u32 elementSize, u32 count, u8 location, u8 componentCount)
+{
+    u32 offset = Align((u32)ctx.extraData.size(), 4);
+    ctx.extraData.resize(offset + elementSize * count);
+    memcpy(ctx.extraData.data() + offset, data, elementSize * count);
+
+    VertexBufferAttribute attribute = {};
+    attribute.location = location;
+    attribute.componentCount = componentCount;
+    attribute.offset = (u32)ctx.extraDataOffset + offset;
+    attribute.stride = elementSize;
+    return attribute;
+}
+
+static bool ProcessGltfPrimitive(GltfContext& ctx, u32 primitiveNode, Submesh& submesh)
+{
+    const JsonDocument& json = ctx.json;
+
+    if (JsonFindNumber(json, primitiveNode, "mode", GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES)
+    {
+        ELOG("LoadGltfModel() - Only triangle primitives are supported (%s)", ctx.filename);
+        return false;
+    }
+
+    u32 attributesNode = JsonFind(json, primitiveNode, "attributes");
+    const GltfAccessor* positionAccessor = FindAccessor(ctx, attributesNode, "POSITION");
+    const GltfAccessor* normalAccessor   = FindAccessor(ctx, attributesNode, "NORMAL");
+    const GltfAccessor* texCoordAccessor = FindAccessor(ctx, attributesNode, "TEXCOORD_0");
+    const GltfAccessor* tangentAccessor  = FindAccessor(ctx, attributesNode, "TANGENT");
+
+    if (!positionAccessor || positionAccessor->componentCount != 3)
+    {
+        ELOG("LoadGltfModel() - Primitive without valid positions in %s", ctx.filename);
+        return false;
+    }
+
+    const u32 vertexCount = positionAccessor->count;
+
+    // Indices: used in place when present
+    std::vector<u32> indices;
+    u32 indicesAccessorIdx = GetJsonIndex(json, primitiveNode, "indices");
+    const GltfAccessor* indexAccessor = NULL;
+    if (indicesAccessorIdx != UINT32_MAX)
+    {
+        indexAccessor = indicesAccessorIdx < ctx.accessors.size() ? &ctx.accessors[indicesAccessorIdx] : NULL;
+        if (!indexAccessor || indexAccessor->sparse || indexAccessor->bufferView >= ctx.bufferViews.size() ||
+            indexAccessor->componentType == GL_FLOAT || ctx.bufferViews[indexAccessor->bufferView].byteStride != 0 ||
+            indexAccessor->byteOffset + (u64)indexAccessor->count * GetComponentSize(indexAccessor->componentType) > ctx.bufferViews[indexAccessor->bufferView].byteLength)
+        {
+            ELOG("LoadGltfModel() - Unsupported index accessor in %s", ctx.filename);
+            return false;
+        }
+
+        indices.resize(indexAccessor->count);
+        for (u32 i = 0; i < indexAccessor->count; ++i)
+        {
+            indices[i] = ReadAccessorIndex(ctx, *indexAccessor, i);
+            if (indices[i] >= vertexCount)
+            {
+                ELOG("LoadGltfModel() - Index out of range in %s", ctx.filename);
+                return false;
+            }
+        }
+
+        submesh.indexOffset = GetAccessorGpuOffset(ctx, *indexAccessor);
+        submesh.indexType = indexAccessor->componentType;
+    }
+    else
+    {
+        indices.resize(vertexCount);
+        for (u32 i = 0; i < vertexCount; ++i)
+            indices[i] = i;
+
+        u32 offset = Align((u32)ctx.extraData.size(), 4);
+        ctx.extraData.resize(offset + vertexCount * sizeof(u32));
+        memcpy(ctx.extraData.data() + offset, indices.data(), vertexCount * sizeof(u32));
+
+        submesh.indexOffset = (u32)ctx.extraDataOffset + offset;
+        submesh.indexType = GL_UNSIGNED_INT;
+    }
+    submesh.indexCount = (u32)indices.size();
+    submesh.vertexOffset = 0; // attribute offsets are absolute
+
+    // CPU copies of what we need to derive the missing attributes
+    std::vector<vec3> positions(vertexCount);
+    submesh.boundsMin = vec3( FLT_MAX);
+    submesh.boundsMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        ReadAccessorFloats(ctx, *positionAccessor, i, &positions[i].x);
+        submesh.boundsMin = glm::min(submesh.boundsMin, positions[i]);
+        submesh.boundsMax = glm::max(submesh.boundsMax, positions[i]);
+    }
+
+    std::vector<vec3> normals(vertexCount, vec3(0.0f));
+    if (normalAccessor && normalAccessor->count == vertexCount)
+    {
+        for (u32 i = 0; i < vertexCount; ++i)
+            ReadAccessorFloats(ctx, *normalAccessor, i, &normals[i].x);
+    }
+    else
+    {
+        GenerateNormals(positions, indices, normals);
+        normalAccessor = NULL;
+    }
+
+    std::vector<vec2> texCoords(vertexCount, vec2(0.0f));
+    if (texCoordAccessor && texCoordAccessor->count == vertexCount)
+    {
+        for (u32 i = 0; i < vertexCount; ++i)
+            ReadAccessorFloats(ctx, *texCoordAccessor, i, &texCoords[i].x);
+    }
+
+    std::vector<vec4> tangents(vertexCount, vec4(0.0f));
+    if (tangentAccessor && tangentAccessor->count == vertexCount && tangentAccessor->componentCount == 4)
+    {
+        for (u32 i = 0; i < vertexCount; ++i)
+            ReadAccessorFloats(ctx, *tangentAccessor, i, &tangents[i].x);
+    }
+    else
+    {
+        GenerateTangents(positions, normals, texCoords, indices, tangents);
+        tangentAccessor = NULL;
+    }
+
+    // Layout: glTF streams are used in place, the rest goes to the extra stream
+    VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    layout.stride = 0;
+
+    layout.attributes.push_back(MakeAttribute(ctx, *positionAccessor, 0, 3));
+
+    if (normalAccessor)
+        layout.attributes.push_back(MakeAttribute(ctx, *normalAccessor, 1, 3));
+    else
+        layout.attributes.push_back(PushExtraAttribute(ctx, normals.data(), sizeof(vec3), vertexCount, 1, 3));
+
+    // glTF puts the uv origin at the top-left corner, our images are flipped on load
+    for (vec2& texCoord : texCoords)
+        texCoord.y = 1.0f - texCoord.y;
+    layout.attributes.push_back(PushExtraAttribute(ctx, texCoords.data(), sizeof(vec2), vertexCount, 2, 2));
+
+    if (tangentAccessor)
+        layout.attributes.push_back(MakeAttribute(ctx, *tangentAccessor, 3, 3));
+    else
+        layout.attributes.push_back(PushExtraAttribute(ctx, tangents.data(), sizeof(vec4), vertexCount, 3, 3));
+
+    // The bitangent follows the glTF definition, which is the orientation the
+    // shaders expect (see the bitangent flip in the Assimp loader)
+    std::vector<vec3> bitangents(vertexCount);
+    for (u32 i = 0; i < vertexCount; ++i)
+        bitangents[i] = glm::cross(normals[i], vec3(tangents[i])) * (tangents[i].w < 0.0f ? -1.0f : 1.0f);
+    layout.attributes.push_back(PushExtraAttribute(ctx, bitangents.data(), sizeof(vec3), vertexCount, 4, 3));
+
+    return true;
+}
+
+static u32 LoadGltfTexture(ModelImport& import, GltfContext& ctx, u32 textureInfoNode, u32 defaultTextureIdx, TextureUsage usage = TextureUsage_Color)
+{
+    const JsonDocument& json = ctx.json;
+    if (textureInfoNode == JSON_INVALID)
+        return defaultTextureIdx;
+
+    std::vector<u32> textures = JsonChildren(json, JsonFind(json, 0, "textures"));
+    std::vector<u32> images = JsonChildren(json, JsonFind(json, 0, "images"));
+
+    u32 textureIdx = GetJsonIndex(json, textureInfoNode, "index");
+    u32 imageIdx = textureIdx < textures.size() ? GetJsonIndex(json, textures[textureIdx], "source") : UINT32_MAX;
+    if (imageIdx >= images.size())
+        return defaultTextureIdx;
+
+    u32 imageNode = images[imageIdx];
+    u32 uriNode = JsonFind(json, imageNode, "uri");
+    u32 loadedIdx = UINT32_MAX;
+
+    char textureName[256];
+    sprintf(textureName, "%.200s#image%u", ctx.filename, imageIdx);
+
+    if (uriNode != JSON_INVALID)
+    {
+        std::string uri = JsonString(json, uriNode, "");
+        if (uri.compare(0, 5, "data:") == 0)
+        {
+            std::vector<u8> imageData;
+            if (DecodeDataUri(uri, imageData))
+                loadedIdx = ImportTextureFromMemory(import, textureName, imageData.data(), (u32)imageData.size());
+        }
+        else
+        {
+            std::string texturePath = MakeModelPath(ctx.directory, DecodeUri(uri).c_str());
+            loadedIdx = ImportTexture(import, texturePath.c_str(), usage);
+        }
+    }
+    else
+    {
+        u32 viewIdx = GetJsonIndex(json, imageNode, "bufferView");
+        if (viewIdx < ctx.bufferViews.size())
+        {
+            const GltfBufferView& view = ctx.bufferViews[viewIdx];
+            const u8* imageData = ctx.buffers[view.buffer].data + view.byteOffset;
+            loadedIdx = ImportTextureFromMemory(import, textureName, imageData, (u32)view.byteLength);
+        }
+    }
+
+    return loadedIdx != UINT32_MAX ? loadedIdx : defaultTextureIdx;
+}
+
+static Material LoadGltfMaterial(ModelImport& import, GltfContext& ctx, u32 materialNode)
+{
+    const JsonDocument& json = ctx.json;
+
+    Material material = {};
+    material.name = JsonFindString(json, materialNode, "name", "");
+    material.albedo = vec3(1.0f);
+    material.emissive = vec3(0.0f);
+    material.smoothness = 0.0f;
+    material.albedoTextureIdx = ctx.whiteTexIdx;
+    material.emissiveTextureIdx = ctx.blackTexIdx;
+    material.specularTextureIdx = ctx.whiteTexIdx;
+    material.normalsTextureIdx = ctx.normalTexIdx;
+    material.bumpTextureIdx = ctx.blackTexIdx;
+
+    if (materialNode == JSON_INVALID)
+        return material;
+
+    u32 pbrNode = JsonFind(json, materialNode, "pbrMetallicRoughness");
+
+    std::vector<u32> baseColor = JsonChildren(json, JsonFind(json, pbrNode, "baseColorFactor"));
+    for (u32 i = 0; i < 3 && i < baseColor.size(); ++i)
+        material.albedo[i] = (f32)JsonNumber(json, baseColor[i], 1.0);
+
+    std::vector<u32> emissive = JsonChildren(json, JsonFind(json, materialNode, "emissiveFactor"));
+    for (u32 i = 0; i < 3 && i < emissive.size(); ++i)
+        material.emissive[i] = (f32)JsonNumber(json, emissive[i], 0.0);
+
+    material.smoothness = 1.0f - (f32)JsonFindNumber(json, pbrNode, "roughnessFactor", 1.0);
+
+    material.albedoTextureIdx = LoadGltfTexture(import, ctx, JsonFind(json, pbrNode, "baseColorTexture"), ctx.whiteTexIdx);
+    material.normalsTextureIdx = LoadGltfTexture(import, ctx, JsonFind(json, materialNode, "normalTexture"), ctx.normalTexIdx, TextureUsage_Normal);
+    material.emissiveTextureIdx = LoadGltfTexture(import, ctx, JsonFind(json, materialNode, "emissiveTexture"), ctx.blackTexIdx);
+
+    return material;
+}
+
+static glm::mat4 GetGltfNodeTransform(const JsonDocument& json, u32 node)
+{
+    std::vector<u32> matrix = JsonChildren(json, JsonFind(json, node, "matrix"));
+    if (matrix.size() == 16)
+    {
+        glm::mat4 transform;
+        for (u32 i = 0; i < 16; ++i)
+            transform[i / 4][i % 4] = (f32)JsonNumber(json, matrix[i], 0.0); // column-major, like glm
+        return transform;
+    }
+
+    vec3 translation(0.0f);
+    glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+    vec3 scale(1.0f);
+
+    std::vector<u32> t = JsonChildren(json, JsonFind(json, node, "translation"));
+    std::vector<u32> r = JsonChildren(json, JsonFind(json, node, "rotation"));
+    std::vector<u32> s = JsonChildren(json, JsonFind(json, node, "scale"));
+
+    if (t.size() == 3) translation = vec3(JsonNumber(json, t[0], 0.0), JsonNumber(json, t[1], 0.0), JsonNumber(json, t[2], 0.0));
+    if (r.size() == 4) rotation = glm::quat((f32)JsonNumber(json, r[3], 1.0), (f32)JsonNumber(json, r[0], 0.0), (f32)JsonNumber(json, r[1], 0.0), (f32)JsonNumber(json, r[2], 0.0)); // glTF stores xyzw
+    if (s.size() == 3) scale = vec3(JsonNumber(json, s[0], 1.0), JsonNumber(json, s[1], 1.0), JsonNumber(json, s[2], 1.0));
+
+    return glm::translate(translation) * glm::mat4_cast(rotation) * glm::scale(scale);
+}
+
+static void ProcessGltfNode(const GltfContext& ctx, const std::vector<u32>& nodes, u32 nodeIdx, const glm::mat4& parentTransform,
+                            const std::vector<std::vector<MeshInstance>>& meshPrimitives, u32 depth, std::vector<MeshInstance>& instances)
+{
+    if (nodeIdx >= nodes.size() || depth > GLTF_MAX_NODE_DEPTH)
+        return;
+
+    const JsonDocument& json = ctx.json;
+    u32 node = nodes[nodeIdx];
+    glm::mat4 transform = parentTransform * GetGltfNodeTransform(json, node);
+
+    u32 meshIdx = GetJsonIndex(json, node, "mesh");
+    if (meshIdx < meshPrimitives.size())
+    {
+        for (MeshInstance instance : meshPrimitives[meshIdx])
+        {
+            instance.transform = transform;
+            instances.push_back(instance);
+        }
+    }
+
+    for (u32 child : JsonChildren(json, JsonFind(json, node, "children")))
+        ProcessGltfNode(ctx, nodes, (u32)JsonNumber(json, child, -1.0), transform, meshPrimitives, depth + 1, instances);
+}
+
+bool LoadGltfModel(const App* app, ModelImport& import, const char* filename)
+{
+    GltfContext ctx = {};
+    ctx.filename = filename;
+    ctx.directory = GetModelDirectory(filename);
+
+    AssetFile file = OpenAsset(filename);
+    if (file.data == NULL)
+    {
+        ELOG("Error loading mesh %s: could not open the file", filename);
+        return false;
+    }
+    ctx.files.push_back(file);
+
+    // Find the JSON (and the binary chunk of .glb files)
+    const char* jsonText = (const char*)file.data;
+    u64 jsonLength = file.size;
+    const u8* binaryChunk = NULL;
+    u64 binaryChunkSize = 0;
+
+    u32 magic = 0;
+    if (file.size >= 12)
+        memcpy(&magic, file.data, sizeof(magic));
+
+    if (magic == GLB_MAGIC)
+    {
+        jsonText = NULL;
+        u64 cursor = 12; // magic, version, length
+        while (cursor + 8 <= file.size)
+        {
+            u32 chunkLength, chunkType;
+            memcpy(&chunkLength, file.data + cursor, 4);
+            memcpy(&chunkType, file.data + cursor + 4, 4);
+            if (cursor + 8 + chunkLength > file.size)
+                break;
+
+            if (chunkType == GLB_CHUNK_JSON)
+            {
+                jsonText = (const char*)file.data + cursor + 8;
+                jsonLength = chunkLength;
+            }
+            else if (chunkType == GLB_CHUNK_BIN && binaryChunk == NULL)
+            {
+                binaryChunk = file.data + cursor + 8;
+                binaryChunkSize = chunkLength;
+            }
+            cursor += 8 + Align(chunkLength, 4);
+        }
+    }
+
+    bool loaded = jsonText != NULL &&
+                  ParseJson(jsonText, (u32)jsonLength, ctx.json) &&
+                  LoadGltfBuffers(ctx, binaryChunk, binaryChunkSize);
+
+    if (!loaded)
+    {
+        ELOG("Error loading mesh %s: invalid glTF file", filename);
+        for (AssetFile& file : ctx.files)
+            CloseAsset(file);
+        return false;
+    }
+
+    PlaceMeshBufferViews(ctx);
+
+    const JsonDocument& json = ctx.json;
+
+    // The default textures are loaded before any model, they do not change
+    ctx.whiteTexIdx = ImportExistingTexture(import, app->whiteTexIdx);
+    ctx.blackTexIdx = ImportExistingTexture(import, app->blackTexIdx);
+    ctx.normalTexIdx = ImportExistingTexture(import, app->normalTexIdx);
+
+    // Materials
+    std::vector<u32> materialNodes = JsonChildren(json, JsonFind(json, 0, "materials"));
+    for (u32 materialNode : materialNodes)
+        import.materials.push_back(LoadGltfMaterial(import, ctx, materialNode));
+
+    u32 defaultMaterialIdx = UINT32_MAX;
+
+    // Meshes: one submesh per primitive
+    Mesh& mesh = import.mesh;
+
+    std::vector<u32> meshNodes = JsonChildren(json, JsonFind(json, 0, "meshes"));
+    std::vector<std::vector<MeshInstance>> meshPrimitives(meshNodes.size());
+
+    for (u32 i = 0; i < meshNodes.size(); ++i)
+    {
+        for (u32 primitiveNode : JsonChildren(json, JsonFind(json, meshNodes[i], "primitives")))
+        {
+            Submesh submesh = {};
+            if (!ProcessGltfPrimitive(ctx, primitiveNode, submesh))
+                continue;
+
+            u32 materialIdx = GetJsonIndex(json, primitiveNode, "material");
+            if (materialIdx >= materialNodes.size())
+            {
+                if (defaultMaterialIdx == UINT32_MAX)
+                {
+                    defaultMaterialIdx = (u32)import.materials.size();
+                    import.materials.push_back(LoadGltfMaterial(import, ctx, JSON_INVALID));
+                }
+                materialIdx = defaultMaterialIdx;
+            }
+
+            MeshInstance instance = {};
+            instance.submesh = SubmeshRef{ 0, (u32)mesh.submeshes.size() };
+            instance.materialIdx = materialIdx;
+            meshPrimitives[i].push_back(instance);
+
+            mesh.submeshes.push_back(submesh);
+        }
+    }
+
+    mesh.boundsMin = vec3( FLT_MAX);
+    mesh.boundsMax = vec3(-FLT_MAX);
+    for (const Submesh& submesh : mesh.submeshes)
+    {
+        mesh.boundsMin = glm::min(mesh.boundsMin, submesh.boundsMin);
+        mesh.boundsMax = glm::max(mesh.boundsMax, submesh.boundsMax);
+    }
+
+    // Node hierarchy
+
+    std::vector<u32> nodes = JsonChildren(json, JsonFind(json, 0, "nodes"));
+    std::vector<u32> scenes = JsonChildren(json, JsonFind(json, 0, "scenes"));
+    u32 sceneIdx = (u32)JsonFindNumber(json, 0, "scene", 0.0);
+
+    if (sceneIdx < scenes.size())
+    {
+        for (u32 rootNode : JsonChildren(json, JsonFind(json, scenes[sceneIdx], "nodes")))
+            ProcessGltfNode(ctx, nodes, (u32)JsonNumber(json, rootNode, -1.0), glm::mat4(1.0f), meshPrimitives, 0, import.instances);
+    }
+    else
+    {
+        // No scene: every node that is nobody's child is a root
+        std::vector<bool> isChild(nodes.size(), false);
+        for (u32 node : nodes)
+            for (u32 child : JsonChildren(json, JsonFind(json, node, "children")))
+                if ((u32)JsonNumber(json, child, 0.0) < nodes.size())
+                    isChild[(u32)JsonNumber(json, child, 0.0)] = true;
+
+        for (u32 i = 0; i < nodes.size(); ++i)
+            if (!isChild[i])
+                ProcessGltfNode(ctx, nodes, i, glm::mat4(1.0f), meshPrimitives, 0, import.instances);
+    }
+
+    // The buffer views read by the meshes plus the extra stream, all uploaded
+    // in one buffer object used for both vertices and indices. Views of opened
+    // files are uploaded straight from them, the import keeps the files open;
+    // only those of data uris are copied, along with the extra stream
+    u64 copiedSize = ctx.extraData.size();
+    for (const GltfBufferView& view : ctx.bufferViews)
+        if (view.gpuOffset != UINT64_MAX && !ctx.buffers[view.buffer].mapped)
+            copiedSize += view.byteLength;
+    import.geometryData.reserve(copiedSize); // the ranges point into it
+
+    for (const GltfBufferView& view : ctx.bufferViews)
+    {
+        if (view.gpuOffset == UINT64_MAX)
+            continue;
+
+        const u8* data = ctx.buffers[view.buffer].data + view.byteOffset;
+        if (!ctx.buffers[view.buffer].mapped)
+        {
+            import.geometryData.insert(import.geometryData.end(), data, data + view.byteLength);
+            data = import.geometryData.data() + import.geometryData.size() - view.byteLength;
+        }
+        import.vertexRanges.push_back(BufferRange{ data, view.byteLength, view.gpuOffset });
+    }
+
+    if (!ctx.extraData.empty())
+    {
+        import.geometryData.insert(import.geometryData.end(), ctx.extraData.begin(), ctx.extraData.end());
+        import.vertexRanges.push_back(BufferRange{ import.geometryData.data() + import.geometryData.size() - ctx.extraData.size(), ctx.extraData.size(), ctx.extraDataOffset });
+    }
+
+    import.vertexDataSize = ctx.extraDataOffset + ctx.extraData.size();
+    import.files.insert(import.files.end(), ctx.files.begin(), ctx.files.end());
+
+    return true;
+}
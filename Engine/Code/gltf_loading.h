@@ -0,0 +1,15 @@
+#pragma once
+
+struct App;
+struct ModelImport;
+
+/**
+ * Native glTF 2.0 loader (.gltf with external/embedded buffers and binary .glb).
+ * The glTF buffers are uploaded as they are and the accessors are mapped onto
+ * the vertex buffer layout of each submesh, so the geometry is not repacked.
+ * Only the data the engine needs and glTF does not provide (bitangents, flipped
+ * texture coordinates, missing normals/tangents) goes into a small extra stream.
+ * The node hierarchy is kept as model instances. The app is only read, for the
+ * default textures.
+ */
+bool LoadGltfModel(const App* app, ModelImport& import, const char* filename);
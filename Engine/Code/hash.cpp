@@ -0,0 +1,125 @@
+#include "hash.h"
+#include "asset_pack.h"
+#include <string.h>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline u64 Rotl64(u64 value, u32 bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline u64 Read64(const u8* ptr)
+{
+    u64 value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static inline u32 Read32(const u8* ptr)
+{
+    u32 value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static inline u64 XXH64Round(u64 acc, u64 input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc  = Rotl64(acc, 31);
+    acc *= XXH_PRIME64_1;
+    return acc;
+}
+
+static inline u64 XXH64MergeRound(u64 acc, u64 value)
+{
+    acc ^= XXH64Round(0, value);
+    acc  = acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+    return acc;
+}
+
+u64 HashBytes(const void* data, u64 size, u64 seed)
+{
+    const u8* ptr = (const u8*)data;
+    const u8* end = ptr + size;
+    u64 hash;
+
+    if (size >= 32)
+    {
+        u64 v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        u64 v2 = seed + XXH_PRIME64_2;
+        u64 v3 = seed;
+        u64 v4 = seed - XXH_PRIME64_1;
+
+        const u8* limit = end - 32;
+        do
+        {
+            v1 = XXH64Round(v1, Read64(ptr));      ptr += 8;
+            v2 = XXH64Round(v2, Read64(ptr));      ptr += 8;
+            v3 = XXH64Round(v3, Read64(ptr));      ptr += 8;
+            v4 = XXH64Round(v4, Read64(ptr));      ptr += 8;
+        } while (ptr <= limit);
+
+        hash = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+        hash = XXH64MergeRound(hash, v1);
+        hash = XXH64MergeRound(hash, v2);
+        hash = XXH64MergeRound(hash, v3);
+        hash = XXH64MergeRound(hash, v4);
+    }
+    else
+    {
+        hash = seed + XXH_PRIME64_5;
+    }
+
+    hash += size;
+
+    while (ptr + 8 <= end)
+    {
+        hash ^= XXH64Round(0, Read64(ptr));
+        hash  = Rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        ptr  += 8;
+    }
+
+    if (ptr + 4 <= end)
+    {
+        hash ^= (u64)Read32(ptr) * XXH_PRIME64_1;
+        hash  = Rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        ptr  += 4;
+    }
+
+    while (ptr < end)
+    {
+        hash ^= (*ptr) * XXH_PRIME64_5;
+        hash  = Rotl64(hash, 11) * XXH_PRIME64_1;
+        ptr++;
+    }
+
+    // avalanche
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+u64 HashCombine(u64 hash, u64 value)
+{
+    return hash ^ (XXH64Round(0, value) + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2));
+}
+
+u64 HashFile(const char* filepath, u64 seed)
+{
+    AssetFile file = OpenAsset(filepath);
+    if (file.data == NULL)
+        return 0;
+
+    u64 hash = HashBytes(file.data, file.size, seed);
+    CloseAsset(file);
+    return hash;
+}
@@ -0,0 +1,23 @@
+//
+// hash.h: Non-cryptographic hashing (xxHash64) used to identify assets by content.
+//
+
+#pragma once
+
+#include "platform.h"
+
+/**
+ * Computes the xxHash64 of a block of memory.
+ */
+u64 HashBytes(const void* data, u64 size, u64 seed = 0);
+
+/**
+ * Mixes a new value into an existing hash.
+ */
+u64 HashCombine(u64 hash, u64 value);
+
+/**
+ * Computes the xxHash64 of the whole contents of a file, read through the asset
+ * pack (see asset_pack.h). Returns 0 if the file could not be opened.
+ */
+u64 HashFile(const char* filepath, u64 seed = 0);
@@ -0,0 +1,158 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+
+struct JobSystem
+{
+    std::vector<std::thread> workers;
+    std::deque<Job>          queue;
+    std::mutex               mutex;
+    std::condition_variable  wakeUp;
+    bool                     quit;
+};
+
+static JobSystem GlobalJobSystem;
+
+// Indices of a ParallelFor, claimed one at a time by the caller and the
+// workers that pick up its helper jobs
+struct ParallelBatch
+{
+    const std::function<void(u32)>* job;
+    u32                             count;
+    std::atomic<u32>                next;
+    std::atomic<u32>                done;
+};
+
+// Returns once no index is left to claim, others may still be running
+static void RunBatchIndices(ParallelBatch& batch)
+{
+    for (u32 i = batch.next++; i < batch.count; i = batch.next++)
+    {
+        (*batch.job)(i);
+        batch.done++;
+    }
+}
+
+static bool PopJob(Job& job)
+{
+    std::lock_guard<std::mutex> lock(GlobalJobSystem.mutex);
+    if (GlobalJobSystem.queue.empty())
+        return false;
+    job = std::move(GlobalJobSystem.queue.front());
+    GlobalJobSystem.queue.pop_front();
+    return true;
+}
+
+static void WorkerThreadMain()
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(GlobalJobSystem.mutex);
+            GlobalJobSystem.wakeUp.wait(lock, [] { return GlobalJobSystem.quit || !GlobalJobSystem.queue.empty(); });
+
+            if (GlobalJobSystem.queue.empty())
+                return; // quit requested and nothing left to do
+
+            job = std::move(GlobalJobSystem.queue.front());
+            GlobalJobSystem.queue.pop_front();
+        }
+        job();
+    }
+}
+
+void InitJobSystem()
+{
+    u32 threadCount = std::thread::hardware_concurrency();
+    u32 workerCount = threadCount > 1 ? threadCount - 1 : 0; // the main thread also works
+
+    GlobalJobSystem.quit = false;
+    for (u32 i = 0; i < workerCount; ++i)
+        GlobalJobSystem.workers.push_back(std::thread(WorkerThreadMain));
+
+    ILOG("Job system started with %u worker threads", workerCount);
+}
+
+void ShutdownJobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(GlobalJobSystem.mutex);
+        GlobalJobSystem.quit = true;
+    }
+    GlobalJobSystem.wakeUp.notify_all();
+
+    for (std::thread& worker : GlobalJobSystem.workers)
+        worker.join();
+    GlobalJobSystem.workers.clear();
+}
+
+u32 GetJobThreadCount()
+{
+    return (u32)GlobalJobSystem.workers.size() + 1;
+}
+
+void ParallelFor(u32 count, const std::function<void(u32)>& job)
+{
+    if (count == 0)
+        return;
+
+    if (count == 1 || GlobalJobSystem.workers.empty())
+    {
+        for (u32 i = 0; i < count; ++i)
+            job(i);
+        return;
+    }
+
+    // Shared with the helper jobs, which may only get to run once the caller
+    // has done every index and returned
+    std::shared_ptr<ParallelBatch> batch = std::make_shared<ParallelBatch>();
+    batch->job = &job;
+    batch->count = count;
+    batch->next = 0;
+    batch->done = 0;
+
+    u32 helperCount = std::min(count - 1, (u32)GlobalJobSystem.workers.size());
+    {
+        std::lock_guard<std::mutex> lock(GlobalJobSystem.mutex);
+        for (u32 i = 0; i < helperCount; ++i)
+            GlobalJobSystem.queue.push_back([batch] { RunBatchIndices(*batch); });
+    }
+    GlobalJobSystem.wakeUp.notify_all();
+
+    // The caller only works on its own batch, the jobs queued before it (model
+    // imports, texture cooks...) are left to the workers
+    RunBatchIndices(*batch);
+    while (batch->done < count)
+        std::this_thread::yield();
+}
+
+void SubmitJob(const Job& job)
+{
+    if (GlobalJobSystem.workers.empty())
+    {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(GlobalJobSystem.mutex);
+        GlobalJobSystem.queue.push_back(job);
+    }
+    GlobalJobSystem.wakeUp.notify_one();
+}
+
+bool RunPendingJob()
+{
+    Job job;
+    if (!PopJob(job))
+        return false;
+    job();
+    return true;
+}
@@ -0,0 +1,47 @@
+//
+// job_system.h: A small pool of worker threads used to spread CPU heavy work
+// (mesh processing, image decoding...) across all the cores of the machine.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <functional>
+
+typedef std::function<void()> Job;
+
+/**
+ * Spawns the worker threads. It has to be called once by the platform layer
+ * before the engine is initialized.
+ */
+void InitJobSystem();
+
+/**
+ * Waits for the pending jobs and joins all the worker threads.
+ */
+void ShutdownJobSystem();
+
+/**
+ * Number of threads that can execute jobs, including the calling thread.
+ */
+u32 GetJobThreadCount();
+
+/**
+ * Runs job(i) for every i in [0, count) across the worker threads and returns
+ * once all of them have finished. The calling thread works on the indices too,
+ * never on other queued jobs, so it is safe to call it even if no workers were
+ * spawned or all of them are busy.
+ */
+void ParallelFor(u32 count, const std::function<void(u32)>& job);
+
+/**
+ * Queues a job and returns right away. The job must signal its own completion.
+ * Without worker threads it runs before returning.
+ */
+void SubmitJob(const Job& job);
+
+/**
+ * Runs one queued job on the calling thread, if there is any. For threads that
+ * wait on jobs, so that they help instead of spinning.
+ */
+bool RunPendingJob();
@@ -0,0 +1,313 @@
+#include "json.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Nesting deeper than this is rejected instead of overflowing the stack
+#define JSON_MAX_DEPTH 64
+
+// Longest number token, more digits than a double can tell apart
+#define JSON_MAX_NUMBER_LENGTH 64
+
+struct JsonParser
+{
+    const char*   cursor;
+    const char*   end;
+    const char*   begin;
+    JsonDocument* document;
+    u32           depth;
+};
+
+static void SkipWhitespace(JsonParser& parser)
+{
+    while (parser.cursor < parser.end &&
+           (*parser.cursor == ' ' || *parser.cursor == '\t' || *parser.cursor == '\n' || *parser.cursor == '\r'))
+        parser.cursor++;
+}
+
+static bool ParseJsonString(JsonParser& parser, const char*& text, u32& length)
+{
+    if (parser.cursor >= parser.end || *parser.cursor != '"')
+        return false;
+
+    const char* start = ++parser.cursor;
+    while (parser.cursor < parser.end && *parser.cursor != '"')
+    {
+        if (*parser.cursor == '\\')
+            parser.cursor++; // skip the escaped character
+        parser.cursor++;
+    }
+
+    if (parser.cursor >= parser.end)
+        return false;
+
+    text = start;
+    length = (u32)(parser.cursor - start);
+    parser.cursor++; // closing quote
+    return true;
+}
+
+static bool ParseJsonLiteral(JsonParser& parser, const char* literal)
+{
+    u32 length = (u32)strlen(literal);
+    if ((u32)(parser.end - parser.cursor) < length || strncmp(parser.cursor, literal, length) != 0)
+        return false;
+    parser.cursor += length;
+    return true;
+}
+
+// The text is not NUL terminated (e.g. the chunk of a mapped .glb), so strtod
+// runs on a bounded copy of the token
+static bool ParseJsonNumber(JsonParser& parser, f64& number)
+{
+    char token[JSON_MAX_NUMBER_LENGTH + 1];
+    u32 length = 0;
+    while (parser.cursor + length < parser.end && strchr("+-.0123456789eE", parser.cursor[length]) && parser.cursor[length] != '\0')
+    {
+        if (length == JSON_MAX_NUMBER_LENGTH)
+            return false;
+        token[length] = parser.cursor[length];
+        length++;
+    }
+    token[length] = '\0';
+
+    char* numberEnd = NULL;
+    number = strtod(token, &numberEnd);
+    if (length == 0 || numberEnd != token + length)
+        return false;
+
+    parser.cursor += length;
+    return true;
+}
+
+static bool ParseJsonValue(JsonParser& parser, u32 nodeIdx);
+
+static bool ParseJsonContainer(JsonParser& parser, u32 nodeIdx, bool isObject)
+{
+    const char closing = isObject ? '}' : ']';
+    parser.cursor++; // opening bracket
+
+    if (++parser.depth > JSON_MAX_DEPTH)
+        return false;
+
+    u32 lastChild = JSON_INVALID;
+
+    SkipWhitespace(parser);
+    if (parser.cursor < parser.end && *parser.cursor == closing)
+    {
+        parser.cursor++;
+        parser.depth--;
+        return true;
+    }
+
+    for (;;)
+    {
+        const char* key = NULL;
+        u32 keyLength = 0;
+
+        SkipWhitespace(parser);
+        if (isObject)
+        {
+            if (!ParseJsonString(parser, key, keyLength))
+                return false;
+            SkipWhitespace(parser);
+            if (parser.cursor >= parser.end || *parser.cursor != ':')
+                return false;
+            parser.cursor++;
+            SkipWhitespace(parser);
+        }
+
+        u32 childIdx = (u32)parser.document->nodes.size();
+        parser.document->nodes.push_back(JsonNode{});
+        parser.document->nodes[childIdx].key = key;
+        parser.document->nodes[childIdx].keyLength = keyLength;
+        parser.document->nodes[childIdx].firstChild = JSON_INVALID;
+        parser.document->nodes[childIdx].nextSibling = JSON_INVALID;
+
+        if (!ParseJsonValue(parser, childIdx))
+            return false;
+
+        // link it (the vector may have grown, so always go through indices)
+        if (lastChild == JSON_INVALID)
+            parser.document->nodes[nodeIdx].firstChild = childIdx;
+        else
+            parser.document->nodes[lastChild].nextSibling = childIdx;
+        parser.document->nodes[nodeIdx].childCount++;
+        lastChild = childIdx;
+
+        SkipWhitespace(parser);
+        if (parser.cursor >= parser.end)
+            return false;
+        if (*parser.cursor == ',')
+        {
+            parser.cursor++;
+            continue;
+        }
+        if (*parser.cursor == closing)
+        {
+            parser.cursor++;
+            parser.depth--;
+            return true;
+        }
+        return false;
+    }
+}
+
+static bool ParseJsonValue(JsonParser& parser, u32 nodeIdx)
+{
+    SkipWhitespace(parser);
+    if (parser.cursor >= parser.end)
+        return false;
+
+    switch (*parser.cursor)
+    {
+        case '{':
+            parser.document->nodes[nodeIdx].type = Json_Object;
+            return ParseJsonContainer(parser, nodeIdx, true);
+
+        case '[':
+            parser.document->nodes[nodeIdx].type = Json_Array;
+            return ParseJsonContainer(parser, nodeIdx, false);
+
+        case '"':
+        {
+            const char* text;
+            u32 length;
+            if (!ParseJsonString(parser, text, length))
+                return false;
+            parser.document->nodes[nodeIdx].type = Json_String;
+            parser.document->nodes[nodeIdx].text = text;
+            parser.document->nodes[nodeIdx].textLength = length;
+            return true;
+        }
+
+        case 't':
+            parser.document->nodes[nodeIdx].type = Json_Bool;
+            parser.document->nodes[nodeIdx].number = 1.0;
+            return ParseJsonLiteral(parser, "true");
+
+        case 'f':
+            parser.document->nodes[nodeIdx].type = Json_Bool;
+            return ParseJsonLiteral(parser, "false");
+
+        case 'n':
+            parser.document->nodes[nodeIdx].type = Json_Null;
+            return ParseJsonLiteral(parser, "null");
+
+        default:
+            parser.document->nodes[nodeIdx].type = Json_Number;
+            return ParseJsonNumber(parser, parser.document->nodes[nodeIdx].number);
+    }
+}
+
+bool ParseJson(const char* text, u32 length, JsonDocument& document)
+{
+    JsonParser parser = {};
+    parser.begin = text;
+    parser.cursor = text;
+    parser.end = text + length;
+    parser.document = &document;
+
+    document.nodes.clear();
+    document.nodes.reserve(length / 8);
+    document.nodes.push_back(JsonNode{});
+    document.nodes[0].firstChild = JSON_INVALID;
+    document.nodes[0].nextSibling = JSON_INVALID;
+
+    // Only whitespace may follow the root value (.glb chunks are padded with spaces)
+    bool parsed = ParseJsonValue(parser, 0);
+    SkipWhitespace(parser);
+    if (!parsed || parser.cursor != parser.end)
+    {
+        ELOG("ParseJson() - Syntax error at offset %u", (u32)(parser.cursor - parser.begin));
+        document.nodes.clear();
+        return false;
+    }
+
+    return true;
+}
+
+u32 JsonFind(const JsonDocument& document, u32 node, const char* key)
+{
+    if (node == JSON_INVALID || document.nodes[node].type != Json_Object)
+        return JSON_INVALID;
+
+    u32 keyLength = (u32)strlen(key);
+    for (u32 child = document.nodes[node].firstChild; child != JSON_INVALID; child = document.nodes[child].nextSibling)
+    {
+        const JsonNode& childNode = document.nodes[child];
+        if (childNode.keyLength == keyLength && strncmp(childNode.key, key, keyLength) == 0)
+            return child;
+    }
+
+    return JSON_INVALID;
+}
+
+std::vector<u32> JsonChildren(const JsonDocument& document, u32 node)
+{
+    std::vector<u32> children;
+    if (node == JSON_INVALID)
+        return children;
+
+    children.reserve(document.nodes[node].childCount);
+    for (u32 child = document.nodes[node].firstChild; child != JSON_INVALID; child = document.nodes[child].nextSibling)
+        children.push_back(child);
+
+    return children;
+}
+
+f64 JsonNumber(const JsonDocument& document, u32 node, f64 defaultValue)
+{
+    if (node == JSON_INVALID || (document.nodes[node].type != Json_Number && document.nodes[node].type != Json_Bool))
+        return defaultValue;
+    return document.nodes[node].number;
+}
+
+std::string JsonString(const JsonDocument& document, u32 node, const char* defaultValue)
+{
+    if (node == JSON_INVALID || document.nodes[node].type != Json_String)
+        return defaultValue;
+
+    const JsonNode& stringNode = document.nodes[node];
+
+    std::string result;
+    result.reserve(stringNode.textLength);
+    for (u32 i = 0; i < stringNode.textLength; ++i)
+    {
+        char c = stringNode.text[i];
+        if (c == '\\' && i + 1 < stringNode.textLength)
+        {
+            c = stringNode.text[++i];
+            switch (c)
+            {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u':
+                {
+                    // only the ASCII range is expected in asset names and uris
+                    char hex[5] = {};
+                    if (i + 4 < stringNode.textLength)
+                        memcpy(hex, stringNode.text + i + 1, 4);
+                    c = (char)strtol(hex, NULL, 16);
+                    i += 4;
+                } break;
+                default: break; // '"', '\\' and '/' map to themselves
+            }
+        }
+        result.push_back(c);
+    }
+
+    return result;
+}
+
+f64 JsonFindNumber(const JsonDocument& document, u32 node, const char* key, f64 defaultValue)
+{
+    return JsonNumber(document, JsonFind(document, node, key), defaultValue);
+}
+
+std::string JsonFindString(const JsonDocument& document, u32 node, const char* key, const char* defaultValue)
+{
+    return JsonString(document, JsonFind(document, node, key), defaultValue);
+}
@@ -0,0 +1,67 @@
+//
+// json.h: Minimal read-only JSON parser. The whole document is parsed into a flat
+// array of nodes that point back into the source text, so the text has to stay
+// alive while the document is used.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#define JSON_INVALID UINT32_MAX
+
+enum JsonType
+{
+    Json_Null,
+    Json_Bool,
+    Json_Number,
+    Json_String,
+    Json_Array,
+    Json_Object
+};
+
+struct JsonNode
+{
+    JsonType    type;
+    const char* key;         // member name when the parent is an object
+    u32         keyLength;
+    const char* text;        // string contents (still escaped)
+    u32         textLength;
+    f64         number;      // also 0/1 for booleans
+    u32         childCount;
+    u32         firstChild;
+    u32         nextSibling;
+};
+
+struct JsonDocument
+{
+    std::vector<JsonNode> nodes; // nodes[0] is the root value
+};
+
+/**
+ * Parses a JSON text, which does not need to be NUL terminated. Returns false
+ * (and logs the position) on syntax errors, on text after the root value and
+ * on nesting deeper than JSON_MAX_DEPTH.
+ */
+bool ParseJson(const char* text, u32 length, JsonDocument& document);
+
+/**
+ * Returns the member of an object with the given name, or JSON_INVALID.
+ */
+u32 JsonFind(const JsonDocument& document, u32 node, const char* key);
+
+/**
+ * Returns the indices of all the children of an array or object.
+ */
+std::vector<u32> JsonChildren(const JsonDocument& document, u32 node);
+
+f64 JsonNumber(const JsonDocument& document, u32 node, f64 defaultValue);
+
+std::string JsonString(const JsonDocument& document, u32 node, const char* defaultValue);
+
+/**
+ * Shortcuts to read a member of an object.
+ */
+f64 JsonFindNumber(const JsonDocument& document, u32 node, const char* key, f64 defaultValue);
+
+std::string JsonFindString(const JsonDocument& document, u32 node, const char* key, const char* defaultValue);
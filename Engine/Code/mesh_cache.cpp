@@ -0,0 +1,425 @@
+#include "mesh_cache.h"
+#include "engine.h"
+#include "hash.h"
+#include "model_loading.h"
+
+static u32 Material::* const CookedTextureSlots[CookedTexture_Count] =
+{
+    &Material::albedoTextureIdx,
+    &Material::emissiveTextureIdx,
+    &Material::specularTextureIdx,
+    &Material::normalsTextureIdx,
+    &Material::bumpTextureIdx,
+};
+
+static const TextureUsage CookedTextureUsages[CookedTexture_Count] =
+{
+    TextureUsage_Color,
+    TextureUsage_Color,
+    TextureUsage_Color,
+    TextureUsage_Normal,
+    TextureUsage_Height,
+};
+
+static u64 AlignOffset(u64 value, u64 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void CopyString(char* dst, u32 dstSize, const char* src)
+{
+    strncpy(dst, src, dstSize - 1);
+    dst[dstSize - 1] = '\0';
+}
+
+u64 GetCookedModelKey(const char* sourcePath, u32 importFlags, const std::vector<std::string>& dependencies)
+{
+    u64 key = HashFile(sourcePath, ((u64)COOKED_MESH_VERSION << 32) | importFlags);
+    if (key == 0)
+        return 0;
+
+    // A missing dependency hashes to 0, so it is out of date once it appears
+    for (const std::string& dependency : dependencies)
+    {
+        key = HashCombine(key, HashBytes(dependency.data(), dependency.size()));
+        key = HashCombine(key, HashFile(dependency.c_str()));
+    }
+    return key;
+}
+
+std::string GetCookedMeshPath(const char* sourcePath)
+{
+    return std::string(sourcePath) + ".mesh";
+}
+
+// Whether [offset, offset + size) is inside a section of the given size
+static bool IsInRange(u64 offset, u64 size, u64 sectionSize)
+{
+    return offset <= sectionSize && size <= sectionSize - offset;
+}
+
+static bool IsTerminated(const char* string, u32 capacity)
+{
+    return memchr(string, '\0', capacity) != NULL;
+}
+
+bool IsCookedMeshValid(const u8* data, u64 size)
+{
+    if (data == NULL || size < sizeof(CookedMeshHeader))
+        return false;
+
+    const CookedMeshHeader* header = (const CookedMeshHeader*)data;
+    if (header->magic != COOKED_MESH_MAGIC || header->version != COOKED_MESH_VERSION)
+        return false;
+
+    if (!IsInRange(header->submeshTableOffset, (u64)header->submeshCount * sizeof(CookedSubmesh), size) ||
+        !IsInRange(header->materialTableOffset, (u64)header->materialCount * sizeof(CookedMaterial), size) ||
+        !IsInRange(header->dependencyTableOffset, (u64)header->dependencyCount * sizeof(CookedDependency), size) ||
+        !IsInRange(header->vertexDataOffset, header->vertexDataSize, size) ||
+        !IsInRange(header->indexDataOffset, header->indexDataSize, size))
+        return false;
+
+    const CookedSubmesh* cookedSubmeshes = (const CookedSubmesh*)(data + header->submeshTableOffset);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& submesh = cookedSubmeshes[i];
+        if (submesh.attributeCount > COOKED_MESH_MAX_ATTRIBUTES ||
+            submesh.materialIdx >= header->materialCount ||
+            !IsInRange(submesh.vertexOffset, submesh.vertexDataSize, header->vertexDataSize) ||
+            !IsInRange(submesh.indexOffset, (u64)submesh.indexCount * sizeof(u32), header->indexDataSize))
+            return false;
+
+        for (u32 j = 0; j < submesh.attributeCount; ++j)
+            if (!IsInRange(submesh.attributes[j].offset, submesh.attributes[j].componentCount * sizeof(float), submesh.stride))
+                return false;
+    }
+
+    const CookedMaterial* cookedMaterials = (const CookedMaterial*)(data + header->materialTableOffset);
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        if (!IsTerminated(cookedMaterials[i].name, sizeof(cookedMaterials[i].name)))
+            return false;
+        for (u32 slot = 0; slot < CookedTexture_Count; ++slot)
+            if (!IsTerminated(cookedMaterials[i].textures[slot], COOKED_MESH_PATH_LENGTH))
+                return false;
+    }
+
+    return true;
+}
+
+bool LoadCookedModel(ModelImport& import, const char* sourcePath, u32 importFlags)
+{
+    std::string cookedPath = GetCookedMeshPath(sourcePath);
+
+    AssetFile file = OpenAsset(cookedPath.c_str());
+    if (file.data == NULL)
+        return false;
+
+    const CookedMeshHeader* header = (const CookedMeshHeader*)file.data;
+
+    bool valid = IsCookedMeshValid(file.data, file.size) && header->importFlags == importFlags;
+
+    // Even if out of date, the bounds are close enough for the proxy while the
+    // source is hashed (or imported again)
+    if (valid)
+    {
+        import.boundsMin = vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+        import.boundsMax = vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+        import.boundsKnown = true;
+    }
+
+    // A missing source is fine (shipping only cooked data), otherwise it must match
+    if (valid)
+    {
+        const CookedDependency* cookedDependencies = (const CookedDependency*)(file.data + header->dependencyTableOffset);
+        for (u32 i = 0; i < header->dependencyCount; ++i)
+            import.dependencies.push_back(std::string(cookedDependencies[i].path, strnlen(cookedDependencies[i].path, COOKED_MESH_PATH_LENGTH)));
+
+        u64 sourceHash = GetCookedModelKey(sourcePath, importFlags, import.dependencies);
+        valid = sourceHash == 0 || sourceHash == header->sourceHash;
+    }
+
+    if (!valid)
+    {
+        ILOG("Cooked mesh %s is out of date", cookedPath.c_str());
+        CloseAsset(file);
+        return false;
+    }
+
+    const CookedSubmesh*  cookedSubmeshes = (const CookedSubmesh*)(file.data + header->submeshTableOffset);
+    const CookedMaterial* cookedMaterials = (const CookedMaterial*)(file.data + header->materialTableOffset);
+
+    // Materials
+    for (u32 i = 0; i < header->materialCount; ++i)
+    {
+        const CookedMaterial& cookedMaterial = cookedMaterials[i];
+
+        Material material = {};
+        material.name = cookedMaterial.name;
+        material.albedo = vec3(cookedMaterial.albedo[0], cookedMaterial.albedo[1], cookedMaterial.albedo[2]);
+        material.emissive = vec3(cookedMaterial.emissive[0], cookedMaterial.emissive[1], cookedMaterial.emissive[2]);
+        material.smoothness = cookedMaterial.smoothness;
+
+        for (u32 slot = 0; slot < CookedTexture_Count; ++slot)
+        {
+            const char* texturePath = cookedMaterial.textures[slot];
+            material.*CookedTextureSlots[slot] = texturePath[0] ? ImportTexture(import, texturePath, CookedTextureUsages[slot]) : UINT32_MAX;
+        }
+
+        import.materials.push_back(material);
+    }
+
+    // Mesh
+    Mesh& mesh = import.mesh;
+    mesh.boundsMin = import.boundsMin;
+    mesh.boundsMax = import.boundsMax;
+    mesh.submeshes.resize(header->submeshCount);
+
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& cookedSubmesh = cookedSubmeshes[i];
+        Submesh& submesh = mesh.submeshes[i];
+
+        for (u32 j = 0; j < cookedSubmesh.attributeCount; ++j)
+        {
+            const CookedAttribute& attribute = cookedSubmesh.attributes[j];
+            submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ attribute.location, attribute.componentCount, attribute.offset });
+        }
+        submesh.vertexBufferLayout.stride = cookedSubmesh.stride;
+        submesh.vertexOffset = cookedSubmesh.vertexOffset;
+        submesh.indexOffset = cookedSubmesh.indexOffset;
+        submesh.indexCount = cookedSubmesh.indexCount;
+        submesh.boundsMin = vec3(cookedSubmesh.boundsMin[0], cookedSubmesh.boundsMin[1], cookedSubmesh.boundsMin[2]);
+        submesh.boundsMax = vec3(cookedSubmesh.boundsMax[0], cookedSubmesh.boundsMax[1], cookedSubmesh.boundsMax[2]);
+
+        import.materialIdx.push_back(cookedSubmesh.materialIdx);
+    }
+
+    // Uploaded straight from the file contents when committed, no intermediate copies
+    import.files.push_back(file);
+    import.vertexRanges.push_back(BufferRange{ file.data + header->vertexDataOffset, header->vertexDataSize, 0 });
+    import.vertexDataSize = header->vertexDataSize;
+    import.indexData = file.data + header->indexDataOffset;
+    import.indexDataSize = header->indexDataSize;
+
+    return true;
+}
+
+// The cooked file of an already loaded mesh. The mesh was created from this
+// file (or cooked into it), so the source hash is not checked again, only that
+// it still fits
+static const CookedMeshHeader* OpenLoadedMeshFile(const char* sourcePath, u32 submeshCount, AssetFile& file)
+{
+    std::string cookedPath = GetCookedMeshPath(sourcePath);
+
+    file = OpenAsset(cookedPath.c_str());
+    if (file.data == NULL)
+        return NULL;
+
+    const CookedMeshHeader* header = (const CookedMeshHeader*)file.data;
+    if (!IsCookedMeshValid(file.data, file.size) || header->submeshCount != submeshCount)
+    {
+        ELOG("%s does not match the loaded mesh", cookedPath.c_str());
+        CloseAsset(file);
+        return NULL;
+    }
+    return header;
+}
+
+bool ReloadCookedMesh(Mesh& mesh, const char* sourcePath)
+{
+    AssetFile file;
+    const CookedMeshHeader* header = OpenLoadedMeshFile(sourcePath, (u32)mesh.submeshes.size(), file);
+    if (!header)
+        return false;
+
+    const CookedSubmesh* cookedSubmeshes = (const CookedSubmesh*)(file.data + header->submeshTableOffset);
+    const u8* vertexData = file.data + header->vertexDataOffset;
+    const u8* indexData = file.data + header->indexDataOffset;
+
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        const CookedSubmesh& cookedSubmesh = cookedSubmeshes[i];
+        Submesh& submesh = mesh.submeshes[i];
+        submesh.vertices.resize(cookedSubmesh.vertexDataSize / sizeof(float));
+        submesh.indices.resize(cookedSubmesh.indexCount);
+        memcpy(submesh.vertices.data(), vertexData + cookedSubmesh.vertexOffset, cookedSubmesh.vertexDataSize);
+        memcpy(submesh.indices.data(), indexData + cookedSubmesh.indexOffset, cookedSubmesh.indexCount * sizeof(u32));
+    }
+
+    CloseAsset(file);
+
+    return true;
+}
+
+bool ReadCookedMeshGeometry(const char* sourcePath, u32 submeshCount, CookedMeshGeometry& geometry)
+{
+    AssetFile file;
+    const CookedMeshHeader* header = OpenLoadedMeshFile(sourcePath, submeshCount, file);
+    if (!header)
+        return false;
+
+    const CookedSubmesh* cookedSubmeshes = (const CookedSubmesh*)(file.data + header->submeshTableOffset);
+    for (u32 i = 0; i < header->submeshCount; ++i)
+    {
+        geometry.vertexOffsets.push_back(cookedSubmeshes[i].vertexOffset);
+        geometry.indexOffsets.push_back(cookedSubmeshes[i].indexOffset);
+    }
+
+    // Copied, so that the file is read here rather than when it is uploaded
+    const u8* vertexData = file.data + header->vertexDataOffset;
+    const u8* indexData = file.data + header->indexDataOffset;
+    geometry.vertexData.assign(vertexData, vertexData + header->vertexDataSize);
+    geometry.indexData.assign(indexData, indexData + header->indexDataSize);
+
+    CloseAsset(file);
+
+    return true;
+}
+
+bool CookModel(const ModelImport& import)
+{
+    const char* sourcePath = import.filename.c_str();
+    const Mesh& mesh = import.mesh;
+
+    if (!import.instances.empty())
+    {
+        ELOG("CookModel() - Hierarchical models can not be cooked (%s)", sourcePath);
+        return false;
+    }
+
+    CookedMeshHeader header = {};
+    header.magic = COOKED_MESH_MAGIC;
+    header.version = COOKED_MESH_VERSION;
+    header.sourceHash = GetCookedModelKey(sourcePath, import.importFlags, import.dependencies);
+    header.importFlags = import.importFlags;
+    header.submeshCount = (u32)mesh.submeshes.size();
+    header.materialCount = (u32)import.materials.size();
+    header.dependencyCount = (u32)import.dependencies.size();
+    header.boundsMin[0] = mesh.boundsMin.x; header.boundsMin[1] = mesh.boundsMin.y; header.boundsMin[2] = mesh.boundsMin.z;
+    header.boundsMax[0] = mesh.boundsMax.x; header.boundsMax[1] = mesh.boundsMax.y; header.boundsMax[2] = mesh.boundsMax.z;
+
+    std::vector<CookedSubmesh> cookedSubmeshes(mesh.submeshes.size());
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        CookedSubmesh& cookedSubmesh = cookedSubmeshes[i];
+
+        if (submesh.vertexBufferLayout.attributes.size() > COOKED_MESH_MAX_ATTRIBUTES || submesh.vertices.empty())
+        {
+            ELOG("CookModel() - Submesh %u of %s can not be cooked", i, sourcePath);
+            return false;
+        }
+
+        cookedSubmesh = CookedSubmesh{};
+        cookedSubmesh.vertexOffset = (u32)header.vertexDataSize;
+        cookedSubmesh.vertexDataSize = submesh.vertices.size() * sizeof(float);
+        cookedSubmesh.indexOffset = (u32)header.indexDataSize;
+        cookedSubmesh.indexCount = submesh.indices.size();
+        cookedSubmesh.materialIdx = import.materialIdx[i];
+        cookedSubmesh.stride = submesh.vertexBufferLayout.stride;
+        cookedSubmesh.attributeCount = submesh.vertexBufferLayout.attributes.size();
+        for (u32 j = 0; j < cookedSubmesh.attributeCount; ++j)
+        {
+            const VertexBufferAttribute& attribute = submesh.vertexBufferLayout.attributes[j];
+            cookedSubmesh.attributes[j] = CookedAttribute{ attribute.location, attribute.componentCount, (u16)attribute.offset };
+        }
+        cookedSubmesh.boundsMin[0] = submesh.boundsMin.x; cookedSubmesh.boundsMin[1] = submesh.boundsMin.y; cookedSubmesh.boundsMin[2] = submesh.boundsMin.z;
+        cookedSubmesh.boundsMax[0] = submesh.boundsMax.x; cookedSubmesh.boundsMax[1] = submesh.boundsMax.y; cookedSubmesh.boundsMax[2] = submesh.boundsMax.z;
+
+        header.vertexDataSize += cookedSubmesh.vertexDataSize;
+        header.indexDataSize += cookedSubmesh.indexCount * sizeof(u32);
+    }
+
+    std::vector<CookedMaterial> cookedMaterials(import.materials.size());
+    for (u32 i = 0; i < import.materials.size(); ++i)
+    {
+        const Material& material = import.materials[i];
+        CookedMaterial& cookedMaterial = cookedMaterials[i];
+
+        cookedMaterial = CookedMaterial{};
+        CopyString(cookedMaterial.name, sizeof(cookedMaterial.name), material.name.c_str());
+        cookedMaterial.albedo[0] = material.albedo.r; cookedMaterial.albedo[1] = material.albedo.g; cookedMaterial.albedo[2] = material.albedo.b;
+        cookedMaterial.emissive[0] = material.emissive.r; cookedMaterial.emissive[1] = material.emissive.g; cookedMaterial.emissive[2] = material.emissive.b;
+        cookedMaterial.smoothness = material.smoothness;
+
+        // Textures already in the app have no path to store, they are left out
+        for (u32 slot = 0; slot < CookedTexture_Count; ++slot)
+        {
+            u32 textureIdx = material.*CookedTextureSlots[slot];
+            if (textureIdx >= import.textures.size() || import.textures[textureIdx].existingTexIdx != UINT32_MAX)
+                continue;
+
+            const std::string& texturePath = import.textures[textureIdx].path;
+            if (texturePath.size() >= COOKED_MESH_PATH_LENGTH)
+            {
+                ELOG("CookModel() - Texture path %s of %s is too long", texturePath.c_str(), sourcePath);
+                return false;
+            }
+            CopyString(cookedMaterial.textures[slot], COOKED_MESH_PATH_LENGTH, texturePath.c_str());
+        }
+    }
+
+    std::vector<CookedDependency> cookedDependencies(import.dependencies.size());
+    for (u32 i = 0; i < import.dependencies.size(); ++i)
+    {
+        if (import.dependencies[i].size() >= COOKED_MESH_PATH_LENGTH)
+        {
+            ELOG("CookModel() - Dependency path %s of %s is too long", import.dependencies[i].c_str(), sourcePath);
+            return false;
+        }
+        cookedDependencies[i] = CookedDependency{};
+        CopyString(cookedDependencies[i].path, COOKED_MESH_PATH_LENGTH, import.dependencies[i].c_str());
+    }
+
+    // Sections: header, tables and then the page aligned geometry
+    header.submeshTableOffset = sizeof(CookedMeshHeader);
+    header.materialTableOffset = header.submeshTableOffset + cookedSubmeshes.size() * sizeof(CookedSubmesh);
+    header.dependencyTableOffset = header.materialTableOffset + cookedMaterials.size() * sizeof(CookedMaterial);
+    header.vertexDataOffset = AlignOffset(header.dependencyTableOffset + cookedDependencies.size() * sizeof(CookedDependency), COOKED_MESH_SECTION_ALIGNMENT);
+    header.indexDataOffset = AlignOffset(header.vertexDataOffset + header.vertexDataSize, COOKED_MESH_SECTION_ALIGNMENT);
+
+    std::vector<u8> fileData(header.indexDataOffset + header.indexDataSize, 0);
+    memcpy(fileData.data(), &header, sizeof(header));
+    memcpy(fileData.data() + header.submeshTableOffset, cookedSubmeshes.data(), cookedSubmeshes.size() * sizeof(CookedSubmesh));
+    memcpy(fileData.data() + header.materialTableOffset, cookedMaterials.data(), cookedMaterials.size() * sizeof(CookedMaterial));
+    memcpy(fileData.data() + header.dependencyTableOffset, cookedDependencies.data(), cookedDependencies.size() * sizeof(CookedDependency));
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        const Submesh& submesh = mesh.submeshes[i];
+        memcpy(fileData.data() + header.vertexDataOffset + cookedSubmeshes[i].vertexOffset, submesh.vertices.data(), cookedSubmeshes[i].vertexDataSize);
+        memcpy(fileData.data() + header.indexDataOffset + cookedSubmeshes[i].indexOffset, submesh.indices.data(), submesh.indices.size() * sizeof(u32));
+    }
+
+    // Written aside and renamed, so a reader or an interrupted write never sees
+    // a half written file. The old one goes only once the new one is complete
+    std::string cookedPath = GetCookedMeshPath(sourcePath);
+    std::string tmpPath = cookedPath + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing file %s", tmpPath.c_str());
+        return false;
+    }
+
+    bool written = fwrite(fileData.data(), 1, fileData.size(), file) == fileData.size();
+    written = fclose(file) == 0 && written;
+
+    if (!written)
+    {
+        ELOG("fwrite() failed writing file %s", tmpPath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    remove(cookedPath.c_str());
+    if (rename(tmpPath.c_str(), cookedPath.c_str()) != 0)
+    {
+        ELOG("rename() failed writing file %s", cookedPath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
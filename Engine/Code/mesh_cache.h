@@ -0,0 +1,139 @@
+//
+// mesh_cache.h: Cooked binary meshes. After a model is imported with Assimp its
+// final interleaved vertex/index data, submesh table, materials and bounds are
+// written next to the source file (<source>.mesh). Next launches map that file
+// and upload the geometry straight from the mapping, skipping the import.
+//
+// The file lists the other files the import read (e.g. the material libraries
+// of an OBJ), so editing any of them makes it out of date too.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <string>
+#include <vector>
+
+struct Mesh;
+struct ModelImport;
+
+#define COOKED_MESH_MAGIC             0x4853454D // "MESH"
+#define COOKED_MESH_VERSION           2
+#define COOKED_MESH_SECTION_ALIGNMENT KB(4)
+#define COOKED_MESH_MAX_ATTRIBUTES    8
+#define COOKED_MESH_PATH_LENGTH       128
+
+enum CookedTextureSlot
+{
+    CookedTexture_Albedo,
+    CookedTexture_Emissive,
+    CookedTexture_Specular,
+    CookedTexture_Normals,
+    CookedTexture_Bump,
+    CookedTexture_Count
+};
+
+struct CookedMeshHeader
+{
+    u32 magic;
+    u32 version;
+    u64 sourceHash;        // GetCookedModelKey of the source and its dependencies
+    u32 importFlags;
+    u32 submeshCount;
+    u32 materialCount;
+    u32 dependencyCount;
+    u64 submeshTableOffset;
+    u64 materialTableOffset;
+    u64 dependencyTableOffset;
+    u64 vertexDataOffset;  // aligned to COOKED_MESH_SECTION_ALIGNMENT
+    u64 vertexDataSize;
+    u64 indexDataOffset;   // aligned to COOKED_MESH_SECTION_ALIGNMENT
+    u64 indexDataSize;
+    f32 boundsMin[3];
+    f32 boundsMax[3];
+};
+
+struct CookedAttribute
+{
+    u8  location;
+    u8  componentCount;
+    u16 offset;
+};
+
+struct CookedSubmesh
+{
+    u32 vertexOffset;      // in bytes, relative to the vertex data section
+    u32 vertexDataSize;
+    u32 indexOffset;       // in bytes, relative to the index data section
+    u32 indexCount;
+    u32 materialIdx;       // relative to the material table of the file
+    u32 stride;
+    u32 attributeCount;
+    CookedAttribute attributes[COOKED_MESH_MAX_ATTRIBUTES];
+    f32 boundsMin[3];
+    f32 boundsMax[3];
+};
+
+struct CookedMaterial
+{
+    char name[64];
+    f32  albedo[3];
+    f32  emissive[3];
+    f32  smoothness;
+    char textures[CookedTexture_Count][COOKED_MESH_PATH_LENGTH]; // empty if none
+};
+
+struct CookedDependency
+{
+    char path[COOKED_MESH_PATH_LENGTH];
+};
+
+// Geometry of a cooked mesh, read back to be uploaded again
+struct CookedMeshGeometry
+{
+    std::vector<u8>  vertexData;
+    std::vector<u8>  indexData;
+    std::vector<u32> vertexOffsets; // of each submesh, in bytes
+    std::vector<u32> indexOffsets;
+};
+
+/**
+ * Path of the cooked file for a given source model.
+ */
+std::string GetCookedMeshPath(const char* sourcePath);
+
+/**
+ * Checks every table and section of a cooked file against its size, so that a
+ * truncated or corrupt file is imported again instead of read out of bounds.
+ */
+bool IsCookedMeshValid(const u8* data, u64 size);
+
+/**
+ * Identifies what a cooked file was made from: contents of the source and of its
+ * dependencies, import flags and cooker version. 0 if the source is missing.
+ */
+u64 GetCookedModelKey(const char* sourcePath, u32 importFlags, const std::vector<std::string>& dependencies);
+
+/**
+ * Tries to import a model from its cooked file. Returns false if there is no
+ * cooked file or it is out of date (source hash or import flags changed).
+ */
+bool LoadCookedModel(ModelImport& import, const char* sourcePath, u32 importFlags);
+
+/**
+ * Reads the CPU copy of an already loaded mesh back from its cooked file.
+ */
+bool ReloadCookedMesh(Mesh& mesh, const char* sourcePath);
+
+/**
+ * Reads the vertex and index data of an already loaded mesh, with submeshCount
+ * submeshes, back from its cooked file to re-create evicted buffers. Does not
+ * touch the mesh, so it runs on the workers.
+ */
+bool ReadCookedMeshGeometry(const char* sourcePath, u32 submeshCount, CookedMeshGeometry& geometry);
+
+/**
+ * Writes the cooked file of a flattened import, before its geometry is uploaded.
+ * Only reads the import, so it runs on the workers.
+ */
+bool CookModel(const ModelImport& import);
@@ -0,0 +1,414 @@
+#include "model_loading.h"
+#include "engine.h"
+#include "job_system.h"
+#include "mesh_cache.h"
+#include <imgui.h>
+
+static u32 Material::* const MaterialTextureSlots[] =
+{
+    &Material::albedoTextureIdx,
+    &Material::emissiveTextureIdx,
+    &Material::specularTextureIdx,
+    &Material::normalsTextureIdx,
+    &Material::bumpTextureIdx,
+};
+
+static ModelLoad* FindModelLoad(const App* app, u32 modelIdx)
+{
+    for (ModelLoad* load : app->modelLoading.loads)
+        if (load->modelIdx == modelIdx)
+            return load;
+    return NULL;
+}
+
+// Unit box centered at the origin, with the attributes the geometry passes read
+static void CreateProxyMesh(App* app, Mesh& mesh)
+{
+    const u32 floatsPerVertex = 14;
+
+    Submesh submesh = {};
+    submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
+    submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
+    submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 2, 2, 6 * sizeof(float) });
+    submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 3, 3, 8 * sizeof(float) });
+    submesh.vertexBufferLayout.attributes.push_back(VertexBufferAttribute{ 4, 3, 11 * sizeof(float) });
+    submesh.vertexBufferLayout.stride = floatsPerVertex * sizeof(float);
+    submesh.boundsMin = vec3(-0.5f);
+    submesh.boundsMax = vec3( 0.5f);
+
+    for (u32 axis = 0; axis < 3; ++axis)
+    {
+        for (f32 sign = -1.0f; sign <= 1.0f; sign += 2.0f)
+        {
+            vec3 normal(0.0f);
+            normal[axis] = sign;
+            vec3 tangent(0.0f);
+            tangent[(axis + 1) % 3] = 1.0f;
+            vec3 bitangent = glm::cross(normal, tangent);
+
+            u32 firstVertex = (u32)(submesh.vertices.size() / floatsPerVertex);
+            const vec2 corners[] = { vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(1.0f, 1.0f), vec2(0.0f, 1.0f) };
+            for (const vec2& uv : corners)
+            {
+                vec3 position = 0.5f * normal + (uv.x - 0.5f) * tangent + (uv.y - 0.5f) * bitangent;
+                const f32 vertex[] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y,
+                                       tangent.x, tangent.y, tangent.z, bitangent.x, bitangent.y, bitangent.z };
+                submesh.vertices.insert(submesh.vertices.end(), vertex, vertex + floatsPerVertex);
+            }
+
+            const u32 quad[] = { 0, 1, 2, 0, 2, 3 };
+            for (u32 index : quad)
+                submesh.indices.push_back(firstVertex + index);
+        }
+    }
+
+    mesh.submeshes.push_back(submesh);
+    UploadMesh(app, mesh);
+}
+
+void InitModelLoading(App* app, u32 proxyMaterialIdx)
+{
+    ModelLoading& loading = app->modelLoading;
+    CreateProxyMesh(app, loading.proxyMesh);
+
+    loading.proxyMaterialIdx = proxyMaterialIdx;
+    if (proxyMaterialIdx != UINT32_MAX)
+        return;
+
+    Material proxyMaterial = {};
+    proxyMaterial.name = "ModelProxy";
+    proxyMaterial.albedo = vec3(1.0f);
+    proxyMaterial.albedoTextureIdx = app->whiteTexIdx;
+    loading.proxyMaterialIdx = AddMaterial(app, proxyMaterial);
+}
+
+// Bounds of the whole model, with the instance transforms of hierarchies
+static void ComputeImportBounds(ModelImport& import, vec3& boundsMin, vec3& boundsMax)
+{
+    boundsMin = vec3( FLT_MAX);
+    boundsMax = vec3(-FLT_MAX);
+
+    if (import.instances.empty())
+    {
+        for (const Submesh& submesh : import.mesh.submeshes)
+        {
+            boundsMin = glm::min(boundsMin, submesh.boundsMin);
+            boundsMax = glm::max(boundsMax, submesh.boundsMax);
+        }
+        return;
+    }
+
+    for (const MeshInstance& instance : import.instances)
+    {
+        const Submesh& submesh = import.mesh.submeshes[instance.submesh.submeshIdx];
+        for (u32 corner = 0; corner < 8; ++corner)
+        {
+            vec3 local((corner & 1) ? submesh.boundsMax.x : submesh.boundsMin.x,
+                       (corner & 2) ? submesh.boundsMax.y : submesh.boundsMin.y,
+                       (corner & 4) ? submesh.boundsMax.z : submesh.boundsMin.z);
+            vec3 position = vec3(instance.transform * vec4(local, 1.0f));
+            boundsMin = glm::min(boundsMin, position);
+            boundsMax = glm::max(boundsMax, position);
+        }
+    }
+}
+
+u32 QueueModelLoad(App* app, const char* filename, u32 importFlags)
+{
+    u32 modelIdx = (u32)app->models.size();
+    app->models.push_back(Model{});
+
+    ModelLoad* load = new ModelLoad;
+    load->modelIdx = modelIdx;
+    load->import.filename = filename;
+    load->import.importFlags = importFlags;
+    load->import.vertexDataSize = 0;
+    load->import.indexData = NULL;
+    load->import.cook = false;
+    load->import.boundsKnown = false;
+    load->done = false;
+    load->succeeded = false;
+    load->proxyReady = false;
+    app->modelLoading.loads.push_back(load);
+
+    SubmitJob([app, load]
+    {
+        ModelImport& import = load->import;
+        load->succeeded = ImportModel(app, import);
+
+        if (load->succeeded && !import.boundsKnown)
+        {
+            ComputeImportBounds(import, import.boundsMin, import.boundsMax);
+            import.boundsKnown = true;
+        }
+
+        load->done = true;
+    });
+
+    return modelIdx;
+}
+
+bool IsModelLoaded(const App* app, u32 modelIdx)
+{
+    return modelIdx < app->models.size() && app->models[modelIdx].meshIdx != UINT32_MAX;
+}
+
+bool GetModelProxyTransform(const App* app, u32 modelIdx, glm::mat4& transform)
+{
+    if (!app->modelLoading.drawProxies)
+        return false;
+
+    const ModelLoad* load = FindModelLoad(app, modelIdx);
+    if (!load || !load->proxyReady)
+        return false;
+
+    const ModelImport& import = load->import;
+    vec3 size = glm::max(import.boundsMax - import.boundsMin, vec3(0.01f));
+    transform = glm::translate((import.boundsMin + import.boundsMax) * 0.5f) * glm::scale(size);
+    return true;
+}
+
+void DeferModelTexture(App* app, u32 modelIdx, u32 Material::* slot, u32 texIdx)
+{
+    ModelLoad* load = FindModelLoad(app, modelIdx);
+    if (load)
+        load->overrides.push_back(ModelTextureOverride{ slot, texIdx });
+}
+
+static bool IsSameVertexLayout(const VertexBufferLayout& a, const VertexBufferLayout& b)
+{
+    if (a.stride != b.stride || a.attributes.size() != b.attributes.size())
+        return false;
+
+    for (u32 i = 0; i < a.attributes.size(); ++i)
+    {
+        const VertexBufferAttribute& x = a.attributes[i];
+        const VertexBufferAttribute& y = b.attributes[i];
+        if (x.location != y.location || x.componentCount != y.componentCount || x.offset != y.offset ||
+            x.type != y.type || x.normalized != y.normalized)
+            return false;
+    }
+    return true;
+}
+
+// Whether a submesh found by hash really has the geometry of an imported one.
+// The second half of the hash stands for the bytes, nothing is read back
+static bool IsSameSubmesh(const App* app, const SharedSubmesh& shared, const SubmeshHash& hash, const Submesh& submesh)
+{
+    const Submesh& sharedSubmesh = app->meshes[shared.ref.meshIdx].submeshes[shared.ref.submeshIdx];
+    return shared.check == hash.check &&
+           IsSameVertexLayout(sharedSubmesh.vertexBufferLayout, submesh.vertexBufferLayout) &&
+           sharedSubmesh.indexCount == submesh.indices.size() &&
+           sharedSubmesh.indexType == GL_UNSIGNED_INT;
+}
+
+static void UploadImportedGeometry(App* app, ModelImport& import, Mesh& mesh)
+{
+    if (import.vertexRanges.empty())
+    {
+        UploadMesh(app, mesh);
+        return;
+    }
+
+    mesh.vertexBufferHandle = CreateStaticBuffer(app, import.vertexDataSize, import.vertexRanges.data(), (u32)import.vertexRanges.size());
+
+    if (import.indexData)
+    {
+        BufferRange indexRange = { import.indexData, import.indexDataSize, 0 };
+        mesh.indexBufferHandle = CreateStaticBuffer(app, import.indexDataSize, &indexRange, 1);
+    }
+    else
+    {
+        mesh.indexBufferHandle = mesh.vertexBufferHandle;
+    }
+}
+
+static void CommitModel(App* app, ModelLoad& load)
+{
+    ModelImport& import = load.import;
+
+    // Textures, then the materials pointing to them
+    std::vector<u32> textureIndices(import.textures.size());
+    for (u32 i = 0; i < import.textures.size(); ++i)
+    {
+        const ImportedTexture& texture = import.textures[i];
+        if (texture.existingTexIdx != UINT32_MAX)
+            textureIndices[i] = texture.existingTexIdx;
+        else if (!texture.encodedData.empty())
+            textureIndices[i] = QueueTexture2DFromMemory(app, texture.path.c_str(), texture.encodedData.data(), (u32)texture.encodedData.size());
+        else
+            textureIndices[i] = QueueTexture2D(app, texture.path.c_str(), texture.usage);
+    }
+
+    std::vector<u32> materialIndices(import.materials.size());
+    for (u32 i = 0; i < import.materials.size(); ++i)
+    {
+        Material material = import.materials[i];
+        for (u32 Material::* slot : MaterialTextureSlots)
+            if (material.*slot != UINT32_MAX)
+                material.*slot = textureIndices[material.*slot];
+
+        for (const ModelTextureOverride& textureOverride : load.overrides)
+            material.*textureOverride.slot = textureOverride.texIdx;
+
+        materialIndices[i] = AddMaterial(app, material);
+    }
+
+    // Cooked while the import still holds the CPU geometry
+    if (import.cook)
+        CookModel(import);
+
+    // Geometry. Submeshes already loaded by other models are shared
+    u32 meshIdx = (u32)app->meshes.size();
+    app->meshes.push_back(Mesh{});
+    Mesh& mesh = app->meshes.back();
+    mesh.boundsMin = import.mesh.boundsMin;
+    mesh.boundsMax = import.mesh.boundsMax;
+
+    std::vector<SubmeshRef> submeshRefs(import.mesh.submeshes.size());
+    for (u32 i = 0; i < import.mesh.submeshes.size(); ++i)
+    {
+        submeshRefs[i] = SubmeshRef{ meshIdx, (u32)mesh.submeshes.size() };
+
+        if (!import.submeshHashes.empty())
+        {
+            const Submesh& submesh = import.mesh.submeshes[i];
+            const SubmeshHash& hash = import.submeshHashes[i];
+            auto it = app->sharedSubmeshes.find(hash.key);
+            if (it == app->sharedSubmeshes.end())
+            {
+                app->sharedSubmeshes[hash.key] = SharedSubmesh{ submeshRefs[i], hash.check };
+            }
+            else if (IsSameSubmesh(app, it->second, hash, submesh))
+            {
+                submeshRefs[i] = it->second.ref;
+                continue;
+            }
+            else
+            {
+                ILOG("Submesh %u of %s has the hash of other geometry, it is not shared", i, import.filename.c_str());
+            }
+        }
+
+        mesh.submeshes.push_back(std::move(import.mesh.submeshes[i]));
+    }
+
+    UploadImportedGeometry(app, import, mesh);
+
+    for (AssetFile& file : import.files)
+        CloseAsset(file);
+
+    Model& model = app->models[load.modelIdx];
+    for (u32 materialIdx : import.materialIdx)
+        model.materialIdx.push_back(materialIndices[materialIdx]);
+
+    for (MeshInstance instance : import.instances)
+    {
+        instance.submesh = submeshRefs[instance.submesh.submeshIdx];
+        instance.materialIdx = materialIndices[instance.materialIdx];
+        model.instances.push_back(instance);
+    }
+
+    // Drawn from now on
+    model.meshIdx = meshIdx;
+
+    // Only flattened models are cooked, so only those can be read back once evicted
+    RegisterMeshResidency(app, meshIdx, import.filename.c_str(), model.instances.empty());
+}
+
+void UpdateModelLoads(App* app)
+{
+    ModelLoading& loading = app->modelLoading;
+
+    u32 commits = 0;
+    for (u32 i = 0; i < loading.loads.size(); )
+    {
+        ModelLoad* load = loading.loads[i];
+        if (!load->done || commits >= loading.commitsPerFrame)
+        {
+            load->proxyReady = load->import.boundsKnown;
+            ++i;
+            continue;
+        }
+
+        if (load->succeeded)
+        {
+            CommitModel(app, *load);
+            loading.loadedModels++;
+            commits++;
+        }
+        else
+        {
+            ELOG("Could not load model %s", load->import.filename.c_str());
+            loading.failedModels++;
+        }
+
+        delete load;
+        loading.loads.erase(loading.loads.begin() + i);
+    }
+}
+
+std::string GetModelDirectory(const char* filename)
+{
+    const char* end = filename;
+    for (const char* c = filename; *c; ++c)
+        if (*c == '/' || *c == '\\')
+            end = c;
+    return std::string(filename, end);
+}
+
+std::string MakeModelPath(const std::string& directory, const char* name)
+{
+    return directory.empty() ? std::string(name) : directory + "/" + name;
+}
+
+u32 ImportTexture(ModelImport& import, const char* filepath, TextureUsage usage)
+{
+    ImportedTexture texture = {};
+    texture.path = filepath;
+    texture.usage = usage;
+    texture.existingTexIdx = UINT32_MAX;
+    import.textures.push_back(texture);
+    return (u32)import.textures.size() - 1;
+}
+
+u32 ImportTextureFromMemory(ModelImport& import, const char* name, const void* data, u32 size)
+{
+    ImportedTexture texture = {};
+    texture.path = name;
+    texture.usage = TextureUsage_Color;
+    texture.encodedData.assign((const u8*)data, (const u8*)data + size);
+    texture.existingTexIdx = UINT32_MAX;
+    import.textures.push_back(texture);
+    return (u32)import.textures.size() - 1;
+}
+
+u32 ImportExistingTexture(ModelImport& import, u32 texIdx)
+{
+    ImportedTexture texture = {};
+    texture.existingTexIdx = texIdx;
+    import.textures.push_back(texture);
+    return (u32)import.textures.size() - 1;
+}
+
+void ModelLoadingGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Model loading"))
+        return;
+
+    ModelLoading& loading = app->modelLoading;
+
+    int commitsPerFrame = (int)loading.commitsPerFrame;
+    if (ImGui::DragInt("Commits per frame", &commitsPerFrame, 0.1f, 1, 64))
+        loading.commitsPerFrame = (u32)commitsPerFrame;
+    ImGui::Checkbox("Proxies", &loading.drawProxies);
+
+    ImGui::Text("Loading: %u   Loaded: %u   Failed: %u", (u32)loading.loads.size(), loading.loadedModels, loading.failedModels);
+    for (const ModelLoad* load : loading.loads)
+        ImGui::BulletText("%s%s", load->import.filename.c_str(), load->done ? " (importing done)" : "");
+
+    int uploadsPerFrame = (int)app->textureRegistry.uploadsPerFrame;
+    if (ImGui::DragInt("Texture uploads per frame", &uploadsPerFrame, 0.1f, 1, 64))
+        app->textureRegistry.uploadsPerFrame = (u32)uploadsPerFrame;
+    ImGui::Text("Textures loading: %u", (u32)app->textureLoads.size());
+}
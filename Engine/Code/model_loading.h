@@ -0,0 +1,164 @@
+//
+// model_loading.h: Models load in the background. LoadModel returns the index
+// of the model right away and a worker imports the file into a ModelImport,
+// which only holds CPU data: geometry, materials and the textures they use, by
+// path. The main thread then commits a few finished imports per frame: the
+// materials are added, the textures queued and the geometry uploaded.
+//
+// Until then the model has no mesh and is not drawn. Once the bounds of the
+// model are known (right away when there is a cooked file) a box of that size
+// stands in for it.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "Mesh.h"
+#include "asset_pack.h"
+#include "texture_cooker.h"
+#include "upload_manager.h"
+#include <atomic>
+
+struct App;
+
+// Texture used by an imported material, queued when the import is committed
+struct ImportedTexture
+{
+    std::string     path;            // file, or name of an embedded image
+    TextureUsage    usage;
+    std::vector<u8> encodedData;     // embedded images
+    u32             existingTexIdx;  // texture already in app->textures, UINT32_MAX if none
+};
+
+// Hash of the vertex and index bytes of a submesh, in two halves: key finds the
+// candidates to share, check confirms them without the geometry, whose CPU copy
+// is dropped once uploaded
+struct SubmeshHash
+{
+    u64 key;
+    u64 check;
+};
+
+// Submesh other models can share, found by content hash (see CommitModel)
+struct SharedSubmesh
+{
+    SubmeshRef ref;
+    u64        check; // of its SubmeshHash
+};
+
+
+struct ModelImport
+{
+    std::string              filename;
+    u32                      importFlags;
+    std::vector<std::string> dependencies; // other files read by the loader, part of the cooked file key
+
+    // The texture indices of the materials point into textures
+    std::vector<ImportedTexture> textures;
+    std::vector<Material>        materials;
+
+    // Flattened models have one material per submesh, hierarchies are drawn
+    // through the instances, whose submeshes are those of mesh
+    Mesh                      mesh;
+    std::vector<u32>          materialIdx;
+    std::vector<MeshInstance> instances;
+    std::vector<SubmeshHash>  submeshHashes; // filled to share identical submeshes between models
+
+    // Geometry uploaded as is instead of from the submesh vectors: a vertex
+    // buffer of vertexDataSize bytes filled by the ranges
+    std::vector<BufferRange> vertexRanges;
+    u64                      vertexDataSize;
+    const u8*                indexData;     // NULL when the indices are in the vertex buffer
+    u64                      indexDataSize;
+    std::vector<u8>          geometryData;  // owns the ranges no file holds (generated glTF data)
+    std::vector<AssetFile>   files;         // hold the others, closed once uploaded
+
+    bool cook;                       // write the cooked file when committed
+
+    // For the proxy, set as soon as the loader knows them
+    glm::vec3         boundsMin;
+    glm::vec3         boundsMax;
+    std::atomic<bool> boundsKnown;
+};
+
+struct ModelTextureOverride
+{
+    u32 Material::* slot;
+    u32             texIdx;
+};
+
+struct ModelLoad
+{
+    u32                               modelIdx;
+    ModelImport                       import;
+    std::vector<ModelTextureOverride> overrides;
+    std::atomic<bool>                 done;
+    bool                              succeeded;
+    bool                              proxyReady; // boundsKnown as of this frame, so Update and Render agree
+};
+
+struct ModelLoading
+{
+    u32  commitsPerFrame = 2;
+    bool drawProxies = true;
+
+    std::vector<ModelLoad*> loads; // in the order they were queued
+
+    // Unit box drawn in place of the models being loaded
+    Mesh proxyMesh;
+    u32  proxyMaterialIdx;
+
+    // since startup
+    u32 loadedModels;
+    u32 failedModels;
+};
+
+/**
+ * Creates the proxy box. Called once from Init, after the white texture is
+ * loaded. A snapshot restores the proxy material along with the rest, so it is
+ * only added when proxyMaterialIdx is UINT32_MAX.
+ */
+void InitModelLoading(App* app, u32 proxyMaterialIdx = UINT32_MAX);
+
+/**
+ * Reserves a model and imports filename on a worker. See LoadModel.
+ */
+u32 QueueModelLoad(App* app, const char* filename, u32 importFlags);
+
+/**
+ * Whether the model was committed. Models that failed to load never are.
+ */
+bool IsModelLoaded(const App* app, u32 modelIdx);
+
+/**
+ * Transform of the unit box standing in for a model that is still loading,
+ * relative to the model. Returns false if there is nothing to draw for it.
+ */
+bool GetModelProxyTransform(const App* app, u32 modelIdx, glm::mat4& transform);
+
+/**
+ * Sets a texture slot of all the materials of a model still loading, once they
+ * are added. Does nothing if the model is not being loaded.
+ */
+void DeferModelTexture(App* app, u32 modelIdx, u32 Material::* slot, u32 texIdx);
+
+/**
+ * Once per frame, before the textures are updated: commits finished imports.
+ */
+void UpdateModelLoads(App* app);
+
+/**
+ * Paths for the loaders. They run on the workers, so unlike MakePath their
+ * strings do not live in the frame arena.
+ */
+std::string GetModelDirectory(const char* filename);
+std::string MakeModelPath(const std::string& directory, const char* name);
+
+/**
+ * Helpers for the loaders, they return the index in import.textures.
+ */
+u32 ImportTexture(ModelImport& import, const char* filepath, TextureUsage usage = TextureUsage_Color);
+u32 ImportTextureFromMemory(ModelImport& import, const char* name, const void* data, u32 size);
+u32 ImportExistingTexture(ModelImport& import, u32 texIdx);
+
+void ModelLoadingGui(App* app);
@@ -0,0 +1,667 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "obj_loading.h"
+#include "engine.h"
+#include "hash.h"
+#include "job_system.h"
+#include "tangent_space.h"
+#include "model_loading.h"
+#include <algorithm>
+
+#define OBJ_MIN_CHUNK_SIZE  MB(1)
+#define OBJ_CHUNKS_PER_THREAD 4
+#define OBJ_MISSING_INDEX   INT32_MIN
+
+// Bits of ObjFixup::mask
+#define OBJ_RELATIVE_POSITION (1 << 0)
+#define OBJ_RELATIVE_TEXCOORD (1 << 1)
+#define OBJ_RELATIVE_NORMAL   (1 << 2)
+
+// Zero based indices into the position/uv/normal streams of the whole file
+struct ObjCorner
+{
+    i32 position;
+    i32 texCoord;
+    i32 normal;
+
+    bool operator==(const ObjCorner& other) const
+    {
+        return position == other.position && texCoord == other.texCoord && normal == other.normal;
+    }
+};
+
+struct ObjCornerHasher
+{
+    size_t operator()(const ObjCorner& corner) const
+    {
+        return (size_t)HashCombine(HashCombine((u32)corner.position, (u32)corner.texCoord), (u32)corner.normal);
+    }
+};
+
+// Negative (relative) indices can only be resolved once we know how many
+// elements the previous chunks declared
+struct ObjFixup
+{
+    u32 corner;
+    u32 mask;
+};
+
+struct ObjMaterialSwitch
+{
+    std::string name;
+    u32         firstCorner;
+};
+
+struct ObjChunk
+{
+    std::vector<vec3>              positions;
+    std::vector<vec2>              texCoords;
+    std::vector<vec3>              normals;
+    std::vector<ObjCorner>         corners; // three per triangle
+    std::vector<ObjFixup>          fixups;
+    std::vector<ObjMaterialSwitch> materialSwitches;
+    std::vector<std::string>       materialLibraries;
+};
+
+// A range of triangles of one chunk that use the same material
+struct ObjSegment
+{
+    u32 chunk;
+    u32 firstCorner;
+    u32 cornerCount;
+};
+
+struct ObjContext
+{
+    std::vector<ObjChunk> chunks;
+    std::vector<vec3>     positions;
+    std::vector<vec2>     texCoords;
+    std::vector<vec3>     normals;
+};
+
+static const f64 PowersOfTen[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool IsDigit(char c)      { return c >= '0' && c <= '9'; }
+static inline bool IsWhitespace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+static inline const char* SkipWhitespace(const char* p, const char* end)
+{
+    while (p < end && IsWhitespace(*p))
+        p++;
+    return p;
+}
+
+static inline const char* SkipToken(const char* p, const char* end)
+{
+    while (p < end && !IsWhitespace(*p))
+        p++;
+    return p;
+}
+
+// Fast path for the plain decimal numbers OBJ exporters write: the digits are
+// accumulated as an integer and scaled by an exact power of ten. Anything
+// unusual (huge exponents, inf/nan) goes through strtod.
+static const char* ParseObjFloat(const char* p, const char* end, f32& value)
+{
+    p = SkipWhitespace(p, end);
+    const char* start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    u64 mantissa = 0;
+    i32 exponent = 0;
+    u32 digits = 0;
+    bool anyDigit = false;
+
+    for (; p < end && IsDigit(*p); ++p)
+    {
+        anyDigit = true;
+        if (digits < 19) { mantissa = mantissa * 10 + (u64)(*p - '0'); digits += mantissa != 0; }
+        else             { exponent++; }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && IsDigit(*p); ++p)
+        {
+            anyDigit = true;
+            if (digits < 19) { mantissa = mantissa * 10 + (u64)(*p - '0'); digits += mantissa != 0; exponent--; }
+        }
+    }
+
+    if (anyDigit && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negativeExponent = *q++ == '-';
+
+        if (q < end && IsDigit(*q))
+        {
+            i32 exponentValue = 0;
+            for (; q < end && IsDigit(*q); ++q)
+                exponentValue = exponentValue < 10000 ? exponentValue * 10 + (*q - '0') : exponentValue;
+            exponent += negativeExponent ? -exponentValue : exponentValue;
+            p = q;
+        }
+    }
+
+    if (anyDigit && exponent >= -22 && exponent <= 22)
+    {
+        f64 result = (f64)mantissa;
+        result = exponent < 0 ? result / PowersOfTen[-exponent] : result * PowersOfTen[exponent];
+        value = (f32)(negative ? -result : result);
+        return p;
+    }
+
+    // slow path: the mapped file is not null-terminated, so copy the token
+    char token[64] = {};
+    const char* tokenEnd = SkipToken(start, end);
+    memcpy(token, start, glm::min<size_t>(tokenEnd - start, sizeof(token) - 1));
+    value = (f32)strtod(token, NULL);
+    return tokenEnd;
+}
+
+static const char* ParseObjIndex(const char* p, const char* end, i32& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    i32 result = 0;
+    for (; p < end && IsDigit(*p); ++p)
+        result = result * 10 + (*p - '0');
+
+    value = negative ? -result : result;
+    return p;
+}
+
+static inline i32 ResolveObjIndex(i32 index, u32 localCount, u32 relativeBit, u32& mask)
+{
+    if (index > 0)
+        return index - 1;
+    if (index < 0)
+    {
+        mask |= relativeBit;
+        return (i32)localCount + index; // the chunk base is added when the chunks are merged
+    }
+    return OBJ_MISSING_INDEX;
+}
+
+static std::string GetObjLineArgument(const char* p, const char* end)
+{
+    p = SkipWhitespace(p, end);
+    while (end > p && IsWhitespace(end[-1]))
+        end--;
+    return std::string(p, end);
+}
+
+static void ParseObjFace(const char* p, const char* lineEnd, ObjChunk& chunk)
+{
+    struct PolygonCorner { ObjCorner corner; u32 mask; };
+    PolygonCorner polygon[64];
+    u32 polygonSize = 0;
+
+    for (p = SkipWhitespace(p, lineEnd); p < lineEnd && polygonSize < ARRAY_COUNT(polygon); p = SkipWhitespace(p, lineEnd))
+    {
+        i32 position = 0, texCoord = 0, normal = 0;
+        p = ParseObjIndex(p, lineEnd, position);
+        if (p < lineEnd && *p == '/')
+        {
+            p = ParseObjIndex(p + 1, lineEnd, texCoord);
+            if (p < lineEnd && *p == '/')
+                p = ParseObjIndex(p + 1, lineEnd, normal);
+        }
+        p = SkipToken(p, lineEnd); // ignore anything malformed
+
+        PolygonCorner& corner = polygon[polygonSize++];
+        corner.mask = 0;
+        corner.corner.position = ResolveObjIndex(position, (u32)chunk.positions.size(), OBJ_RELATIVE_POSITION, corner.mask);
+        corner.corner.texCoord = ResolveObjIndex(texCoord, (u32)chunk.texCoords.size(), OBJ_RELATIVE_TEXCOORD, corner.mask);
+        corner.corner.normal   = ResolveObjIndex(normal,   (u32)chunk.normals.size(),   OBJ_RELATIVE_NORMAL,   corner.mask);
+    }
+
+    // triangle fan, like the Triangulate step of Assimp
+    for (u32 i = 2; i < polygonSize; ++i)
+    {
+        const PolygonCorner* triangle[3] = { &polygon[0], &polygon[i - 1], &polygon[i] };
+        for (const PolygonCorner* corner : triangle)
+        {
+            if (corner->mask)
+                chunk.fixups.push_back(ObjFixup{ (u32)chunk.corners.size(), corner->mask });
+            chunk.corners.push_back(corner->corner);
+        }
+    }
+}
+
+static void ParseObjChunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+    // rough guess to avoid most reallocations: ~30 bytes per line
+    const size_t lineEstimate = (end - begin) / 30;
+    chunk.positions.reserve(lineEstimate / 2);
+    chunk.corners.reserve(lineEstimate * 3 / 2);
+
+    for (const char* line = begin; line < end; )
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        const char* p = SkipWhitespace(line, lineEnd);
+        const size_t length = lineEnd - p;
+
+        if (length >= 2 && p[0] == 'v' && IsWhitespace(p[1]))
+        {
+            vec3 position;
+            p = ParseObjFloat(p + 2, lineEnd, position.x);
+            p = ParseObjFloat(p, lineEnd, position.y);
+            p = ParseObjFloat(p, lineEnd, position.z);
+            chunk.positions.push_back(position);
+        }
+        else if (length >= 3 && p[0] == 'v' && p[1] == 't' && IsWhitespace(p[2]))
+        {
+            vec2 texCoord;
+            p = ParseObjFloat(p + 3, lineEnd, texCoord.x);
+            p = ParseObjFloat(p, lineEnd, texCoord.y);
+            chunk.texCoords.push_back(texCoord);
+        }
+        else if (length >= 3 && p[0] == 'v' && p[1] == 'n' && IsWhitespace(p[2]))
+        {
+            vec3 normal;
+            p = ParseObjFloat(p + 3, lineEnd, normal.x);
+            p = ParseObjFloat(p, lineEnd, normal.y);
+            p = ParseObjFloat(p, lineEnd, normal.z);
+            chunk.normals.push_back(normal);
+        }
+        else if (length >= 2 && p[0] == 'f' && IsWhitespace(p[1]))
+        {
+            ParseObjFace(p + 2, lineEnd, chunk);
+        }
+        else if (length >= 7 && strncmp(p, "usemtl", 6) == 0 && IsWhitespace(p[6]))
+        {
+            chunk.materialSwitches.push_back(ObjMaterialSwitch{ GetObjLineArgument(p + 7, lineEnd), (u32)chunk.corners.size() });
+        }
+        else if (length >= 7 && strncmp(p, "mtllib", 6) == 0 && IsWhitespace(p[6]))
+        {
+            chunk.materialLibraries.push_back(GetObjLineArgument(p + 7, lineEnd));
+        }
+        // o, g, s, l, comments... are not needed for a flattened model
+
+        line = lineEnd + 1;
+    }
+}
+
+static u32 LoadObjTexture(ModelImport& import, const std::string& directory, const char* p, const char* end, TextureUsage usage = TextureUsage_Color)
+{
+    // the file name is the last argument, anything before it are options (-bm 1.0, -clamp on...)
+    while (end > p && IsWhitespace(end[-1]))
+        end--;
+    const char* name = end;
+    while (name > p && !IsWhitespace(name[-1]))
+        name--;
+
+    std::string filepath = MakeModelPath(directory, std::string(name, end).c_str());
+    return ImportTexture(import, filepath.c_str(), usage);
+}
+
+static void LoadObjMaterialLibrary(ModelImport& import, const std::string& directory, const std::string& libraryName,
+                                   std::unordered_map<std::string, u32>& materials)
+{
+    std::string filepath = MakeModelPath(directory, libraryName.c_str());
+    if (std::find(import.dependencies.begin(), import.dependencies.end(), filepath) == import.dependencies.end())
+        import.dependencies.push_back(filepath);
+
+    AssetFile file = OpenAsset(filepath.c_str());
+    if (file.data == NULL)
+    {
+        ELOG("LoadObjModel() - Could not open material library %s", filepath.c_str());
+        return;
+    }
+
+    const char* begin = (const char*)file.data;
+    const char* end = begin + file.size;
+    std::vector<Material> libraryMaterials;
+    Material* material = NULL;
+
+    for (const char* line = begin; line < end; )
+    {
+        const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+        if (lineEnd == NULL)
+            lineEnd = end;
+
+        const char* p = SkipWhitespace(line, lineEnd);
+        const char* keywordEnd = SkipToken(p, lineEnd);
+        std::string keyword(p, keywordEnd);
+
+        if (keyword == "newmtl")
+        {
+            libraryMaterials.push_back(Material{});
+            material = &libraryMaterials.back();
+            material->name = GetObjLineArgument(keywordEnd, lineEnd);
+        }
+        else if (material != NULL)
+        {
+            if (keyword == "Kd")
+            {
+                p = ParseObjFloat(keywordEnd, lineEnd, material->albedo.r);
+                p = ParseObjFloat(p, lineEnd, material->albedo.g);
+                p = ParseObjFloat(p, lineEnd, material->albedo.b);
+            }
+            else if (keyword == "Ke")
+            {
+                p = ParseObjFloat(keywordEnd, lineEnd, material->emissive.r);
+                p = ParseObjFloat(p, lineEnd, material->emissive.g);
+                p = ParseObjFloat(p, lineEnd, material->emissive.b);
+            }
+            else if (keyword == "Ns")
+            {
+                f32 shininess = 0.0f;
+                ParseObjFloat(keywordEnd, lineEnd, shininess);
+                material->smoothness = shininess / 256.0f; // same mapping as ProcessAssimpMaterial
+            }
+            // same texture slots Assimp fills for OBJ materials
+            else if (keyword == "map_Kd")                                              material->albedoTextureIdx = LoadObjTexture(import, directory, keywordEnd, lineEnd);
+            else if (keyword == "map_Ke")                                              material->emissiveTextureIdx = LoadObjTexture(import, directory, keywordEnd, lineEnd);
+            else if (keyword == "map_Ks")                                              material->specularTextureIdx = LoadObjTexture(import, directory, keywordEnd, lineEnd);
+            else if (keyword == "norm" || keyword == "map_Kn")                         material->normalsTextureIdx = LoadObjTexture(import, directory, keywordEnd, lineEnd, TextureUsage_Normal);
+            else if (keyword == "map_Bump" || keyword == "map_bump" || keyword == "bump") material->bumpTextureIdx = LoadObjTexture(import, directory, keywordEnd, lineEnd, TextureUsage_Height);
+        }
+
+        line = lineEnd + 1;
+    }
+
+    CloseAsset(file);
+
+    for (const Material& libraryMaterial : libraryMaterials)
+    {
+        materials[libraryMaterial.name] = (u32)import.materials.size();
+        import.materials.push_back(libraryMaterial);
+    }
+}
+
+// Returns the number of triangles dropped because of out of range indices
+static u32 BuildObjSubmesh(const ObjContext& ctx, const std::vector<ObjSegment>& segments, Submesh& submesh)
+{
+    const bool hasTexCoords = !ctx.texCoords.empty();
+    const i32 positionCount = (i32)ctx.positions.size();
+    const i32 texCoordCount = (i32)ctx.texCoords.size();
+    const i32 normalCount   = (i32)ctx.normals.size();
+
+    u32 cornerCount = 0;
+    for (const ObjSegment& segment : segments)
+        cornerCount += segment.cornerCount;
+
+    // de-duplicate the index triples
+    std::unordered_map<ObjCorner, u32, ObjCornerHasher> vertexMap;
+    vertexMap.reserve(cornerCount / 2);
+    std::vector<ObjCorner> uniqueCorners;
+    std::vector<u32> indices;
+    indices.reserve(cornerCount);
+    u32 droppedTriangles = 0;
+
+    for (const ObjSegment& segment : segments)
+    {
+        const ObjCorner* corners = ctx.chunks[segment.chunk].corners.data() + segment.firstCorner;
+        for (u32 i = 0; i + 2 < segment.cornerCount; i += 3)
+        {
+            ObjCorner triangle[3] = { corners[i], corners[i + 1], corners[i + 2] };
+
+            bool valid = true;
+            for (ObjCorner& corner : triangle)
+            {
+                valid = valid && corner.position >= 0 && corner.position < positionCount;
+                if (corner.texCoord < 0 || corner.texCoord >= texCoordCount) corner.texCoord = OBJ_MISSING_INDEX;
+                if (corner.normal   < 0 || corner.normal   >= normalCount)   corner.normal   = OBJ_MISSING_INDEX;
+            }
+            if (!valid)
+            {
+                droppedTriangles++;
+                continue;
+            }
+
+            for (const ObjCorner& corner : triangle)
+            {
+                auto it = vertexMap.find(corner);
+                if (it == vertexMap.end())
+                {
+                    it = vertexMap.emplace(corner, (u32)uniqueCorners.size()).first;
+                    uniqueCorners.push_back(corner);
+                }
+                indices.push_back(it->second);
+            }
+        }
+    }
+
+    // gather the attributes of the unique vertices
+    const u32 vertexCount = (u32)uniqueCorners.size();
+    std::vector<vec3> positions(vertexCount);
+    std::vector<vec3> normals(vertexCount);
+    std::vector<vec2> texCoords(vertexCount, vec2(0.0f));
+    bool missingNormals = false;
+
+    submesh.boundsMin = vec3( FLT_MAX);
+    submesh.boundsMax = vec3(-FLT_MAX);
+    for (u32 i = 0; i < vertexCount; ++i)
+    {
+        const ObjCorner& corner = uniqueCorners[i];
+        positions[i] = ctx.positions[corner.position];
+        submesh.boundsMin = glm::min(submesh.boundsMin, positions[i]);
+        submesh.boundsMax = glm::max(submesh.boundsMax, positions[i]);
+
+        if (corner.texCoord != OBJ_MISSING_INDEX)
+            texCoords[i] = ctx.texCoords[corner.texCoord];
+
+        if (corner.normal != OBJ_MISSING_INDEX)
+            normals[i] = ctx.normals[corner.normal];
+        else
+            missingNormals = true;
+    }
+
+    if (missingNormals)
+    {
+        std::vector<vec3> smoothNormals;
+        GenerateNormals(positions, indices, smoothNormals);
+        for (u32 i = 0; i < vertexCount; ++i)
+            if (uniqueCorners[i].normal == OBJ_MISSING_INDEX)
+                normals[i] = smoothNormals[i];
+    }
+
+    std::vector<vec4> tangents;
+    if (hasTexCoords)
+        GenerateTangents(positions, normals, texCoords, indices, tangents);
+
+    // same interleaved layout as ProcessAssimpMesh
+    VertexBufferLayout& layout = submesh.vertexBufferLayout;
+    layout.attributes.push_back(VertexBufferAttribute{ 0, 3, 0 });
+    layout.attributes.push_back(VertexBufferAttribute{ 1, 3, 3 * sizeof(float) });
+    layout.stride = 6 * sizeof(float);
+    if (hasTexCoords)
+    {
+        layout.attributes.push_back(VertexBufferAttribute{ 2, 2, 6 * sizeof(float) });
+        layout.attributes.push_back(VertexBufferAttribute{ 3, 3, 8 * sizeof(float) });
+        layout.attributes.push_back(VertexBufferAttribute{ 4, 3, 11 * sizeof(float) });
+        layout.stride = 14 * sizeof(float);
+    }
+
+    const u32 floatsPerVertex = layout.stride / sizeof(float);
+    submesh.vertices.resize(vertexCount * floatsPerVertex);
+    float* dst = submesh.vertices.data();
+    for (u32 i = 0; i < vertexCount; ++i, dst += floatsPerVertex)
+    {
+        memcpy(dst + 0, &positions[i], sizeof(vec3));
+        memcpy(dst + 3, &normals[i], sizeof(vec3));
+        if (hasTexCoords)
+        {
+            // the engine stores the bitangent pointing towards decreasing v,
+            // like the (flipped) Assimp bitangents
+            vec3 tangent(tangents[i]);
+            vec3 bitangent = -glm::cross(normals[i], tangent) * tangents[i].w;
+            memcpy(dst + 6, &texCoords[i], sizeof(vec2));
+            memcpy(dst + 8, &tangent, sizeof(vec3));
+            memcpy(dst + 11, &bitangent, sizeof(vec3));
+        }
+    }
+
+    submesh.indices = std::move(indices);
+    return droppedTriangles;
+}
+
+bool LoadObjModel(ModelImport& import, const char* filename)
+{
+    AssetFile file = OpenAsset(filename);
+    if (file.data == NULL)
+    {
+        ELOG("Error loading mesh %s: could not open the file", filename);
+        return false;
+    }
+
+    const char* text = (const char*)file.data;
+    const u64 size = file.size;
+
+    // Split the file in chunks that start at the beginning of a line
+    u64 chunkCount = glm::clamp<u64>(size / OBJ_MIN_CHUNK_SIZE, 1, GetJobThreadCount() * OBJ_CHUNKS_PER_THREAD);
+    std::vector<u64> chunkStarts(chunkCount + 1, size);
+    chunkStarts[0] = 0;
+    for (u64 i = 1; i < chunkCount; ++i)
+    {
+        u64 start = glm::max(size * i / chunkCount, chunkStarts[i - 1]);
+        const char* newline = (const char*)memchr(text + start, '\n', size - start);
+        chunkStarts[i] = newline ? (u64)(newline - text) + 1 : size;
+    }
+
+    ObjContext ctx;
+    ctx.chunks.resize(chunkCount);
+
+    ParallelFor((u32)chunkCount, [&](u32 i)
+    {
+        ParseObjChunk(text + chunkStarts[i], text + chunkStarts[i + 1], ctx.chunks[i]);
+    });
+
+    // Merge the vertex streams
+    std::vector<u32> positionBases(chunkCount), texCoordBases(chunkCount), normalBases(chunkCount);
+    u32 positionCount = 0, texCoordCount = 0, normalCount = 0;
+    for (u64 i = 0; i < chunkCount; ++i)
+    {
+        positionBases[i] = positionCount; positionCount += (u32)ctx.chunks[i].positions.size();
+        texCoordBases[i] = texCoordCount; texCoordCount += (u32)ctx.chunks[i].texCoords.size();
+        normalBases[i]   = normalCount;   normalCount   += (u32)ctx.chunks[i].normals.size();
+    }
+
+    ctx.positions.resize(positionCount);
+    ctx.texCoords.resize(texCoordCount);
+    ctx.normals.resize(normalCount);
+
+    ParallelFor((u32)chunkCount, [&](u32 i)
+    {
+        ObjChunk& chunk = ctx.chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), ctx.positions.begin() + positionBases[i]);
+        std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), ctx.texCoords.begin() + texCoordBases[i]);
+        std::copy(chunk.normals.begin(),   chunk.normals.end(),   ctx.normals.begin()   + normalBases[i]);
+        std::vector<vec3>().swap(chunk.positions);
+        std::vector<vec2>().swap(chunk.texCoords);
+        std::vector<vec3>().swap(chunk.normals);
+
+        for (const ObjFixup& fixup : chunk.fixups)
+        {
+            ObjCorner& corner = chunk.corners[fixup.corner];
+            if (fixup.mask & OBJ_RELATIVE_POSITION) corner.position += (i32)positionBases[i];
+            if (fixup.mask & OBJ_RELATIVE_TEXCOORD) corner.texCoord += (i32)texCoordBases[i];
+            if (fixup.mask & OBJ_RELATIVE_NORMAL)   corner.normal   += (i32)normalBases[i];
+        }
+    });
+
+    CloseAsset(file);
+
+    // Materials
+    std::string directory = GetModelDirectory(filename);
+    std::unordered_map<std::string, u32> materials;
+    std::vector<std::string> loadedLibraries;
+    for (const ObjChunk& chunk : ctx.chunks)
+    {
+        for (const std::string& library : chunk.materialLibraries)
+        {
+            if (std::find(loadedLibraries.begin(), loadedLibraries.end(), library) == loadedLibraries.end())
+            {
+                LoadObjMaterialLibrary(import, directory, library, materials);
+                loadedLibraries.push_back(library);
+            }
+        }
+    }
+
+    // Group the triangles by material, one submesh per material
+    std::unordered_map<std::string, u32> submeshByMaterial;
+    std::vector<std::string> submeshMaterials;
+    std::vector<std::vector<ObjSegment>> submeshSegments;
+    std::string currentMaterial;
+
+    for (u32 i = 0; i < chunkCount; ++i)
+    {
+        const ObjChunk& chunk = ctx.chunks[i];
+        u32 segmentStart = 0;
+
+        for (u32 s = 0; s <= chunk.materialSwitches.size(); ++s)
+        {
+            u32 segmentEnd = s < chunk.materialSwitches.size() ? chunk.materialSwitches[s].firstCorner : (u32)chunk.corners.size();
+            if (segmentEnd > segmentStart)
+            {
+                auto it = submeshByMaterial.find(currentMaterial);
+                if (it == submeshByMaterial.end())
+                {
+                    it = submeshByMaterial.emplace(currentMaterial, (u32)submeshMaterials.size()).first;
+                    submeshMaterials.push_back(currentMaterial);
+                    submeshSegments.push_back(std::vector<ObjSegment>());
+                }
+                submeshSegments[it->second].push_back(ObjSegment{ i, segmentStart, segmentEnd - segmentStart });
+            }
+
+            if (s < chunk.materialSwitches.size())
+                currentMaterial = chunk.materialSwitches[s].name;
+            segmentStart = segmentEnd;
+        }
+    }
+
+    Mesh& mesh = import.mesh;
+
+    u32 defaultMaterialIdx = UINT32_MAX;
+    for (const std::string& materialName : submeshMaterials)
+    {
+        auto it = materials.find(materialName);
+        if (it != materials.end())
+        {
+            import.materialIdx.push_back(it->second);
+            continue;
+        }
+
+        // faces without (known) material, Assimp also gives them a default one
+        if (defaultMaterialIdx == UINT32_MAX)
+        {
+            Material defaultMaterial = {};
+            defaultMaterial.name = "DefaultMaterial";
+            defaultMaterial.albedo = vec3(0.6f);
+            defaultMaterialIdx = (u32)import.materials.size();
+            import.materials.push_back(defaultMaterial);
+        }
+        import.materialIdx.push_back(defaultMaterialIdx);
+    }
+
+    // De-duplicate and build every submesh in parallel
+    mesh.submeshes.resize(submeshSegments.size());
+    std::vector<u32> droppedTriangles(submeshSegments.size());
+
+    ParallelFor((u32)submeshSegments.size(), [&](u32 i)
+    {
+        droppedTriangles[i] = BuildObjSubmesh(ctx, submeshSegments[i], mesh.submeshes[i]);
+    });
+
+    for (u32 i = 0; i < droppedTriangles.size(); ++i)
+        if (droppedTriangles[i] > 0)
+            ELOG("LoadObjModel() - %s: dropped %u triangles with invalid indices", filename, droppedTriangles[i]);
+
+    return true;
+}
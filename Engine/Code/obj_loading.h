@@ -0,0 +1,11 @@
+#pragma once
+
+struct ModelImport;
+
+/**
+ * Native Wavefront OBJ/MTL loader for large files. The file is memory mapped
+ * and split into newline-aligned chunks that are parsed in parallel, then the
+ * position/uv/normal index triples of each material are de-duplicated into
+ * one submesh. The result is equivalent to a flattened Assimp import.
+ */
+bool LoadObjModel(ModelImport& import, const char* filename);
@@ -12,13 +12,18 @@
 #else
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
 #endif
 
 #include "engine.h"
+#include "job_system.h"
 
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <string.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
@@ -116,13 +121,19 @@ void OnGlfwCloseWindow(GLFWwindow* window)
     app->isRunning = false;
 }
 
-int main()
+// The Cooker target has its own main (see cooker.cpp)
+#ifndef ENGINE_COOKER
+int main(int argc, char** argv)
 {
     App app         = {};
     app.deltaTime   = 1.0f/60.0f;
     app.displaySize = ivec2(WINDOW_WIDTH, WINDOW_HEIGHT);
     app.isRunning   = true;
 
+    for (int i = 1; i < argc; ++i)
+        if (strcmp(argv[i], "--warmup-programs") == 0)
+            app.warmupPrograms = true;
+
 		glfwSetErrorCallback(OnGlfwError);
 
     if (!glfwInit())
@@ -201,6 +212,8 @@ int main()
 
     GlobalFrameArenaMemory = (u8*)malloc(GLOBAL_FRAME_ARENA_SIZE);
 
+    InitJobSystem();
+
     Init(&app);
 
     while (app.isRunning)
@@ -264,6 +277,8 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    ShutdownJobSystem();
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -275,6 +290,7 @@ int main()
 
     return 0;
 }
+#endif // ENGINE_COOKER
 
 u32 Strlen(const char* string)
 {
@@ -377,6 +393,81 @@ String ReadTextFile(const char* filepath)
     return fileText;
 }
 
+MappedFile MapFile(const char* filepath)
+{
+    MappedFile file = {};
+
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == NULL)
+    {
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.data = (const u8*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (file.data == NULL)
+    {
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+        return file;
+    }
+
+    file.size = (u64)fileSize.QuadPart;
+    file.fileHandle = fileHandle;
+    file.mappingHandle = mappingHandle;
+#else
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return file;
+
+    struct stat attrib;
+    if (fstat(fd, &attrib) != 0 || attrib.st_size == 0)
+    {
+        close(fd);
+        return file;
+    }
+
+    void* data = mmap(NULL, attrib.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+
+    if (data == MAP_FAILED)
+        return file;
+
+    file.data = (const u8*)data;
+    file.size = (u64)attrib.st_size;
+#endif
+
+    return file;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (file.data == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(file.data);
+    CloseHandle((HANDLE)file.mappingHandle);
+    CloseHandle((HANDLE)file.fileHandle);
+#else
+    munmap((void*)file.data, file.size);
+#endif
+
+    file = MappedFile{};
+}
+
 u64 GetFileLastWriteTimestamp(const char* filepath)
 {
 #ifdef _WIN32
@@ -401,6 +492,58 @@ u64 GetFileLastWriteTimestamp(const char* filepath)
     return 0;
 }
 
+void ListFiles(const char* directory, std::vector<std::string>& filepaths)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE findHandle = FindFirstFileA((std::string(directory) + "/*").c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        if (strcmp(findData.cFileName, ".") == 0 || strcmp(findData.cFileName, "..") == 0)
+            continue;
+
+        std::string filepath = std::string(directory) + "/" + findData.cFileName;
+        if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            ListFiles(filepath.c_str(), filepaths);
+        else
+            filepaths.push_back(filepath);
+    }
+    while (FindNextFileA(findHandle, &findData));
+
+    FindClose(findHandle);
+#else
+    DIR* dir = opendir(directory);
+    if (dir == NULL)
+        return;
+
+    while (struct dirent* entry = readdir(dir))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        std::string filepath = std::string(directory) + "/" + entry->d_name;
+        struct stat attrib;
+        if (stat(filepath.c_str(), &attrib) != 0)
+            continue;
+
+        if (S_ISDIR(attrib.st_mode))
+            ListFiles(filepath.c_str(), filepaths);
+        else
+            filepaths.push_back(filepath);
+    }
+
+    closedir(dir);
+#endif
+}
+
+void* GetGLProcAddress(const char* name)
+{
+    return (void*)glfwGetProcAddress(name);
+}
+
 void LogString(const char* str)
 {
 #ifdef _WIN32
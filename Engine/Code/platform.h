@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
+#include <float.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -77,12 +78,43 @@ String GetDirectoryPart(String path);
  */
 String ReadTextFile(const char *filepath);
 
+/**
+ * Read-only memory mapping of a whole file. The contents are paged in by the OS
+ * on demand, so it is the cheapest way to read large binary assets.
+ */
+struct MappedFile
+{
+    const u8* data;
+    u64       size;
+    void*     fileHandle;
+    void*     mappingHandle;
+};
+
+/**
+ * Maps a file in memory. On failure the returned data pointer is NULL.
+ */
+MappedFile MapFile(const char *filepath);
+
+void UnmapFile(MappedFile& file);
+
 /**
  * It retrieves a timestamp indicating the last time the file was modified.
  * Can be useful in order to check for file modifications to implement hot reloads.
  */
 u64 GetFileLastWriteTimestamp(const char *filepath);
 
+/**
+ * Appends the paths of every file under a directory and its subdirectories,
+ * joined with forward slashes.
+ */
+void ListFiles(const char *directory, std::vector<std::string>& filepaths);
+
+/**
+ * Address of an OpenGL function glad does not load, such as those of extensions.
+ * NULL if the driver does not export it.
+ */
+void* GetGLProcAddress(const char* name);
+
 /**
  * It logs a string to whichever outputs are configured in the platform layer.
  * By default, the string is printed in the output console of VisualStudio.
@@ -0,0 +1,745 @@
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "programs.h"
+#include "engine.h"
+#include "hash.h"
+#include "shader_cooker.h"
+#include "uniform_blocks.h"
+#include <imgui.h>
+#include <algorithm>
+#include <map>
+
+// GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile share the token
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static const u32 ReliefStepBuckets[] = { 8, 16, 32, 64 };
+
+u32 QuantizeReliefSteps(u32 steps)
+{
+    for (u32 bucket : ReliefStepBuckets)
+        if (steps <= bucket)
+            return bucket;
+    return ReliefStepBuckets[ARRAY_COUNT(ReliefStepBuckets) - 1];
+}
+
+std::string GetProgramPreamble(const char* programName, u32 features)
+{
+    static const char* const FeatureDefines[] = { "NORMAL_MAP", "RELIEF_MAP", "NO_TEXTURE", "BINDLESS_TEXTURES" };
+
+    char define[128];
+    std::string preamble = PROGRAM_GLSL_VERSION;
+    if (features & ProgramFeature_Bindless)
+        preamble += "#extension GL_ARB_bindless_texture : require\n"; // before any other token
+    sprintf(define, "#define %s\n", programName);
+    preamble += define;
+
+    for (u32 i = 0; i < ARRAY_COUNT(FeatureDefines); ++i)
+    {
+        if (features & (1u << i))
+        {
+            sprintf(define, "#define %s\n", FeatureDefines[i]);
+            preamble += define;
+        }
+    }
+
+    if (u32 reliefSteps = features >> PROGRAM_RELIEF_STEPS_SHIFT)
+    {
+        sprintf(define, "#define RELIEF_STEPS %u\n", reliefSteps);
+        preamble += define;
+    }
+    return preamble;
+}
+
+static ProgramBuild StartProgramBuild(const char* source, u32 sourceLength, const char* shaderName, u32 features)
+{
+    std::string preamble = GetProgramPreamble(shaderName, features);
+    char vertexShaderDefine[] = "#define VERTEX\n";
+    char fragmentShaderDefine[] = "#define FRAGMENT\n";
+
+    const GLchar* vertexShaderSource[] = {
+        preamble.c_str(),
+        vertexShaderDefine,
+        source
+    };
+    const GLint vertexShaderLengths[] = {
+        (GLint) preamble.size(),
+        (GLint) strlen(vertexShaderDefine),
+        (GLint) sourceLength
+    };
+    const GLchar* fragmentShaderSource[] = {
+        preamble.c_str(),
+        fragmentShaderDefine,
+        source
+    };
+    const GLint fragmentShaderLengths[] = {
+        (GLint) preamble.size(),
+        (GLint) strlen(fragmentShaderDefine),
+        (GLint) sourceLength
+    };
+
+    // Nothing here queries a status, so with parallel compilation none of it blocks
+    ProgramBuild build = {};
+    build.startTime = std::chrono::steady_clock::now();
+
+    build.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(build.vertexShader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
+    glCompileShader(build.vertexShader);
+
+    build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(build.fragmentShader, ARRAY_COUNT(fragmentShaderSource), fragmentShaderSource, fragmentShaderLengths);
+    glCompileShader(build.fragmentShader);
+
+    build.handle = glCreateProgram();
+    glProgramParameteri(build.handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); // for the snapshot
+    glAttachShader(build.handle, build.vertexShader);
+    glAttachShader(build.handle, build.fragmentShader);
+    glLinkProgram(build.handle);
+
+    return build;
+}
+
+static bool IsProgramBuildDone(App* app, const ProgramBuild& build)
+{
+    // Without the extension the status queries in FinishProgramBuild wait for the driver
+    if (!app->programReload.parallelCompile)
+        return true;
+
+    GLint done = GL_FALSE;
+    glGetProgramiv(build.handle, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+// Logs the errors and deletes the shaders. Returns whether the program linked.
+static bool FinishProgramBuild(ProgramBuild& build, const char* shaderName)
+{
+    GLchar  infoLogBuffer[1024] = {};
+    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+    GLsizei infoLogSize;
+    GLint   success;
+
+    glGetShaderiv(build.vertexShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(build.vertexShader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glCompileShader() failed with vertex shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    glGetShaderiv(build.fragmentShader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(build.fragmentShader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    GLint linked;
+    glGetProgramiv(build.handle, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        glGetProgramInfoLog(build.handle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    glDetachShader(build.handle, build.vertexShader);
+    glDetachShader(build.handle, build.fragmentShader);
+    glDeleteShader(build.vertexShader);
+    glDeleteShader(build.fragmentShader);
+    build.vertexShader = 0;
+    build.fragmentShader = 0;
+
+    return linked == GL_TRUE;
+}
+
+static void QueryVertexInputLayout(Program& program)
+{
+    program.vertexInputLayout.attributes.clear();
+
+    // By location rather than by name, which SPIR-V programs may not have
+    GLint attributeCount = 0;
+    glGetProgramInterfaceiv(program.handle, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &attributeCount);
+
+    const GLenum properties[] = { GL_LOCATION, GL_ARRAY_SIZE };
+    for (GLint i = 0; i < attributeCount; ++i)
+    {
+        GLint values[ARRAY_COUNT(properties)] = {};
+        glGetProgramResourceiv(program.handle, GL_PROGRAM_INPUT, i, ARRAY_COUNT(properties), properties, ARRAY_COUNT(values), NULL, values);
+
+        // Built-ins such as gl_VertexID have no location
+        if (values[0] >= 0)
+            program.vertexInputLayout.attributes.push_back({ (u8)values[0], (u8)values[1] });
+    }
+}
+
+void QueryProgramUniforms(Program& program)
+{
+    program.uniformMaterialIdx = glGetUniformLocation(program.handle, "uMaterialIdx");
+    program.uniformTextureSlots = glGetUniformLocation(program.handle, "uTextureSlots");
+    program.uniformBumpiness = glGetUniformLocation(program.handle, "uBumpiness");
+    program.uniformVirtualTexture = glGetUniformLocation(program.handle, "uVirtualTexture");
+    program.uniformFeedbackOffset = glGetUniformLocation(program.handle, "uFeedbackOffset");
+}
+
+static std::string ReadProgramSource(const char* filepath)
+{
+    AssetFile file = OpenAsset(filepath);
+    std::string source;
+    if (file.data)
+        source.assign((const char*)file.data, (size_t)file.size);
+    else
+        ELOG("Could not open program file %s", filepath);
+    CloseAsset(file);
+    return source;
+}
+
+u64 GetProgramCacheKey(App* app, const char* source, u32 sourceLength, const char* programName, u32 features)
+{
+    std::string preamble = GetProgramPreamble(programName, features);
+
+    u64 key = HashBytes(preamble.data(), preamble.size(), PROGRAM_CACHE_VERSION);
+    key = HashCombine(key, HashBytes(source, sourceLength));
+    key = HashCombine(key, HashBytes(app->glInfo.vendor.data(), app->glInfo.vendor.size()));
+    key = HashCombine(key, HashBytes(app->glInfo.renderer.data(), app->glInfo.renderer.size()));
+    return HashCombine(key, HashBytes(app->glInfo.version.data(), app->glInfo.version.size()));
+}
+
+static std::string GetProgramCachePath(u64 key)
+{
+    char path[64];
+    sprintf(path, PROGRAM_CACHE_DIRECTORY "/%016llx.bin", (unsigned long long)key);
+    return path;
+}
+
+static const ProgramCacheHeader* MapCachedProgram(u64 key, MappedFile& file)
+{
+    file = MapFile(GetProgramCachePath(key).c_str());
+    if (!file.data)
+        return NULL;
+
+    const ProgramCacheHeader* header = (const ProgramCacheHeader*)file.data;
+    bool valid = file.size >= sizeof(ProgramCacheHeader) &&
+                 header->magic == PROGRAM_CACHE_MAGIC &&
+                 header->version == PROGRAM_CACHE_VERSION &&
+                 header->key == key &&
+                 file.size == sizeof(ProgramCacheHeader) + header->binarySize;
+    if (!valid)
+    {
+        UnmapFile(file);
+        return NULL;
+    }
+    return header;
+}
+
+// Creates the program from its cached binary. Returns 0 on a miss.
+static GLuint LoadCachedProgram(App* app, u64 key)
+{
+    ProgramCache& cache = app->programCache;
+    if (!cache.enabled)
+        return 0;
+
+    MappedFile file;
+    const ProgramCacheHeader* header = MapCachedProgram(key, file);
+    if (!header)
+    {
+        cache.misses++;
+        return 0;
+    }
+
+    const u8* binary = file.data + sizeof(ProgramCacheHeader);
+    GLint success = GL_FALSE;
+    GLuint handle = 0;
+    if (HashBytes(binary, header->binarySize) == header->binaryHash)
+    {
+        handle = glCreateProgram();
+        glProgramParameteri(handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); // for the snapshot
+        glProgramBinary(handle, header->binaryFormat, binary, (GLsizei)header->binarySize);
+        glGetProgramiv(handle, GL_LINK_STATUS, &success);
+    }
+    UnmapFile(file);
+
+    // Drivers may reject their own binaries after an update that kept the version string
+    if (!success)
+    {
+        if (handle)
+            glDeleteProgram(handle);
+        remove(GetProgramCachePath(key).c_str());
+        cache.rejected++;
+        cache.misses++;
+        return 0;
+    }
+
+    cache.hits++;
+    return handle;
+}
+
+static void WriteCachedProgram(App* app, u64 key, GLuint handle)
+{
+    ProgramCache& cache = app->programCache;
+    if (!cache.enabled)
+        return;
+
+    GLint binarySize = 0;
+    glGetProgramiv(handle, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if (binarySize <= 0)
+        return;
+
+    std::vector<u8> data(sizeof(ProgramCacheHeader) + binarySize);
+    GLenum binaryFormat;
+    GLsizei length = 0;
+    glGetProgramBinary(handle, binarySize, &length, &binaryFormat, data.data() + sizeof(ProgramCacheHeader));
+
+    ProgramCacheHeader header = {};
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.binaryFormat = binaryFormat;
+    header.binarySize = (u32)length;
+    header.binaryHash = HashBytes(data.data() + sizeof(ProgramCacheHeader), length);
+    memcpy(data.data(), &header, sizeof(header));
+    data.resize(sizeof(ProgramCacheHeader) + length);
+
+    // Written aside and renamed, so an interrupted write never looks like a valid binary
+    std::string path = GetProgramCachePath(key);
+    std::string tmpPath = path + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (file)
+        written = fclose(file) == 0 && written;
+
+    remove(path.c_str());
+    if (!written || rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        ELOG("Could not write program binary %s", path.c_str());
+        remove(tmpPath.c_str());
+        return;
+    }
+    cache.writes++;
+}
+
+bool HasGLExtension(App* app, const char* name)
+{
+    for (const std::string& extension : app->glInfo.extensions)
+        if (extension == name)
+            return true;
+    return false;
+}
+
+void InitPrograms(App* app)
+{
+    ProgramReload& reload = app->programReload;
+
+    const char* maxThreadsName = NULL;
+    if (HasGLExtension(app, "GL_KHR_parallel_shader_compile"))
+        maxThreadsName = "glMaxShaderCompilerThreadsKHR";
+    else if (HasGLExtension(app, "GL_ARB_parallel_shader_compile"))
+        maxThreadsName = "glMaxShaderCompilerThreadsARB";
+
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = NULL;
+    if (maxThreadsName)
+        maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)GetGLProcAddress(maxThreadsName);
+
+    // As many threads as the driver sees fit
+    if (maxShaderCompilerThreads)
+        maxShaderCompilerThreads(0xFFFFFFFF);
+    reload.parallelCompile = maxShaderCompilerThreads != NULL;
+
+    GLint binaryFormatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+    app->programCache.enabled = binaryFormatCount > 0;
+    app->programCache.spirv = InitSpirvPrograms(app);
+
+    // Fails harmlessly if it is already there
+#ifdef _WIN32
+    _mkdir(PROGRAM_CACHE_DIRECTORY);
+#else
+    mkdir(PROGRAM_CACHE_DIRECTORY, 0755);
+#endif
+}
+
+GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+{
+    ProgramBuild build = StartProgramBuild(programSource.str, programSource.len, shaderName, 0);
+    FinishProgramBuild(build, shaderName);
+    return build.handle;
+}
+
+// From the cache, or from cooked SPIR-V, which is added to it. Returns 0 when
+// the program has to be compiled.
+static GLuint LoadProgramBinary(App* app, u64 key, const std::string& source, const char* filepath, const char* programName, u32 features)
+{
+    GLuint handle = LoadCachedProgram(app, key);
+    if (!handle && app->programCache.spirv)
+    {
+        // Cooked by the Cooker, see shader_cooker.h
+        handle = LoadSpirvProgram(app, filepath, HashBytes(source.data(), source.size()), programName, features);
+        if (handle)
+        {
+            app->programCache.spirvLoads++;
+            WriteCachedProgram(app, key, handle);
+        }
+    }
+    return handle;
+}
+
+static u32 AddProgram(App* app, GLuint handle, const char* filepath, const char* programName, u32 features)
+{
+    Program program = {};
+    program.handle = handle;
+    program.filepath = filepath;
+    program.programName = programName;
+    program.features = features;
+    QueryVertexInputLayout(program);
+    QueryProgramUniforms(program);
+    if (program.handle)
+        CheckProgramBlocks(program.handle, programName);
+
+    app->programs.push_back(program);
+    return app->programs.size() - 1;
+}
+
+u32 LoadProgram(App* app, const char* filepath, const char* programName, u32 features)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    // Edits of the loose file are picked up by the watcher, see StartProgramWatcher
+    std::string source = ReadProgramSource(filepath);
+    u64 key = GetProgramCacheKey(app, source.c_str(), (u32)source.size(), programName, features);
+
+    GLuint handle = LoadProgramBinary(app, key, source, filepath, programName, features);
+    if (!handle)
+    {
+        ProgramBuild build = StartProgramBuild(source.c_str(), (u32)source.size(), programName, features);
+        if (FinishProgramBuild(build, programName))
+            WriteCachedProgram(app, key, build.handle);
+        handle = build.handle;
+    }
+    u32 programIdx = AddProgram(app, handle, filepath, programName, features);
+
+    app->programCache.loadMs += (f32)std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return programIdx;
+}
+
+static u64 GetProgramVariantKey(const Program& program, u32 features)
+{
+    u64 key = HashBytes(program.filepath.data(), program.filepath.size());
+    key = HashCombine(key, HashBytes(program.programName.data(), program.programName.size()));
+    return HashCombine(key, features);
+}
+
+u32 GetProgramVariant(App* app, u32 programIdx, u32 features)
+{
+    const Program& program = app->programs[programIdx];
+    if (program.features == features)
+        return programIdx;
+
+    u64 key = GetProgramVariantKey(program, features);
+    auto it = app->programVariants.find(key);
+    if (it != app->programVariants.end())
+        return it->second;
+
+    ProgramReload& reload = app->programReload;
+    for (const ProgramBuild& build : reload.pendingVariants)
+        if (build.variantKey == key)
+            return programIdx;
+
+    // Restored from the snapshot, or the first time it is drawn with
+    for (u32 i = 0; i < app->programs.size(); ++i)
+    {
+        const Program& other = app->programs[i];
+        if (other.features == features && other.programName == program.programName && other.filepath == program.filepath)
+        {
+            app->programVariants[key] = i;
+            return i;
+        }
+    }
+
+    // Binaries load within the frame, compiling is left to the driver threads
+    auto start = std::chrono::steady_clock::now();
+    std::string filepath = program.filepath;
+    std::string programName = program.programName;
+    std::string source = ReadProgramSource(filepath.c_str());
+    u64 cacheKey = GetProgramCacheKey(app, source.c_str(), (u32)source.size(), programName.c_str(), features);
+
+    u32 variantIdx = programIdx;
+    if (GLuint handle = LoadProgramBinary(app, cacheKey, source, filepath.c_str(), programName.c_str(), features))
+    {
+        variantIdx = AddProgram(app, handle, filepath.c_str(), programName.c_str(), features);
+        app->programVariants[key] = variantIdx;
+    }
+    else
+    {
+        ProgramBuild build = StartProgramBuild(source.c_str(), (u32)source.size(), programName.c_str(), features);
+        build.programIdx = programIdx;
+        build.cacheKey = cacheKey;
+        build.features = features;
+        build.variantKey = key;
+        reload.pendingVariants.push_back(build);
+    }
+
+    app->programCache.loadMs += (f32)std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return variantIdx;
+}
+
+void WarmUpProgramCache(App* app, const ProgramDesc* programs, u32 programCount)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::map<std::string, std::string> sources;
+    std::vector<ProgramBuild> builds;
+    std::vector<const char*> buildNames;
+    u32 variantCount = 0;
+    for (u32 i = 0; i < programCount; ++i)
+    {
+        const ProgramDesc& desc = programs[i];
+        if (sources.find(desc.filepath) == sources.end())
+            sources[desc.filepath] = ReadProgramSource(desc.filepath);
+        const std::string& source = sources[desc.filepath];
+
+        // Every subset of the flags, walked as submasks
+        u32 flags = desc.featureFlags & ProgramFeature_Flags;
+        for (u32 subset = flags; ; subset = (subset - 1) & flags)
+        {
+            // Programs with material variants sample the maps through handles wherever they can
+            u32 subsetFeatures = subset;
+            if (flags != 0 && app->textureArrays.bindless)
+                subsetFeatures |= ProgramFeature_Bindless;
+
+            // Relief mapping variants once per step bucket
+            u32 stepCount = (subset & ProgramFeature_ReliefMap) ? ARRAY_COUNT(ReliefStepBuckets) : 1;
+            for (u32 step = 0; step < stepCount; ++step)
+            {
+                u32 features = subsetFeatures;
+                if (subset & ProgramFeature_ReliefMap)
+                    features |= PROGRAM_RELIEF_STEPS(ReliefStepBuckets[step]);
+                variantCount++;
+
+                u64 key = GetProgramCacheKey(app, source.c_str(), (u32)source.size(), desc.programName, features);
+                MappedFile file;
+                if (MapCachedProgram(key, file))
+                {
+                    UnmapFile(file);
+                }
+                else
+                {
+                    ProgramBuild build = StartProgramBuild(source.c_str(), (u32)source.size(), desc.programName, features);
+                    build.cacheKey = key;
+                    builds.push_back(build);
+                    buildNames.push_back(desc.programName);
+                }
+            }
+
+            if (subset == 0)
+                break;
+        }
+    }
+
+    u32 compiled = 0;
+    for (u32 i = 0; i < builds.size(); ++i)
+    {
+        if (FinishProgramBuild(builds[i], buildNames[i]))
+        {
+            WriteCachedProgram(app, builds[i].cacheKey, builds[i].handle);
+            compiled++;
+        }
+        glDeleteProgram(builds[i].handle);
+    }
+
+    f32 ms = (f32)std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ILOG("Program cache warmup: %u compiled, %u failed, %u already cached in %.1f ms",
+         compiled, (u32)builds.size() - compiled, variantCount - (u32)builds.size(), ms);
+}
+
+void StartProgramWatcher(App* app)
+{
+    ProgramReload& reload = app->programReload;
+    StopFileWatcher(reload.watcher);
+
+    // Only loose files can be edited, packed ones are read from the pack
+    std::vector<std::string> filepaths;
+    for (const Program& program : app->programs)
+    {
+        if (GetFileLastWriteTimestamp(program.filepath.c_str()) == 0)
+            continue;
+        if (std::find(filepaths.begin(), filepaths.end(), program.filepath) == filepaths.end())
+            filepaths.push_back(program.filepath);
+    }
+
+    reload.watcher = StartFileWatcher(filepaths);
+}
+
+static void ReleaseProgramBuild(ProgramBuild& build)
+{
+    if (build.vertexShader)
+        glDeleteShader(build.vertexShader);
+    if (build.fragmentShader)
+        glDeleteShader(build.fragmentShader);
+    glDeleteProgram(build.handle);
+}
+
+// The old program is in use until here, so draws never miss it
+static void SwapProgram(App* app, u32 programIdx, GLuint handle)
+{
+    Program& program = app->programs[programIdx];
+    glDeleteProgram(program.handle);
+    program.handle = handle;
+    QueryVertexInputLayout(program);
+    QueryProgramUniforms(program);
+    CheckProgramBlocks(handle, program.programName.c_str());
+
+    if (programIdx == app->texturedGeometryProgramIdx)
+        app->programUniformTexture = glGetUniformLocation(program.handle, "uTexture");
+
+    app->programReload.reloadCount++;
+}
+
+void UpdateProgramReload(App* app)
+{
+    ProgramReload& reload = app->programReload;
+
+    std::vector<FileChange> changes;
+    PollFileChanges(reload.watcher, changes);
+
+    // Every program of a changed file is rebuilt from the text the watcher read
+    for (const FileChange& change : changes)
+    {
+        for (u32 i = 0; i < app->programs.size(); ++i)
+        {
+            Program& program = app->programs[i];
+            if (program.filepath != change.path)
+                continue;
+
+            // A build of an older version of the file is of no use anymore
+            for (u32 j = 0; j < reload.pendingBuilds.size(); ++j)
+            {
+                if (reload.pendingBuilds[j].programIdx == i)
+                {
+                    ReleaseProgramBuild(reload.pendingBuilds[j]);
+                    reload.pendingBuilds.erase(reload.pendingBuilds.begin() + j);
+                    break;
+                }
+            }
+
+            // Neither is a variant being compiled from it, it starts over the next
+            // time it is drawn, as do those that failed to
+            for (auto it = app->programVariants.begin(); it != app->programVariants.end(); )
+            {
+                if (it->second == i)
+                    it = app->programVariants.erase(it);
+                else
+                    ++it;
+            }
+            for (u32 j = 0; j < reload.pendingVariants.size(); )
+            {
+                if (reload.pendingVariants[j].programIdx == i)
+                {
+                    ReleaseProgramBuild(reload.pendingVariants[j]);
+                    reload.pendingVariants.erase(reload.pendingVariants.begin() + j);
+                }
+                else
+                {
+                    ++j;
+                }
+            }
+
+            // Undoing an edit finds the previous binary
+            const char* source = change.contents.c_str();
+            u32 sourceLength = (u32)change.contents.size();
+            u64 key = GetProgramCacheKey(app, source, sourceLength, program.programName.c_str(), program.features);
+            if (GLuint handle = LoadCachedProgram(app, key))
+            {
+                SwapProgram(app, i, handle);
+                continue;
+            }
+
+            ProgramBuild build = StartProgramBuild(source, sourceLength, program.programName.c_str(), program.features);
+            build.programIdx = i;
+            build.cacheKey = key;
+            reload.pendingBuilds.push_back(build);
+        }
+    }
+
+    for (u32 i = 0; i < reload.pendingBuilds.size(); )
+    {
+        ProgramBuild& build = reload.pendingBuilds[i];
+        if (!IsProgramBuildDone(app, build))
+        {
+            ++i;
+            continue;
+        }
+
+        Program& program = app->programs[build.programIdx];
+        if (FinishProgramBuild(build, program.programName.c_str()))
+        {
+            WriteCachedProgram(app, build.cacheKey, build.handle);
+            SwapProgram(app, build.programIdx, build.handle);
+            reload.lastBuildMs = (f32)std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - build.startTime).count();
+            ILOG("Reloaded program %s in %.1f ms", program.programName.c_str(), reload.lastBuildMs);
+        }
+        else
+        {
+            // The old program stays until the file is fixed
+            glDeleteProgram(build.handle);
+            reload.failureCount++;
+        }
+
+        reload.pendingBuilds.erase(reload.pendingBuilds.begin() + i);
+    }
+
+    for (u32 i = 0; i < reload.pendingVariants.size(); )
+    {
+        ProgramBuild& build = reload.pendingVariants[i];
+        if (!IsProgramBuildDone(app, build))
+        {
+            ++i;
+            continue;
+        }
+
+        // Copied, adding the variant may move the base program
+        std::string filepath = app->programs[build.programIdx].filepath;
+        std::string programName = app->programs[build.programIdx].programName;
+        if (FinishProgramBuild(build, programName.c_str()))
+        {
+            WriteCachedProgram(app, build.cacheKey, build.handle);
+            app->programVariants[build.variantKey] = AddProgram(app, build.handle, filepath.c_str(), programName.c_str(), build.features);
+        }
+        else
+        {
+            // Drawn with the base program until the file is fixed
+            glDeleteProgram(build.handle);
+            app->programVariants[build.variantKey] = build.programIdx;
+        }
+
+        reload.pendingVariants.erase(reload.pendingVariants.begin() + i);
+    }
+}
+
+void ProgramsGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Programs"))
+        return;
+
+    ProgramReload& reload = app->programReload;
+
+    ImGui::Text("Programs: %u (%u variants)", (u32)app->programs.size(), (u32)app->programVariants.size());
+    ImGui::Text("Parallel compilation: %s", reload.parallelCompile ? "yes" : "no");
+    ImGui::Text("Watcher: %s", reload.watcher ? GetFileWatcherBackend() : "off");
+    ImGui::Text("Reloads: %u (%u failed)", reload.reloadCount, reload.failureCount);
+    if (reload.reloadCount > 0)
+        ImGui::Text("Last build: %.1f ms", reload.lastBuildMs);
+    ImGui::Text("Compiling: %u (%u variants)", (u32)reload.pendingBuilds.size() + (u32)reload.pendingVariants.size(), (u32)reload.pendingVariants.size());
+
+    ProgramCache& cache = app->programCache;
+    ImGui::Separator();
+    if (!cache.enabled)
+        ImGui::Text("Binary cache: the driver has no binary formats");
+    ImGui::Text("Binary cache: %u hits, %u misses, %u rejected, %u written", cache.hits, cache.misses, cache.rejected, cache.writes);
+    if (cache.spirv)
+        ImGui::Text("SPIR-V: %u programs", cache.spirvLoads);
+    else
+        ImGui::Text("SPIR-V: off");
+    ImGui::Text("Load time: %.1f ms", cache.loadMs);
+}
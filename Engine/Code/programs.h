@@ -0,0 +1,205 @@
+//
+// programs.h: GLSL programs. Each one is a section of a source file selected by
+// a define with its name (see shaders.glsl), compiled as a vertex and a fragment
+// shader.
+//
+// Edits of the source files are hot reloaded. A watcher thread reads every
+// changed file once (see file_watcher.h) and each program built from it is
+// recompiled from that text. With GL_KHR_parallel_shader_compile the driver
+// compiles them on its own threads and the builds are polled every frame; the
+// old program keeps being drawn with until the new one links, and stays if it
+// fails to.
+//
+// Linked programs are cached in PROGRAM_CACHE_DIRECTORY as driver binaries, one
+// file per key. The key hashes the text the shaders are compiled from (the
+// source with the version line and the defines prepended) and the vendor,
+// renderer and version strings of the driver, so an edit, another define set
+// or a driver update simply misses. Running the engine with --warmup-programs
+// builds every known program into the cache and quits. Programs missing from
+// it are created from SPIR-V instead of GLSL where the Cooker compiled their
+// source (see shader_cooker.h).
+//
+// A program can have variants with features compiled in or out (NORMAL_MAP,
+// RELIEF_MAP...), so that draws only pay for the features their material uses
+// instead of branching on uniforms. Variants are loaded the first time they are
+// asked for, from the cache once it is warm. Those that have to be compiled are
+// built in the background like reloads, and draws use the base program until
+// they link.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "Mesh.h"
+#include "file_watcher.h"
+#include <glad/glad.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct App;
+
+#define PROGRAM_GLSL_VERSION    "#version 430\n"
+#define PROGRAM_CACHE_DIRECTORY "program_cache"
+#define PROGRAM_CACHE_MAGIC     0x47525043 // "CPRG"
+#define PROGRAM_CACHE_VERSION   1
+
+// Each one is a define of the shader source
+enum ProgramFeature
+{
+    ProgramFeature_NormalMap = 1 << 0, // NORMAL_MAP
+    ProgramFeature_ReliefMap = 1 << 1, // RELIEF_MAP
+    ProgramFeature_NoTexture = 1 << 2, // NO_TEXTURE: the material color instead of an albedo map
+    ProgramFeature_Bindless  = 1 << 3, // BINDLESS_TEXTURES: the maps through the handles of the material table, GLSL only
+    ProgramFeature_Flags     = 0xFF,
+};
+
+// RELIEF_STEPS=N, in the feature bits above the flags. 0 leaves the shader
+// default. The step count is rounded up to a few buckets (see
+// QuantizeReliefSteps), so that moving the slider only ever needs four variants
+#define PROGRAM_RELIEF_STEPS_SHIFT    8
+#define PROGRAM_RELIEF_STEPS(steps)   ((u32)(steps) << PROGRAM_RELIEF_STEPS_SHIFT)
+#define PROGRAM_DEFAULT_RELIEF_STEPS  32
+
+struct Program
+{
+    GLuint             handle;
+    std::string        filepath;
+    std::string        programName;
+    u32                features;          // ProgramFeature flags and relief steps
+    VertexShaderLayout vertexInputLayout;
+
+    // Looked up once linked, -1 where the program does not have them
+    GLint              uniformMaterialIdx;
+    GLint              uniformTextureSlots;
+    GLint              uniformBumpiness;
+    GLint              uniformVirtualTexture;
+    GLint              uniformFeedbackOffset;
+};
+
+// Programs the engine loads, for the warmup
+struct ProgramDesc
+{
+    const char* filepath;
+    const char* programName;
+    u32         featureFlags; // ProgramFeature flags it has variants for
+};
+
+struct ProgramCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;          // GetProgramCacheKey
+    u32 binaryFormat;
+    u32 binarySize;   // follows the header
+    u64 binaryHash;
+};
+
+struct ProgramCache
+{
+    bool enabled;     // the driver supports at least one binary format
+    u32  hits;
+    u32  misses;
+    u32  rejected;    // binaries the driver did not take back
+    u32  writes;
+    f32  loadMs;      // spent in LoadProgram, cached or not
+
+    bool spirv;       // programs are created from cooked SPIR-V when there is some
+    u32  spirvLoads;
+};
+
+// Shaders being compiled and linked into a program that replaces another one,
+// or into a variant of it
+struct ProgramBuild
+{
+    u32    programIdx;
+    GLuint handle;
+    GLuint vertexShader;
+    GLuint fragmentShader;
+    u64    cacheKey;
+    u32    features;   // of the variant
+    u64    variantKey; // see GetProgramVariant
+
+    std::chrono::steady_clock::time_point startTime;
+};
+
+struct ProgramReload
+{
+    bool                      parallelCompile; // GL_KHR_parallel_shader_compile or the ARB one
+    FileWatcher*              watcher;
+    std::vector<ProgramBuild> pendingBuilds;
+    std::vector<ProgramBuild> pendingVariants; // programIdx is the base program
+
+    u32                       reloadCount;
+    u32                       failureCount;
+    f32                       lastBuildMs;     // from reading the file to linking
+};
+
+/**
+ * Lets the driver compile on background threads when it can. Called from Init
+ * before any program is loaded.
+ */
+void InitPrograms(App* app);
+
+/**
+ * The relief step count of the variant drawn with the given one: the smallest
+ * bucket (8, 16, 32 or 64 steps) that has at least as many.
+ */
+u32 QuantizeReliefSteps(u32 steps);
+
+/**
+ * Version line, program name and feature defines: everything that goes before
+ * the source but the stage define.
+ */
+std::string GetProgramPreamble(const char* programName, u32 features);
+
+bool HasGLExtension(App* app, const char* name);
+
+/**
+ * Fills the uniform locations of a linked program.
+ */
+void QueryProgramUniforms(Program& program);
+
+/**
+ * Identifies a program in the cache: its source, define set and the driver.
+ */
+u64 GetProgramCacheKey(App* app, const char* source, u32 sourceLength, const char* programName, u32 features);
+
+/**
+ * Compiles and links a program, waiting for the driver. Errors are logged.
+ */
+GLuint CreateProgramFromSource(String programSource, const char* shaderName);
+
+/**
+ * Loads a program from an asset and returns its index in app->programs. The
+ * binary is taken from the cache if it is there, otherwise the program is
+ * created from cooked SPIR-V or compiled, and added to it.
+ */
+u32 LoadProgram(App* app, const char* filepath, const char* programName, u32 features = 0);
+
+/**
+ * Index in app->programs of the variant of a program with the given features,
+ * loaded the first time it is asked for. While it compiles, programIdx itself.
+ */
+u32 GetProgramVariant(App* app, u32 programIdx, u32 features);
+
+/**
+ * Compiles every program missing from the cache, with every combination of its
+ * feature flags and every relief step bucket, all at once so that the driver
+ * can spread them across its compiler threads, and writes them to the cache.
+ */
+void WarmUpProgramCache(App* app, const ProgramDesc* programs, u32 programCount);
+
+/**
+ * Starts watching the source files of app->programs. Called from Init once the
+ * programs are loaded or restored.
+ */
+void StartProgramWatcher(App* app);
+
+/**
+ * Once per frame: starts rebuilding the programs whose files changed, swaps in
+ * the builds that are done and adds the variants that linked.
+ */
+void UpdateProgramReload(App* app);
+
+void ProgramsGui(App* app);
@@ -0,0 +1,355 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "residency.h"
+#include "engine.h"
+#include "job_system.h"
+#include <imgui.h>
+#include <algorithm>
+
+static const char* ResidencyPolicyNames[Residency_Count] =
+{
+    "Drop CPU copy",
+    "Keep CPU copy",
+    "Reload on demand",
+};
+
+static bool HasCpuCopy(const Mesh& mesh)
+{
+    for (const Submesh& submesh : mesh.submeshes)
+        if (!submesh.vertices.empty())
+            return true;
+    return false;
+}
+
+static u64 GetCpuFootprint(const Mesh& mesh)
+{
+    u64 bytes = 0;
+    for (const Submesh& submesh : mesh.submeshes)
+        bytes += submesh.vertices.capacity() * sizeof(float) + submesh.indices.capacity() * sizeof(u32);
+    return bytes;
+}
+
+static u64 QueryGpuFootprint(const Mesh& mesh)
+{
+    // Query through GL_ARRAY_BUFFER so that no VAO state is touched
+    GLint size = 0;
+    u64 bytes = 0;
+
+    if (mesh.vertexBufferHandle)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+        glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+        bytes += (u64)size;
+    }
+    if (mesh.indexBufferHandle && mesh.indexBufferHandle != mesh.vertexBufferHandle)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.indexBufferHandle);
+        glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+        bytes += (u64)size;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return bytes;
+}
+
+static void DropCpuCopy(Mesh& mesh)
+{
+    for (Submesh& submesh : mesh.submeshes)
+    {
+        std::vector<float>().swap(submesh.vertices);
+        std::vector<u32>().swap(submesh.indices);
+    }
+}
+
+static void EvictGpuBuffers(Mesh& mesh)
+{
+    // The VAOs point to the buffers, so they go too
+    for (Submesh& submesh : mesh.submeshes)
+    {
+        for (const Vao& vao : submesh.vaos)
+            glDeleteVertexArrays(1, &vao.handle);
+        submesh.vaos.clear();
+    }
+
+    if (mesh.indexBufferHandle != mesh.vertexBufferHandle)
+        glDeleteBuffers(1, &mesh.indexBufferHandle);
+    glDeleteBuffers(1, &mesh.vertexBufferHandle);
+
+    mesh.vertexBufferHandle = 0;
+    mesh.indexBufferHandle = 0;
+    mesh.gpuBytes = 0;
+}
+
+static bool CanEvictGpuBuffers(const Mesh& mesh)
+{
+    return mesh.reloadable || HasCpuCopy(mesh);
+}
+
+static bool CanEvictCpuCopy(const Mesh& mesh)
+{
+    return mesh.reloadable && mesh.residencyPolicy != Residency_KeepCpuCopy;
+}
+
+void RegisterMeshResidency(App* app, u32 meshIdx, const char* sourcePath, bool cooked)
+{
+    Mesh& mesh = app->meshes[meshIdx];
+    mesh.sourcePath = sourcePath;
+
+    mesh.reloadable = false;
+    if (cooked)
+    {
+        std::string cookedPath = GetCookedMeshPath(sourcePath);
+        FILE* cookedFile = fopen(cookedPath.c_str(), "rb");
+        mesh.reloadable = cookedFile != NULL || IsAssetPacked(cookedPath.c_str());
+        if (cookedFile)
+            fclose(cookedFile);
+    }
+
+    mesh.gpuBytes = QueryGpuFootprint(mesh);
+    mesh.lastDrawnFrame = app->residency.frame;
+    mesh.lastCpuUseFrame = app->residency.frame;
+
+    SetMeshResidencyPolicy(app, meshIdx, Residency_DropCpuCopy);
+}
+
+void SetMeshResidencyPolicy(App* app, u32 meshIdx, ResidencyPolicy policy)
+{
+    Mesh& mesh = app->meshes[meshIdx];
+    mesh.residencyPolicy = policy;
+
+    if (policy == Residency_KeepCpuCopy)
+    {
+        if (!RequestMeshCpuData(app, meshIdx))
+            ELOG("SetMeshResidencyPolicy() - The geometry of %s can not be read back", mesh.sourcePath.c_str());
+    }
+    else
+    {
+        DropCpuCopy(mesh);
+    }
+}
+
+bool RequestMeshCpuData(App* app, u32 meshIdx)
+{
+    Mesh& mesh = app->meshes[meshIdx];
+    mesh.lastCpuUseFrame = app->residency.frame;
+
+    if (HasCpuCopy(mesh) || mesh.submeshes.empty())
+        return true;
+
+    if (mesh.residencyPolicy == Residency_DropCpuCopy)
+        return false;
+
+    return mesh.reloadable && ReloadCookedMesh(mesh, mesh.sourcePath.c_str());
+}
+
+static void UploadReloadedGeometry(App* app, Mesh& mesh, const CookedMeshGeometry& geometry)
+{
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        mesh.submeshes[i].vertexOffset = geometry.vertexOffsets[i];
+        mesh.submeshes[i].indexOffset = geometry.indexOffsets[i];
+    }
+
+    BufferRange vertexRange = { geometry.vertexData.data(), geometry.vertexData.size(), 0 };
+    BufferRange indexRange = { geometry.indexData.data(), geometry.indexData.size(), 0 };
+    mesh.vertexBufferHandle = CreateStaticBuffer(app, geometry.vertexData.size(), &vertexRange, 1);
+    mesh.indexBufferHandle = CreateStaticBuffer(app, geometry.indexData.size(), &indexRange, 1);
+
+    mesh.gpuBytes = QueryGpuFootprint(mesh);
+    app->residency.gpuReloads++;
+}
+
+bool MakeMeshResident(App* app, Mesh& mesh, bool wait)
+{
+    Residency& residency = app->residency;
+    mesh.lastDrawnFrame = residency.frame;
+
+    if (mesh.vertexBufferHandle != 0)
+        return true;
+
+    if (HasCpuCopy(mesh))
+    {
+        UploadMesh(app, mesh);
+        mesh.gpuBytes = QueryGpuFootprint(mesh);
+        residency.gpuReloads++;
+        return true;
+    }
+
+    if (!mesh.reloadable)
+        return false;
+
+    if (wait)
+    {
+        CookedMeshGeometry geometry;
+        if (!ReadCookedMeshGeometry(mesh.sourcePath.c_str(), (u32)mesh.submeshes.size(), geometry))
+            return false;
+        UploadReloadedGeometry(app, mesh, geometry);
+        return true;
+    }
+
+    // Only meshes of app->meshes are ever evicted
+    u32 meshIdx = (u32)(&mesh - app->meshes.data());
+    ASSERT(meshIdx < app->meshes.size(), "Evicted meshes are in app->meshes");
+    for (const MeshReload* reload : residency.reloads)
+        if (reload->meshIdx == meshIdx)
+            return false;
+
+    MeshReload* reload = new MeshReload;
+    reload->meshIdx = meshIdx;
+    reload->done = false;
+    reload->succeeded = false;
+    residency.reloads.push_back(reload);
+
+    std::string sourcePath = mesh.sourcePath;
+    u32 submeshCount = (u32)mesh.submeshes.size();
+    SubmitJob([reload, sourcePath, submeshCount]
+    {
+        reload->succeeded = ReadCookedMeshGeometry(sourcePath.c_str(), submeshCount, reload->geometry);
+        reload->done = true;
+    });
+
+    return false;
+}
+
+static void UpdateMeshReloads(App* app)
+{
+    Residency& residency = app->residency;
+    for (u32 i = 0; i < residency.reloads.size(); )
+    {
+        MeshReload* reload = residency.reloads[i];
+        if (!reload->done)
+        {
+            ++i;
+            continue;
+        }
+
+        // The buffers may be back already, from a CPU copy or for a snapshot
+        Mesh& mesh = app->meshes[reload->meshIdx];
+        if (reload->succeeded && mesh.vertexBufferHandle == 0)
+            UploadReloadedGeometry(app, mesh, reload->geometry);
+
+        delete reload;
+        residency.reloads.erase(residency.reloads.begin() + i);
+    }
+}
+
+void UpdateResidency(App* app)
+{
+    Residency& residency = app->residency;
+
+    UpdateMeshReloads(app);
+
+    residency.ramUsage = 0;
+    residency.vramUsage = 0;
+    for (const Mesh& mesh : app->meshes)
+    {
+        residency.ramUsage += GetCpuFootprint(mesh);
+        residency.vramUsage += mesh.gpuBytes;
+    }
+
+    // Meshes drawn (or used) this frame are never evicted, so a budget smaller
+    // than what is on screen does not make geometry go back and forth
+    if (residency.ramUsage > residency.ramBudget)
+    {
+        std::vector<u32> candidates;
+        for (u32 i = 0; i < app->meshes.size(); ++i)
+            if (CanEvictCpuCopy(app->meshes[i]) && HasCpuCopy(app->meshes[i]) && app->meshes[i].lastCpuUseFrame < residency.frame)
+                candidates.push_back(i);
+
+        std::sort(candidates.begin(), candidates.end(), [app](u32 a, u32 b)
+        {
+            return app->meshes[a].lastCpuUseFrame < app->meshes[b].lastCpuUseFrame;
+        });
+
+        for (u32 i = 0; i < candidates.size() && residency.ramUsage > residency.ramBudget; ++i)
+        {
+            Mesh& mesh = app->meshes[candidates[i]];
+            residency.ramUsage -= GetCpuFootprint(mesh);
+            DropCpuCopy(mesh);
+            residency.cpuEvictions++;
+        }
+    }
+
+    if (residency.vramUsage > residency.vramBudget)
+    {
+        std::vector<u32> candidates;
+        for (u32 i = 0; i < app->meshes.size(); ++i)
+            if (CanEvictGpuBuffers(app->meshes[i]) && app->meshes[i].gpuBytes > 0 && app->meshes[i].lastDrawnFrame < residency.frame)
+                candidates.push_back(i);
+
+        std::sort(candidates.begin(), candidates.end(), [app](u32 a, u32 b)
+        {
+            return app->meshes[a].lastDrawnFrame < app->meshes[b].lastDrawnFrame;
+        });
+
+        for (u32 i = 0; i < candidates.size() && residency.vramUsage > residency.vramBudget; ++i)
+        {
+            Mesh& mesh = app->meshes[candidates[i]];
+            residency.vramUsage -= mesh.gpuBytes;
+            EvictGpuBuffers(mesh);
+            residency.gpuEvictions++;
+        }
+    }
+
+    residency.frame++;
+}
+
+void ResidencyGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Residency"))
+        return;
+
+    Residency& residency = app->residency;
+
+    int ramBudgetMB = (int)(residency.ramBudget / MB(1));
+    int vramBudgetMB = (int)(residency.vramBudget / MB(1));
+    if (ImGui::DragInt("RAM budget (MB)", &ramBudgetMB, 1.0f, 0, 65536))
+        residency.ramBudget = (u64)ramBudgetMB * MB(1);
+    if (ImGui::DragInt("VRAM budget (MB)", &vramBudgetMB, 1.0f, 0, 65536))
+        residency.vramBudget = (u64)vramBudgetMB * MB(1);
+
+    ImGui::Text("RAM: %.2f MB   VRAM: %.2f MB", residency.ramUsage / (f32)MB(1), residency.vramUsage / (f32)MB(1));
+    ImGui::Text("Evictions: %u CPU, %u GPU   GPU reloads: %u", residency.cpuEvictions, residency.gpuEvictions, residency.gpuReloads);
+
+    if (ImGui::BeginTable("##residency", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupColumn("Asset");
+        ImGui::TableSetupColumn("Policy");
+        ImGui::TableSetupColumn("RAM (KB)");
+        ImGui::TableSetupColumn("VRAM (KB)");
+        ImGui::TableSetupColumn("Last drawn");
+        ImGui::TableHeadersRow();
+
+        for (u32 i = 0; i < app->meshes.size(); ++i)
+        {
+            Mesh& mesh = app->meshes[i];
+            ImGui::PushID(i);
+            ImGui::TableNextRow();
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%s%s", mesh.sourcePath.empty() ? "(unnamed)" : mesh.sourcePath.c_str(), mesh.reloadable ? "" : " (not cooked)");
+
+            ImGui::TableNextColumn();
+            int policy = (int)mesh.residencyPolicy;
+            ImGui::SetNextItemWidth(140.0f);
+            if (ImGui::Combo("##policy", &policy, ResidencyPolicyNames, Residency_Count))
+                SetMeshResidencyPolicy(app, i, (ResidencyPolicy)policy);
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", GetCpuFootprint(mesh) / 1024.0f);
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", mesh.gpuBytes / 1024.0f);
+
+            ImGui::TableNextColumn();
+            if (mesh.gpuBytes == 0)
+                ImGui::Text("evicted");
+            else
+                ImGui::Text("%llu frames ago", (unsigned long long)(residency.frame - mesh.lastDrawnFrame));
+
+            ImGui::PopID();
+        }
+
+        ImGui::EndTable();
+    }
+}
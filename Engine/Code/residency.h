@@ -0,0 +1,88 @@
+//
+// residency.h: Decides which copies of the mesh geometry are kept in RAM and in
+// VRAM. Every mesh has a policy for its CPU copy and both memories have a
+// budget. When a budget is exceeded, the least recently drawn (or used) meshes
+// that can be brought back later are evicted first.
+//
+// Evicted buffers come back when the mesh is drawn again: a worker reads the
+// cooked file and the buffers are uploaded at the end of the frame, the mesh
+// is skipped until then.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "mesh_cache.h"
+#include <atomic>
+#include <vector>
+
+struct App;
+struct Mesh;
+
+enum ResidencyPolicy
+{
+    Residency_DropCpuCopy,    // the CPU copy is freed as soon as the mesh is uploaded and never read back
+    Residency_KeepCpuCopy,    // the CPU copy stays for picking, physics... and is never evicted
+    Residency_ReloadOnDemand, // freed after upload, read back from the cooked file when requested
+    Residency_Count
+};
+
+// Evicted buffers being read back from the cooked file
+struct MeshReload
+{
+    u32                meshIdx;
+    CookedMeshGeometry geometry;
+    std::atomic<bool>  done;
+    bool               succeeded;
+};
+
+struct Residency
+{
+    u64 ramBudget = MB(256);  // CPU copies of mesh geometry
+    u64 vramBudget = MB(512); // vertex and index buffers
+    u64 ramUsage;
+    u64 vramUsage;
+    u64 frame;
+
+    std::vector<MeshReload*> reloads;
+
+    // since startup
+    u32 cpuEvictions;
+    u32 gpuEvictions;
+    u32 gpuReloads;
+};
+
+/**
+ * Starts tracking a freshly loaded mesh and applies the default policy
+ * (Residency_DropCpuCopy). Evicted geometry can only be reloaded when the mesh
+ * was cooked from sourcePath, otherwise its buffers are never evicted.
+ */
+void RegisterMeshResidency(App* app, u32 meshIdx, const char* sourcePath, bool cooked);
+
+void SetMeshResidencyPolicy(App* app, u32 meshIdx, ResidencyPolicy policy);
+
+/**
+ * Makes sure the submeshes of a mesh hold their vertices and indices, reading
+ * them back from the cooked file if needed. Returns false if not possible, as
+ * for meshes whose policy is Residency_DropCpuCopy once their copy is gone.
+ */
+bool RequestMeshCpuData(App* app, u32 meshIdx);
+
+/**
+ * Marks the mesh as drawn this frame. If its buffers were evicted they are
+ * re-uploaded, from the CPU copy right away, otherwise from the cooked file in
+ * the background unless wait is set. Returns false if the mesh can not be drawn
+ * this frame.
+ */
+bool MakeMeshResident(App* app, Mesh& mesh, bool wait = false);
+
+/**
+ * Uploads the buffers read back since the last frame, updates the memory usage
+ * and evicts meshes over budget. Called once per frame after rendering.
+ */
+void UpdateResidency(App* app);
+
+/**
+ * Budgets and per-asset footprints, for the debug window.
+ */
+void ResidencyGui(App* app);
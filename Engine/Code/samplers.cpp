@@ -0,0 +1,42 @@
+#include "samplers.h"
+#include "engine.h"
+
+static GLuint CreateSampler(GLenum minFilter, GLenum magFilter)
+{
+    GLuint sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, magFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return sampler;
+}
+
+void InitSamplers(App* app)
+{
+    Samplers& samplers = app->samplers;
+    samplers.handles[Sampler_Nearest] = CreateSampler(GL_NEAREST, GL_NEAREST);
+    samplers.handles[Sampler_Linear] = CreateSampler(GL_LINEAR, GL_LINEAR);
+    samplers.handles[Sampler_Trilinear] = CreateSampler(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+    samplers.handles[Sampler_NearestMipLinear] = CreateSampler(GL_LINEAR_MIPMAP_LINEAR, GL_NEAREST);
+    samplers.handles[Sampler_NearestMip] = CreateSampler(GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST);
+
+    for (u32 slot = 0; slot < TEXTURE_ARRAY_SLOTS; ++slot)
+        BindSampler(app, TEXTURE_ARRAY_FIRST_UNIT + slot, Sampler_Trilinear);
+}
+
+void BindSampler(App* app, u32 unit, SamplerType type)
+{
+    Samplers& samplers = app->samplers;
+    GLuint sampler = samplers.handles[type];
+
+    if (unit < SAMPLER_TRACKED_UNITS)
+    {
+        if (samplers.boundSamplers[unit] == sampler)
+            return;
+        samplers.boundSamplers[unit] = sampler;
+    }
+
+    glBindSampler(unit, sampler);
+}
@@ -0,0 +1,42 @@
+//
+// samplers.h: Shared sampler objects. Filtering and wrapping are set once per
+// sampler instead of on every texture: a pass binds the sampler it needs to the
+// units it reads, so sampling a texture differently never edits the texture.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+struct App;
+
+// All of them clamp to edge
+enum SamplerType
+{
+    Sampler_Nearest,          // render targets read texel to texel
+    Sampler_Linear,           // no mips
+    Sampler_Trilinear,        // material textures
+    Sampler_NearestMipLinear, // bloom chain: linear between mips, nearest texels
+    Sampler_NearestMip,       // virtual texture indirection
+    Sampler_Count
+};
+
+#define SAMPLER_TRACKED_UNITS 32
+
+struct Samplers
+{
+    GLuint handles[Sampler_Count];
+    GLuint boundSamplers[SAMPLER_TRACKED_UNITS]; // to skip redundant binds
+};
+
+/**
+ * Creates the shared samplers and binds the material one to the texture array
+ * slots, which keep it. Called once from Init.
+ */
+void InitSamplers(App* app);
+
+/**
+ * Binds a shared sampler to a texture unit unless it is bound already.
+ */
+void BindSampler(App* app, u32 unit, SamplerType type);
@@ -0,0 +1,569 @@
+#include "scene.h"
+#include "engine.h"
+#include "hash.h"
+#include "json.h"
+#include "mesh_cache.h"
+#include <imgui.h>
+
+static const char* const SceneTextureUsageNames[TextureUsage_Count] =
+{
+    "color",
+    "colorHighQuality",
+    "normal",
+    "height",
+    "normalHeight",
+};
+
+static const char* const SceneTextureSlotNames[CookedTexture_Count] =
+{
+    "albedo",
+    "emissive",
+    "specular",
+    "normals",
+    "bump",
+};
+
+static u32 Material::* const SceneTextureSlots[CookedTexture_Count] =
+{
+    &Material::albedoTextureIdx,
+    &Material::emissiveTextureIdx,
+    &Material::specularTextureIdx,
+    &Material::normalsTextureIdx,
+    &Material::bumpTextureIdx,
+};
+
+static const char* const SceneLightTypeNames[] =
+{
+    "directional",
+    "point",
+};
+
+// The arrays of a scene file, parsed from the JSON before they are written
+struct SceneData
+{
+    std::vector<SceneTexture>         textures;
+    std::vector<SceneModel>           models;
+    std::vector<SceneTextureOverride> overrides;
+    std::vector<glm::mat4>            entityWorldMatrices;
+    std::vector<u32>                  entityModels;
+    std::vector<u32>                  lightTypes;
+    std::vector<vec3>                 lightColors;
+    std::vector<vec3>                 lightDirections;
+    std::vector<vec3>                 lightPositions;
+    std::vector<vec3>                 cameraPositions;
+    std::vector<vec3>                 cameraReferences;
+    std::vector<vec3>                 cameraLenses;
+};
+
+static u32 FindName(const char* const* names, u32 count, const std::string& name)
+{
+    for (u32 i = 0; i < count; ++i)
+        if (name == names[i])
+            return i;
+    return UINT32_MAX;
+}
+
+static void CopyPath(char* dst, const std::string& src)
+{
+    strncpy(dst, src.c_str(), SCENE_PATH_LENGTH - 1);
+    dst[SCENE_PATH_LENGTH - 1] = '\0';
+}
+
+static vec3 JsonFindVec3(const JsonDocument& json, u32 node, const char* key, vec3 defaultValue)
+{
+    std::vector<u32> components = JsonChildren(json, JsonFind(json, node, key));
+    if (components.size() != 3)
+        return defaultValue;
+    return vec3((f32)JsonNumber(json, components[0], 0.0), (f32)JsonNumber(json, components[1], 0.0), (f32)JsonNumber(json, components[2], 0.0));
+}
+
+static bool ParseScene(const char* sourcePath, const char* text, u32 length, SceneData& scene)
+{
+    JsonDocument json;
+    if (!ParseJson(text, length, json))
+    {
+        ELOG("ParseScene() - %s is not valid JSON", sourcePath);
+        return false;
+    }
+
+    for (u32 textureNode : JsonChildren(json, JsonFind(json, 0, "textures")))
+    {
+        SceneTexture texture = {};
+        CopyPath(texture.path, JsonFindString(json, textureNode, "path", ""));
+        texture.usage = FindName(SceneTextureUsageNames, TextureUsage_Count, JsonFindString(json, textureNode, "usage", "color"));
+        if (texture.usage == UINT32_MAX)
+        {
+            ELOG("ParseScene() - Texture %s of %s has an unknown usage", texture.path, sourcePath);
+            return false;
+        }
+        scene.textures.push_back(texture);
+    }
+
+    for (u32 modelNode : JsonChildren(json, JsonFind(json, 0, "models")))
+    {
+        u32 modelIdx = (u32)scene.models.size();
+
+        SceneModel model = {};
+        CopyPath(model.path, JsonFindString(json, modelNode, "path", ""));
+        model.importFlags = JsonFindNumber(json, modelNode, "keepHierarchy", 0.0) != 0.0 ? ModelImport_KeepHierarchy : ModelImport_Flatten;
+        scene.models.push_back(model);
+
+        // Textures the model file does not reference, by slot
+        u32 texturesNode = JsonFind(json, modelNode, "textures");
+        for (u32 slotNode : JsonChildren(json, texturesNode))
+        {
+            SceneTextureOverride textureOverride = {};
+            textureOverride.modelIdx = modelIdx;
+            textureOverride.slot = FindName(SceneTextureSlotNames, CookedTexture_Count, std::string(json.nodes[slotNode].key, json.nodes[slotNode].keyLength));
+            textureOverride.textureIdx = (u32)JsonNumber(json, slotNode, -1.0);
+            if (textureOverride.slot == UINT32_MAX || textureOverride.textureIdx >= scene.textures.size())
+            {
+                ELOG("ParseScene() - Model %s of %s has an invalid texture", model.path, sourcePath);
+                return false;
+            }
+            scene.overrides.push_back(textureOverride);
+        }
+    }
+
+    // Either a whole matrix (column major) or a position and a scale
+    for (u32 entityNode : JsonChildren(json, JsonFind(json, 0, "entities")))
+    {
+        u32 modelIdx = (u32)JsonFindNumber(json, entityNode, "model", -1.0);
+        if (modelIdx >= scene.models.size())
+        {
+            ELOG("ParseScene() - Entity %u of %s has an invalid model", (u32)scene.entityModels.size(), sourcePath);
+            return false;
+        }
+
+        glm::mat4 worldMatrix(1.0f);
+        std::vector<u32> elements = JsonChildren(json, JsonFind(json, entityNode, "transform"));
+        if (elements.size() == 16)
+        {
+            for (u32 i = 0; i < 16; ++i)
+                worldMatrix[i / 4][i % 4] = (f32)JsonNumber(json, elements[i], 0.0);
+        }
+        else
+        {
+            worldMatrix = glm::translate(worldMatrix, JsonFindVec3(json, entityNode, "position", vec3(0.0f)));
+            worldMatrix = glm::scale(worldMatrix, JsonFindVec3(json, entityNode, "scale", vec3(1.0f)));
+        }
+
+        scene.entityWorldMatrices.push_back(worldMatrix);
+        scene.entityModels.push_back(modelIdx);
+    }
+
+    for (u32 lightNode : JsonChildren(json, JsonFind(json, 0, "lights")))
+    {
+        u32 type = FindName(SceneLightTypeNames, ARRAY_COUNT(SceneLightTypeNames), JsonFindString(json, lightNode, "type", "point"));
+        if (type == UINT32_MAX)
+        {
+            ELOG("ParseScene() - Light %u of %s has an unknown type", (u32)scene.lightTypes.size(), sourcePath);
+            return false;
+        }
+        scene.lightTypes.push_back(type);
+        scene.lightColors.push_back(JsonFindVec3(json, lightNode, "color", vec3(1.0f)));
+        scene.lightDirections.push_back(JsonFindVec3(json, lightNode, "direction", vec3(0.0f, 1.0f, 0.0f)));
+        scene.lightPositions.push_back(JsonFindVec3(json, lightNode, "position", vec3(0.0f)));
+    }
+
+    for (u32 cameraNode : JsonChildren(json, JsonFind(json, 0, "cameras")))
+    {
+        scene.cameraPositions.push_back(JsonFindVec3(json, cameraNode, "position", vec3(0.0f)));
+        scene.cameraReferences.push_back(JsonFindVec3(json, cameraNode, "reference", vec3(0.0f, 0.0f, -1.0f)));
+        scene.cameraLenses.push_back(vec3((f32)JsonFindNumber(json, cameraNode, "fieldOfView", 60.0),
+                                          (f32)JsonFindNumber(json, cameraNode, "near", 0.1),
+                                          (f32)JsonFindNumber(json, cameraNode, "far", 1000.0)));
+    }
+
+    return true;
+}
+
+template <typename T>
+static u64 AppendArray(std::vector<u8>& data, const std::vector<T>& array)
+{
+    data.resize((data.size() + SCENE_ARRAY_ALIGNMENT - 1) & ~(u64)(SCENE_ARRAY_ALIGNMENT - 1));
+    u64 offset = data.size();
+    const u8* bytes = (const u8*)array.data();
+    data.insert(data.end(), bytes, bytes + array.size() * sizeof(T));
+    return offset;
+}
+
+static void BuildSceneFile(const SceneData& scene, u64 sourceHash, std::vector<u8>& data)
+{
+    SceneFileHeader header = {};
+    header.magic = SCENE_MAGIC;
+    header.version = SCENE_VERSION;
+    header.sourceHash = sourceHash;
+    header.textureCount = (u32)scene.textures.size();
+    header.modelCount = (u32)scene.models.size();
+    header.overrideCount = (u32)scene.overrides.size();
+    header.entityCount = (u32)scene.entityModels.size();
+    header.lightCount = (u32)scene.lightTypes.size();
+    header.cameraCount = (u32)scene.cameraPositions.size();
+
+    data.assign(sizeof(header), 0);
+    header.texturesOffset = AppendArray(data, scene.textures);
+    header.modelsOffset = AppendArray(data, scene.models);
+    header.overridesOffset = AppendArray(data, scene.overrides);
+    header.entityWorldMatricesOffset = AppendArray(data, scene.entityWorldMatrices);
+    header.entityModelsOffset = AppendArray(data, scene.entityModels);
+    header.lightTypesOffset = AppendArray(data, scene.lightTypes);
+    header.lightColorsOffset = AppendArray(data, scene.lightColors);
+    header.lightDirectionsOffset = AppendArray(data, scene.lightDirections);
+    header.lightPositionsOffset = AppendArray(data, scene.lightPositions);
+    header.cameraPositionsOffset = AppendArray(data, scene.cameraPositions);
+    header.cameraReferencesOffset = AppendArray(data, scene.cameraReferences);
+    header.cameraLensesOffset = AppendArray(data, scene.cameraLenses);
+    memcpy(data.data(), &header, sizeof(header));
+}
+
+// Parses the JSON into the contents of the binary file
+static bool BuildSceneFile(const char* sourcePath, std::vector<u8>& data)
+{
+    AssetFile file = OpenAsset(sourcePath);
+    if (file.data == NULL)
+        return false;
+
+    SceneData scene;
+    bool parsed = ParseScene(sourcePath, (const char*)file.data, (u32)file.size, scene);
+    u64 sourceHash = HashBytes(file.data, file.size);
+    CloseAsset(file);
+
+    if (parsed)
+        BuildSceneFile(scene, sourceHash, data);
+    return parsed;
+}
+
+static bool WriteSceneFile(const char* cookedPath, const std::vector<u8>& data)
+{
+    FILE* file = fopen(cookedPath, "wb");
+    bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (file)
+        written = fclose(file) == 0 && written;
+
+    if (!written)
+    {
+        ELOG("WriteSceneFile() - Could not write %s", cookedPath);
+        remove(cookedPath);
+    }
+    return written;
+}
+
+std::string GetCookedScenePath(const char* sourcePath)
+{
+    return std::string(sourcePath) + ".bin";
+}
+
+bool CookScene(const char* sourcePath)
+{
+    std::vector<u8> data;
+    return BuildSceneFile(sourcePath, data) && WriteSceneFile(GetCookedScenePath(sourcePath).c_str(), data);
+}
+
+static bool ArrayFits(u64 fileSize, u64 offset, u32 count, u64 elementSize)
+{
+    return offset <= fileSize && count * elementSize <= fileSize - offset;
+}
+
+static bool IsSceneFileValid(const u8* data, u64 size, u64 sourceHash)
+{
+    const SceneFileHeader* header = (const SceneFileHeader*)data;
+    return data != NULL &&
+           size >= sizeof(SceneFileHeader) &&
+           header->magic == SCENE_MAGIC &&
+           header->version == SCENE_VERSION &&
+           (sourceHash == 0 || header->sourceHash == sourceHash) &&
+           ArrayFits(size, header->texturesOffset, header->textureCount, sizeof(SceneTexture)) &&
+           ArrayFits(size, header->modelsOffset, header->modelCount, sizeof(SceneModel)) &&
+           ArrayFits(size, header->overridesOffset, header->overrideCount, sizeof(SceneTextureOverride)) &&
+           ArrayFits(size, header->entityWorldMatricesOffset, header->entityCount, sizeof(glm::mat4)) &&
+           ArrayFits(size, header->entityModelsOffset, header->entityCount, sizeof(u32)) &&
+           ArrayFits(size, header->lightTypesOffset, header->lightCount, sizeof(u32)) &&
+           ArrayFits(size, header->lightColorsOffset, header->lightCount, sizeof(vec3)) &&
+           ArrayFits(size, header->lightDirectionsOffset, header->lightCount, sizeof(vec3)) &&
+           ArrayFits(size, header->lightPositionsOffset, header->lightCount, sizeof(vec3)) &&
+           ArrayFits(size, header->cameraPositionsOffset, header->cameraCount, sizeof(vec3)) &&
+           ArrayFits(size, header->cameraReferencesOffset, header->cameraCount, sizeof(vec3)) &&
+           ArrayFits(size, header->cameraLensesOffset, header->cameraCount, sizeof(vec3));
+}
+
+template <typename T>
+static const T* GetSceneArray(const u8* data, u64 offset)
+{
+    return (const T*)(data + offset);
+}
+
+static void InstantiateScene(App* app, const char* sourcePath, const u8* data)
+{
+    const SceneFileHeader* header = (const SceneFileHeader*)data;
+
+    Scene& scene = app->scene;
+    scene.path = sourcePath;
+    scene.textures.assign(GetSceneArray<SceneTexture>(data, header->texturesOffset), GetSceneArray<SceneTexture>(data, header->texturesOffset) + header->textureCount);
+    scene.models.assign(GetSceneArray<SceneModel>(data, header->modelsOffset), GetSceneArray<SceneModel>(data, header->modelsOffset) + header->modelCount);
+    scene.overrides.assign(GetSceneArray<SceneTextureOverride>(data, header->overridesOffset), GetSceneArray<SceneTextureOverride>(data, header->overridesOffset) + header->overrideCount);
+
+    scene.textureIndices.clear();
+    for (const SceneTexture& texture : scene.textures)
+        scene.textureIndices.push_back(QueueTexture2D(app, texture.path, (TextureUsage)texture.usage));
+
+    // Models are reserved in order, so the scene indices only need an offset
+    scene.firstModelIdx = (u32)app->models.size();
+    for (const SceneModel& model : scene.models)
+        LoadModel(app, model.path, model.importFlags);
+
+    for (const SceneTextureOverride& textureOverride : scene.overrides)
+    {
+        if (textureOverride.modelIdx < header->modelCount && textureOverride.slot < CookedTexture_Count && textureOverride.textureIdx < header->textureCount)
+            SetModelTexture(app, scene.firstModelIdx + textureOverride.modelIdx, SceneTextureSlots[textureOverride.slot], scene.textureIndices[textureOverride.textureIdx]);
+    }
+
+    // The entities are used as they are stored
+    Entities& entities = app->entities;
+    const glm::mat4* worldMatrices = GetSceneArray<glm::mat4>(data, header->entityWorldMatricesOffset);
+    const u32* entityModels = GetSceneArray<u32>(data, header->entityModelsOffset);
+    entities.worldMatrices.assign(worldMatrices, worldMatrices + header->entityCount);
+    entities.modelIndices.assign(entityModels, entityModels + header->entityCount);
+    if (scene.firstModelIdx != 0)
+    {
+        for (u32& modelIdx : entities.modelIndices)
+            modelIdx += scene.firstModelIdx;
+    }
+
+    // A handful of lights, they go in the engine's own layout
+    app->lights.clear();
+    for (u32 i = 0; i < header->lightCount; ++i)
+    {
+        app->lights.push_back(Light((LightType)GetSceneArray<u32>(data, header->lightTypesOffset)[i],
+                                    GetSceneArray<vec3>(data, header->lightColorsOffset)[i],
+                                    GetSceneArray<vec3>(data, header->lightDirectionsOffset)[i],
+                                    GetSceneArray<vec3>(data, header->lightPositionsOffset)[i]));
+    }
+
+    // The first camera is the one the scene starts from
+    if (header->cameraCount > 0)
+    {
+        vec3 lens = GetSceneArray<vec3>(data, header->cameraLensesOffset)[0];
+        app->cameraPosition = GetSceneArray<vec3>(data, header->cameraPositionsOffset)[0];
+        app->cameraReference = GetSceneArray<vec3>(data, header->cameraReferencesOffset)[0];
+        app->cameraFieldOfView = lens.x;
+        app->cameraNearPlane = lens.y;
+        app->cameraFarPlane = lens.z;
+    }
+}
+
+bool LoadSceneFile(App* app, const char* sourcePath)
+{
+    std::string cookedPath = GetCookedScenePath(sourcePath);
+
+    // A missing source is fine (shipping only cooked data), otherwise it must match
+    u64 sourceHash = HashFile(sourcePath);
+    AssetFile file = OpenAsset(cookedPath.c_str());
+    if (IsSceneFileValid(file.data, file.size, sourceHash))
+    {
+        InstantiateScene(app, sourcePath, file.data);
+        CloseAsset(file);
+        return true;
+    }
+    CloseAsset(file);
+
+    // Cooked again, and still loaded if it can not be written
+    std::vector<u8> data;
+    if (!BuildSceneFile(sourcePath, data))
+        return false;
+
+    ILOG("Cooked scene %s", sourcePath);
+    WriteSceneFile(cookedPath.c_str(), data);
+    InstantiateScene(app, sourcePath, data.data());
+    return true;
+}
+
+// Shortest text that reads back as the same float
+static void WriteSceneNumber(FILE* file, f32 value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%g", value);
+    if ((f32)atof(text) != value)
+        snprintf(text, sizeof(text), "%.9g", value);
+    fputs(text, file);
+}
+
+// Quoted JSON string, escaped the way JsonString() reads it back
+static void WriteSceneString(FILE* file, const char* value)
+{
+    fputc('"', file);
+    for (const char* c = value; *c != '\0'; ++c)
+    {
+        switch (*c)
+        {
+            case '"':  fputs("\\\"", file); break;
+            case '\\': fputs("\\\\", file); break;
+            case '\n': fputs("\\n", file); break;
+            case '\t': fputs("\\t", file); break;
+            case '\r': fputs("\\r", file); break;
+            case '\b': fputs("\\b", file); break;
+            case '\f': fputs("\\f", file); break;
+            default:
+                if ((u8)*c < 0x20)
+                    fprintf(file, "\\u%04x", (u8)*c);
+                else
+                    fputc(*c, file);
+                break;
+        }
+    }
+    fputc('"', file);
+}
+
+static void WriteSceneVec3(FILE* file, const char* key, vec3 value)
+{
+    fputs(", ", file);
+    WriteSceneString(file, key);
+    fputs(": [", file);
+    for (u32 i = 0; i < 3; ++i)
+    {
+        if (i > 0)
+            fputs(", ", file);
+        WriteSceneNumber(file, value[i]);
+    }
+    fputs("]", file);
+}
+
+static bool IsTranslationAndScale(const glm::mat4& matrix)
+{
+    for (u32 column = 0; column < 3; ++column)
+        for (u32 row = 0; row < 4; ++row)
+            if (row != column && matrix[column][row] != 0.0f)
+                return false;
+    return matrix[3][3] == 1.0f;
+}
+
+// One line per entry, so that editing an entity changes one line of the file
+static bool WriteSceneText(App* app, const char* sourcePath)
+{
+    FILE* file = fopen(sourcePath, "w");
+    if (file == NULL)
+        return false;
+
+    const Scene& scene = app->scene;
+
+    fputs("{\n    \"textures\": [", file);
+    for (u32 i = 0; i < scene.textures.size(); ++i)
+    {
+        fprintf(file, "%s\n        { \"path\": ", i > 0 ? "," : "");
+        WriteSceneString(file, scene.textures[i].path);
+        fputs(", \"usage\": ", file);
+        WriteSceneString(file, SceneTextureUsageNames[scene.textures[i].usage]);
+        fputs(" }", file);
+    }
+
+    fputs("\n    ],\n    \"models\": [", file);
+    for (u32 i = 0; i < scene.models.size(); ++i)
+    {
+        fprintf(file, "%s\n        { \"path\": ", i > 0 ? "," : "");
+        WriteSceneString(file, scene.models[i].path);
+        if (scene.models[i].importFlags & ModelImport_KeepHierarchy)
+            fputs(", \"keepHierarchy\": true", file);
+
+        bool first = true;
+        for (const SceneTextureOverride& textureOverride : scene.overrides)
+        {
+            if (textureOverride.modelIdx != i)
+                continue;
+            fputs(first ? ", \"textures\": { " : ", ", file);
+            WriteSceneString(file, SceneTextureSlotNames[textureOverride.slot]);
+            fprintf(file, ": %u", textureOverride.textureIdx);
+            first = false;
+        }
+        fputs(first ? " }" : " } }", file);
+    }
+
+    fputs("\n    ],\n    \"entities\": [", file);
+    const Entities& entities = app->entities;
+    for (u32 i = 0; i < entities.worldMatrices.size(); ++i)
+    {
+        const glm::mat4& worldMatrix = entities.worldMatrices[i];
+        fprintf(file, "%s\n        { \"model\": %u", i > 0 ? "," : "", entities.modelIndices[i] - scene.firstModelIdx);
+
+        if (IsTranslationAndScale(worldMatrix))
+        {
+            WriteSceneVec3(file, "position", vec3(worldMatrix[3]));
+            vec3 scale(worldMatrix[0][0], worldMatrix[1][1], worldMatrix[2][2]);
+            if (scale != vec3(1.0f))
+                WriteSceneVec3(file, "scale", scale);
+        }
+        else
+        {
+            fputs(", \"transform\": [", file);
+            for (u32 j = 0; j < 16; ++j)
+            {
+                if (j > 0)
+                    fputs(", ", file);
+                WriteSceneNumber(file, worldMatrix[j / 4][j % 4]);
+            }
+            fputs("]", file);
+        }
+        fputs(" }", file);
+    }
+
+    fputs("\n    ],\n    \"lights\": [", file);
+    for (u32 i = 0; i < app->lights.size(); ++i)
+    {
+        const Light& light = app->lights[i];
+        fprintf(file, "%s\n        { \"type\": ", i > 0 ? "," : "");
+        WriteSceneString(file, SceneLightTypeNames[light.type]);
+        WriteSceneVec3(file, "color", light.color);
+        WriteSceneVec3(file, "direction", light.direction);
+        WriteSceneVec3(file, "position", light.position);
+        fputs(" }", file);
+    }
+
+    fputs("\n    ],\n    \"cameras\": [\n        { ", file);
+    fputs("\"fieldOfView\": ", file);
+    WriteSceneNumber(file, app->cameraFieldOfView);
+    fputs(", \"near\": ", file);
+    WriteSceneNumber(file, app->cameraNearPlane);
+    fputs(", \"far\": ", file);
+    WriteSceneNumber(file, app->cameraFarPlane);
+    WriteSceneVec3(file, "position", app->cameraPosition);
+    WriteSceneVec3(file, "reference", app->cameraReference);
+    fputs(" }\n    ]\n}\n", file);
+
+    return fclose(file) == 0;
+}
+
+bool SaveSceneFile(App* app, const char* sourcePath)
+{
+    if (!WriteSceneText(app, sourcePath))
+    {
+        ELOG("SaveSceneFile() - Could not write %s", sourcePath);
+        return false;
+    }
+    return CookScene(sourcePath);
+}
+
+void SceneGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Scene"))
+        return;
+
+    Scene& scene = app->scene;
+    Entities& entities = app->entities;
+
+    ImGui::Text("%s: %u entities, %u models, %u lights", scene.path.c_str(), (u32)entities.worldMatrices.size(), (u32)scene.models.size(), (u32)app->lights.size());
+    if (entities.worldMatrices.empty())
+        return;
+
+    int selected = (int)glm::min(scene.selectedEntity, (u32)entities.worldMatrices.size() - 1);
+    if (ImGui::InputInt("Entity", &selected))
+        scene.selectedEntity = (u32)glm::clamp(selected, 0, (int)entities.worldMatrices.size() - 1);
+    selected = (int)glm::min(scene.selectedEntity, (u32)entities.worldMatrices.size() - 1);
+
+    u32 modelIdx = entities.modelIndices[selected] - scene.firstModelIdx;
+    if (modelIdx < scene.models.size())
+        ImGui::Text("Model: %s", scene.models[modelIdx].path);
+
+    ImGui::DragFloat3("Position", &entities.worldMatrices[selected][3][0], 0.1f);
+
+    if (ImGui::Button("Save"))
+        SaveSceneFile(app, scene.path.c_str());
+}
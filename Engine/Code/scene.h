@@ -0,0 +1,109 @@
+//
+// scene.h: Scene files. A scene lists the textures and models it uses, the
+// textures to set on the materials of some models (e.g. normal maps the model
+// files do not reference), the entities, the lights and the cameras.
+//
+// Scenes are written as JSON (<name>.json) so that they diff well, and cooked
+// into a binary file next to it (<name>.json.bin). The binary file keeps every
+// table as a flat array (one per field for the entities, lights and cameras),
+// so loading a scene copies each array in one go. Like the other cooked files
+// it is rebuilt when the JSON changes.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <string>
+#include <vector>
+
+struct App;
+
+#define SCENE_PATH            "scene.json"
+#define SCENE_MAGIC           0x4E454353 // "SCEN"
+#define SCENE_VERSION         1
+#define SCENE_PATH_LENGTH     128
+#define SCENE_ARRAY_ALIGNMENT 16
+
+struct SceneTexture
+{
+    char path[SCENE_PATH_LENGTH];
+    u32  usage;       // TextureUsage
+};
+
+struct SceneModel
+{
+    char path[SCENE_PATH_LENGTH];
+    u32  importFlags; // ModelImportFlags
+};
+
+// Texture set on every material of a model once it is loaded
+struct SceneTextureOverride
+{
+    u32 modelIdx;     // in the scene tables
+    u32 slot;         // CookedTextureSlot
+    u32 textureIdx;
+};
+
+// Offsets are from the start of the file and aligned to SCENE_ARRAY_ALIGNMENT
+struct SceneFileHeader
+{
+    u32 magic;
+    u32 version;
+    u64 sourceHash;                // of the JSON file
+    u32 textureCount;
+    u32 modelCount;
+    u32 overrideCount;
+    u32 entityCount;
+    u32 lightCount;
+    u32 cameraCount;
+    u64 texturesOffset;            // SceneTexture
+    u64 modelsOffset;              // SceneModel
+    u64 overridesOffset;           // SceneTextureOverride
+    u64 entityWorldMatricesOffset; // glm::mat4
+    u64 entityModelsOffset;        // u32, in the scene tables
+    u64 lightTypesOffset;          // u32, LightType
+    u64 lightColorsOffset;         // glm::vec3
+    u64 lightDirectionsOffset;     // glm::vec3
+    u64 lightPositionsOffset;      // glm::vec3
+    u64 cameraPositionsOffset;     // glm::vec3
+    u64 cameraReferencesOffset;    // glm::vec3
+    u64 cameraLensesOffset;        // glm::vec3: vertical field of view (degrees), near and far planes
+};
+
+/**
+ * Tables of the loaded scene, kept to save it back and for the snapshot.
+ */
+struct Scene
+{
+    std::string                       path;
+    std::vector<SceneTexture>         textures;
+    std::vector<SceneModel>           models;
+    std::vector<SceneTextureOverride> overrides;
+    std::vector<u32>                  textureIndices; // in app->textures, for each of textures
+    u32                               firstModelIdx;  // the models are loaded in order from this one
+    u32                               selectedEntity;
+};
+
+/**
+ * Path of the binary file cooked from a JSON scene.
+ */
+std::string GetCookedScenePath(const char* sourcePath);
+
+/**
+ * Parses the JSON scene and writes the binary file.
+ */
+bool CookScene(const char* sourcePath);
+
+/**
+ * Queues the textures and models of the scene and fills the entities, lights
+ * and camera. Reads the binary file, cooking it first if it is out of date.
+ */
+bool LoadSceneFile(App* app, const char* sourcePath);
+
+/**
+ * Writes the current entities, lights and camera with the tables of the loaded
+ * scene as JSON, and cooks it.
+ */
+bool SaveSceneFile(App* app, const char* sourcePath);
+
+void SceneGui(App* app);
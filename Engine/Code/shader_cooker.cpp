@@ -0,0 +1,340 @@
+#include "shader_cooker.h"
+#include "engine.h"
+#include "hash.h"
+#include "job_system.h"
+
+typedef void (APIENTRYP PFNGLSPECIALIZESHADERARBPROC)(GLuint shader, const GLchar* pEntryPoint, GLuint numSpecializationConstants,
+                                                      const GLuint* pConstantIndex, const GLuint* pConstantValue);
+
+// NULL without ARB_gl_spirv
+static PFNGLSPECIALIZESHADERARBPROC SpecializeShader = NULL;
+
+static const char* const ShaderStageDefines[ShaderStage_Count] = { "#define VERTEX\n", "#define FRAGMENT\n" };
+static const char* const ShaderStageNames[ShaderStage_Count] = { "vert", "frag" };
+
+static u64 AlignOffset(u64 value, u64 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+std::string GetCookedShadersPath(const char* sourcePath)
+{
+    return std::string(sourcePath) + ".spv";
+}
+
+u64 GetCookedProgramsHash(const ProgramDesc* programs, u32 programCount)
+{
+    u64 hash = COOKED_SHADERS_VERSION;
+    for (u32 i = 0; i < programCount; ++i)
+    {
+        hash = HashCombine(hash, HashBytes(programs[i].filepath, strlen(programs[i].filepath)));
+        hash = HashCombine(hash, HashBytes(programs[i].programName, strlen(programs[i].programName)));
+        hash = HashCombine(hash, programs[i].featureFlags);
+    }
+    return hash;
+}
+
+// Validated header of a cooked file, NULL if it is not usable for the source
+static const CookedShadersHeader* GetCookedShadersHeader(const AssetFile& file, u64 sourceHash)
+{
+    if (!file.data || file.size < sizeof(CookedShadersHeader))
+        return NULL;
+
+    const CookedShadersHeader* header = (const CookedShadersHeader*)file.data;
+    bool valid = header->magic == COOKED_SHADERS_MAGIC &&
+                 header->version == COOKED_SHADERS_VERSION &&
+                 header->sourceHash == sourceHash &&
+                 header->modulesOffset + (u64)header->moduleCount * sizeof(CookedShaderModule) <= file.size;
+    return valid ? header : NULL;
+}
+
+bool IsCookedShadersUpToDate(const char* sourcePath, u64 sourceHash, u64 programsHash)
+{
+    AssetFile file = OpenAsset(GetCookedShadersPath(sourcePath).c_str());
+    const CookedShadersHeader* header = GetCookedShadersHeader(file, sourceHash);
+    bool upToDate = header && header->programsHash == programsHash;
+    CloseAsset(file);
+    return upToDate;
+}
+
+// Cooking ----------------------------------------------------------------------
+
+struct ShaderModuleJob
+{
+    const char*     programName;
+    u32             stage;
+    std::vector<u8> spirv;
+};
+
+static bool WriteWholeFile(const std::string& path, const void* data, size_t size)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    bool written = file && fwrite(data, 1, size, file) == size;
+    if (file)
+        written = fclose(file) == 0 && written;
+    return written;
+}
+
+static bool ReadWholeFile(const std::string& path, std::vector<u8>& data)
+{
+    MappedFile file = MapFile(path.c_str());
+    if (!file.data)
+        return false;
+    data.assign(file.data, file.data + file.size);
+    UnmapFile(file);
+    return true;
+}
+
+// Runs a tool with its output in a log, which is printed if it fails
+static bool RunTool(const std::string& command, const std::string& logPath)
+{
+    std::string redirected = command + " > \"" + logPath + "\" 2>&1";
+    if (system(redirected.c_str()) == 0)
+        return true;
+
+    std::vector<u8> log;
+    ReadWholeFile(logPath, log);
+    ELOG("%s\n%.*s", command.c_str(), (int)log.size(), (const char*)log.data());
+    return false;
+}
+
+// The section of one program and stage, as the engine would compile it
+static bool CompileShaderModule(const char* sourcePath, const std::string& source, u32 jobIdx, ShaderModuleJob& job)
+{
+    char suffix[32];
+    sprintf(suffix, ".%u", jobIdx);
+    std::string tmpBase = GetCookedShadersPath(sourcePath) + suffix;
+    std::string glslPath = tmpBase + ".glsl";
+    std::string spirvPath = tmpBase + ".tmp.spv";
+    std::string optimizedPath = tmpBase + ".opt.spv";
+    std::string logPath = tmpBase + ".log";
+
+    std::string text = GetProgramPreamble(job.programName, 0) + ShaderStageDefines[job.stage] + source;
+    bool compiled = WriteWholeFile(glslPath, text.data(), text.size());
+
+    // OpenGL SPIR-V needs locations and bindings on everything, the stages
+    // declare their varyings in the same order so the mapped ones match
+    compiled = compiled && RunTool(std::string("glslangValidator -G --auto-map-locations --auto-map-bindings -S ") + ShaderStageNames[job.stage] +
+                                   " -o \"" + spirvPath + "\" \"" + glslPath + "\"", logPath);
+    compiled = compiled && RunTool("spirv-opt -O --target-env=opengl4.5 \"" + spirvPath + "\" -o \"" + optimizedPath + "\"", logPath);
+    compiled = compiled && ReadWholeFile(optimizedPath, job.spirv);
+
+    if (!compiled)
+        ELOG("Could not compile %s (%s) to SPIR-V", job.programName, ShaderStageNames[job.stage]);
+
+    remove(glslPath.c_str());
+    remove(spirvPath.c_str());
+    remove(optimizedPath.c_str());
+    remove(logPath.c_str());
+    return compiled;
+}
+
+bool CookShaders(const char* sourcePath, const ProgramDesc* programs, u32 programCount)
+{
+    AssetFile file = OpenAsset(sourcePath);
+    if (!file.data)
+    {
+        ELOG("Could not open shader source %s", sourcePath);
+        return false;
+    }
+    std::string source((const char*)file.data, (size_t)file.size);
+    CloseAsset(file);
+
+    // Every stage of every program, the feature flags and relief steps are specialized
+    std::vector<ShaderModuleJob> jobs;
+    std::string normalizedSource = NormalizeAssetPath(sourcePath);
+    for (u32 i = 0; i < programCount; ++i)
+    {
+        const ProgramDesc& desc = programs[i];
+        if (NormalizeAssetPath(desc.filepath) != normalizedSource)
+            continue;
+
+        for (u32 stage = 0; stage < ShaderStage_Count; ++stage)
+        {
+            ShaderModuleJob job = {};
+            job.programName = desc.programName;
+            job.stage = stage;
+            jobs.push_back(job);
+        }
+    }
+
+    std::vector<u8> compiled(jobs.size());
+    ParallelFor((u32)jobs.size(), [&](u32 i)
+    {
+        compiled[i] = CompileShaderModule(sourcePath, source, i, jobs[i]);
+    });
+    for (u8 succeeded : compiled)
+        if (!succeeded)
+            return false;
+
+    // Header, module table and the SPIR-V of each module
+    CookedShadersHeader header = {};
+    header.magic = COOKED_SHADERS_MAGIC;
+    header.version = COOKED_SHADERS_VERSION;
+    header.sourceHash = HashBytes(source.data(), source.size());
+    header.programsHash = GetCookedProgramsHash(programs, programCount);
+    header.moduleCount = (u32)jobs.size();
+    header.modulesOffset = AlignOffset(sizeof(header), COOKED_SHADERS_ALIGNMENT);
+
+    std::vector<CookedShaderModule> modules(jobs.size());
+    u64 offset = AlignOffset(header.modulesOffset + modules.size() * sizeof(CookedShaderModule), COOKED_SHADERS_ALIGNMENT);
+    for (u32 i = 0; i < jobs.size(); ++i)
+    {
+        CookedShaderModule& module = modules[i];
+        strncpy(module.programName, jobs[i].programName, COOKED_SHADER_NAME_LENGTH - 1);
+        module.stage = jobs[i].stage;
+        module.offset = offset;
+        module.size = jobs[i].spirv.size();
+        offset = AlignOffset(offset + module.size, COOKED_SHADERS_ALIGNMENT);
+    }
+
+    std::vector<u8> data(offset, 0);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + header.modulesOffset, modules.data(), modules.size() * sizeof(CookedShaderModule));
+    for (u32 i = 0; i < jobs.size(); ++i)
+        memcpy(data.data() + modules[i].offset, jobs[i].spirv.data(), jobs[i].spirv.size());
+
+    // Written aside and renamed, so an interrupted write never looks like a valid file
+    std::string cookedPath = GetCookedShadersPath(sourcePath);
+    std::string tmpPath = cookedPath + ".tmp";
+    remove(cookedPath.c_str());
+    if (!WriteWholeFile(tmpPath, data.data(), data.size()) || rename(tmpPath.c_str(), cookedPath.c_str()) != 0)
+    {
+        ELOG("Could not write %s", cookedPath.c_str());
+        remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Loading ----------------------------------------------------------------------
+
+bool InitSpirvPrograms(App* app)
+{
+    if (!HasGLExtension(app, "GL_ARB_gl_spirv"))
+        return false;
+
+    // Core in 4.6 without the suffix
+    SpecializeShader = (PFNGLSPECIALIZESHADERARBPROC)GetGLProcAddress("glSpecializeShaderARB");
+    if (!SpecializeShader)
+        SpecializeShader = (PFNGLSPECIALIZESHADERARBPROC)GetGLProcAddress("glSpecializeShader");
+    return SpecializeShader != NULL;
+}
+
+static const CookedShaderModule* FindShaderModule(const AssetFile& file, const CookedShadersHeader* header, const char* programName, u32 stage)
+{
+    const CookedShaderModule* modules = (const CookedShaderModule*)(file.data + header->modulesOffset);
+    for (u32 i = 0; i < header->moduleCount; ++i)
+    {
+        const CookedShaderModule& module = modules[i];
+        if (module.stage == stage && module.offset + module.size <= file.size &&
+            strncmp(module.programName, programName, COOKED_SHADER_NAME_LENGTH) == 0)
+            return &module;
+    }
+    return NULL;
+}
+
+// The engine looks uniforms up by name, which SPIR-V programs only have if the driver keeps them
+static bool HasUniformNames(GLuint program)
+{
+    GLint uniformCount = 0;
+    glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+    for (GLint i = 0; i < uniformCount; ++i)
+    {
+        char name[64];
+        GLsizei length = 0;
+        glGetProgramResourceName(program, GL_UNIFORM, i, sizeof(name), &length, name);
+        if (length == 0)
+            return false;
+    }
+    return true;
+}
+
+GLuint LoadSpirvProgram(App* app, const char* filepath, u64 sourceHash, const char* programName, u32 features)
+{
+    // ARB_bindless_texture has no SPIR-V counterpart
+    if (features & ProgramFeature_Bindless)
+        return 0;
+
+    AssetFile file = OpenAsset(GetCookedShadersPath(filepath).c_str());
+    const CookedShadersHeader* header = GetCookedShadersHeader(file, sourceHash);
+
+    const CookedShaderModule* modules[ShaderStage_Count] = {};
+    bool found = header != NULL;
+    for (u32 stage = 0; stage < ShaderStage_Count && found; ++stage)
+    {
+        modules[stage] = FindShaderModule(file, header, programName, stage);
+        found = modules[stage] != NULL;
+    }
+    if (!found)
+    {
+        CloseAsset(file);
+        return 0;
+    }
+
+    // Only the fragment shaders of the programs with variants have the
+    // constants, the base variant keeps their defaults
+    u32 reliefSteps = features >> PROGRAM_RELIEF_STEPS_SHIFT;
+    GLuint constantIndices[] = { SHADER_SPEC_RELIEF_STEPS, SHADER_SPEC_NORMAL_MAP, SHADER_SPEC_RELIEF_MAP, SHADER_SPEC_NO_TEXTURE };
+    GLuint constantValues[] =
+    {
+        reliefSteps > 0 ? reliefSteps : PROGRAM_DEFAULT_RELIEF_STEPS,
+        (features & ProgramFeature_NormalMap) ? 1u : 0u,
+        (features & ProgramFeature_ReliefMap) ? 1u : 0u,
+        (features & ProgramFeature_NoTexture) ? 1u : 0u,
+    };
+    bool specialize = features != 0;
+
+    GLuint program = glCreateProgram();
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); // for the snapshot and the binary cache
+
+    GLint success = GL_TRUE;
+    GLuint shaders[ShaderStage_Count];
+    const GLenum shaderTypes[ShaderStage_Count] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for (u32 stage = 0; stage < ShaderStage_Count; ++stage)
+    {
+        GLuint constantCount = stage == ShaderStage_Fragment && specialize ? ARRAY_COUNT(constantIndices) : 0;
+
+        shaders[stage] = glCreateShader(shaderTypes[stage]);
+        glShaderBinary(1, &shaders[stage], GL_SHADER_BINARY_FORMAT_SPIR_V_ARB, file.data + modules[stage]->offset, (GLsizei)modules[stage]->size);
+        SpecializeShader(shaders[stage], "main", constantCount, constantIndices, constantValues);
+
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shaders[stage], GL_COMPILE_STATUS, &compiled);
+        if (!compiled)
+        {
+            GLchar infoLog[1024] = {};
+            glGetShaderInfoLog(shaders[stage], sizeof(infoLog), NULL, infoLog);
+            ELOG("glSpecializeShader() failed with %s shader %s\nReported message:\n%s\n", ShaderStageNames[stage], programName, infoLog);
+            success = GL_FALSE;
+        }
+        glAttachShader(program, shaders[stage]);
+    }
+    CloseAsset(file);
+
+    if (success)
+    {
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+    }
+
+    for (u32 stage = 0; stage < ShaderStage_Count; ++stage)
+    {
+        glDetachShader(program, shaders[stage]);
+        glDeleteShader(shaders[stage]);
+    }
+
+    if (success && !HasUniformNames(program))
+    {
+        ILOG("The driver keeps no uniform names in SPIR-V programs, compiling GLSL instead");
+        app->programCache.spirv = false;
+        success = GL_FALSE;
+    }
+
+    if (!success)
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
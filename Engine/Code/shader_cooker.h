@@ -0,0 +1,104 @@
+//
+// shader_cooker.h: Programs compiled offline to SPIR-V (ARB_gl_spirv). The Cooker
+// takes the section of every program of a GLSL file, for each stage, with the
+// version line and program define the engine prepends, compiles it with
+// glslangValidator and optimizes it with spirv-opt. Shader errors show up when
+// cooking instead of when the engine runs. The modules are stored in one file
+// next to the source (<source>.spv) with the hash of the source.
+//
+// The engine creates programs from it with glShaderBinary and glSpecializeShader
+// instead of compiling the GLSL. The feature flags and the relief steps are
+// specialization constants (SHADER_SPEC_*), so one module per stage serves every
+// variant of a program. Bindless variants, drivers without ARB_gl_spirv or that
+// drop the names the engine looks uniforms up by, and sources edited since the
+// file was cooked compile the GLSL as before.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include <string>
+
+struct App;
+struct ProgramDesc;
+
+#define COOKED_SHADERS_MAGIC      0x56525053 // "SPRV"
+#define COOKED_SHADERS_VERSION    2
+#define COOKED_SHADERS_ALIGNMENT  16
+#define COOKED_SHADER_NAME_LENGTH 64
+
+// constant_id of the specialization constants in shaders.glsl
+#define SHADER_SPEC_RELIEF_STEPS  0
+#define SHADER_SPEC_NORMAL_MAP    1
+#define SHADER_SPEC_RELIEF_MAP    2
+#define SHADER_SPEC_NO_TEXTURE    3
+
+// ARB_gl_spirv is not core in 4.3, so glad does not define it
+#ifndef GL_SHADER_BINARY_FORMAT_SPIR_V_ARB
+#define GL_SHADER_BINARY_FORMAT_SPIR_V_ARB 0x9551
+#endif
+
+enum ShaderStage
+{
+    ShaderStage_Vertex,
+    ShaderStage_Fragment,
+    ShaderStage_Count
+};
+
+struct CookedShadersHeader
+{
+    u32 magic;
+    u32 version;
+    u64 sourceHash;
+    u64 programsHash;  // names and feature flags of the programs cooked
+    u32 moduleCount;
+    u32 reserved;
+    u64 modulesOffset; // CookedShaderModule
+};
+
+// The SPIR-V words follow at offset, aligned to COOKED_SHADERS_ALIGNMENT
+struct CookedShaderModule
+{
+    char programName[COOKED_SHADER_NAME_LENGTH];
+    u32  stage;        // ShaderStage
+    u32  reserved;
+    u64  offset;
+    u64  size;
+};
+
+/**
+ * Path of the SPIR-V file cooked from a GLSL source.
+ */
+std::string GetCookedShadersPath(const char* sourcePath);
+
+/**
+ * Identifies the programs cooked from a source, stored in the header.
+ */
+u64 GetCookedProgramsHash(const ProgramDesc* programs, u32 programCount);
+
+/**
+ * Whether the SPIR-V file of a source is there, of this version and made from
+ * the source and programs given.
+ */
+bool IsCookedShadersUpToDate(const char* sourcePath, u64 sourceHash, u64 programsHash);
+
+/**
+ * Compiles the programs of a source (those of the list whose file it is) and
+ * writes the SPIR-V file. Needs glslangValidator and spirv-opt on the PATH.
+ */
+bool CookShaders(const char* sourcePath, const ProgramDesc* programs, u32 programCount);
+
+/**
+ * Looks for the SPIR-V entry points, false without ARB_gl_spirv. Called from
+ * InitPrograms.
+ */
+bool InitSpirvPrograms(App* app);
+
+/**
+ * Creates a program from the cooked SPIR-V of its source, given the hash of the
+ * source text, specialized for the features. Returns 0 if the file is out of
+ * date, does not have the program or the variant is bindless, and turns SPIR-V
+ * off if the driver drops the uniform names.
+ */
+GLuint LoadSpirvProgram(App* app, const char* filepath, u64 sourceHash, const char* programName, u32 features);
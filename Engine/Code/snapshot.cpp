@@ -0,0 +1,773 @@
+#include "snapshot.h"
+#include "engine.h"
+#include "hash.h"
+#include "mesh_cache.h"
+#include <imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+#define SNAPSHOT_MAGIC 0x50414E53 // "SNAP"
+
+// Payloads start at this alignment, so they can be handed to GL as they are mapped
+#define SNAPSHOT_PAYLOAD_ALIGNMENT 16
+
+struct SnapshotHeader
+{
+    u32 magic;
+    u32 version;
+    u64 environmentHash; // driver and cooked formats
+    u64 size;            // of the whole file
+    u64 contentHash;     // of everything after the header
+};
+
+// Indices into the resource tables that the rest of the engine refers to
+static u32 App::* const SnapshotAppIndices[] =
+{
+    &App::texturedGeometryProgramIdx,
+    &App::texturedMeshProgramIdx,
+    &App::deferredGeometryProgramIdx,
+    &App::deferredLightingProgramIdx,
+    &App::blitBrightestPixelsProgram,
+    &App::blur,
+    &App::bloomProgram,
+    &App::normalMappingProgramIdx,
+    &App::whiteTexIdx,
+    &App::blackTexIdx,
+    &App::normalTexIdx,
+    &App::magentaTexIdx,
+};
+
+static u32 Material::* const SnapshotMaterialTextures[] =
+{
+    &Material::albedoTextureIdx,
+    &Material::emissiveTextureIdx,
+    &Material::specularTextureIdx,
+    &Material::normalsTextureIdx,
+    &Material::bumpTextureIdx,
+    &Material::normalHeightTextureIdx,
+};
+
+struct SnapshotWriter
+{
+    std::vector<u8> data;
+};
+
+struct SnapshotReader
+{
+    const u8* data;
+    u64       size;
+    u64       offset;
+    bool      failed;
+};
+
+static void WriteBytes(SnapshotWriter& writer, const void* src, u64 size)
+{
+    const u8* bytes = (const u8*)src;
+    writer.data.insert(writer.data.end(), bytes, bytes + size);
+}
+
+template <typename T>
+static void Write(SnapshotWriter& writer, const T& value)
+{
+    WriteBytes(writer, &value, sizeof(T));
+}
+
+static void WriteString(SnapshotWriter& writer, const std::string& value)
+{
+    Write<u32>(writer, (u32)value.size());
+    WriteBytes(writer, value.data(), value.size());
+}
+
+static void WritePayload(SnapshotWriter& writer, const void* src, u64 size)
+{
+    Write<u64>(writer, size);
+    writer.data.resize((writer.data.size() + SNAPSHOT_PAYLOAD_ALIGNMENT - 1) & ~(u64)(SNAPSHOT_PAYLOAD_ALIGNMENT - 1));
+    WriteBytes(writer, src, size);
+}
+
+template <typename T>
+static void WriteArray(SnapshotWriter& writer, const std::vector<T>& array)
+{
+    WritePayload(writer, array.data(), array.size() * sizeof(T));
+}
+
+static const u8* ReadBytes(SnapshotReader& reader, u64 size)
+{
+    if (reader.failed || size > reader.size - reader.offset)
+    {
+        reader.failed = true;
+        return NULL;
+    }
+    const u8* bytes = reader.data + reader.offset;
+    reader.offset += size;
+    return bytes;
+}
+
+template <typename T>
+static T Read(SnapshotReader& reader)
+{
+    T value = {};
+    if (const u8* bytes = ReadBytes(reader, sizeof(T)))
+        memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+static std::string ReadString(SnapshotReader& reader)
+{
+    u32 length = Read<u32>(reader);
+    const u8* bytes = ReadBytes(reader, length);
+    return bytes ? std::string((const char*)bytes, length) : std::string();
+}
+
+static const u8* ReadPayload(SnapshotReader& reader, u64& size)
+{
+    size = Read<u64>(reader);
+    u64 aligned = (reader.offset + SNAPSHOT_PAYLOAD_ALIGNMENT - 1) & ~(u64)(SNAPSHOT_PAYLOAD_ALIGNMENT - 1);
+    if (aligned > reader.size)
+        reader.failed = true;
+    else
+        reader.offset = aligned;
+    return ReadBytes(reader, size);
+}
+
+template <typename T>
+static void ReadArray(SnapshotReader& reader, std::vector<T>& array)
+{
+    u64 size;
+    const T* elements = (const T*)ReadPayload(reader, size);
+    if (elements)
+        array.assign(elements, elements + size / sizeof(T));
+}
+
+static u64 GetEnvironmentHash(const App* app)
+{
+    // The program binaries only load on the driver that made them
+    u64 hash = HashBytes(app->glInfo.vendor.data(), app->glInfo.vendor.size());
+    hash = HashCombine(hash, HashBytes(app->glInfo.renderer.data(), app->glInfo.renderer.size()));
+    hash = HashCombine(hash, HashBytes(app->glInfo.version.data(), app->glInfo.version.size()));
+    return HashCombine(hash, ((u64)COOKED_TEXTURE_VERSION << 32) | COOKED_MESH_VERSION);
+}
+
+// Files the state was built from. Assets read from the pack are covered by the
+// pack itself, the loose files are missing (timestamp 0) both times
+static std::vector<std::string> GatherSources(const App* app)
+{
+    std::vector<std::string> sources;
+    auto addSource = [&sources](const std::string& path)
+    {
+        if (!path.empty() && std::find(sources.begin(), sources.end(), path) == sources.end())
+            sources.push_back(path);
+    };
+
+    addSource("assets.pack");
+    addSource(app->scene.path);
+    for (const Program& program : app->programs)
+        addSource(program.filepath);
+    for (const Texture& tex : app->textures)
+        if (!tex.fromMemory)
+            addSource(tex.filepath);
+    for (const Mesh& mesh : app->meshes)
+        addSource(mesh.sourcePath);
+
+    return sources;
+}
+
+static bool WritePrograms(App* app, SnapshotWriter& writer)
+{
+    Write<u32>(writer, (u32)app->programs.size());
+
+    std::vector<u8> binary;
+    for (const Program& program : app->programs)
+    {
+        GLint length = 0;
+        glGetProgramiv(program.handle, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+        {
+            ELOG("WriteSnapshot() - The driver gives no binary for program %s", program.programName.c_str());
+            return false;
+        }
+
+        GLenum binaryFormat = 0;
+        binary.resize(length);
+        glGetProgramBinary(program.handle, length, &length, &binaryFormat, binary.data());
+
+        WriteString(writer, program.filepath);
+        WriteString(writer, program.programName);
+        Write<u32>(writer, program.features);
+        Write<u32>(writer, binaryFormat);
+        WritePayload(writer, binary.data(), (u64)length);
+
+        Write<u32>(writer, (u32)program.vertexInputLayout.attributes.size());
+        for (const VertexShaderAttribute& attribute : program.vertexInputLayout.attributes)
+        {
+            Write<u8>(writer, attribute.location);
+            Write<u8>(writer, attribute.componentCount);
+        }
+    }
+    return true;
+}
+
+static void WriteTextures(App* app, SnapshotWriter& writer)
+{
+    Write<u32>(writer, (u32)app->textures.size());
+
+    // Textures sharing contents share the array texture, the first one owns it
+    std::unordered_map<u32, u32> owners;
+    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+    {
+        const Texture& tex = app->textures[texIdx];
+        if (tex.arrayTextureIdx != UINT32_MAX && owners.find(tex.arrayTextureIdx) == owners.end())
+            owners[tex.arrayTextureIdx] = texIdx;
+    }
+
+    for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+    {
+        const Texture& tex = app->textures[texIdx];
+        u32 ownerTexIdx = tex.arrayTextureIdx != UINT32_MAX ? owners[tex.arrayTextureIdx] : UINT32_MAX;
+
+        WriteString(writer, tex.filepath);
+        Write<u8>(writer, tex.fromMemory);
+        Write<u32>(writer, ownerTexIdx);
+        if (ownerTexIdx != texIdx)
+            continue;
+
+        Write<u8>(writer, tex.streamedIdx != UINT32_MAX);
+        Write<u8>(writer, tex.virtualIdx != UINT32_MAX);
+
+        // Streamed textures keep every level, not only the resident ones
+        if (tex.streamedIdx != UINT32_MAX)
+        {
+            const CookedTexture& cooked = app->textureStreaming.textures[tex.streamedIdx].cooked;
+            Write<u32>(writer, cooked.glFormat);
+            Write<u32>(writer, cooked.width);
+            Write<u32>(writer, cooked.height);
+            Write<u32>(writer, cooked.levelCount);
+            for (u32 level = 0; level < cooked.levelCount; ++level)
+                WritePayload(writer, cooked.levelData[level], cooked.levelSizes[level]);
+        }
+        else
+        {
+            const ArrayTexture& location = app->textureArrays.textures[tex.arrayTextureIdx];
+            const TextureArray& array = app->textureArrays.arrays[location.arrayIdx];
+            Write<u32>(writer, array.glFormat);
+            Write<u32>(writer, array.width);
+            Write<u32>(writer, array.height);
+            Write<u32>(writer, array.levelCount);
+            for (u32 level = 0; level < array.levelCount; ++level)
+            {
+                std::vector<u8> levelData = ReadArrayTextureLevel(app, tex.arrayTextureIdx, level);
+                WritePayload(writer, levelData.data(), levelData.size());
+            }
+        }
+    }
+}
+
+static void WriteMaterials(App* app, SnapshotWriter& writer)
+{
+    Write<u32>(writer, (u32)app->materials.size());
+    for (const Material& material : app->materials)
+    {
+        WriteString(writer, material.name);
+        Write(writer, material.albedo);
+        Write(writer, material.emissive);
+        Write(writer, material.smoothness);
+        for (u32 Material::* slot : SnapshotMaterialTextures)
+            Write<u32>(writer, material.*slot);
+    }
+}
+
+static std::vector<u8> ReadBuffer(GLuint handle)
+{
+    GLint size = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, handle);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+
+    std::vector<u8> data(size);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, size, data.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return data;
+}
+
+static bool WriteMeshes(App* app, SnapshotWriter& writer)
+{
+    Write<u32>(writer, (u32)app->meshes.size());
+    for (Mesh& mesh : app->meshes)
+    {
+        // Evicted buffers are brought back to read them
+        if (!MakeMeshResident(app, mesh, true))
+        {
+            ELOG("WriteSnapshot() - The geometry of %s is not available", mesh.sourcePath.c_str());
+            return false;
+        }
+
+        bool sharedIndexBuffer = mesh.indexBufferHandle == mesh.vertexBufferHandle;
+
+        WriteString(writer, mesh.sourcePath);
+        Write<u8>(writer, mesh.reloadable);
+        Write<u32>(writer, mesh.residencyPolicy);
+        Write(writer, mesh.boundsMin);
+        Write(writer, mesh.boundsMax);
+        Write<u8>(writer, sharedIndexBuffer);
+
+        std::vector<u8> vertexData = ReadBuffer(mesh.vertexBufferHandle);
+        WritePayload(writer, vertexData.data(), vertexData.size());
+        if (!sharedIndexBuffer)
+        {
+            std::vector<u8> indexData = ReadBuffer(mesh.indexBufferHandle);
+            WritePayload(writer, indexData.data(), indexData.size());
+        }
+
+        Write<u32>(writer, (u32)mesh.submeshes.size());
+        for (const Submesh& submesh : mesh.submeshes)
+        {
+            Write<u32>(writer, (u32)submesh.vertexBufferLayout.attributes.size());
+            for (const VertexBufferAttribute& attribute : submesh.vertexBufferLayout.attributes)
+            {
+                Write(writer, attribute.location);
+                Write(writer, attribute.componentCount);
+                Write(writer, attribute.offset);
+                Write<u32>(writer, attribute.type);
+                Write(writer, attribute.normalized);
+                Write(writer, attribute.stride);
+            }
+            Write(writer, submesh.vertexBufferLayout.stride);
+            Write(writer, submesh.vertexOffset);
+            Write(writer, submesh.indexOffset);
+            Write(writer, submesh.indexCount);
+            Write<u32>(writer, submesh.indexType);
+            Write(writer, submesh.boundsMin);
+            Write(writer, submesh.boundsMax);
+        }
+    }
+    return true;
+}
+
+static void WriteScene(App* app, SnapshotWriter& writer)
+{
+    Write<u32>(writer, (u32)app->models.size());
+    for (const Model& model : app->models)
+    {
+        Write(writer, model.meshIdx);
+        WriteArray(writer, model.materialIdx);
+        WriteArray(writer, model.instances);
+    }
+
+    WriteArray(writer, app->entities.worldMatrices);
+    WriteArray(writer, app->entities.modelIndices);
+
+    Write<u32>(writer, (u32)app->lights.size());
+    for (const Light& light : app->lights)
+    {
+        Write<u32>(writer, light.type);
+        Write(writer, light.color);
+        Write(writer, light.direction);
+        Write(writer, light.position);
+    }
+
+    for (u32 App::* index : SnapshotAppIndices)
+        Write(writer, app->*index);
+    Write(writer, app->modelLoading.proxyMaterialIdx);
+    Write(writer, app->cameraPosition);
+    Write(writer, app->cameraReference);
+    Write(writer, app->cameraFieldOfView);
+    Write(writer, app->cameraNearPlane);
+    Write(writer, app->cameraFarPlane);
+
+    // To save the scene back
+    const Scene& scene = app->scene;
+    WriteString(writer, scene.path);
+    WriteArray(writer, scene.textures);
+    WriteArray(writer, scene.models);
+    WriteArray(writer, scene.overrides);
+    WriteArray(writer, scene.textureIndices);
+    Write(writer, scene.firstModelIdx);
+}
+
+bool WriteSnapshot(App* app, const char* path)
+{
+    if (!app->textureLoads.empty() || !app->modelLoading.loads.empty())
+    {
+        ELOG("WriteSnapshot() - Textures or models are still loading");
+        return false;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    SnapshotWriter writer;
+    writer.data.resize(sizeof(SnapshotHeader));
+
+    std::vector<std::string> sources = GatherSources(app);
+    Write<u32>(writer, (u32)sources.size());
+    for (const std::string& source : sources)
+    {
+        WriteString(writer, source);
+        Write<u64>(writer, GetFileLastWriteTimestamp(source.c_str()));
+    }
+
+    if (!WritePrograms(app, writer))
+        return false;
+    WriteTextures(app, writer);
+    WriteMaterials(app, writer);
+    if (!WriteMeshes(app, writer))
+        return false;
+    WriteScene(app, writer);
+
+    SnapshotHeader header = {};
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.environmentHash = GetEnvironmentHash(app);
+    header.size = writer.data.size();
+    header.contentHash = HashBytes(writer.data.data() + sizeof(header), writer.data.size() - sizeof(header));
+    memcpy(writer.data.data(), &header, sizeof(header));
+
+    // Written aside and renamed, so an interrupted write never looks like a valid snapshot.
+    // The snapshot the engine is running from stays mapped, which Windows does not let replace
+    std::string tmpPath = std::string(path) + ".tmp";
+    FILE* file = fopen(tmpPath.c_str(), "wb");
+    bool written = file && fwrite(writer.data.data(), 1, writer.data.size(), file) == writer.data.size();
+    if (file)
+        written = fclose(file) == 0 && written;
+
+    remove(path);
+    if (!written || rename(tmpPath.c_str(), path) != 0)
+    {
+        ELOG("WriteSnapshot() - Could not write %s", path);
+        remove(tmpPath.c_str());
+        return false;
+    }
+
+    Snapshot& snapshot = app->snapshot;
+    snapshot.writtenBytes = writer.data.size();
+    snapshot.writeMs = (f32)std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ILOG("Wrote snapshot %s (%.1f MB) in %.1f ms", path, snapshot.writtenBytes / (f32)MB(1), snapshot.writeMs);
+    return true;
+}
+
+static bool RestorePrograms(App* app, SnapshotReader& reader)
+{
+    u32 programCount = Read<u32>(reader);
+    for (u32 i = 0; i < programCount && !reader.failed; ++i)
+    {
+        Program program = {};
+        program.filepath = ReadString(reader);
+        program.programName = ReadString(reader);
+        program.features = Read<u32>(reader);
+
+        GLenum binaryFormat = Read<u32>(reader);
+        u64 binarySize;
+        const u8* binary = ReadPayload(reader, binarySize);
+
+        u32 attributeCount = Read<u32>(reader);
+        for (u32 j = 0; j < attributeCount; ++j)
+        {
+            VertexShaderAttribute attribute;
+            attribute.location = Read<u8>(reader);
+            attribute.componentCount = Read<u8>(reader);
+            program.vertexInputLayout.attributes.push_back(attribute);
+        }
+
+        if (reader.failed)
+            break;
+
+        GLint success = GL_FALSE;
+        program.handle = glCreateProgram();
+        glProgramParameteri(program.handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glProgramBinary(program.handle, binaryFormat, binary, (GLsizei)binarySize);
+        glGetProgramiv(program.handle, GL_LINK_STATUS, &success);
+        QueryProgramUniforms(program);
+
+        app->programs.push_back(program);
+
+        // Drivers may reject their own binaries after an update that kept the version string
+        if (!success)
+        {
+            ILOG("Snapshot program %s was rejected by the driver", program.programName.c_str());
+            reader.failed = true;
+        }
+    }
+
+    if (reader.failed)
+    {
+        for (const Program& program : app->programs)
+            glDeleteProgram(program.handle);
+        app->programs.clear();
+        return false;
+    }
+    return true;
+}
+
+static void RestoreTextures(App* app, SnapshotReader& reader)
+{
+    u32 textureCount = Read<u32>(reader);
+    app->textures.resize(textureCount);
+
+    // Owners may come after the textures sharing with them
+    std::vector<std::pair<u32, u32>> shared;
+
+    for (u32 texIdx = 0; texIdx < textureCount && !reader.failed; ++texIdx)
+    {
+        Texture& tex = app->textures[texIdx];
+        tex.filepath = ReadString(reader);
+        tex.fromMemory = Read<u8>(reader) != 0;
+        app->textureRegistry.byPath[tex.filepath] = texIdx;
+
+        u32 ownerTexIdx = Read<u32>(reader);
+        if (ownerTexIdx != texIdx)
+        {
+            if (ownerTexIdx != UINT32_MAX)
+                shared.push_back(std::make_pair(ownerTexIdx, texIdx));
+            continue;
+        }
+
+        bool streamed = Read<u8>(reader) != 0;
+        bool isVirtual = Read<u8>(reader) != 0;
+
+        CookedTexture cooked = {};
+        cooked.glFormat = Read<u32>(reader);
+        cooked.width = Read<u32>(reader);
+        cooked.height = Read<u32>(reader);
+        cooked.levelCount = Read<u32>(reader);
+        for (u32 level = 0; level < cooked.levelCount && !reader.failed; ++level)
+        {
+            u64 levelSize;
+            cooked.levelData.push_back(ReadPayload(reader, levelSize));
+            cooked.levelSizes.push_back((u32)levelSize);
+        }
+
+        if (reader.failed)
+            break;
+
+        // The cooked texture has no file of its own, its levels point into the mapping
+        if (streamed)
+        {
+            tex.arrayTextureIdx = StreamTexture(app, texIdx, cooked);
+            if (isVirtual)
+                RegisterVirtualTexture(app, texIdx);
+        }
+        else
+        {
+            tex.arrayTextureIdx = CreateArrayTexture(app, cooked.glFormat, cooked.width, cooked.height, cooked.levelCount);
+            for (u32 level = 0; level < cooked.levelCount; ++level)
+                UploadArrayTextureLevel(app, tex.arrayTextureIdx, level, cooked.levelData[level], cooked.levelSizes[level]);
+        }
+    }
+
+    for (const std::pair<u32, u32>& pair : shared)
+        if (pair.first < textureCount)
+            ShareTexture(app, pair.first, pair.second);
+}
+
+static void RestoreMaterials(App* app, SnapshotReader& reader)
+{
+    // Added as they are: sharedMaterials is not rebuilt, so models loaded later
+    // do not share the restored materials
+    u32 materialCount = Read<u32>(reader);
+    for (u32 i = 0; i < materialCount && !reader.failed; ++i)
+    {
+        Material material = {};
+        material.name = ReadString(reader);
+        material.albedo = Read<vec3>(reader);
+        material.emissive = Read<vec3>(reader);
+        material.smoothness = Read<f32>(reader);
+        for (u32 Material::* slot : SnapshotMaterialTextures)
+            material.*slot = Read<u32>(reader);
+        app->materials.push_back(material);
+    }
+}
+
+static void RestoreMeshes(App* app, SnapshotReader& reader)
+{
+    // Nor is sharedSubmeshes, for the same reason
+    u32 meshCount = Read<u32>(reader);
+    for (u32 meshIdx = 0; meshIdx < meshCount && !reader.failed; ++meshIdx)
+    {
+        app->meshes.push_back(Mesh{});
+        Mesh& mesh = app->meshes.back();
+        std::string sourcePath = ReadString(reader);
+        bool reloadable = Read<u8>(reader) != 0;
+        ResidencyPolicy policy = (ResidencyPolicy)Read<u32>(reader);
+        mesh.boundsMin = Read<vec3>(reader);
+        mesh.boundsMax = Read<vec3>(reader);
+        bool sharedIndexBuffer = Read<u8>(reader) != 0;
+
+        u64 vertexDataSize;
+        u64 indexDataSize = 0;
+        const u8* vertexData = ReadPayload(reader, vertexDataSize);
+        const u8* indexData = sharedIndexBuffer ? NULL : ReadPayload(reader, indexDataSize);
+
+        u32 submeshCount = Read<u32>(reader);
+        for (u32 i = 0; i < submeshCount && !reader.failed; ++i)
+        {
+            mesh.submeshes.push_back(Submesh{});
+            Submesh& submesh = mesh.submeshes.back();
+
+            u32 attributeCount = Read<u32>(reader);
+            for (u32 j = 0; j < attributeCount; ++j)
+            {
+                VertexBufferAttribute attribute;
+                attribute.location = Read<u8>(reader);
+                attribute.componentCount = Read<u8>(reader);
+                attribute.offset = Read<u32>(reader);
+                attribute.type = Read<u32>(reader);
+                attribute.normalized = Read<GLboolean>(reader);
+                attribute.stride = Read<u32>(reader);
+                submesh.vertexBufferLayout.attributes.push_back(attribute);
+            }
+            submesh.vertexBufferLayout.stride = Read<u8>(reader);
+            submesh.vertexOffset = Read<u32>(reader);
+            submesh.indexOffset = Read<u32>(reader);
+            submesh.indexCount = Read<u32>(reader);
+            submesh.indexType = Read<u32>(reader);
+            submesh.boundsMin = Read<vec3>(reader);
+            submesh.boundsMax = Read<vec3>(reader);
+        }
+
+        if (reader.failed)
+            break;
+
+        BufferRange vertexRange = { vertexData, vertexDataSize, 0 };
+        mesh.vertexBufferHandle = CreateStaticBuffer(app, vertexDataSize, &vertexRange, 1);
+        if (sharedIndexBuffer)
+        {
+            mesh.indexBufferHandle = mesh.vertexBufferHandle;
+        }
+        else
+        {
+            BufferRange indexRange = { indexData, indexDataSize, 0 };
+            mesh.indexBufferHandle = CreateStaticBuffer(app, indexDataSize, &indexRange, 1);
+        }
+
+        RegisterMeshResidency(app, meshIdx, sourcePath.c_str(), reloadable);
+        if (policy != Residency_DropCpuCopy && policy < Residency_Count)
+            SetMeshResidencyPolicy(app, meshIdx, policy);
+    }
+}
+
+static void RestoreScene(App* app, SnapshotReader& reader)
+{
+    u32 modelCount = Read<u32>(reader);
+    for (u32 i = 0; i < modelCount && !reader.failed; ++i)
+    {
+        Model model;
+        model.meshIdx = Read<u32>(reader);
+        ReadArray(reader, model.materialIdx);
+        ReadArray(reader, model.instances);
+        app->models.push_back(model);
+    }
+
+    ReadArray(reader, app->entities.worldMatrices);
+    ReadArray(reader, app->entities.modelIndices);
+
+    u32 lightCount = Read<u32>(reader);
+    for (u32 i = 0; i < lightCount && !reader.failed; ++i)
+    {
+        LightType type = (LightType)Read<u32>(reader);
+        vec3 color = Read<vec3>(reader);
+        vec3 direction = Read<vec3>(reader);
+        vec3 position = Read<vec3>(reader);
+        app->lights.push_back(Light(type, color, direction, position));
+    }
+
+    for (u32 App::* index : SnapshotAppIndices)
+        app->*index = Read<u32>(reader);
+    app->modelLoading.proxyMaterialIdx = Read<u32>(reader);
+    app->cameraPosition = Read<vec3>(reader);
+    app->cameraReference = Read<vec3>(reader);
+    app->cameraFieldOfView = Read<f32>(reader);
+    app->cameraNearPlane = Read<f32>(reader);
+    app->cameraFarPlane = Read<f32>(reader);
+
+    Scene& scene = app->scene;
+    scene.path = ReadString(reader);
+    ReadArray(reader, scene.textures);
+    ReadArray(reader, scene.models);
+    ReadArray(reader, scene.overrides);
+    ReadArray(reader, scene.textureIndices);
+    scene.firstModelIdx = Read<u32>(reader);
+}
+
+bool RestoreSnapshot(App* app, const char* path)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file = MapFile(path);
+    if (file.data == NULL)
+        return false;
+
+    const SnapshotHeader* header = (const SnapshotHeader*)file.data;
+    bool valid = file.size >= sizeof(SnapshotHeader) &&
+                 header->magic == SNAPSHOT_MAGIC &&
+                 header->version == SNAPSHOT_VERSION &&
+                 header->environmentHash == GetEnvironmentHash(app) &&
+                 header->size == file.size &&
+                 header->contentHash == HashBytes(file.data + sizeof(SnapshotHeader), file.size - sizeof(SnapshotHeader));
+
+    SnapshotReader reader = { file.data, file.size, sizeof(SnapshotHeader), false };
+
+    u32 sourceCount = valid ? Read<u32>(reader) : 0;
+    for (u32 i = 0; i < sourceCount && valid; ++i)
+    {
+        std::string source = ReadString(reader);
+        u64 timestamp = Read<u64>(reader);
+        if (!reader.failed && GetFileLastWriteTimestamp(source.c_str()) != timestamp)
+        {
+            ILOG("Snapshot %s is out of date, %s changed", path, source.c_str());
+            valid = false;
+        }
+    }
+
+    if (!valid || !RestorePrograms(app, reader))
+    {
+        ILOG("Snapshot %s can not be used, loading the scene", path);
+        UnmapFile(file);
+        return false;
+    }
+
+    RestoreTextures(app, reader);
+    RestoreMaterials(app, reader);
+    RestoreMeshes(app, reader);
+    RestoreScene(app, reader);
+
+    // The contents hash matched, so this only happens if the format changed
+    // without a version bump
+    if (reader.failed)
+        ELOG("RestoreSnapshot() - %s is truncated, the scene is incomplete", path);
+
+    Snapshot& snapshot = app->snapshot;
+    snapshot.file = file;
+    snapshot.restored = true;
+    snapshot.restoreMs = (f32)std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+    ILOG("Restored snapshot %s (%.1f MB) in %.1f ms", path, file.size / (f32)MB(1), snapshot.restoreMs);
+    return true;
+}
+
+void UpdateSnapshot(App* app)
+{
+    Snapshot& snapshot = app->snapshot;
+    if (snapshot.writeWhenLoaded && app->textureLoads.empty() && app->modelLoading.loads.empty())
+    {
+        WriteSnapshot(app, SNAPSHOT_PATH);
+        snapshot.writeWhenLoaded = false;
+    }
+}
+
+void SnapshotGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Snapshot"))
+        return;
+
+    Snapshot& snapshot = app->snapshot;
+
+    if (snapshot.restored)
+        ImGui::Text("Restored from %s in %.1f ms (%.1f MB)", SNAPSHOT_PATH, snapshot.restoreMs, snapshot.file.size / (f32)MB(1));
+    else
+        ImGui::Text("Loaded from the assets");
+
+    if (snapshot.writtenBytes > 0)
+        ImGui::Text("Written: %.1f MB in %.1f ms", snapshot.writtenBytes / (f32)MB(1), snapshot.writeMs);
+
+    ImGui::Checkbox("Write once loaded", &snapshot.writeWhenLoaded);
+    if (ImGui::Button("Write now"))
+        WriteSnapshot(app, SNAPSHOT_PATH);
+}
@@ -0,0 +1,52 @@
+//
+// snapshot.h: Warm starts. Once everything Init queued is loaded, the engine
+// state is written to a single file: program binaries, texture levels and mesh
+// buffers as they are uploaded, plus the resource tables, entities, lights and
+// camera. The next launch maps the file and creates the GL objects straight
+// from it, without importing, decoding or compiling anything.
+//
+// The snapshot records the write timestamps of the files the state was built
+// from and the GL driver it was written with. If any of them changed, the scene
+// is loaded from the assets as usual and the snapshot is written again.
+//
+
+#pragma once
+
+#include "platform.h"
+
+struct App;
+
+#define SNAPSHOT_PATH    "snapshot.bin"
+#define SNAPSHOT_VERSION 4
+
+struct Snapshot
+{
+    bool writeWhenLoaded = false; // write it as soon as no texture or model is loading
+
+    // Streamed textures read their levels from the mapping, so it stays mapped
+    MappedFile file;
+    bool       restored;
+    f32        restoreMs;
+    u64        writtenBytes;
+    f32        writeMs;
+};
+
+/**
+ * Recreates the scene from the snapshot. Returns false, touching nothing but
+ * the programs it created (and deleted), when there is no snapshot or it is
+ * out of date. Called from Init after the GL state that does not depend on
+ * the scene (framebuffers, samplers, buffers) is created.
+ */
+bool RestoreSnapshot(App* app, const char* path);
+
+/**
+ * Writes the current state. Fails while textures or models are loading.
+ */
+bool WriteSnapshot(App* app, const char* path);
+
+/**
+ * Once per frame: writes the snapshot once the loads are done, if requested.
+ */
+void UpdateSnapshot(App* app);
+
+void SnapshotGui(App* app);
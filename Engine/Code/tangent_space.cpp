@@ -0,0 +1,55 @@
+#include "tangent_space.h"
+#include "engine.h"
+
+void GenerateNormals(const std::vector<vec3>& positions, const std::vector<u32>& indices, std::vector<vec3>& normals)
+{
+    normals.assign(positions.size(), vec3(0.0f));
+    for (u32 i = 0; i + 2 < indices.size(); i += 3)
+    {
+        u32 i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+        vec3 faceNormal = glm::cross(positions[i1] - positions[i0], positions[i2] - positions[i0]); // area weighted
+        normals[i0] += faceNormal;
+        normals[i1] += faceNormal;
+        normals[i2] += faceNormal;
+    }
+    for (vec3& normal : normals)
+        normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : vec3(0.0f, 1.0f, 0.0f);
+}
+
+void GenerateTangents(const std::vector<vec3>& positions, const std::vector<vec3>& normals, const std::vector<vec2>& texCoords,
+                      const std::vector<u32>& indices, std::vector<vec4>& tangents)
+{
+    std::vector<vec3> uDirections(positions.size(), vec3(0.0f));
+    std::vector<vec3> vDirections(positions.size(), vec3(0.0f));
+
+    for (u32 i = 0; i + 2 < indices.size(); i += 3)
+    {
+        u32 i0 = indices[i], i1 = indices[i + 1], i2 = indices[i + 2];
+        vec3 edge1 = positions[i1] - positions[i0];
+        vec3 edge2 = positions[i2] - positions[i0];
+        vec2 deltaUV1 = texCoords[i1] - texCoords[i0];
+        vec2 deltaUV2 = texCoords[i2] - texCoords[i0];
+
+        f32 determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+        if (fabsf(determinant) < 1e-12f)
+            continue;
+
+        f32 r = 1.0f / determinant;
+        vec3 uDirection = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * r;
+        vec3 vDirection = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * r;
+        uDirections[i0] += uDirection; uDirections[i1] += uDirection; uDirections[i2] += uDirection;
+        vDirections[i0] += vDirection; vDirections[i1] += vDirection; vDirections[i2] += vDirection;
+    }
+
+    tangents.resize(positions.size());
+    for (u32 i = 0; i < positions.size(); ++i)
+    {
+        const vec3& n = normals[i];
+        vec3 t = uDirections[i] - n * glm::dot(n, uDirections[i]); // Gram-Schmidt
+        if (glm::length(t) < 1e-6f)
+            t = glm::cross(n, fabsf(n.x) < 0.9f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f));
+        t = glm::normalize(t);
+        f32 handedness = glm::dot(glm::cross(n, t), vDirections[i]) < 0.0f ? -1.0f : 1.0f;
+        tangents[i] = vec4(t, handedness);
+    }
+}
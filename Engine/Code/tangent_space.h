@@ -0,0 +1,21 @@
+//
+// tangent_space.h: Generation of the vertex attributes that some model formats
+// are allowed to leave out (smooth normals and per-vertex tangent frames).
+//
+
+#pragma once
+
+#include "platform.h"
+
+/**
+ * Area weighted smooth normals of an indexed triangle list.
+ */
+void GenerateNormals(const std::vector<glm::vec3>& positions, const std::vector<u32>& indices, std::vector<glm::vec3>& normals);
+
+/**
+ * Per-vertex tangents of an indexed triangle list, orthogonalized against the
+ * normals. The w component holds the handedness: cross(normal, tangent) * w
+ * points along the direction in which the v texture coordinate grows.
+ */
+void GenerateTangents(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& texCoords,
+                      const std::vector<u32>& indices, std::vector<glm::vec4>& tangents);
@@ -0,0 +1,399 @@
+#include "texture_arrays.h"
+#include "engine.h"
+#include <imgui.h>
+
+#define TEXTURE_ARRAY_MIN_LAYERS 4
+
+// ARB_bindless_texture is not core, so glad does not load it
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTURESAMPLERHANDLEARBPROC)(GLuint texture, GLuint sampler);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)(GLuint64 handle);
+
+static PFNGLGETTEXTURESAMPLERHANDLEARBPROC      GetTextureSamplerHandle = NULL;
+static PFNGLMAKETEXTUREHANDLERESIDENTARBPROC    MakeTextureHandleResident = NULL;
+static PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC MakeTextureHandleNonResident = NULL;
+
+static u32 GetBlockBytes(GLenum glFormat)
+{
+    switch (glFormat)
+    {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RED_RGTC1:
+            return 8;
+        case GL_RGBA8:
+            return 0;
+        default:
+            return 16;
+    }
+}
+
+static u64 GetLevelBytes(GLenum glFormat, u32 width, u32 height, u32 level)
+{
+    u32 blockBytes = GetBlockBytes(glFormat);
+    u32 levelWidth = glm::max(width >> level, 1u);
+    u32 levelHeight = glm::max(height >> level, 1u);
+    return blockBytes ? (u64)((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * blockBytes : (u64)levelWidth * levelHeight * 4;
+}
+
+static u64 GetLayerBytes(GLenum glFormat, u32 width, u32 height, u32 levelCount)
+{
+    u64 bytes = 0;
+    for (u32 level = 0; level < levelCount; ++level)
+        bytes += GetLevelBytes(glFormat, width, height, level);
+    return bytes;
+}
+
+// Creation and uploads go through the unit after the slots, so the arrays bound
+// to the slots stay bound
+static void BindArrayForUpdate(GLuint handle)
+{
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_FIRST_UNIT + TEXTURE_ARRAY_SLOTS);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+}
+
+static void EndArrayUpdate()
+{
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+static void BindArrayToSlot(const TextureArray& array)
+{
+    if (array.slot == UINT32_MAX)
+        return;
+
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_FIRST_UNIT + array.slot);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.handle);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Reallocates the array with room for capacity layers. The used layers are
+// packed at the beginning, so the textures may change layer
+static void ResizeTextureArray(App* app, u32 arrayIdx, u32 capacity)
+{
+    TextureArrays& arrays = app->textureArrays;
+    TextureArray& array = arrays.arrays[arrayIdx];
+
+    GLuint handle = 0;
+    GLuint64 bindlessHandle = 0;
+    if (capacity > 0)
+    {
+        glGenTextures(1, &handle);
+        BindArrayForUpdate(handle);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levelCount, array.glFormat, array.width, array.height, capacity);
+        EndArrayUpdate();
+
+        // The handle takes the material sampler, which the slots have bound otherwise
+        if (arrays.bindless)
+        {
+            bindlessHandle = GetTextureSamplerHandle(handle, app->samplers.handles[Sampler_Trilinear]);
+            MakeTextureHandleResident(bindlessHandle);
+        }
+    }
+
+    std::vector<u32> layerTextures(capacity, UINT32_MAX);
+    u32 newLayer = 0;
+    for (u32 layer = 0; layer < array.layerTextures.size(); ++layer)
+    {
+        u32 texIdx = array.layerTextures[layer];
+        if (texIdx == UINT32_MAX)
+            continue;
+
+        for (u32 level = 0; level < array.levelCount; ++level)
+        {
+            u32 levelWidth = glm::max(array.width >> level, 1u);
+            u32 levelHeight = glm::max(array.height >> level, 1u);
+            glCopyImageSubData(array.handle, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                               handle, GL_TEXTURE_2D_ARRAY, level, 0, 0, newLayer, levelWidth, levelHeight, 1);
+        }
+
+        arrays.textures[texIdx].layer = newLayer;
+        layerTextures[newLayer++] = texIdx;
+    }
+
+    if (array.bindlessHandle != 0)
+        MakeTextureHandleNonResident(array.bindlessHandle);
+    if (array.handle != 0)
+        glDeleteTextures(1, &array.handle);
+
+    arrays.vramUsage -= array.layerBytes * array.layerTextures.size();
+    arrays.vramUsage += array.layerBytes * capacity;
+
+    array.handle = handle;
+    array.bindlessHandle = bindlessHandle;
+    array.layerTextures.swap(layerTextures);
+    arrays.version++;
+    arrays.resizes++;
+
+    // Empty arrays give their slot back
+    if (handle == 0 && array.slot != UINT32_MAX)
+    {
+        arrays.slotArrays[array.slot] = 0;
+        array.slot = UINT32_MAX;
+    }
+
+    BindArrayToSlot(array);
+}
+
+static u32 FindTextureArray(App* app, GLenum glFormat, u32 width, u32 height, u32 levelCount)
+{
+    TextureArrays& arrays = app->textureArrays;
+    for (u32 i = 0; i < arrays.arrays.size(); ++i)
+    {
+        const TextureArray& array = arrays.arrays[i];
+        if (array.glFormat == glFormat && array.width == width && array.height == height && array.levelCount == levelCount)
+            return i;
+    }
+
+    TextureArray array = {};
+    array.glFormat = glFormat;
+    array.width = width;
+    array.height = height;
+    array.levelCount = levelCount;
+    array.slot = UINT32_MAX;
+    array.layerBytes = GetLayerBytes(glFormat, width, height, levelCount);
+    arrays.arrays.push_back(array);
+    return (u32)arrays.arrays.size() - 1;
+}
+
+static void FreeArrayLayer(App* app, const ArrayTexture& location)
+{
+    TextureArrays& arrays = app->textureArrays;
+    TextureArray& array = arrays.arrays[location.arrayIdx];
+
+    array.layerTextures[location.layer] = UINT32_MAX;
+    array.usedLayers--;
+
+    // Shrink once mostly empty, so evicted mips actually free memory
+    u32 capacity = (u32)array.layerTextures.size();
+    if (array.usedLayers == 0)
+        ResizeTextureArray(app, location.arrayIdx, 0);
+    else if (capacity > TEXTURE_ARRAY_MIN_LAYERS && array.usedLayers <= capacity / 4)
+        ResizeTextureArray(app, location.arrayIdx, capacity / 2);
+}
+
+void InitTextureArrays(App* app)
+{
+    if (!HasGLExtension(app, "GL_ARB_bindless_texture"))
+        return;
+
+    GetTextureSamplerHandle = (PFNGLGETTEXTURESAMPLERHANDLEARBPROC)GetGLProcAddress("glGetTextureSamplerHandleARB");
+    MakeTextureHandleResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)GetGLProcAddress("glMakeTextureHandleResidentARB");
+    MakeTextureHandleNonResident = (PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC)GetGLProcAddress("glMakeTextureHandleNonResidentARB");
+    app->textureArrays.bindless = GetTextureSamplerHandle && MakeTextureHandleResident && MakeTextureHandleNonResident;
+}
+
+u32 CreateArrayTexture(App* app, GLenum glFormat, u32 width, u32 height, u32 levelCount)
+{
+    TextureArrays& arrays = app->textureArrays;
+
+    u32 arrayIdx = FindTextureArray(app, glFormat, width, height, levelCount);
+    TextureArray& array = arrays.arrays[arrayIdx];
+
+    u32 capacity = (u32)array.layerTextures.size();
+    if (array.usedLayers == capacity)
+        ResizeTextureArray(app, arrayIdx, glm::max(capacity * 2, (u32)TEXTURE_ARRAY_MIN_LAYERS));
+
+    u32 layer = 0;
+    while (array.layerTextures[layer] != UINT32_MAX)
+        layer++;
+
+    u32 texIdx;
+    if (!arrays.freeTextures.empty())
+    {
+        texIdx = arrays.freeTextures.back();
+        arrays.freeTextures.pop_back();
+    }
+    else
+    {
+        texIdx = (u32)arrays.textures.size();
+        arrays.textures.push_back(ArrayTexture{});
+    }
+
+    arrays.textures[texIdx].arrayIdx = arrayIdx;
+    arrays.textures[texIdx].layer = layer;
+    array.layerTextures[layer] = texIdx;
+    array.usedLayers++;
+    arrays.version++;
+
+    return texIdx;
+}
+
+void DestroyArrayTexture(App* app, u32 texIdx)
+{
+    TextureArrays& arrays = app->textureArrays;
+    ArrayTexture location = arrays.textures[texIdx];
+
+    arrays.textures[texIdx].arrayIdx = UINT32_MAX;
+    arrays.freeTextures.push_back(texIdx);
+
+    FreeArrayLayer(app, location);
+}
+
+void ReplaceArrayTexture(App* app, u32 texIdx, u32 replacementIdx)
+{
+    TextureArrays& arrays = app->textureArrays;
+    ArrayTexture previous = arrays.textures[texIdx];
+    ArrayTexture replacement = arrays.textures[replacementIdx];
+
+    arrays.textures[texIdx] = replacement;
+    arrays.arrays[replacement.arrayIdx].layerTextures[replacement.layer] = texIdx;
+    arrays.textures[replacementIdx].arrayIdx = UINT32_MAX;
+    arrays.freeTextures.push_back(replacementIdx);
+    arrays.version++;
+
+    FreeArrayLayer(app, previous);
+}
+
+void UploadArrayTextureLevel(App* app, u32 texIdx, u32 level, const void* data, u32 size)
+{
+    const ArrayTexture& location = app->textureArrays.textures[texIdx];
+    const TextureArray& array = app->textureArrays.arrays[location.arrayIdx];
+
+    BindArrayForUpdate(array.handle);
+    if (GetBlockBytes(array.glFormat) == 0)
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, location.layer, glm::max(array.width >> level, 1u), glm::max(array.height >> level, 1u), 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, data);
+    else
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, location.layer, glm::max(array.width >> level, 1u), glm::max(array.height >> level, 1u), 1,
+                                  array.glFormat, (GLsizei)size, data);
+    EndArrayUpdate();
+}
+
+std::vector<u8> ReadArrayTextureLevel(App* app, u32 texIdx, u32 level)
+{
+    const ArrayTexture& location = app->textureArrays.textures[texIdx];
+    const TextureArray& array = app->textureArrays.arrays[location.arrayIdx];
+
+    // GL 4.3 reads whole levels, with every layer
+    u64 levelBytes = GetLevelBytes(array.glFormat, array.width, array.height, level);
+    std::vector<u8> layers(levelBytes * array.layerTextures.size());
+
+    BindArrayForUpdate(array.handle);
+    if (GetBlockBytes(array.glFormat) == 0)
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, GL_UNSIGNED_BYTE, layers.data());
+    else
+        glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, level, layers.data());
+    EndArrayUpdate();
+
+    return std::vector<u8>(layers.begin() + levelBytes * location.layer, layers.begin() + levelBytes * (location.layer + 1));
+}
+
+void CopyArrayTextureLevel(App* app, u32 srcIdx, u32 srcLevel, u32 dstIdx, u32 dstLevel)
+{
+    const TextureArrays& arrays = app->textureArrays;
+    const ArrayTexture& src = arrays.textures[srcIdx];
+    const ArrayTexture& dst = arrays.textures[dstIdx];
+    const TextureArray& srcArray = arrays.arrays[src.arrayIdx];
+    const TextureArray& dstArray = arrays.arrays[dst.arrayIdx];
+
+    glCopyImageSubData(srcArray.handle, GL_TEXTURE_2D_ARRAY, srcLevel, 0, 0, src.layer,
+                       dstArray.handle, GL_TEXTURE_2D_ARRAY, dstLevel, 0, 0, dst.layer,
+                       glm::max(dstArray.width >> dstLevel, 1u), glm::max(dstArray.height >> dstLevel, 1u), 1);
+}
+
+void CopyTextureToArrayTexture(App* app, GLuint srcTexture, u32 dstIdx)
+{
+    const ArrayTexture& dst = app->textureArrays.textures[dstIdx];
+    const TextureArray& array = app->textureArrays.arrays[dst.arrayIdx];
+
+    for (u32 level = 0; level < array.levelCount; ++level)
+    {
+        glCopyImageSubData(srcTexture, GL_TEXTURE_2D, level, 0, 0, 0,
+                           array.handle, GL_TEXTURE_2D_ARRAY, level, 0, 0, dst.layer,
+                           glm::max(array.width >> level, 1u), glm::max(array.height >> level, 1u), 1);
+    }
+}
+
+u32 GetArrayTextureLayer(const App* app, u32 texIdx)
+{
+    return app->textureArrays.textures[texIdx].layer;
+}
+
+GLuint64 GetArrayTextureHandle(const App* app, u32 texIdx)
+{
+    const TextureArrays& arrays = app->textureArrays;
+    return arrays.arrays[arrays.textures[texIdx].arrayIdx].bindlessHandle;
+}
+
+void BeginArrayTextureDraw(App* app)
+{
+    app->textureArrays.drawCounter++;
+}
+
+u32 BindArrayTexture(App* app, u32 texIdx)
+{
+    TextureArrays& arrays = app->textureArrays;
+    u32 arrayIdx = arrays.textures[texIdx].arrayIdx;
+    TextureArray& array = arrays.arrays[arrayIdx];
+
+    if (array.slot == UINT32_MAX)
+    {
+        // Least recently used slot. A draw binds a few arrays at most, so it is
+        // never one of the arrays of the current draw
+        u32 slot = 0;
+        for (u32 i = 1; i < TEXTURE_ARRAY_SLOTS; ++i)
+            if (arrays.slotLastUsed[i] < arrays.slotLastUsed[slot])
+                slot = i;
+
+        if (arrays.slotArrays[slot] != 0)
+            arrays.arrays[arrays.slotArrays[slot] - 1].slot = UINT32_MAX;
+
+        arrays.slotArrays[slot] = arrayIdx + 1;
+        array.slot = slot;
+        BindArrayToSlot(array);
+        arrays.binds++;
+    }
+
+    arrays.slotLastUsed[array.slot] = arrays.drawCounter;
+    return array.slot;
+}
+
+void TextureArraysGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Texture arrays"))
+        return;
+
+    TextureArrays& arrays = app->textureArrays;
+
+    ImGui::Text("VRAM: %.2f MB   Binds: %u   Resizes: %u", arrays.vramUsage / (f32)MB(1), arrays.binds, arrays.resizes);
+    ImGui::Text("Bindless handles: %s", arrays.bindless ? "yes" : "no (slots)");
+
+    if (ImGui::BeginTable("##textureArrays", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupColumn("Format");
+        ImGui::TableSetupColumn("Size");
+        ImGui::TableSetupColumn("Layers");
+        ImGui::TableSetupColumn("Slot");
+        ImGui::TableSetupColumn("VRAM (KB)");
+        ImGui::TableHeadersRow();
+
+        for (const TextureArray& array : arrays.arrays)
+        {
+            if (array.handle == 0)
+                continue;
+
+            ImGui::TableNextRow();
+
+            ImGui::TableNextColumn();
+            ImGui::Text("0x%04X", array.glFormat);
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%ux%u (%u mips)", array.width, array.height, array.levelCount);
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%u / %u", array.usedLayers, (u32)array.layerTextures.size());
+
+            ImGui::TableNextColumn();
+            if (array.slot != UINT32_MAX)
+                ImGui::Text("%u", array.slot);
+            else
+                ImGui::Text("-");
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", array.layerBytes * array.layerTextures.size() / 1024.0f);
+        }
+
+        ImGui::EndTable();
+    }
+}
@@ -0,0 +1,124 @@
+//
+// texture_arrays.h: The material textures are stored in GL_TEXTURE_2D_ARRAY
+// objects, one per format, size and mip count, instead of a texture object each.
+// The arrays stay bound to a fixed set of texture units (slots) and the material
+// table tells the shaders which layer to sample, so switching materials between
+// draws does not bind anything unless an array is not bound yet.
+//
+// With ARB_bindless_texture every array has a resident handle instead, which the
+// material table holds next to the layers: nothing is bound per draw at all, and
+// the slots are left unused.
+//
+// Textures are referred to by a stable index. Streaming resizes them, which moves
+// them to another array, and arrays are compacted when they get empty: the array
+// and layer of a texture change, its index does not.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+struct App;
+
+// Units 16 to 27 (uTextureArrays in the shaders), the passes and ImGui use the
+// first ones. Unit 28 is used for uploads
+#define TEXTURE_ARRAY_FIRST_UNIT 16
+#define TEXTURE_ARRAY_SLOTS      12
+
+struct TextureArray
+{
+    GLenum           glFormat;
+    u32              width;
+    u32              height;
+    u32              levelCount;
+    GLuint           handle;        // 0 while it holds no texture
+    std::vector<u32> layerTextures; // texture in every layer, UINT32_MAX if free
+    u32              usedLayers;
+    u32              slot;          // UINT32_MAX if not bound
+    u64              layerBytes;
+    GLuint64         bindlessHandle; // resident while the array has storage, bindless only
+};
+
+struct ArrayTexture
+{
+    u32 arrayIdx; // UINT32_MAX once destroyed
+    u32 layer;
+};
+
+struct TextureArrays
+{
+    bool bindless; // ARB_bindless_texture
+
+    std::vector<TextureArray> arrays;
+    std::vector<ArrayTexture> textures;
+    std::vector<u32>          freeTextures;
+
+    u32 slotArrays[TEXTURE_ARRAY_SLOTS];   // array bound to each slot + 1, 0 if none
+    u64 slotLastUsed[TEXTURE_ARRAY_SLOTS];
+    u64 drawCounter;
+
+    u32 version;   // changes every time a texture is placed in a layer
+    u64 vramUsage; // allocated layers, used or not
+
+    // since startup
+    u32 binds;
+    u32 resizes;
+};
+
+/**
+ * Loads ARB_bindless_texture where the driver has it. Called from Init before
+ * any texture is created.
+ */
+void InitTextureArrays(App* app);
+
+/**
+ * Allocates a layer in the array matching the format, size and mip count,
+ * creating or growing it as needed. The contents are undefined until uploaded.
+ */
+u32 CreateArrayTexture(App* app, GLenum glFormat, u32 width, u32 height, u32 levelCount);
+
+void DestroyArrayTexture(App* app, u32 texIdx);
+
+/**
+ * Moves the storage of replacementIdx to texIdx, whose previous layer is freed.
+ * Used to resize a texture without changing its index.
+ */
+void ReplaceArrayTexture(App* app, u32 texIdx, u32 replacementIdx);
+
+/**
+ * Uploads a level of block compressed data, or of RGBA8 pixels.
+ */
+void UploadArrayTextureLevel(App* app, u32 texIdx, u32 level, const void* data, u32 size);
+
+/**
+ * Reads a level back in the form it is uploaded. Slow, it waits for the GPU.
+ */
+std::vector<u8> ReadArrayTextureLevel(App* app, u32 texIdx, u32 level);
+
+void CopyArrayTextureLevel(App* app, u32 srcIdx, u32 srcLevel, u32 dstIdx, u32 dstLevel);
+
+/**
+ * Copies all the levels of a GL_TEXTURE_2D with the same format and size.
+ */
+void CopyTextureToArrayTexture(App* app, GLuint srcTexture, u32 dstIdx);
+
+u32 GetArrayTextureLayer(const App* app, u32 texIdx);
+
+/**
+ * Handle of the array holding the texture, for the material table. Bindless only.
+ */
+GLuint64 GetArrayTextureHandle(const App* app, u32 texIdx);
+
+/**
+ * Starts a draw: the arrays bound from now on are kept until it is issued.
+ */
+void BeginArrayTextureDraw(App* app);
+
+/**
+ * Binds the array holding the texture if it is not bound yet and returns its
+ * slot, to be passed to the shaders.
+ */
+u32 BindArrayTexture(App* app, u32 texIdx);
+
+void TextureArraysGui(App* app);
@@ -0,0 +1,390 @@
+#include "texture_compression.h"
+#include <math.h>
+
+// Mean and main direction of a set of 16 points with up to 4 dimensions (found
+// with a few power iterations over their covariance matrix)
+static void ComputePrincipalAxis(const f32 points[16][4], u32 dims, f32 mean[4], f32 axis[4])
+{
+    for (u32 d = 0; d < 4; ++d)
+    {
+        mean[d] = 0.0f;
+        axis[d] = 0.0f;
+    }
+
+    for (u32 i = 0; i < 16; ++i)
+        for (u32 d = 0; d < dims; ++d)
+            mean[d] += points[i][d] / 16.0f;
+
+    f32 covariance[4][4] = {};
+    for (u32 i = 0; i < 16; ++i)
+        for (u32 r = 0; r < dims; ++r)
+            for (u32 c = 0; c < dims; ++c)
+                covariance[r][c] += (points[i][r] - mean[r]) * (points[i][c] - mean[c]);
+
+    // start from the direction of the channel that varies the most
+    u32 largest = 0;
+    for (u32 d = 1; d < dims; ++d)
+        if (covariance[d][d] > covariance[largest][largest])
+            largest = d;
+
+    f32 vector[4] = {};
+    for (u32 d = 0; d < dims; ++d)
+        vector[d] = covariance[largest][d];
+
+    for (u32 iteration = 0; iteration < 8; ++iteration)
+    {
+        f32 next[4] = {};
+        f32 maxComponent = 0.0f;
+        for (u32 r = 0; r < dims; ++r)
+        {
+            for (u32 c = 0; c < dims; ++c)
+                next[r] += covariance[r][c] * vector[c];
+            maxComponent = fmaxf(maxComponent, fabsf(next[r]));
+        }
+
+        if (maxComponent == 0.0f)
+            return; // flat block, the axis stays null
+
+        for (u32 d = 0; d < dims; ++d)
+            vector[d] = next[d] / maxComponent;
+    }
+
+    f32 length = 0.0f;
+    for (u32 d = 0; d < dims; ++d)
+        length += vector[d] * vector[d];
+    length = sqrtf(length);
+
+    for (u32 d = 0; d < dims; ++d)
+        axis[d] = vector[d] / length;
+}
+
+// Projects the points on the axis and returns the extremes as endpoints
+static void ComputeEndpoints(const f32 points[16][4], u32 dims, const f32 mean[4], const f32 axis[4], f32 low[4], f32 high[4])
+{
+    f32 tMin = 0.0f, tMax = 0.0f;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        f32 t = 0.0f;
+        for (u32 d = 0; d < dims; ++d)
+            t += (points[i][d] - mean[d]) * axis[d];
+        tMin = fminf(tMin, t);
+        tMax = fmaxf(tMax, t);
+    }
+
+    for (u32 d = 0; d < 4; ++d)
+    {
+        low[d]  = fminf(fmaxf(mean[d] + axis[d] * tMin, 0.0f), 255.0f);
+        high[d] = fminf(fmaxf(mean[d] + axis[d] * tMax, 0.0f), 255.0f);
+    }
+}
+
+static f32 SquaredDistance(const f32* a, const f32* b, u32 dims)
+{
+    f32 distance = 0.0f;
+    for (u32 d = 0; d < dims; ++d)
+        distance += (a[d] - b[d]) * (a[d] - b[d]);
+    return distance;
+}
+
+// BC1 --------------------------------------------------------------------------
+
+static u16 PackRGB565(const f32 color[3])
+{
+    u32 r = (u32)(color[0] * 31.0f / 255.0f + 0.5f);
+    u32 g = (u32)(color[1] * 63.0f / 255.0f + 0.5f);
+    u32 b = (u32)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(u16 packed, f32 color[4])
+{
+    u32 r = (packed >> 11) & 31;
+    u32 g = (packed >> 5) & 63;
+    u32 b = packed & 31;
+    color[0] = (f32)((r << 3) | (r >> 2));
+    color[1] = (f32)((g << 2) | (g >> 4));
+    color[2] = (f32)((b << 3) | (b >> 2));
+    color[3] = 0.0f;
+}
+
+// Chooses the closest of the 4 colors for each pixel. Returns the total error.
+static f32 FitBC1Indices(const f32 points[16][4], u16& color0, u16& color1, u32& indices)
+{
+    // c0 > c1 selects the 4 color mode (c0 == c1 is fine, every index is 0)
+    if (color0 < color1)
+    {
+        u16 swap = color0;
+        color0 = color1;
+        color1 = swap;
+    }
+
+    f32 palette[4][4];
+    UnpackRGB565(color0, palette[0]);
+    UnpackRGB565(color1, palette[1]);
+    for (u32 d = 0; d < 3; ++d)
+    {
+        palette[2][d] = (2.0f * palette[0][d] + palette[1][d]) / 3.0f;
+        palette[3][d] = (palette[0][d] + 2.0f * palette[1][d]) / 3.0f;
+    }
+
+    indices = 0;
+    f32 error = 0.0f;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        u32 best = 0;
+        f32 bestDistance = SquaredDistance(points[i], palette[0], 3);
+        for (u32 p = 1; p < (color0 == color1 ? 1u : 4u); ++p)
+        {
+            f32 distance = SquaredDistance(points[i], palette[p], 3);
+            if (distance < bestDistance)
+            {
+                best = p;
+                bestDistance = distance;
+            }
+        }
+        indices |= best << (2 * i);
+        error += bestDistance;
+    }
+
+    return error;
+}
+
+// Least squares endpoints for a given set of indices
+static bool RefineBC1Endpoints(const f32 points[16][4], u32 indices, f32 color0[3], f32 color1[3])
+{
+    static const f32 weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+    f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    f32 ax[3] = {}, bx[3] = {};
+    for (u32 i = 0; i < 16; ++i)
+    {
+        f32 a = weights[(indices >> (2 * i)) & 3];
+        f32 b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (u32 d = 0; d < 3; ++d)
+        {
+            ax[d] += a * points[i][d];
+            bx[d] += b * points[i][d];
+        }
+    }
+
+    f32 determinant = aa * bb - ab * ab;
+    if (fabsf(determinant) < 1e-6f)
+        return false;
+
+    for (u32 d = 0; d < 3; ++d)
+    {
+        color0[d] = fminf(fmaxf((bb * ax[d] - ab * bx[d]) / determinant, 0.0f), 255.0f);
+        color1[d] = fminf(fmaxf((aa * bx[d] - ab * ax[d]) / determinant, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+void EncodeBC1Block(const u8 rgba[16 * 4], u8 output[8])
+{
+    f32 points[16][4];
+    for (u32 i = 0; i < 16; ++i)
+    {
+        points[i][0] = rgba[i * 4 + 0];
+        points[i][1] = rgba[i * 4 + 1];
+        points[i][2] = rgba[i * 4 + 2];
+        points[i][3] = 0.0f;
+    }
+
+    f32 mean[4], axis[4], low[4], high[4];
+    ComputePrincipalAxis(points, 3, mean, axis);
+    ComputeEndpoints(points, 3, mean, axis, low, high);
+
+    u16 color0 = PackRGB565(high);
+    u16 color1 = PackRGB565(low);
+    u32 indices;
+    f32 error = FitBC1Indices(points, color0, color1, indices);
+
+    f32 refined0[3], refined1[3];
+    if (error > 0.0f && RefineBC1Endpoints(points, indices, refined0, refined1))
+    {
+        u16 refinedColor0 = PackRGB565(refined0);
+        u16 refinedColor1 = PackRGB565(refined1);
+        u32 refinedIndices;
+        if (FitBC1Indices(points, refinedColor0, refinedColor1, refinedIndices) < error)
+        {
+            color0 = refinedColor0;
+            color1 = refinedColor1;
+            indices = refinedIndices;
+        }
+    }
+
+    output[0] = (u8)(color0 & 0xFF);
+    output[1] = (u8)(color0 >> 8);
+    output[2] = (u8)(color1 & 0xFF);
+    output[3] = (u8)(color1 >> 8);
+    output[4] = (u8)(indices & 0xFF);
+    output[5] = (u8)((indices >> 8) & 0xFF);
+    output[6] = (u8)((indices >> 16) & 0xFF);
+    output[7] = (u8)(indices >> 24);
+}
+
+// BC4 / BC5 / BC3 --------------------------------------------------------------
+
+void EncodeBC4Block(const u8 values[16], u8 output[8])
+{
+    u8 minValue = 255, maxValue = 0;
+    for (u32 i = 0; i < 16; ++i)
+    {
+        minValue = values[i] < minValue ? values[i] : minValue;
+        maxValue = values[i] > maxValue ? values[i] : maxValue;
+    }
+
+    // max > min selects the mode with 6 interpolated values. Palette index 0 is
+    // the max, 1 the min and 2..7 go from the max towards the min.
+    output[0] = maxValue;
+    output[1] = minValue;
+
+    u64 bits = 0;
+    if (maxValue > minValue)
+    {
+        const f32 range = (f32)(maxValue - minValue);
+        for (u32 i = 0; i < 16; ++i)
+        {
+            u32 step = (u32)((maxValue - values[i]) * 7.0f / range + 0.5f);
+            u64 index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+            bits |= index << (3 * i);
+        }
+    }
+
+    for (u32 i = 0; i < 6; ++i)
+        output[2 + i] = (u8)(bits >> (8 * i));
+}
+
+void EncodeBC5Block(const u8 red[16], const u8 green[16], u8 output[16])
+{
+    EncodeBC4Block(red, output);
+    EncodeBC4Block(green, output + 8);
+}
+
+void EncodeBC3Block(const u8 rgba[16 * 4], u8 output[16])
+{
+    u8 alpha[16];
+    for (u32 i = 0; i < 16; ++i)
+        alpha[i] = rgba[i * 4 + 3];
+
+    EncodeBC4Block(alpha, output);
+    EncodeBC1Block(rgba, output + 8); // BC3 color blocks always use the 4 color mode
+}
+
+// BC7 --------------------------------------------------------------------------
+
+struct BitWriter
+{
+    u8* data;
+    u32 bit;
+};
+
+static void WriteBits(BitWriter& writer, u32 value, u32 count)
+{
+    for (u32 i = 0; i < count; ++i, ++writer.bit)
+        if ((value >> i) & 1)
+            writer.data[writer.bit >> 3] |= (u8)(1 << (writer.bit & 7));
+}
+
+// Mode 6: one subset, RGBA 7.7.7.7 endpoints with a unique p-bit each and
+// 4 bit indices. It is the usual single mode choice for fast encoders.
+void EncodeBC7Block(const u8 rgba[16 * 4], u8 output[16])
+{
+    static const u32 weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    f32 points[16][4];
+    for (u32 i = 0; i < 16; ++i)
+        for (u32 d = 0; d < 4; ++d)
+            points[i][d] = rgba[i * 4 + d];
+
+    f32 mean[4], axis[4];
+    f32 endpoints[2][4];
+    ComputePrincipalAxis(points, 4, mean, axis);
+    ComputeEndpoints(points, 4, mean, axis, endpoints[0], endpoints[1]);
+
+    // quantize to 7 bits plus the p-bit that fits each endpoint best
+    u32 quantized[2][4];
+    u32 pBits[2];
+    for (u32 e = 0; e < 2; ++e)
+    {
+        f32 bestError = FLT_MAX;
+        for (u32 p = 0; p < 2; ++p)
+        {
+            u32 candidate[4];
+            f32 error = 0.0f;
+            for (u32 d = 0; d < 4; ++d)
+            {
+                i32 q = (i32)((endpoints[e][d] - p) / 2.0f + 0.5f);
+                candidate[d] = (u32)(q < 0 ? 0 : q > 127 ? 127 : q);
+                f32 reconstructed = (f32)((candidate[d] << 1) | p);
+                error += (reconstructed - endpoints[e][d]) * (reconstructed - endpoints[e][d]);
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pBits[e] = p;
+                memcpy(quantized[e], candidate, sizeof(candidate));
+            }
+        }
+    }
+
+    f32 palette[16][4];
+    for (u32 i = 0; i < 16; ++i)
+    {
+        for (u32 d = 0; d < 4; ++d)
+        {
+            u32 e0 = (quantized[0][d] << 1) | pBits[0];
+            u32 e1 = (quantized[1][d] << 1) | pBits[1];
+            palette[i][d] = (f32)(((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6);
+        }
+    }
+
+    u32 indices[16];
+    for (u32 i = 0; i < 16; ++i)
+    {
+        indices[i] = 0;
+        f32 bestDistance = SquaredDistance(points[i], palette[0], 4);
+        for (u32 p = 1; p < 16; ++p)
+        {
+            f32 distance = SquaredDistance(points[i], palette[p], 4);
+            if (distance < bestDistance)
+            {
+                indices[i] = p;
+                bestDistance = distance;
+            }
+        }
+    }
+
+    // the msb of the first index is implicitly 0, swap the endpoints if needed
+    if (indices[0] & 8)
+    {
+        for (u32 d = 0; d < 4; ++d)
+        {
+            u32 swap = quantized[0][d];
+            quantized[0][d] = quantized[1][d];
+            quantized[1][d] = swap;
+        }
+        u32 swap = pBits[0];
+        pBits[0] = pBits[1];
+        pBits[1] = swap;
+        for (u32 i = 0; i < 16; ++i)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(output, 0, 16);
+    BitWriter writer = { output, 0 };
+    WriteBits(writer, 1 << 6, 7); // mode 6
+    for (u32 d = 0; d < 4; ++d)
+    {
+        WriteBits(writer, quantized[0][d], 7);
+        WriteBits(writer, quantized[1][d], 7);
+    }
+    WriteBits(writer, pBits[0], 1);
+    WriteBits(writer, pBits[1], 1);
+    WriteBits(writer, indices[0], 3);
+    for (u32 i = 1; i < 16; ++i)
+        WriteBits(writer, indices[i], 4);
+}
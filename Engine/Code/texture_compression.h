@@ -0,0 +1,26 @@
+//
+// texture_compression.h: Encoders for the block compressed (BCn) texture
+// formats. Every function encodes one 4x4 block of pixels given in row order.
+// They favor speed over the best possible quality, as they run when cooking.
+//
+
+#pragma once
+
+#include "platform.h"
+
+#define BC_BLOCK_SIZE 4
+
+// 4 bpp RGB, for opaque color textures
+void EncodeBC1Block(const u8 rgba[16 * 4], u8 output[8]);
+
+// 8 bpp RGBA: BC4 alpha plus BC1 color, for color textures with alpha
+void EncodeBC3Block(const u8 rgba[16 * 4], u8 output[16]);
+
+// 4 bpp single channel, for height/displacement maps
+void EncodeBC4Block(const u8 values[16], u8 output[8]);
+
+// 8 bpp two channels, for the XY of tangent space normal maps
+void EncodeBC5Block(const u8 red[16], const u8 green[16], u8 output[16]);
+
+// 8 bpp RGBA with better quality than BC1/BC3 (mode 6 only)
+void EncodeBC7Block(const u8 rgba[16 * 4], u8 output[16]);
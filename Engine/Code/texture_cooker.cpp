@@ -0,0 +1,627 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "texture_cooker.h"
+#include "texture_compression.h"
+#include "engine.h"
+#include "hash.h"
+#include "job_system.h"
+#include <stb_image.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COOKER_SSE 1
+#include <emmintrin.h>
+#endif
+
+#define KTX2_LEVEL_ALIGNMENT 16
+#define KTX2_SOURCE_HASH_KEY "OGLEngine.sourceHash"
+
+// Vulkan formats, used by KTX2 to identify the data
+#define VK_FORMAT_BC1_RGB_UNORM_BLOCK 131
+#define VK_FORMAT_BC3_UNORM_BLOCK     137
+#define VK_FORMAT_BC4_UNORM_BLOCK     139
+#define VK_FORMAT_BC5_UNORM_BLOCK     141
+#define VK_FORMAT_BC7_UNORM_BLOCK     145
+
+// Khronos data format descriptor values
+#define KHR_DF_MODEL_BC1A            128
+#define KHR_DF_MODEL_BC3             130
+#define KHR_DF_MODEL_BC4             131
+#define KHR_DF_MODEL_BC5             132
+#define KHR_DF_MODEL_BC7             134
+#define KHR_DF_PRIMARIES_BT709       1
+#define KHR_DF_TRANSFER_LINEAR       1
+#define KHR_DF_CHANNEL_COLOR         0
+#define KHR_DF_CHANNEL_GREEN         1
+#define KHR_DF_CHANNEL_ALPHA         15
+
+static const u8 Ktx2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct Ktx2Header
+{
+    u8  identifier[12];
+    u32 vkFormat;
+    u32 typeSize;
+    u32 pixelWidth;
+    u32 pixelHeight;
+    u32 pixelDepth;
+    u32 layerCount;
+    u32 faceCount;
+    u32 levelCount;
+    u32 supercompressionScheme;
+    u32 dfdByteOffset;
+    u32 dfdByteLength;
+    u32 kvdByteOffset;
+    u32 kvdByteLength;
+    u64 sgdByteOffset;
+    u64 sgdByteLength;
+};
+
+struct Ktx2Level
+{
+    u64 byteOffset;
+    u64 byteLength;
+    u64 uncompressedByteLength;
+};
+
+struct CookedTextureFormat
+{
+    u32    vkFormat;
+    GLenum glFormat;
+    u32    blockBytes;
+    u8     colorModel;
+};
+
+static const CookedTextureFormat CookedTextureFormats[] =
+{
+    { VK_FORMAT_BC1_RGB_UNORM_BLOCK, GL_COMPRESSED_RGB_S3TC_DXT1_EXT,  8,  KHR_DF_MODEL_BC1A },
+    { VK_FORMAT_BC3_UNORM_BLOCK,     GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16, KHR_DF_MODEL_BC3  },
+    { VK_FORMAT_BC4_UNORM_BLOCK,     GL_COMPRESSED_RED_RGTC1,          8,  KHR_DF_MODEL_BC4  },
+    { VK_FORMAT_BC5_UNORM_BLOCK,     GL_COMPRESSED_RG_RGTC2,           16, KHR_DF_MODEL_BC5  },
+    { VK_FORMAT_BC7_UNORM_BLOCK,     GL_COMPRESSED_RGBA_BPTC_UNORM,    16, KHR_DF_MODEL_BC7  },
+};
+
+static const CookedTextureFormat* FindCookedTextureFormat(u32 vkFormat)
+{
+    for (u32 i = 0; i < ARRAY_COUNT(CookedTextureFormats); ++i)
+        if (CookedTextureFormats[i].vkFormat == vkFormat)
+            return &CookedTextureFormats[i];
+    return NULL;
+}
+
+static const CookedTextureFormat* ChooseCookedTextureFormat(TextureUsage usage, bool hasAlpha)
+{
+    switch (usage)
+    {
+        case TextureUsage_ColorHighQuality: return FindCookedTextureFormat(VK_FORMAT_BC7_UNORM_BLOCK);
+        case TextureUsage_Normal:           return FindCookedTextureFormat(VK_FORMAT_BC5_UNORM_BLOCK);
+        case TextureUsage_Height:           return FindCookedTextureFormat(VK_FORMAT_BC4_UNORM_BLOCK);
+        case TextureUsage_NormalHeight:     return FindCookedTextureFormat(VK_FORMAT_BC7_UNORM_BLOCK);
+        default:                            return FindCookedTextureFormat(hasAlpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+    }
+}
+
+u64 GetCookedTextureKey(u64 sourceHash, TextureUsage usage)
+{
+    return sourceHash != 0 ? HashCombine(sourceHash, ((u64)COOKED_TEXTURE_VERSION << 32) | (u64)usage) : 0;
+}
+
+std::string GetCookedTexturePath(const char* sourcePath)
+{
+    return std::string(sourcePath) + ".ktx2";
+}
+
+// Pixel conversions -------------------------------------------------------------
+
+static f32 SrgbToLinear(f32 value)
+{
+    return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static f32 LinearToSrgb(f32 value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static u8 ToUnorm8(f32 value)
+{
+    return (u8)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// The mip chain is filtered in a space where averaging makes sense: linear
+// light for colors and [-1, 1] vectors for normals. Packed normal and height
+// texels are decoded from both images, see CookPackedTexture
+static vec4 DecodeTexel(const u8* texel, TextureUsage usage, const f32* srgbToLinear)
+{
+    switch (usage)
+    {
+        case TextureUsage_Normal: return vec4(texel[0] / 127.5f - 1.0f, texel[1] / 127.5f - 1.0f, texel[2] / 127.5f - 1.0f, 0.0f);
+        case TextureUsage_Height: return vec4(texel[0] / 255.0f, 0.0f, 0.0f, 0.0f);
+        default:                  return vec4(srgbToLinear[texel[0]], srgbToLinear[texel[1]], srgbToLinear[texel[2]], texel[3] / 255.0f);
+    }
+}
+
+static void EncodeTexel(const vec4& value, TextureUsage usage, u8* texel)
+{
+    switch (usage)
+    {
+        case TextureUsage_Normal:
+        {
+            vec3 normal(value);
+            f32 length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : vec3(0.0f, 0.0f, 1.0f);
+            texel[0] = ToUnorm8(normal.x * 0.5f + 0.5f);
+            texel[1] = ToUnorm8(normal.y * 0.5f + 0.5f);
+            texel[2] = ToUnorm8(normal.z * 0.5f + 0.5f);
+            texel[3] = 255;
+        } break;
+
+        case TextureUsage_Height:
+            texel[0] = texel[1] = texel[2] = ToUnorm8(value.x);
+            texel[3] = 255;
+            break;
+
+        case TextureUsage_NormalHeight:
+        {
+            // xy from the renormalized xyz, as the Z rebuilt in the shaders assumes a unit vector
+            vec2 normal(value);
+            f32 length = glm::length(vec3(value));
+            normal = length > 0.0f ? normal / length : vec2(0.0f);
+            texel[0] = ToUnorm8(normal.x * 0.5f + 0.5f);
+            texel[1] = ToUnorm8(normal.y * 0.5f + 0.5f);
+            texel[2] = ToUnorm8(value.w);
+            texel[3] = 255;
+        } break;
+
+        default:
+            texel[0] = ToUnorm8(LinearToSrgb(value.x));
+            texel[1] = ToUnorm8(LinearToSrgb(value.y));
+            texel[2] = ToUnorm8(LinearToSrgb(value.z));
+            texel[3] = ToUnorm8(value.w);
+            break;
+    }
+}
+
+// Mip chain ---------------------------------------------------------------------
+
+// 2x2 box filter (odd sizes clamp to the last row/column)
+static void DownsampleLevel(const std::vector<vec4>& src, u32 srcWidth, u32 srcHeight,
+                            std::vector<vec4>& dst, u32 dstWidth, u32 dstHeight)
+{
+    dst.resize(dstWidth * dstHeight);
+
+    ParallelFor(dstHeight, [&](u32 y)
+    {
+        const vec4* row0 = &src[glm::min(2 * y, srcHeight - 1) * srcWidth];
+        const vec4* row1 = &src[glm::min(2 * y + 1, srcHeight - 1) * srcWidth];
+        vec4* out = &dst[y * dstWidth];
+
+        for (u32 x = 0; x < dstWidth; ++x)
+        {
+            u32 x0 = glm::min(2 * x, srcWidth - 1);
+            u32 x1 = glm::min(2 * x + 1, srcWidth - 1);
+#if TEXTURE_COOKER_SSE
+            __m128 top    = _mm_add_ps(_mm_loadu_ps(&row0[x0].x), _mm_loadu_ps(&row0[x1].x));
+            __m128 bottom = _mm_add_ps(_mm_loadu_ps(&row1[x0].x), _mm_loadu_ps(&row1[x1].x));
+            _mm_storeu_ps(&out[x].x, _mm_mul_ps(_mm_add_ps(top, bottom), _mm_set1_ps(0.25f)));
+#else
+            out[x] = (row0[x0] + row0[x1] + row1[x0] + row1[x1]) * 0.25f;
+#endif
+        }
+    });
+}
+
+static void CompressLevel(const std::vector<vec4>& level, u32 width, u32 height, TextureUsage usage,
+                          const CookedTextureFormat& format, std::vector<u8>& output)
+{
+    // back to 8 bits first, the encoders work on those
+    std::vector<u8> texels(width * height * 4);
+    ParallelFor(height, [&](u32 y)
+    {
+        for (u32 x = 0; x < width; ++x)
+            EncodeTexel(level[y * width + x], usage, &texels[(y * width + x) * 4]);
+    });
+
+    const u32 blocksX = (width + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE;
+    const u32 blocksY = (height + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE;
+    output.resize(blocksX * blocksY * format.blockBytes);
+
+    ParallelFor(blocksY, [&](u32 by)
+    {
+        for (u32 bx = 0; bx < blocksX; ++bx)
+        {
+            // partial blocks repeat the last row/column
+            u8 rgba[16 * 4], red[16], green[16];
+            for (u32 i = 0; i < 16; ++i)
+            {
+                u32 x = glm::min(bx * BC_BLOCK_SIZE + i % 4, width - 1);
+                u32 y = glm::min(by * BC_BLOCK_SIZE + i / 4, height - 1);
+                memcpy(&rgba[i * 4], &texels[(y * width + x) * 4], 4);
+                red[i] = rgba[i * 4 + 0];
+                green[i] = rgba[i * 4 + 1];
+            }
+
+            u8* block = &output[(by * blocksX + bx) * format.blockBytes];
+            switch (format.vkFormat)
+            {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK: EncodeBC1Block(rgba, block); break;
+                case VK_FORMAT_BC3_UNORM_BLOCK:     EncodeBC3Block(rgba, block); break;
+                case VK_FORMAT_BC4_UNORM_BLOCK:     EncodeBC4Block(red, block); break;
+                case VK_FORMAT_BC5_UNORM_BLOCK:     EncodeBC5Block(red, green, block); break;
+                case VK_FORMAT_BC7_UNORM_BLOCK:     EncodeBC7Block(rgba, block); break;
+            }
+        }
+    });
+}
+
+// KTX2 --------------------------------------------------------------------------
+
+// Basic data format descriptor, required by the KTX2 spec
+static std::vector<u32> MakeDataFormatDescriptor(const CookedTextureFormat& format)
+{
+    struct Sample { u32 bitOffset; u32 bitLength; u32 channelType; };
+    Sample samples[2];
+    u32 sampleCount = 1;
+
+    switch (format.vkFormat)
+    {
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+            samples[0] = Sample{ 0, 64, KHR_DF_CHANNEL_ALPHA };
+            samples[1] = Sample{ 64, 64, KHR_DF_CHANNEL_COLOR };
+            sampleCount = 2;
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            samples[0] = Sample{ 0, 64, KHR_DF_CHANNEL_COLOR };
+            samples[1] = Sample{ 64, 64, KHR_DF_CHANNEL_GREEN };
+            sampleCount = 2;
+            break;
+        default:
+            samples[0] = Sample{ 0, format.blockBytes * 8, KHR_DF_CHANNEL_COLOR };
+            break;
+    }
+
+    const u32 blockSize = 24 + 16 * sampleCount;
+
+    std::vector<u32> words;
+    words.push_back(4 + blockSize);                                          // dfdTotalSize
+    words.push_back(0);                                                      // vendorId, descriptorType
+    words.push_back(2 | (blockSize << 16));                                  // versionNumber, descriptorBlockSize
+    words.push_back(format.colorModel | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+    words.push_back(3 | (3 << 8));                                           // 4x4 texel blocks
+    words.push_back(format.blockBytes);                                      // bytesPlane0
+    words.push_back(0);
+    for (u32 i = 0; i < sampleCount; ++i)
+    {
+        words.push_back(samples[i].bitOffset | ((samples[i].bitLength - 1) << 16) | (samples[i].channelType << 24));
+        words.push_back(0);          // sample position
+        words.push_back(0);          // sampleLower
+        words.push_back(0xFFFFFFFF); // sampleUpper
+    }
+    return words;
+}
+
+static bool WriteKtx2(const char* path, const CookedTextureFormat& format, u32 width, u32 height,
+                      const std::vector<std::vector<u8>>& levels, u64 sourceHash)
+{
+    const u32 levelCount = (u32)levels.size();
+    std::vector<u32> dfd = MakeDataFormatDescriptor(format);
+
+    // one key/value pair: the hash of the source image
+    const u32 keyLength = (u32)strlen(KTX2_SOURCE_HASH_KEY) + 1;
+    const u32 keyAndValueLength = keyLength + sizeof(u64);
+
+    Ktx2Header header = {};
+    memcpy(header.identifier, Ktx2Identifier, sizeof(Ktx2Identifier));
+    header.vkFormat = format.vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+    header.dfdByteOffset = sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level);
+    header.dfdByteLength = (u32)(dfd.size() * sizeof(u32));
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = Align(sizeof(u32) + keyAndValueLength, 4);
+
+    // the smallest level goes first
+    std::vector<Ktx2Level> levelIndex(levelCount);
+    u64 offset = header.kvdByteOffset + header.kvdByteLength;
+    for (i32 level = (i32)levelCount - 1; level >= 0; --level)
+    {
+        offset = (offset + KTX2_LEVEL_ALIGNMENT - 1) & ~(u64)(KTX2_LEVEL_ALIGNMENT - 1);
+        levelIndex[level].byteOffset = offset;
+        levelIndex[level].byteLength = levels[level].size();
+        levelIndex[level].uncompressedByteLength = levels[level].size();
+        offset += levels[level].size();
+    }
+
+    std::vector<u8> fileData(offset, 0);
+    memcpy(fileData.data(), &header, sizeof(header));
+    memcpy(fileData.data() + sizeof(header), levelIndex.data(), levelCount * sizeof(Ktx2Level));
+    memcpy(fileData.data() + header.dfdByteOffset, dfd.data(), header.dfdByteLength);
+
+    u8* keyValue = fileData.data() + header.kvdByteOffset;
+    memcpy(keyValue, &keyAndValueLength, sizeof(u32));
+    memcpy(keyValue + sizeof(u32), KTX2_SOURCE_HASH_KEY, keyLength);
+    memcpy(keyValue + sizeof(u32) + keyLength, &sourceHash, sizeof(u64));
+
+    for (u32 level = 0; level < levelCount; ++level)
+        memcpy(fileData.data() + levelIndex[level].byteOffset, levels[level].data(), levels[level].size());
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        ELOG("fopen() failed writing file %s", path);
+        return false;
+    }
+
+    bool written = fwrite(fileData.data(), 1, fileData.size(), file) == fileData.size();
+    fclose(file);
+
+    if (!written)
+    {
+        ELOG("fwrite() failed writing file %s", path);
+        remove(path);
+        return false;
+    }
+
+    return true;
+}
+
+static bool FindKtx2SourceHash(const AssetFile& file, const Ktx2Header& header, u64& sourceHash)
+{
+    if ((u64)header.kvdByteOffset + header.kvdByteLength > file.size)
+        return false;
+
+    const u8* cursor = file.data + header.kvdByteOffset;
+    const u8* end = cursor + header.kvdByteLength;
+    const u32 keyLength = (u32)strlen(KTX2_SOURCE_HASH_KEY) + 1;
+
+    while (cursor + sizeof(u32) <= end)
+    {
+        u32 keyAndValueLength;
+        memcpy(&keyAndValueLength, cursor, sizeof(u32));
+        const u8* keyAndValue = cursor + sizeof(u32);
+        if (keyAndValue + keyAndValueLength > end)
+            return false;
+
+        if (keyAndValueLength == keyLength + sizeof(u64) && memcmp(keyAndValue, KTX2_SOURCE_HASH_KEY, keyLength) == 0)
+        {
+            memcpy(&sourceHash, keyAndValue + keyLength, sizeof(u64));
+            return true;
+        }
+
+        cursor = keyAndValue + Align(keyAndValueLength, 4);
+    }
+
+    return false;
+}
+
+// Builds the mip chain of the decoded level 0, compresses it and writes the cooked
+// file of sourcePath
+static bool CookLevels(std::vector<vec4>& level, u32 width, u32 height, TextureUsage usage,
+                       const CookedTextureFormat& format, const char* sourcePath, u64 cookedKey)
+{
+    u32 levelWidth = width;
+    u32 levelHeight = height;
+    const u32 levelCount = 1 + (u32)floorf(log2f((f32)glm::max(levelWidth, levelHeight)));
+    std::vector<std::vector<u8>> levels(levelCount);
+    std::vector<vec4> nextLevel;
+
+    for (u32 i = 0; i < levelCount; ++i)
+    {
+        CompressLevel(level, levelWidth, levelHeight, usage, format, levels[i]);
+
+        if (i + 1 < levelCount)
+        {
+            u32 nextWidth = glm::max(levelWidth / 2, 1u);
+            u32 nextHeight = glm::max(levelHeight / 2, 1u);
+            DownsampleLevel(level, levelWidth, levelHeight, nextLevel, nextWidth, nextHeight);
+            level.swap(nextLevel);
+            levelWidth = nextWidth;
+            levelHeight = nextHeight;
+        }
+    }
+
+    return WriteKtx2(GetCookedTexturePath(sourcePath).c_str(), format, width, height, levels, cookedKey);
+}
+
+// RGBA8, through the asset pack. Free with stbi_image_free
+static u8* LoadImageRGBA8(const char* filepath, int& width, int& height, int& channels)
+{
+    AssetFile file = OpenAsset(filepath);
+    if (file.data == NULL)
+        return NULL;
+
+    u8* pixels = stbi_load_from_memory(file.data, (int)file.size, &width, &height, &channels, 4);
+    CloseAsset(file);
+    return pixels;
+}
+
+// Public API --------------------------------------------------------------------
+
+bool CookTexture(const char* sourcePath, TextureUsage usage)
+{
+    // Same orientation as the uncooked textures. The flag is per thread as
+    // textures are cooked from the decode pool
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    int width, height, channels;
+    u8* pixels = LoadImageRGBA8(sourcePath, width, height, channels);
+    if (!pixels)
+        return false; // the uncooked path reports it
+
+    bool hasAlpha = false;
+    if (channels == 2 || channels == 4)
+        for (int i = 0; i < width * height && !hasAlpha; ++i)
+            hasAlpha = pixels[i * 4 + 3] != 255;
+
+    const CookedTextureFormat& format = *ChooseCookedTextureFormat(usage, hasAlpha);
+
+    f32 srgbToLinear[256];
+    for (u32 i = 0; i < 256; ++i)
+        srgbToLinear[i] = SrgbToLinear(i / 255.0f);
+
+    u32 levelWidth = (u32)width;
+    u32 levelHeight = (u32)height;
+    std::vector<vec4> level(levelWidth * levelHeight);
+    ParallelFor(levelHeight, [&](u32 y)
+    {
+        for (u32 x = 0; x < levelWidth; ++x)
+            level[y * levelWidth + x] = DecodeTexel(&pixels[(y * levelWidth + x) * 4], usage, srgbToLinear);
+    });
+    stbi_image_free(pixels);
+
+    return CookLevels(level, (u32)width, (u32)height, usage, format, sourcePath, GetCookedTextureKey(HashFile(sourcePath), usage));
+}
+
+std::string GetPackedTextureName(const char* normalPath, const char* heightPath)
+{
+    // next to the normal map: <normal map>+<height map file name>
+    const char* heightName = heightPath;
+    for (const char* c = heightPath; *c; ++c)
+        if (*c == '/' || *c == '\\')
+            heightName = c + 1;
+
+    return std::string(normalPath) + "+" + heightName;
+}
+
+u64 HashPackedTextureSources(const char* normalPath, const char* heightPath)
+{
+    u64 normalHash = HashFile(normalPath);
+    u64 heightHash = HashFile(heightPath);
+    return normalHash != 0 && heightHash != 0 ? HashCombine(normalHash, heightHash) : 0;
+}
+
+bool CookPackedTexture(const char* normalPath, const char* heightPath)
+{
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    int width, height, heightWidth, heightHeight, channels;
+    u8* normalPixels = LoadImageRGBA8(normalPath, width, height, channels);
+    u8* heightPixels = LoadImageRGBA8(heightPath, heightWidth, heightHeight, channels);
+
+    bool valid = normalPixels && heightPixels && width == heightWidth && height == heightHeight;
+    if (normalPixels && heightPixels && !valid)
+        ELOG("Can not pack %s with %s, their sizes differ", normalPath, heightPath);
+
+    std::vector<vec4> level;
+    if (valid)
+    {
+        // xyz of the normal and the height, filtered together
+        level.resize((u32)width * height);
+        ParallelFor((u32)height, [&](u32 y)
+        {
+            for (u32 x = 0; x < (u32)width; ++x)
+            {
+                u32 i = y * width + x;
+                vec4 normal = DecodeTexel(&normalPixels[i * 4], TextureUsage_Normal, NULL);
+                level[i] = vec4(vec3(normal), DecodeTexel(&heightPixels[i * 4], TextureUsage_Height, NULL).x);
+            }
+        });
+    }
+
+    stbi_image_free(normalPixels);
+    stbi_image_free(heightPixels);
+    if (!valid)
+        return false;
+
+    const TextureUsage usage = TextureUsage_NormalHeight;
+    std::string packedName = GetPackedTextureName(normalPath, heightPath);
+    return CookLevels(level, (u32)width, (u32)height, usage, *ChooseCookedTextureFormat(usage, false), packedName.c_str(),
+                      GetCookedTextureKey(HashPackedTextureSources(normalPath, heightPath), usage));
+}
+
+bool ReadCookedTexture(const char* sourcePath, u64 sourceHash, TextureUsage usage, CookedTexture& cooked)
+{
+    std::string cookedPath = GetCookedTexturePath(sourcePath);
+
+    AssetFile file = OpenAsset(cookedPath.c_str());
+    if (file.data == NULL)
+        return false;
+
+    const Ktx2Header* header = (const Ktx2Header*)file.data;
+    const Ktx2Level* levels = (const Ktx2Level*)(file.data + sizeof(Ktx2Header));
+    const CookedTextureFormat* format = NULL;
+
+    bool valid = file.size >= sizeof(Ktx2Header) &&
+                 memcmp(header->identifier, Ktx2Identifier, sizeof(Ktx2Identifier)) == 0 &&
+                 (format = FindCookedTextureFormat(header->vkFormat)) != NULL &&
+                 header->pixelDepth == 0 && header->layerCount == 0 && header->faceCount == 1 &&
+                 header->supercompressionScheme == 0 && header->levelCount > 0 &&
+                 sizeof(Ktx2Header) + header->levelCount * sizeof(Ktx2Level) <= file.size;
+
+    for (u32 level = 0; valid && level < header->levelCount; ++level)
+        valid = levels[level].byteOffset + levels[level].byteLength <= file.size;
+
+    // A missing source is fine (shipping only cooked data), otherwise it must match
+    u64 cookedHash = 0;
+    if (valid)
+    {
+        valid = FindKtx2SourceHash(file, *header, cookedHash) && (sourceHash == 0 || GetCookedTextureKey(sourceHash, usage) == cookedHash);
+    }
+
+    if (!valid)
+    {
+        ILOG("Cooked texture %s is out of date", cookedPath.c_str());
+        CloseAsset(file);
+        return false;
+    }
+
+    cooked.file = file;
+    cooked.width = header->pixelWidth;
+    cooked.height = header->pixelHeight;
+    cooked.levelCount = header->levelCount;
+    cooked.glFormat = format->glFormat;
+    for (u32 level = 0; level < header->levelCount; ++level)
+    {
+        cooked.levelData.push_back(file.data + levels[level].byteOffset);
+        cooked.levelSizes.push_back((u32)levels[level].byteLength);
+    }
+
+    return true;
+}
+
+// Filtering and wrapping come from the shared samplers (see samplers.h)
+GLuint UploadCookedTexture(const CookedTexture& cooked)
+{
+    const GLExtensions& ext = GlobalGLExtensions;
+    GLuint texHandle = CreateTextureStorage2D(cooked.glFormat, cooked.width, cooked.height, cooked.levelCount);
+
+    if (!ext.directStateAccess)
+        glBindTexture(GL_TEXTURE_2D, texHandle);
+
+    for (u32 level = 0; level < cooked.levelCount; ++level)
+    {
+        GLsizei levelWidth = glm::max(cooked.width >> level, 1u);
+        GLsizei levelHeight = glm::max(cooked.height >> level, 1u);
+        if (ext.directStateAccess)
+            ext.CompressedTextureSubImage2D(texHandle, level, 0, 0, levelWidth, levelHeight, cooked.glFormat,
+                                            (GLsizei)cooked.levelSizes[level], cooked.levelData[level]);
+        else
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelWidth, levelHeight, cooked.glFormat,
+                                      (GLsizei)cooked.levelSizes[level], cooked.levelData[level]);
+    }
+
+    if (!ext.directStateAccess)
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texHandle;
+}
+
+void ReleaseCookedTexture(CookedTexture& cooked)
+{
+    CloseAsset(cooked.file);
+    cooked = CookedTexture{};
+}
+
+GLuint LoadCookedTexture(const char* sourcePath, TextureUsage usage)
+{
+    CookedTexture cooked = {};
+    if (!ReadCookedTexture(sourcePath, HashFile(sourcePath), usage, cooked))
+        return 0;
+
+    GLuint texHandle = UploadCookedTexture(cooked);
+    ReleaseCookedTexture(cooked);
+    return texHandle;
+}
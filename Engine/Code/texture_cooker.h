@@ -0,0 +1,99 @@
+//
+// texture_cooker.h: Cooked textures. Source images are decoded once, their mip
+// chain is generated on the CPU and every level is block compressed with the
+// format that suits how the texture is used. The result is stored in a KTX2
+// file next to the source (<source>.ktx2) and later launches upload it level
+// by level without decoding anything.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "asset_pack.h"
+#include <glad/glad.h>
+#include <vector>
+
+#define COOKED_TEXTURE_VERSION 2
+
+// S3TC is an extension, so glad (core profile) does not define it
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum TextureUsage
+{
+    TextureUsage_Color,            // BC1, or BC3 if it has alpha. Mips filtered in linear space
+    TextureUsage_ColorHighQuality, // BC7
+    TextureUsage_Normal,           // BC5 with the tangent space XY, Z is rebuilt in the shaders
+    TextureUsage_Height,           // BC4 with the red channel (displacement, relief maps)
+    TextureUsage_NormalHeight,     // BC7 with a normal map's XY in RG and a height map in B (see CookPackedTexture)
+    TextureUsage_Count
+};
+
+/**
+ * A cooked file opened (see asset_pack.h) and validated, ready to be uploaded.
+ */
+struct CookedTexture
+{
+    AssetFile              file;
+    u32                    width;
+    u32                    height;
+    u32                    levelCount;
+    GLenum                 glFormat;
+    std::vector<const u8*> levelData;
+    std::vector<u32>       levelSizes;
+};
+
+/**
+ * Path of the cooked file for a given source image.
+ */
+std::string GetCookedTexturePath(const char* sourcePath);
+
+/**
+ * Identifies what a cooked file is made from: source contents, usage and cooker
+ * version. 0 if the source hash is 0 (the source is missing).
+ */
+u64 GetCookedTextureKey(u64 sourceHash, TextureUsage usage);
+
+/**
+ * Decodes, builds the mip chain, compresses and writes the cooked file.
+ */
+bool CookTexture(const char* sourcePath, TextureUsage usage);
+
+/**
+ * Name of the texture packing a normal map with a height map, so relief mapped
+ * materials sample one texture for both. Used as the source path of the cooked
+ * file (<name>.ktx2) and to register the texture.
+ */
+std::string GetPackedTextureName(const char* normalPath, const char* heightPath);
+
+/**
+ * Hash of both sources of a packed texture, 0 if either is missing.
+ */
+u64 HashPackedTextureSources(const char* normalPath, const char* heightPath);
+
+/**
+ * Cooks a TextureUsage_NormalHeight texture. Both images must have the same size.
+ */
+bool CookPackedTexture(const char* normalPath, const char* heightPath);
+
+/**
+ * Maps and validates the cooked file. It does not touch GL, so it can run on
+ * any thread. The source hash is HashFile(sourcePath), 0 if the source is not
+ * available. Returns false if there is no cooked file or it is out of date.
+ */
+bool ReadCookedTexture(const char* sourcePath, u64 sourceHash, TextureUsage usage, CookedTexture& cooked);
+
+/**
+ * Creates the texture and uploads every level. Main thread only.
+ */
+GLuint UploadCookedTexture(const CookedTexture& cooked);
+
+void ReleaseCookedTexture(CookedTexture& cooked);
+
+/**
+ * Creates a texture from the cooked file. Returns 0 if there is no cooked file
+ * or it is out of date (source changed or cooked with another usage).
+ */
+GLuint LoadCookedTexture(const char* sourcePath, TextureUsage usage);
@@ -0,0 +1,424 @@
+#include "texture_loading.h"
+#include "asset_pack.h"
+#include "engine.h"
+#include "job_system.h"
+#include "hash.h"
+#include <stb_image.h>
+#include <chrono>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEXTURE_LOADING_SIMD 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_SSSE3
+#else
+#include <cpuid.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+// Pixel conversion --------------------------------------------------------------
+
+#if TEXTURE_LOADING_SIMD
+static bool CpuHasSSSE3()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSSE3) != 0;
+#endif
+}
+
+static const bool HasSSSE3 = CpuHasSSSE3();
+
+// Returns the number of pixels converted, the caller finishes the tail
+TARGET_SSSE3 static u32 ConvertRGBToRGBA8_SSSE3(const u8* src, u32 pixelCount, u8* dst)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+    // Every load reads 16 bytes to use 12 (4 pixels), so stop 6 pixels before the end
+    u32 i = 0;
+    for (; i + 6 <= pixelCount; i += 4)
+    {
+        __m128i rgb = _mm_loadu_si128((const __m128i*)(src + i * 3));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+    }
+    return i;
+}
+
+static u32 ConvertGrayToRGBA8_SSE2(const u8* src, u32 pixelCount, u8* dst)
+{
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+
+    u32 i = 0;
+    for (; i + 16 <= pixelCount; i += 16)
+    {
+        __m128i gray = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i grayGrayLo = _mm_unpacklo_epi8(gray, gray);
+        __m128i grayGrayHi = _mm_unpackhi_epi8(gray, gray);
+        __m128i grayAlphaLo = _mm_unpacklo_epi8(gray, alpha);
+        __m128i grayAlphaHi = _mm_unpackhi_epi8(gray, alpha);
+        _mm_storeu_si128((__m128i*)(dst + i * 4 + 0),  _mm_unpacklo_epi16(grayGrayLo, grayAlphaLo));
+        _mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_unpackhi_epi16(grayGrayLo, grayAlphaLo));
+        _mm_storeu_si128((__m128i*)(dst + i * 4 + 32), _mm_unpacklo_epi16(grayGrayHi, grayAlphaHi));
+        _mm_storeu_si128((__m128i*)(dst + i * 4 + 48), _mm_unpackhi_epi16(grayGrayHi, grayAlphaHi));
+    }
+    return i;
+}
+#endif
+
+void ConvertToRGBA8(const u8* src, u32 channels, u32 pixelCount, u8* dst)
+{
+    u32 i = 0;
+
+#if TEXTURE_LOADING_SIMD
+    if (channels == 3 && HasSSSE3)
+        i = ConvertRGBToRGBA8_SSSE3(src, pixelCount, dst);
+    else if (channels == 1)
+        i = ConvertGrayToRGBA8_SSE2(src, pixelCount, dst);
+#endif
+
+    for (; i < pixelCount; ++i)
+    {
+        const u8* in = src + i * channels;
+        u8* out = dst + i * 4;
+        switch (channels)
+        {
+            case 1: out[0] = out[1] = out[2] = in[0]; out[3] = 255; break;
+            case 2: out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+            case 3: out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255; break;
+            default: memcpy(out, in, 4); break;
+        }
+    }
+}
+
+// Decoding (worker threads) -----------------------------------------------------
+
+static bool DecodeImageRGBA8(TextureLoadRequest& request)
+{
+    // stbi keeps the flip flag in a global unless it is set per thread
+    stbi_set_flip_vertically_on_load_thread(true);
+
+    AssetFile file = {};
+    if (request.encodedData.empty())
+    {
+        file = OpenAsset(request.filepath.c_str());
+        if (file.data == NULL)
+            return false;
+    }
+
+    int width, height, channels;
+    u8* decoded = request.encodedData.empty()
+        ? stbi_load_from_memory(file.data, (int)file.size, &width, &height, &channels, 0)
+        : stbi_load_from_memory(request.encodedData.data(), (int)request.encodedData.size(), &width, &height, &channels, 0);
+    CloseAsset(file);
+
+    if (!decoded)
+        return false;
+
+    // stbi allocates with malloc too, so either buffer goes with stbi_image_free
+    if (channels == 4)
+    {
+        request.pixels = decoded;
+    }
+    else
+    {
+        request.pixels = (u8*)malloc((size_t)width * height * 4);
+        ConvertToRGBA8(decoded, channels, (u32)(width * height), request.pixels);
+        stbi_image_free(decoded);
+    }
+
+    request.width = width;
+    request.height = height;
+    return true;
+}
+
+static void HashTextureContents(TextureLoadRequest& request)
+{
+    if (request.usage == TextureUsage_NormalHeight)
+        request.contentHash = HashPackedTextureSources(request.filepath.c_str(), request.heightPath.c_str());
+    else
+        request.contentHash = request.encodedData.empty()
+            ? HashFile(request.filepath.c_str())
+            : HashBytes(request.encodedData.data(), request.encodedData.size());
+}
+
+static void ProcessTextureLoad(TextureLoadRequest& request)
+{
+    // Packed textures only exist cooked
+    if (request.usage == TextureUsage_NormalHeight)
+    {
+        const char* normalPath = request.filepath.c_str();
+        const char* heightPath = request.heightPath.c_str();
+        std::string packedName = GetPackedTextureName(normalPath, heightPath);
+        request.isCooked = ReadCookedTexture(packedName.c_str(), request.contentHash, request.usage, request.cooked) ||
+                           (CookPackedTexture(normalPath, heightPath) && ReadCookedTexture(packedName.c_str(), request.contentHash, request.usage, request.cooked));
+        return;
+    }
+
+    // Embedded images are not cooked, they have no file to put the cooked one next to
+    if (request.encodedData.empty())
+    {
+        const char* filepath = request.filepath.c_str();
+        request.isCooked = ReadCookedTexture(filepath, request.contentHash, request.usage, request.cooked) ||
+                           (CookTexture(filepath, request.usage) && ReadCookedTexture(filepath, request.contentHash, request.usage, request.cooked));
+        if (request.isCooked)
+            return;
+    }
+
+    DecodeImageRGBA8(request);
+}
+
+// Queue -------------------------------------------------------------------------
+
+static u32 ReserveTexture(App* app, const char* name, bool& alreadyLoaded)
+{
+    std::string normalizedName = NormalizeAssetPath(name);
+
+    auto it = app->textureRegistry.byPath.find(normalizedName);
+    if (it != app->textureRegistry.byPath.end())
+    {
+        alreadyLoaded = true;
+        return it->second;
+    }
+
+    u32 texIdx = (u32)app->textures.size();
+    app->textureRegistry.byPath[normalizedName] = texIdx;
+
+    Texture tex = {};
+    tex.filepath = normalizedName;
+    tex.loading = true;
+    app->textures.push_back(tex);
+
+    alreadyLoaded = false;
+    return texIdx;
+}
+
+static TextureLoadRequest& AddTextureLoad(App* app, u32 texIdx)
+{
+    TextureRegistry& registry = app->textureRegistry;
+    if (app->textureLoads.empty())
+    {
+        registry.batchLoads = 0;
+        registry.batchShared = 0;
+        registry.batchStart = std::chrono::steady_clock::now();
+    }
+    registry.batchLoads++;
+
+    TextureLoad* load = new TextureLoad;
+    load->request = TextureLoadRequest{};
+    load->request.textureIdx = texIdx;
+    load->stage = TextureLoad_Hashing;
+    app->textureLoads.push_back(load);
+    return load->request;
+}
+
+// Hashed first, so duplicated images are decoded only once
+static void StartTextureLoad(TextureLoad* load)
+{
+    SubmitJob([load]
+    {
+        HashTextureContents(load->request);
+        load->stage = TextureLoad_Hashed;
+    });
+}
+
+u32 QueueTexture2D(App* app, const char* filepath, TextureUsage usage)
+{
+    bool alreadyLoaded;
+    u32 texIdx = ReserveTexture(app, filepath, alreadyLoaded);
+    if (alreadyLoaded)
+        return texIdx;
+
+    TextureLoadRequest& request = AddTextureLoad(app, texIdx);
+    request.filepath = filepath;
+    request.usage = usage;
+    StartTextureLoad(app->textureLoads.back());
+
+    return texIdx;
+}
+
+u32 QueueTexture2DFromMemory(App* app, const char* name, const void* data, u32 size)
+{
+    bool alreadyLoaded;
+    u32 texIdx = ReserveTexture(app, name, alreadyLoaded);
+    if (alreadyLoaded)
+        return texIdx;
+
+    TextureLoadRequest& request = AddTextureLoad(app, texIdx);
+    request.filepath = name;
+    request.usage = TextureUsage_Color;
+    request.encodedData.assign((const u8*)data, (const u8*)data + size);
+    app->textures[texIdx].fromMemory = true;
+    StartTextureLoad(app->textureLoads.back());
+
+    return texIdx;
+}
+
+u32 QueuePackedTexture2D(App* app, u32 normalTexIdx, u32 heightTexIdx)
+{
+    if (app->textures[normalTexIdx].fromMemory || app->textures[heightTexIdx].fromMemory)
+        return UINT32_MAX;
+
+    // copies, reserving the texture may reallocate app->textures
+    std::string normalPath = app->textures[normalTexIdx].filepath;
+    std::string heightPath = app->textures[heightTexIdx].filepath;
+    std::string packedName = GetPackedTextureName(normalPath.c_str(), heightPath.c_str());
+
+    bool alreadyLoaded;
+    u32 texIdx = ReserveTexture(app, packedName.c_str(), alreadyLoaded);
+    if (alreadyLoaded)
+        return texIdx;
+
+    TextureLoadRequest& request = AddTextureLoad(app, texIdx);
+    request.filepath = normalPath;
+    request.heightPath = heightPath;
+    request.usage = TextureUsage_NormalHeight;
+    StartTextureLoad(app->textureLoads.back());
+
+    return texIdx;
+}
+
+// Looks for a texture with the same contents, otherwise decodes it on a worker
+static void DedupeTextureLoad(App* app, TextureLoad* load)
+{
+    TextureRegistry& registry = app->textureRegistry;
+    TextureLoadRequest& request = load->request;
+    request.sharedTextureIdx = UINT32_MAX;
+
+    if (registry.dedupeContents && request.contentHash != 0)
+    {
+        // the same image used as color and as normal map is cooked differently
+        u64 contentKey = HashCombine(request.contentHash, request.usage);
+        auto it = registry.byContent.find(contentKey);
+        if (it != registry.byContent.end())
+        {
+            request.sharedTextureIdx = it->second;
+            registry.sharedTextures++;
+            registry.batchShared++;
+            load->stage = TextureLoad_Processed;
+            return;
+        }
+        registry.byContent[contentKey] = request.textureIdx;
+    }
+
+    load->stage = TextureLoad_Processing;
+    SubmitJob([load]
+    {
+        ProcessTextureLoad(load->request);
+        load->stage = TextureLoad_Processed;
+    });
+}
+
+// GL calls stay on the main thread
+static void FinishTextureLoad(App* app, TextureLoadRequest& request)
+{
+    Texture& tex = app->textures[request.textureIdx];
+
+    if (request.sharedTextureIdx != UINT32_MAX)
+    {
+        ShareTexture(app, request.sharedTextureIdx, request.textureIdx);
+    }
+    else if (request.isCooked)
+    {
+        tex.arrayTextureIdx = StreamTexture(app, request.textureIdx, request.cooked);
+        if (request.usage == TextureUsage_Color || request.usage == TextureUsage_ColorHighQuality)
+            RegisterVirtualTexture(app, request.textureIdx);
+    }
+    else if (request.pixels)
+    {
+        Image image = {};
+        image.pixels = request.pixels;
+        image.size = ivec2(request.width, request.height);
+        image.nchannels = 4;
+        image.stride = request.width * 4;
+
+        // The mips are generated in a texture of its own, then moved to its array
+        GLuint handle = CreateTexture2DFromImage(image);
+        stbi_image_free(request.pixels);
+
+        u32 levelCount = 1 + (u32)log2f((f32)glm::max(request.width, request.height));
+        tex.arrayTextureIdx = CreateArrayTexture(app, GL_RGBA8, request.width, request.height, levelCount);
+        CopyTextureToArrayTexture(app, handle, tex.arrayTextureIdx);
+        glDeleteTextures(1, &handle);
+    }
+    else if (request.usage == TextureUsage_NormalHeight)
+    {
+        ILOG("Could not pack %s with %s, they are sampled apart", request.filepath.c_str(), request.heightPath.c_str());
+    }
+    else
+    {
+        // Missing textures stand out instead of sampling texture 0
+        ELOG("Could not open file %s", request.filepath.c_str());
+        if (app->magentaTexIdx < app->textures.size() && !app->textures[app->magentaTexIdx].loading)
+            ShareTexture(app, app->magentaTexIdx, request.textureIdx);
+    }
+
+    app->textures[request.textureIdx].loading = false;
+    app->textureRegistry.finishedLoads++;
+}
+
+static void AdvanceTextureLoads(App* app, u32 uploadBudget)
+{
+    if (app->textureLoads.empty())
+        return;
+
+    TextureRegistry& registry = app->textureRegistry;
+
+    u32 uploads = 0;
+    for (u32 i = 0; i < app->textureLoads.size(); )
+    {
+        TextureLoad* load = app->textureLoads[i];
+        TextureLoadRequest& request = load->request;
+
+        if (load->stage == TextureLoad_Hashed)
+            DedupeTextureLoad(app, load);
+
+        // Shared textures upload nothing, they wait for their owner instead
+        bool shared = request.sharedTextureIdx != UINT32_MAX;
+        bool ready = load->stage == TextureLoad_Processed &&
+                     (shared ? !app->textures[request.sharedTextureIdx].loading : uploads < uploadBudget);
+        if (!ready)
+        {
+            ++i;
+            continue;
+        }
+
+        FinishTextureLoad(app, request);
+        if (!shared)
+            uploads++;
+
+        delete load;
+        app->textureLoads.erase(app->textureLoads.begin() + i);
+    }
+
+    if (app->textureLoads.empty())
+    {
+        ILOG("Loaded %u textures (%u shared by contents) in %.1f ms (%u threads)",
+             registry.batchLoads, registry.batchShared,
+             std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - registry.batchStart).count(),
+             GetJobThreadCount());
+    }
+}
+
+void UpdateTextureLoads(App* app)
+{
+    AdvanceTextureLoads(app, app->textureRegistry.uploadsPerFrame);
+}
+
+void FlushTextureLoads(App* app)
+{
+    while (!app->textureLoads.empty())
+    {
+        AdvanceTextureLoads(app, UINT32_MAX);
+        if (!app->textureLoads.empty() && !RunPendingJob())
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,110 @@
+//
+// texture_loading.h: Background texture loading. Queuing a texture returns its
+// slot right away; the worker threads hash the file, read the cooked texture
+// (or cook / decode the source image) and, a few per frame, the main thread
+// creates the GL textures and uploads the data. Until then the texture is
+// marked loading and materials sample a placeholder instead.
+//
+// Textures are registered by normalized path, and images with the same
+// contents under different paths share a single GL texture.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "texture_cooker.h"
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+
+struct App;
+
+struct TextureLoadRequest
+{
+    u32             textureIdx;
+    std::string     filepath;
+    TextureUsage    usage;
+    std::vector<u8> encodedData; // images embedded in other files (glTF)
+    std::string     heightPath;  // TextureUsage_NormalHeight: packed with the normal map in filepath
+
+    // Filled in by the workers
+    u64             contentHash;      // 0 if the image could not be read
+    u32             sharedTextureIdx; // texture with the same contents, UINT32_MAX if none
+    CookedTexture   cooked;
+    bool            isCooked;
+    u8*             pixels;           // RGBA8, when there is no cooked data
+    i32             width;
+    i32             height;
+};
+
+enum TextureLoadStage
+{
+    TextureLoad_Hashing,    // on a worker
+    TextureLoad_Hashed,     // waiting for the main thread to look for its contents
+    TextureLoad_Processing, // on a worker
+    TextureLoad_Processed,  // waiting to be uploaded
+};
+
+struct TextureLoad
+{
+    TextureLoadRequest request;
+    std::atomic<u32>   stage; // TextureLoadStage
+};
+
+struct TextureRegistry
+{
+    // Normalized path (or name) -> texture. The keys are the interned paths
+    std::unordered_map<std::string, u32> byPath;
+
+    // Contents and usage -> texture owning the GL texture with those contents
+    std::unordered_map<u64, u32> byContent;
+
+    bool dedupeContents = true;
+    u32  uploadsPerFrame = 4;
+
+    // since startup
+    u32 sharedTextures = 0;
+    u32 finishedLoads = 0;
+
+    // Loads since the queue was last empty, for the log
+    u32                                   batchLoads = 0;
+    u32                                   batchShared = 0;
+    std::chrono::steady_clock::time_point batchStart;
+};
+
+/**
+ * Reserves a texture slot and starts loading it. The texture has no array
+ * texture until the load finishes (see UpdateTextureLoads). Returns the existing
+ * slot if the file was already loaded or queued.
+ */
+u32 QueueTexture2D(App* app, const char* filepath, TextureUsage usage = TextureUsage_Color);
+
+/**
+ * Same as QueueTexture2D for an encoded image already in memory. The data is
+ * copied, the name identifies the texture in place of a file path.
+ */
+u32 QueueTexture2DFromMemory(App* app, const char* name, const void* data, u32 size);
+
+/**
+ * Queues the texture packing a normal map and a height map (TextureUsage_NormalHeight).
+ * Returns UINT32_MAX if either is embedded in another file. The texture stays
+ * unloaded if they can not be packed, so materials keep sampling them apart.
+ */
+u32 QueuePackedTexture2D(App* app, u32 normalTexIdx, u32 heightTexIdx);
+
+/**
+ * Once per frame: moves the loads along and uploads up to uploadsPerFrame of
+ * the finished ones. Textures that can not be loaded get the magenta texture,
+ * and the ones whose contents are already loaded reuse that GL texture.
+ */
+void UpdateTextureLoads(App* app);
+
+/**
+ * Blocks until every queued texture is loaded, helping the workers meanwhile.
+ */
+void FlushTextureLoads(App* app);
+
+/**
+ * Expands 1, 2 or 3 channel pixels to RGBA8 (SIMD when the CPU supports it).
+ */
+void ConvertToRGBA8(const u8* src, u32 channels, u32 pixelCount, u8* dst);
@@ -0,0 +1,361 @@
+#include "texture_streaming.h"
+#include "engine.h"
+#include "job_system.h"
+#include "upload_manager.h"
+#include <imgui.h>
+#include <algorithm>
+
+static u32 GetLevelWidth(const CookedTexture& cooked, u32 level)
+{
+    return glm::max(cooked.width >> level, 1u);
+}
+
+static u32 GetLevelHeight(const CookedTexture& cooked, u32 level)
+{
+    return glm::max(cooked.height >> level, 1u);
+}
+
+static u64 GetResidentBytes(const CookedTexture& cooked, u32 base)
+{
+    u64 bytes = 0;
+    for (u32 level = base; level < cooked.levelCount; ++level)
+        bytes += cooked.levelSizes[level];
+    return bytes;
+}
+
+// Resizes the texture to hold the levels [newBase, levelCount). The levels
+// already on the GPU are copied over, the rest come from the load (or straight
+// from the mapped file when there is no load).
+static void RebuildStreamedTexture(App* app, StreamedTexture& st, u32 newBase, StreamingLoad* load)
+{
+    const CookedTexture& cooked = st.cooked;
+
+    u32 rebuilt = CreateArrayTexture(app, cooked.glFormat, GetLevelWidth(cooked, newBase), GetLevelHeight(cooked, newBase), cooked.levelCount - newBase);
+
+    for (u32 level = newBase; level < cooked.levelCount; ++level)
+    {
+        if (st.arrayTextureIdx != UINT32_MAX && level >= st.residentBase)
+        {
+            CopyArrayTextureLevel(app, st.arrayTextureIdx, level - st.residentBase, rebuilt, level - newBase);
+        }
+        else if (load)
+        {
+            Upload*& upload = load->levels[level - load->base];
+            u32 size = upload->size;
+            IssueArrayTextureUpload(app, upload, rebuilt, level - newBase, [app, size]
+            {
+                app->textureStreaming.uploadedBytes += size;
+            });
+            upload = NULL;
+        }
+        else
+        {
+            UploadArrayTextureLevel(app, rebuilt, level - newBase, cooked.levelData[level], cooked.levelSizes[level]);
+        }
+    }
+
+    // The textures showing it keep the same index
+    if (st.arrayTextureIdx == UINT32_MAX)
+        st.arrayTextureIdx = rebuilt;
+    else
+        ReplaceArrayTexture(app, st.arrayTextureIdx, rebuilt);
+
+    TextureStreaming& streaming = app->textureStreaming;
+    streaming.vramUsage -= st.residentBytes;
+    st.residentBytes = GetResidentBytes(cooked, newBase);
+    streaming.vramUsage += st.residentBytes;
+
+    st.residentBase = newBase;
+}
+
+static void DiscardStreamingLoad(App* app, StreamedTexture& st)
+{
+    for (Upload* upload : st.load->levels)
+        if (upload)
+            CancelUpload(app, upload);
+
+    delete st.load;
+    st.load = NULL;
+}
+
+// Does nothing if there is no staging memory left, it is tried again next frame
+static void StartStreamingLoad(App* app, StreamedTexture& st, u32 base)
+{
+    StreamingLoad* load = new StreamingLoad;
+    load->base = base;
+    st.load = load;
+
+    for (u32 level = base; level < st.residentBase; ++level)
+    {
+        Upload* upload = BeginUpload(app, st.cooked.levelSizes[level]);
+        if (!upload)
+        {
+            DiscardStreamingLoad(app, st);
+            return;
+        }
+        load->levels.push_back(upload);
+    }
+
+    // Copying from the mapping is what reads the file, so it happens on a worker
+    std::vector<const u8*> sources(st.cooked.levelData.begin() + base, st.cooked.levelData.begin() + st.residentBase);
+    std::vector<Upload*> uploads = load->levels;
+
+    SubmitJob([sources, uploads]
+    {
+        for (u32 i = 0; i < sources.size(); ++i)
+        {
+            memcpy(uploads[i]->data, sources[i], uploads[i]->size);
+            uploads[i]->written = true;
+        }
+    });
+}
+
+static bool IsStreamingLoadReady(const StreamingLoad* load)
+{
+    for (const Upload* upload : load->levels)
+        if (!upload->written)
+            return false;
+    return true;
+}
+
+// Drops the mips that are finer than needed, least recently requested textures
+// first, until the usage gets down to targetUsage
+static void EvictTextureMips(App* app, u64 targetUsage)
+{
+    TextureStreaming& streaming = app->textureStreaming;
+    if (streaming.vramUsage <= targetUsage)
+        return;
+
+    std::vector<u32> candidates;
+    for (u32 i = 0; i < streaming.textures.size(); ++i)
+        if (streaming.textures[i].residentBase < streaming.textures[i].wantedBase)
+            candidates.push_back(i);
+
+    std::sort(candidates.begin(), candidates.end(), [&streaming](u32 a, u32 b)
+    {
+        const StreamedTexture& ta = streaming.textures[a];
+        const StreamedTexture& tb = streaming.textures[b];
+        if (ta.lastRequestedFrame != tb.lastRequestedFrame)
+            return ta.lastRequestedFrame < tb.lastRequestedFrame;
+        return ta.wantedBase - ta.residentBase > tb.wantedBase - tb.residentBase;
+    });
+
+    for (u32 i = 0; i < candidates.size() && streaming.vramUsage > targetUsage; ++i)
+    {
+        StreamedTexture& st = streaming.textures[candidates[i]];
+        RebuildStreamedTexture(app, st, st.wantedBase, NULL);
+        streaming.evictions++;
+    }
+}
+
+// Makes room for extraBytes more, returns false if the budget does not allow it
+static bool ReserveTextureMemory(App* app, u64 extraBytes)
+{
+    TextureStreaming& streaming = app->textureStreaming;
+    if (extraBytes > streaming.vramBudget)
+        return false;
+
+    EvictTextureMips(app, streaming.vramBudget - extraBytes);
+    return streaming.vramUsage + extraBytes <= streaming.vramBudget;
+}
+
+u32 StreamTexture(App* app, u32 texIdx, CookedTexture& cooked)
+{
+    u32 tailBase = 0;
+    while (tailBase + 1 < cooked.levelCount && glm::max(GetLevelWidth(cooked, tailBase), GetLevelHeight(cooked, tailBase)) > STREAMING_TAIL_SIZE)
+        tailBase++;
+
+    // Small enough to be all tail, nothing to stream
+    if (tailBase == 0)
+    {
+        u32 arrayTextureIdx = CreateArrayTexture(app, cooked.glFormat, cooked.width, cooked.height, cooked.levelCount);
+        for (u32 level = 0; level < cooked.levelCount; ++level)
+            UploadArrayTextureLevel(app, arrayTextureIdx, level, cooked.levelData[level], cooked.levelSizes[level]);
+        ReleaseCookedTexture(cooked);
+        return arrayTextureIdx;
+    }
+
+    TextureStreaming& streaming = app->textureStreaming;
+    streaming.textures.push_back(StreamedTexture{});
+    StreamedTexture& st = streaming.textures.back();
+    st.cooked = std::move(cooked);
+    st.textureIndices.push_back(texIdx);
+    st.arrayTextureIdx = UINT32_MAX;
+    st.residentBase = st.cooked.levelCount;
+    st.tailBase = tailBase;
+    st.wantedBase = tailBase;
+    st.requestedBase = tailBase;
+    st.lastRequestedFrame = streaming.frame;
+
+    cooked = CookedTexture{};
+
+    app->textures[texIdx].streamedIdx = (u32)streaming.textures.size() - 1;
+    RebuildStreamedTexture(app, st, tailBase, NULL);
+
+    return st.arrayTextureIdx;
+}
+
+void ShareTexture(App* app, u32 ownerTexIdx, u32 texIdx)
+{
+    const Texture& owner = app->textures[ownerTexIdx];
+    Texture& tex = app->textures[texIdx];
+
+    tex.arrayTextureIdx = owner.arrayTextureIdx;
+    tex.streamedIdx = owner.streamedIdx;
+    tex.virtualIdx = owner.virtualIdx;
+    if (owner.streamedIdx != UINT32_MAX)
+        app->textureStreaming.textures[owner.streamedIdx].textureIndices.push_back(texIdx);
+}
+
+f32 ComputeScreenCoverage(const App* app, const glm::mat4& worldMatrix, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    vec3 center = vec3(worldMatrix * vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+    f32 scale = glm::max(glm::length(vec3(worldMatrix[0])), glm::max(glm::length(vec3(worldMatrix[1])), glm::length(vec3(worldMatrix[2]))));
+    f32 radius = 0.5f * glm::length(boundsMax - boundsMin) * scale;
+
+    f32 depth = -(app->cameraMatrix * vec4(center, 1.0f)).z;
+    if (depth <= radius)
+        return (f32)glm::max(app->displaySize.x, app->displaySize.y); // the camera is (almost) inside
+
+    // projected diameter: 2r/d in NDC units (scaled by the projection) times half the screen
+    return radius / depth * app->projectionMatrix[1][1] * app->displaySize.y;
+}
+
+void RequestTextureDetail(App* app, u32 texIdx, f32 screenPixels)
+{
+    if (texIdx >= app->textures.size() || app->textures[texIdx].streamedIdx == UINT32_MAX)
+        return;
+
+    TextureStreaming& streaming = app->textureStreaming;
+    StreamedTexture& st = streaming.textures[app->textures[texIdx].streamedIdx];
+
+    // One texel per pixel when the texture is mapped once over the surface
+    f32 texelsPerPixel = glm::max(st.cooked.width, st.cooked.height) / glm::max(screenPixels, 1.0f);
+    i32 level = (i32)floorf(log2f(glm::max(texelsPerPixel, 1.0f)) - streaming.lodBias);
+    u32 base = (u32)glm::clamp(level, 0, (i32)st.tailBase);
+
+    if (st.lastRequestedFrame != streaming.frame)
+    {
+        st.requestedBase = base;
+        st.lastRequestedFrame = streaming.frame;
+    }
+    else
+    {
+        st.requestedBase = glm::min(st.requestedBase, base);
+    }
+}
+
+void UpdateTextureStreaming(App* app)
+{
+    TextureStreaming& streaming = app->textureStreaming;
+
+    // Levels wanted, from this frame requests. Textures not seen for a while go back to the tail
+    for (StreamedTexture& st : streaming.textures)
+    {
+        if (st.lastRequestedFrame == streaming.frame)
+            st.wantedBase = st.requestedBase;
+        else if (streaming.frame - st.lastRequestedFrame > streaming.unusedFrames)
+            st.wantedBase = st.tailBase;
+    }
+
+    EvictTextureMips(app, streaming.vramBudget);
+
+    // Finished loads, the textures missing more detail first
+    std::vector<u32> readyLoads;
+    for (u32 i = 0; i < streaming.textures.size(); ++i)
+        if (streaming.textures[i].load && IsStreamingLoadReady(streaming.textures[i].load))
+            readyLoads.push_back(i);
+
+    std::sort(readyLoads.begin(), readyLoads.end(), [&streaming](u32 a, u32 b)
+    {
+        const StreamedTexture& ta = streaming.textures[a];
+        const StreamedTexture& tb = streaming.textures[b];
+        return (i32)ta.residentBase - (i32)ta.wantedBase > (i32)tb.residentBase - (i32)tb.wantedBase;
+    });
+
+    for (u32 idx : readyLoads)
+    {
+        StreamedTexture& st = streaming.textures[idx];
+        StreamingLoad* load = st.load;
+
+        // The wanted level may have changed since the load started, and the
+        // resident ones may have been evicted past what the load holds
+        u32 newBase = glm::max(load->base, st.wantedBase);
+        if (newBase >= st.residentBase || load->base + load->levels.size() < st.residentBase)
+        {
+            DiscardStreamingLoad(app, st);
+            continue;
+        }
+
+        u64 extraBytes = GetResidentBytes(st.cooked, newBase) - st.residentBytes;
+        if (!CanIssueUpload(app, extraBytes))
+            break; // next frame
+
+        if (!ReserveTextureMemory(app, extraBytes))
+        {
+            DiscardStreamingLoad(app, st);
+            continue;
+        }
+
+        RebuildStreamedTexture(app, st, newBase, load);
+        DiscardStreamingLoad(app, st);
+        streaming.upgrades++;
+    }
+
+    // New loads, only if the budget can hold them
+    for (StreamedTexture& st : streaming.textures)
+    {
+        if (st.load || st.wantedBase >= st.residentBase)
+            continue;
+
+        u64 extraBytes = GetResidentBytes(st.cooked, st.wantedBase) - st.residentBytes;
+        if (ReserveTextureMemory(app, extraBytes))
+            StartStreamingLoad(app, st, st.wantedBase);
+    }
+
+    streaming.frame++;
+}
+
+void TextureStreamingGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Texture streaming"))
+        return;
+
+    TextureStreaming& streaming = app->textureStreaming;
+
+    int vramBudgetMB = (int)(streaming.vramBudget / MB(1));
+    if (ImGui::DragInt("VRAM budget (MB)", &vramBudgetMB, 1.0f, 0, 65536))
+        streaming.vramBudget = (u64)vramBudgetMB * MB(1);
+    ImGui::DragFloat("LOD bias", &streaming.lodBias, 0.05f, -4.0f, 4.0f);
+
+    ImGui::Text("VRAM: %.2f MB   Uploaded: %.2f MB", streaming.vramUsage / (f32)MB(1), streaming.uploadedBytes / (f32)MB(1));
+    ImGui::Text("Upgrades: %u   Evictions: %u", streaming.upgrades, streaming.evictions);
+
+    if (ImGui::BeginTable("##streaming", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupColumn("Texture");
+        ImGui::TableSetupColumn("Resident");
+        ImGui::TableSetupColumn("Wanted");
+        ImGui::TableSetupColumn("VRAM (KB)");
+        ImGui::TableHeadersRow();
+
+        for (const StreamedTexture& st : streaming.textures)
+        {
+            ImGui::TableNextRow();
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", app->textures[st.textureIndices[0]].filepath.c_str());
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%ux%u%s", GetLevelWidth(st.cooked, st.residentBase), GetLevelHeight(st.cooked, st.residentBase), st.load ? " (loading)" : "");
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%ux%u", GetLevelWidth(st.cooked, st.wantedBase), GetLevelHeight(st.cooked, st.wantedBase));
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", st.residentBytes / 1024.0f);
+        }
+
+        ImGui::EndTable();
+    }
+}
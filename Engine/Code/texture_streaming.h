@@ -0,0 +1,89 @@
+//
+// texture_streaming.h: Keeps only the mips that are needed on the GPU. Every
+// frame the draws report how big (in pixels) the surfaces using each texture
+// are on screen, and that decides the finest mip worth having. Missing mips are
+// read from the cooked file by a worker thread and uploaded a few per frame,
+// while the ones no longer needed are dropped when the VRAM budget is exceeded.
+//
+// Only cooked textures are streamed. The small mips (the tail) are uploaded at
+// load time and never evicted, so a texture always has something to show.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "texture_cooker.h"
+
+struct App;
+struct Upload;
+
+#define STREAMING_TAIL_SIZE 64 // mips this size or smaller are always resident
+
+// Levels being read from the cooked file by a worker, straight into staging memory
+struct StreamingLoad
+{
+    u32                  base;   // finest level of the load
+    std::vector<Upload*> levels; // base, base + 1... up to the resident ones, NULL once issued
+};
+
+struct StreamedTexture
+{
+    CookedTexture    cooked;         // kept mapped, it is where the levels come from
+    std::vector<u32> textureIndices; // app->textures showing this texture
+    u32              arrayTextureIdx; // in app->textureArrays, it keeps its index when resized
+    u32              residentBase;   // finest level on the GPU
+    u32              tailBase;       // residentBase never goes coarser than this
+    u32              wantedBase;     // finest level needed, from the last requests
+    u32              requestedBase;  // accumulates the requests of the current frame
+    u64              lastRequestedFrame;
+    u64              residentBytes;
+    StreamingLoad*   load;           // NULL unless a load is in flight
+};
+
+struct TextureStreaming
+{
+    std::vector<StreamedTexture> textures;
+
+    u64 vramBudget = MB(256);
+    f32 lodBias = 0.0f;         // positive values keep sharper mips
+    u32 unusedFrames = 120;     // not requested for this long: only the tail is wanted
+
+    u64 vramUsage;
+    u64 frame;
+
+    // since startup
+    u64 uploadedBytes;
+    u32 upgrades;
+    u32 evictions;
+};
+
+/**
+ * Starts streaming a cooked texture, which the streaming system takes ownership
+ * of. Only the tail is uploaded now. Returns the texture in app->textureArrays.
+ */
+u32 StreamTexture(App* app, u32 texIdx, CookedTexture& cooked);
+
+/**
+ * Makes texIdx show the same texture as ownerTexIdx, following it if it is
+ * streamed.
+ */
+void ShareTexture(App* app, u32 ownerTexIdx, u32 texIdx);
+
+/**
+ * Approximate size in pixels on screen of a bounding box, for RequestTextureDetail.
+ */
+f32 ComputeScreenCoverage(const App* app, const glm::mat4& worldMatrix, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+/**
+ * Reports that a texture is drawn on a surface covering screenPixels pixels.
+ * Does nothing for textures that are not streamed.
+ */
+void RequestTextureDetail(App* app, u32 texIdx, f32 screenPixels);
+
+/**
+ * Once per frame: uploads finished loads (within the upload manager budget), starts new
+ * loads and evicts mips to stay within the VRAM budget.
+ */
+void UpdateTextureStreaming(App* app);
+
+void TextureStreamingGui(App* app);
@@ -0,0 +1,103 @@
+#include "uniform_blocks.h"
+
+struct BlockMemberDesc
+{
+    const char* name;   // as the driver reports it
+    u32         offset;
+};
+
+struct BlockDesc
+{
+    const char*            name;
+    GLenum                 blockInterface;
+    GLenum                 memberInterface;
+    u32                    size;         // 0 for blocks ending in an unsized array
+    u32                    arrayStride;  // of that array, checked on the first member
+    const BlockMemberDesc* members;
+    u32                    memberCount;
+};
+
+#define LIGHT_OFFSET(i, member) (u32)(offsetof(GlobalParamsBlock, lights) + (i) * sizeof(LightBlock) + offsetof(LightBlock, member))
+
+// The second light is there for the array stride
+static const BlockMemberDesc GlobalParamsMembers[] =
+{
+    { "uCameraPosition",     offsetof(GlobalParamsBlock, cameraPosition) },
+    { "uLightCount",         offsetof(GlobalParamsBlock, lightCount) },
+    { "uLight[0].type",      LIGHT_OFFSET(0, type) },
+    { "uLight[0].color",     LIGHT_OFFSET(0, color) },
+    { "uLight[0].direction", LIGHT_OFFSET(0, direction) },
+    { "uLight[0].position",  LIGHT_OFFSET(0, position) },
+    { "uLight[1].type",      LIGHT_OFFSET(1, type) },
+};
+
+static const BlockMemberDesc LocalParamsMembers[] =
+{
+    { "uWorldMatrix",               offsetof(LocalParamsBlock, worldMatrix) },
+    { "uWorldViewProjectionMatrix", offsetof(LocalParamsBlock, worldViewProjectionMatrix) },
+};
+
+static const BlockMemberDesc MaterialsMembers[] =
+{
+    { "uMaterials[0].albedo",     offsetof(MaterialData, albedo) },
+    { "uMaterials[0].layers",     offsetof(MaterialData, layers) },
+    { "uMaterials[0].handles[0]", offsetof(MaterialData, handles) },
+};
+
+static const BlockDesc Blocks[] =
+{
+    { "GlobalParams", GL_UNIFORM_BLOCK,        GL_UNIFORM,         sizeof(GlobalParamsBlock), 0,                    GlobalParamsMembers, ARRAY_COUNT(GlobalParamsMembers) },
+    { "LocalParams",  GL_UNIFORM_BLOCK,        GL_UNIFORM,         sizeof(LocalParamsBlock),  0,                    LocalParamsMembers,  ARRAY_COUNT(LocalParamsMembers) },
+    { "Materials",    GL_SHADER_STORAGE_BLOCK, GL_BUFFER_VARIABLE, 0,                         sizeof(MaterialData), MaterialsMembers,    ARRAY_COUNT(MaterialsMembers) },
+};
+
+static GLint GetProgramResource(GLuint program, GLenum resourceInterface, GLuint index, GLenum property)
+{
+    GLint value = 0;
+    glGetProgramResourceiv(program, resourceInterface, index, 1, &property, 1, NULL, &value);
+    return value;
+}
+
+bool CheckProgramBlocks(GLuint program, const char* programName)
+{
+    bool matches = true;
+    for (const BlockDesc& block : Blocks)
+    {
+        GLuint blockIndex = glGetProgramResourceIndex(program, block.blockInterface, block.name);
+        if (blockIndex == GL_INVALID_INDEX)
+            continue;
+
+        u32 size = (u32)GetProgramResource(program, block.blockInterface, blockIndex, GL_BUFFER_DATA_SIZE);
+        if (block.size != 0 && size != block.size)
+        {
+            ELOG("%s: block %s is %u bytes, %u in C++ (see uniform_blocks.h)", programName, block.name, size, block.size);
+            matches = false;
+        }
+
+        for (u32 i = 0; i < block.memberCount; ++i)
+        {
+            const BlockMemberDesc& member = block.members[i];
+            GLuint memberIndex = glGetProgramResourceIndex(program, block.memberInterface, member.name);
+            if (memberIndex == GL_INVALID_INDEX)
+                continue;
+
+            u32 offset = (u32)GetProgramResource(program, block.memberInterface, memberIndex, GL_OFFSET);
+            if (offset != member.offset)
+            {
+                ELOG("%s: %s is at offset %u of block %s, %u in C++ (see uniform_blocks.h)", programName, member.name, offset, block.name, member.offset);
+                matches = false;
+            }
+
+            if (i > 0 || block.arrayStride == 0)
+                continue;
+
+            u32 stride = (u32)GetProgramResource(program, block.memberInterface, memberIndex, GL_TOP_LEVEL_ARRAY_STRIDE);
+            if (stride != block.arrayStride)
+            {
+                ELOG("%s: the array of block %s has a stride of %u, %u in C++ (see uniform_blocks.h)", programName, block.name, stride, block.arrayStride);
+                matches = false;
+            }
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,141 @@
+//
+// uniform_blocks.h: C++ mirrors of the uniform and storage blocks of
+// shaders.glsl. Each member is declared with the base alignment std140 or
+// std430 gives its type (STD140/STD430), so the structs have the layout of the
+// GLSL blocks: a block is filled as a plain struct and copied to the buffer with
+// one memcpy, or written in place in the mapped buffer.
+//
+// The offsets are checked twice: at compile time against the layout rules
+// (CHECK_STD140_MEMBER, CHECK_STD430_MEMBER), and when a program is loaded
+// against the offsets the driver reports for its blocks (CheckProgramBlocks).
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include <cstddef>
+
+enum BlockLayout
+{
+    BlockLayout_Std140,
+    BlockLayout_Std430
+};
+
+constexpr u32 AlignBlockOffset(u32 offset, u32 alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Base alignment and size of a member type. Structs are aligned like their most
+// aligned member (declared with STD140/STD430 too), rounded up to a vec4 in std140
+template <typename T, BlockLayout Layout>
+struct BlockMemberLayout
+{
+    static constexpr u32 Alignment = Layout == BlockLayout_Std140 ? AlignBlockOffset(alignof(T), 16) : (u32)alignof(T);
+    static constexpr u32 Size = sizeof(T);
+};
+
+#define BLOCK_MEMBER_LAYOUT(type, alignment) \
+    template <BlockLayout Layout> struct BlockMemberLayout<type, Layout> \
+    { \
+        static constexpr u32 Alignment = alignment; \
+        static constexpr u32 Size = sizeof(type); \
+    }
+
+BLOCK_MEMBER_LAYOUT(u32, 4);
+BLOCK_MEMBER_LAYOUT(i32, 4);
+BLOCK_MEMBER_LAYOUT(f32, 4);
+BLOCK_MEMBER_LAYOUT(glm::vec2, 8);
+BLOCK_MEMBER_LAYOUT(glm::uvec2, 8);
+BLOCK_MEMBER_LAYOUT(glm::vec3, 16);
+BLOCK_MEMBER_LAYOUT(glm::vec4, 16);
+BLOCK_MEMBER_LAYOUT(glm::uvec4, 16);
+BLOCK_MEMBER_LAYOUT(glm::mat4, 16);
+
+// std140 rounds the alignment, and so the stride, of arrays up to a vec4
+template <typename T, size_t N, BlockLayout Layout>
+struct BlockMemberLayout<T[N], Layout>
+{
+    static constexpr u32 Alignment = Layout == BlockLayout_Std140 ? AlignBlockOffset(BlockMemberLayout<T, Layout>::Alignment, 16)
+                                                                  : BlockMemberLayout<T, Layout>::Alignment;
+    static constexpr u32 Stride = AlignBlockOffset(BlockMemberLayout<T, Layout>::Size, Alignment);
+    static constexpr u32 Size = Stride * (u32)N;
+};
+
+#define STD140(type) alignas(BlockMemberLayout<type, BlockLayout_Std140>::Alignment) type
+#define STD430(type) alignas(BlockMemberLayout<type, BlockLayout_Std430>::Alignment) type
+
+// A member is where the layout puts it after the previous one, and as big
+#define CHECK_BLOCK_MEMBER(layout, block, previous, member) \
+    static_assert(offsetof(block, member) == AlignBlockOffset(offsetof(block, previous) + BlockMemberLayout<decltype(block::previous), layout>::Size, \
+                                                              BlockMemberLayout<decltype(block::member), layout>::Alignment), \
+                  #block "::" #member " is not at its " #layout " offset"); \
+    static_assert(sizeof(block::member) == BlockMemberLayout<decltype(block::member), layout>::Size, \
+                  #block "::" #member " does not have its " #layout " size")
+
+#define CHECK_STD140_MEMBER(block, previous, member) CHECK_BLOCK_MEMBER(BlockLayout_Std140, block, previous, member)
+#define CHECK_STD430_MEMBER(block, previous, member) CHECK_BLOCK_MEMBER(BlockLayout_Std430, block, previous, member)
+
+// Blocks -----------------------------------------------------------------------
+
+#define GLOBAL_PARAMS_MAX_LIGHTS 16 // uLight
+
+// struct Light
+struct LightBlock
+{
+    STD140(u32)       type;
+    STD140(glm::vec3) color;
+    STD140(glm::vec3) direction;
+    STD140(glm::vec3) position;
+};
+
+CHECK_STD140_MEMBER(LightBlock, type, color);
+CHECK_STD140_MEMBER(LightBlock, color, direction);
+CHECK_STD140_MEMBER(LightBlock, direction, position);
+
+// GlobalParams, binding 0. Only the lights in use are written and bound
+struct GlobalParamsBlock
+{
+    STD140(glm::vec3)  cameraPosition;
+    STD140(u32)        lightCount;
+    STD140(LightBlock) lights[GLOBAL_PARAMS_MAX_LIGHTS];
+};
+
+CHECK_STD140_MEMBER(GlobalParamsBlock, cameraPosition, lightCount);
+CHECK_STD140_MEMBER(GlobalParamsBlock, lightCount, lights);
+
+// LocalParams, binding 1
+struct LocalParamsBlock
+{
+    STD140(glm::mat4) worldMatrix;
+    STD140(glm::mat4) worldViewProjectionMatrix;
+};
+
+CHECK_STD140_MEMBER(LocalParamsBlock, worldMatrix, worldViewProjectionMatrix);
+
+// struct Material of the Materials storage buffer
+struct MaterialData
+{
+    STD430(glm::vec4)  albedo;     // color and smoothness
+    STD430(u32)        layers[4];  // albedo, normal and bump map layers, flags and swizzle
+    STD430(glm::uvec2) handles[3]; // of the arrays holding the maps, bindless only
+};
+
+CHECK_STD430_MEMBER(MaterialData, albedo, layers);
+CHECK_STD430_MEMBER(MaterialData, layers, handles);
+
+/**
+ * Size of the part of GlobalParams holding the given number of lights.
+ */
+inline u32 GetGlobalParamsSize(u32 lightCount)
+{
+    return (u32)offsetof(GlobalParamsBlock, lights) + lightCount * (u32)sizeof(LightBlock);
+}
+
+/**
+ * Compares the blocks above with the ones of a program as the driver laid them
+ * out, and logs the members that differ. Blocks and members the program does
+ * not use are skipped.
+ */
+bool CheckProgramBlocks(GLuint program, const char* programName);
@@ -0,0 +1,409 @@
+#include "upload_manager.h"
+#include "engine.h"
+#include <imgui.h>
+
+#define STAGING_MIN_CAPACITY   KB(256)
+#define STAGING_RING_ALIGNMENT 64
+
+static u32 NextPowerOfTwo(u32 value)
+{
+    u32 result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+// The smallest free buffer that fits, or a new one if the budget allows it
+static u32 AcquireStagingBuffer(UploadManager& manager, u32 size)
+{
+    u32 best = UINT32_MAX;
+    for (u32 i = 0; i < manager.stagingBuffers.size(); ++i)
+    {
+        const StagingBuffer& buffer = manager.stagingBuffers[i];
+        if (buffer.handle != 0 && !buffer.inUse && buffer.capacity >= size &&
+            (best == UINT32_MAX || buffer.capacity < manager.stagingBuffers[best].capacity))
+            best = i;
+    }
+
+    if (best != UINT32_MAX)
+        return best;
+
+    u32 capacity = glm::max(NextPowerOfTwo(size), (u32)STAGING_MIN_CAPACITY);
+
+    // Free buffers too small for this are dropped to make room
+    for (StagingBuffer& buffer : manager.stagingBuffers)
+    {
+        if (manager.stagingUsage + capacity <= manager.stagingBudget)
+            break;
+
+        if (buffer.handle != 0 && !buffer.inUse)
+        {
+            glDeleteBuffers(1, &buffer.handle);
+            manager.stagingUsage -= buffer.capacity;
+            buffer = StagingBuffer{};
+        }
+    }
+
+    if (manager.stagingUsage + capacity > manager.stagingBudget)
+        return UINT32_MAX;
+
+    u32 idx = 0;
+    while (idx < manager.stagingBuffers.size() && manager.stagingBuffers[idx].handle != 0)
+        idx++;
+    if (idx == manager.stagingBuffers.size())
+        manager.stagingBuffers.push_back(StagingBuffer{});
+
+    StagingBuffer& buffer = manager.stagingBuffers[idx];
+    buffer.capacity = capacity;
+    glGenBuffers(1, &buffer.handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.handle);
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    manager.stagingUsage += capacity;
+    return idx;
+}
+
+static bool CreateStagingRing(UploadManager& manager)
+{
+    const GLExtensions& ext = GlobalGLExtensions;
+    StagingRing& ring = manager.ring;
+    if (!ext.bufferStorage)
+        return false;
+
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &ring.handle);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring.handle);
+    ext.BufferStorage(GL_COPY_WRITE_BUFFER, manager.ringSize, NULL, flags);
+    ring.data = (u8*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, manager.ringSize, flags);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (!ring.data)
+    {
+        ELOG("Could not map the staging ring, using staging buffers");
+        glDeleteBuffers(1, &ring.handle);
+        ring.handle = 0;
+        return false;
+    }
+
+    ring.capacity = manager.ringSize;
+    return true;
+}
+
+// The space after the newest allocation, or at the start of the ring once the
+// end is reached. Returns false when the oldest allocations are still in use
+static bool AllocateFromRing(StagingRing& ring, u64 size, u64& offset, u64& serial)
+{
+    u64 tail = ring.allocations.empty() ? 0 : ring.allocations.front().offset;
+    if (ring.allocations.empty())
+        ring.head = 0;
+
+    u64 start = Align((u32)ring.head, STAGING_RING_ALIGNMENT);
+    u64 skipped = start - ring.head;
+    if (ring.head >= tail)
+    {
+        if (start + size > ring.capacity)
+        {
+            // Wraps around, the rest of the ring goes with this allocation. The
+            // head never reaches the tail, so that a full ring is not an empty one
+            if (!ring.allocations.empty() && size >= tail)
+                return false;
+            skipped = ring.capacity - ring.head;
+            start = 0;
+        }
+    }
+    else if (start + size >= tail)
+    {
+        return false;
+    }
+
+    RingAllocation allocation = {};
+    allocation.offset = start;
+    allocation.size = size;
+    allocation.released = false;
+    if (!ring.allocations.empty())
+        ring.allocations.back().size += skipped;
+    ring.allocations.push_back(allocation);
+    ring.head = start + size;
+    ring.usage += skipped + size;
+
+    offset = start;
+    serial = ring.firstSerial + ring.allocations.size() - 1;
+    return true;
+}
+
+// Space is given back in order, once every older allocation is released too
+static void ReleaseRingAllocation(StagingRing& ring, u64 serial)
+{
+    ring.allocations[serial - ring.firstSerial].released = true;
+    while (!ring.allocations.empty() && ring.allocations.front().released)
+    {
+        ring.usage -= ring.allocations.front().size;
+        ring.allocations.pop_front();
+        ring.firstSerial++;
+    }
+}
+
+// Binds the staging buffer to target, unmapped, and returns the offset of the
+// upload in it
+static u64 BindUploadSource(UploadManager& manager, Upload* upload, GLenum target)
+{
+    if (upload->stagingIdx == UINT32_MAX)
+    {
+        glBindBuffer(target, manager.ring.handle);
+        return upload->ringOffset;
+    }
+
+    glBindBuffer(target, manager.stagingBuffers[upload->stagingIdx].handle);
+    glUnmapBuffer(target);
+    upload->data = NULL;
+    return 0;
+}
+
+static void ReleaseUpload(UploadManager& manager, Upload* upload)
+{
+    if (upload->stagingIdx == UINT32_MAX)
+        ReleaseRingAllocation(manager.ring, upload->ringSerial);
+    else
+        manager.stagingBuffers[upload->stagingIdx].inUse = false;
+    delete upload;
+}
+
+Upload* BeginUpload(App* app, u32 size)
+{
+    UploadManager& manager = app->uploads;
+
+    if (manager.ring.handle == 0 && !manager.ringFailed)
+        manager.ringFailed = !CreateStagingRing(manager);
+
+    // The ring is coherent, what the producer writes is seen by the copy
+    if (manager.ring.handle != 0 && size <= manager.ring.capacity)
+    {
+        u64 offset, serial;
+        if (!AllocateFromRing(manager.ring, size, offset, serial))
+            return NULL;
+
+        Upload* upload = new Upload;
+        upload->data = manager.ring.data + offset;
+        upload->size = size;
+        upload->written = false;
+        upload->stagingIdx = UINT32_MAX;
+        upload->ringOffset = offset;
+        upload->ringSerial = serial;
+        return upload;
+    }
+
+    u32 stagingIdx = AcquireStagingBuffer(manager, size);
+    if (stagingIdx == UINT32_MAX)
+        return NULL;
+
+    StagingBuffer& buffer = manager.stagingBuffers[stagingIdx];
+    buffer.inUse = true;
+
+    // The buffer is not used by the GPU anymore (its batch completed), so it is
+    // mapped without waiting for anything
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.handle);
+    void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (!data)
+    {
+        ELOG("Could not map a staging buffer of %u bytes", size);
+        buffer.inUse = false;
+        return NULL;
+    }
+
+    Upload* upload = new Upload;
+    upload->data = (u8*)data;
+    upload->size = size;
+    upload->written = false;
+    upload->stagingIdx = stagingIdx;
+    upload->ringOffset = 0;
+    upload->ringSerial = 0;
+    return upload;
+}
+
+bool CanIssueUpload(const App* app, u64 size)
+{
+    const UploadManager& manager = app->uploads;
+    return manager.frameBytes == 0 || manager.frameBytes + size <= manager.frameBudget;
+}
+
+static void AddToFrame(UploadManager& manager, Upload* upload, UploadCallback&& onComplete)
+{
+    upload->onComplete = std::move(onComplete);
+    manager.frameUploads.push_back(upload);
+    manager.frameBytes += upload->size;
+    manager.uploadedBytes += upload->size;
+}
+
+void IssueArrayTextureUpload(App* app, Upload* upload, u32 arrayTextureIdx, u32 level, UploadCallback onComplete)
+{
+    ASSERT(upload->written, "Uploads are issued once written");
+    UploadManager& manager = app->uploads;
+
+    // With a pixel unpack buffer bound the data pointer is an offset into it
+    u64 offset = BindUploadSource(manager, upload, GL_PIXEL_UNPACK_BUFFER);
+    UploadArrayTextureLevel(app, arrayTextureIdx, level, (const void*)offset, upload->size);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    AddToFrame(manager, upload, std::move(onComplete));
+}
+
+void IssueTextureUpload(App* app, Upload* upload, GLuint texture, u32 x, u32 y, u32 width, u32 height, GLenum glFormat, UploadCallback onComplete)
+{
+    ASSERT(upload->written, "Uploads are issued once written");
+    UploadManager& manager = app->uploads;
+
+    u64 offset = BindUploadSource(manager, upload, GL_PIXEL_UNPACK_BUFFER);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, glFormat, (GLsizei)upload->size, (const void*)offset);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    AddToFrame(manager, upload, std::move(onComplete));
+}
+
+void IssueBufferUpload(App* app, Upload* upload, GLuint buffer, u64 offset, UploadCallback onComplete)
+{
+    ASSERT(upload->written, "Uploads are issued once written");
+    UploadManager& manager = app->uploads;
+
+    u64 sourceOffset = BindUploadSource(manager, upload, GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, offset, upload->size);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    AddToFrame(manager, upload, std::move(onComplete));
+}
+
+GLuint CreateStaticBuffer(App* app, u64 size, const BufferRange* ranges, u32 rangeCount)
+{
+    const GLExtensions& ext = GlobalGLExtensions;
+
+    // Immutable where possible, written by copies and by glBufferSubData as a fallback
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if (ext.bufferStorage)
+        ext.BufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_STORAGE_BIT);
+    else
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+
+    for (u32 i = 0; i < rangeCount; ++i)
+    {
+        const BufferRange& range = ranges[i];
+        if (range.size == 0)
+            continue;
+
+        Upload* upload = range.size <= UINT32_MAX ? BeginUpload(app, (u32)range.size) : NULL;
+        if (!upload)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset, range.size, range.data);
+            continue;
+        }
+
+        memcpy(upload->data, range.data, range.size);
+        upload->written = true;
+        IssueBufferUpload(app, upload, buffer, range.offset);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    return buffer;
+}
+
+void CancelUpload(App* app, Upload* upload)
+{
+    UploadManager& manager = app->uploads;
+
+    // A worker may still be writing to the mapping
+    if (!upload->written)
+    {
+        manager.canceled.push_back(upload);
+        return;
+    }
+
+    BindUploadSource(manager, upload, GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    ReleaseUpload(manager, upload);
+}
+
+void UpdateUploads(App* app)
+{
+    UploadManager& manager = app->uploads;
+
+    if (!manager.frameUploads.empty())
+    {
+        UploadBatch batch;
+        batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        batch.uploads.swap(manager.frameUploads);
+        manager.batches.push_back(std::move(batch));
+    }
+    manager.frameBytes = 0;
+
+    // Batches complete in order, the first one still pending stops the rest
+    u32 completed = 0;
+    while (completed < manager.batches.size())
+    {
+        UploadBatch& batch = manager.batches[completed];
+        GLenum status = glClientWaitSync(batch.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+
+        glDeleteSync(batch.fence);
+        for (Upload* upload : batch.uploads)
+        {
+            if (upload->onComplete)
+                upload->onComplete();
+            ReleaseUpload(manager, upload);
+            manager.completedUploads++;
+        }
+        completed++;
+    }
+    manager.batches.erase(manager.batches.begin(), manager.batches.begin() + completed);
+
+    for (u32 i = 0; i < manager.canceled.size(); )
+    {
+        Upload* upload = manager.canceled[i];
+        if (!upload->written)
+        {
+            ++i;
+            continue;
+        }
+
+        BindUploadSource(manager, upload, GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        ReleaseUpload(manager, upload);
+        manager.canceled.erase(manager.canceled.begin() + i);
+    }
+}
+
+void UploadManagerGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Uploads"))
+        return;
+
+    UploadManager& manager = app->uploads;
+
+    int frameBudgetKB = (int)(manager.frameBudget / KB(1));
+    int stagingBudgetMB = (int)(manager.stagingBudget / MB(1));
+    if (ImGui::DragInt("Per frame (KB)", &frameBudgetKB, 16.0f, 16, 1048576))
+        manager.frameBudget = (u64)frameBudgetKB * KB(1);
+    if (ImGui::DragInt("Staging budget (MB)", &stagingBudgetMB, 1.0f, 1, 4096))
+        manager.stagingBudget = (u64)stagingBudgetMB * MB(1);
+
+    u32 buffersInUse = 0;
+    for (const StagingBuffer& buffer : manager.stagingBuffers)
+        if (buffer.handle != 0 && buffer.inUse)
+            buffersInUse++;
+
+    if (manager.ring.handle != 0)
+        ImGui::Text("Staging ring: %.2f / %.2f MB   Allocations: %u", manager.ring.usage / (f32)MB(1), manager.ring.capacity / (f32)MB(1), (u32)manager.ring.allocations.size());
+    else
+        ImGui::Text("Staging ring: no (ARB_buffer_storage missing), buffers are mapped per upload");
+    ImGui::Text("Staging: %.2f MB   Buffers in use: %u", manager.stagingUsage / (f32)MB(1), buffersInUse);
+    ImGui::Text("Batches in flight: %u   Canceled: %u", (u32)manager.batches.size(), (u32)manager.canceled.size());
+    ImGui::Text("Uploaded: %.2f MB   Completed: %u", manager.uploadedBytes / (f32)MB(1), manager.completedUploads);
+}
@@ -0,0 +1,153 @@
+//
+// upload_manager.h: GPU uploads go through staging buffers (pixel unpack and
+// copy read buffers) instead of client memory. A producer, usually a worker
+// thread, gets mapped staging memory with BeginUpload, fills it and marks it
+// written; the main thread then issues the copy into the texture or buffer,
+// which the GL performs from the staging buffer without blocking on a driver
+// copy.
+//
+// With ARB_buffer_storage the staging memory is a ring in one buffer, mapped
+// once, persistently and coherently: uploads are carved out of it in order and
+// nothing is mapped or unmapped per upload. Without it, or for uploads bigger
+// than the ring, staging buffers from a pool are mapped and unmapped each time.
+//
+// The copies issued during a frame form a batch that is fenced at the end of
+// the frame. Once the fence signals the completion callbacks run and the
+// staging buffers are reused. How many bytes are issued per frame is limited by
+// a budget shared by everything that streams data.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+struct App;
+
+typedef std::function<void()> UploadCallback;
+
+struct Upload
+{
+    u8*               data;       // staging memory, mapped until the upload is issued
+    u32               size;
+    std::atomic<bool> written;    // set by the producer once data is filled
+    u32               stagingIdx; // pool buffer, UINT32_MAX when in the ring
+    u64               ringOffset;
+    u64               ringSerial; // of its allocation
+    UploadCallback    onComplete;
+};
+
+struct StagingBuffer
+{
+    GLuint handle;
+    u32    capacity;
+    bool   inUse;
+};
+
+struct RingAllocation
+{
+    u64  offset;
+    u64  size;     // with the end of the ring skipped to wrap around, if any
+    bool released;
+};
+
+// Persistently mapped staging memory, allocated in order and freed in order
+struct StagingRing
+{
+    GLuint                     handle;   // 0 without ARB_buffer_storage
+    u8*                        data;
+    u64                        capacity;
+    u64                        head;     // where the next allocation starts
+    u64                        usage;
+    std::deque<RingAllocation> allocations; // oldest first
+    u64                        firstSerial;  // of allocations.front()
+};
+
+// Piece of a buffer filled by CreateStaticBuffer
+struct BufferRange
+{
+    const void* data;
+    u64         size;
+    u64         offset; // in the buffer
+};
+
+// Uploads issued in the same frame
+struct UploadBatch
+{
+    GLsync               fence;
+    std::vector<Upload*> uploads;
+};
+
+struct UploadManager
+{
+    u64 frameBudget = MB(8);    // bytes issued per frame
+    u64 stagingBudget = MB(64); // staging memory allocated at once, pool buffers
+    u64 ringSize = MB(64);      // the ring is created with it on the first upload
+
+    StagingRing                ring;
+    bool                       ringFailed;   // could not be created, the pool is used
+    std::vector<StagingBuffer> stagingBuffers;
+    std::vector<Upload*>       frameUploads; // issued this frame, not fenced yet
+    std::vector<UploadBatch>   batches;      // oldest first
+    std::vector<Upload*>       canceled;     // waiting for their producer to finish
+
+    u64 stagingUsage;
+    u64 frameBytes;
+
+    // since startup
+    u64 uploadedBytes;
+    u32 completedUploads;
+};
+
+/**
+ * Returns mapped staging memory for size bytes, or NULL if the staging budget
+ * is used up (try again in a later frame). The producer fills upload->data from
+ * any thread and then sets upload->written.
+ */
+Upload* BeginUpload(App* app, u32 size);
+
+/**
+ * Whether size more bytes fit in this frame's budget. The first upload of a
+ * frame always fits, so that big ones get through.
+ */
+bool CanIssueUpload(const App* app, u64 size);
+
+/**
+ * Issues the copy of a written upload into a level of an array texture (see
+ * texture_arrays.h), as block compressed data. The upload belongs to the
+ * manager afterwards: onComplete runs once the GPU is done with it.
+ */
+void IssueArrayTextureUpload(App* app, Upload* upload, u32 arrayTextureIdx, u32 level, UploadCallback onComplete = nullptr);
+
+/**
+ * Same for a region of the first level of a block compressed GL_TEXTURE_2D.
+ */
+void IssueTextureUpload(App* app, Upload* upload, GLuint texture, u32 x, u32 y, u32 width, u32 height, GLenum glFormat, UploadCallback onComplete = nullptr);
+
+/**
+ * Same for a range of a buffer object, copied with glCopyBufferSubData.
+ */
+void IssueBufferUpload(App* app, Upload* upload, GLuint buffer, u64 offset, UploadCallback onComplete = nullptr);
+
+/**
+ * Creates a buffer object of size bytes, for geometry, and fills it from the
+ * ranges through staging memory. The ranges are read before it returns; those
+ * the staging memory can not take right now are given to the driver directly.
+ */
+GLuint CreateStaticBuffer(App* app, u64 size, const BufferRange* ranges, u32 rangeCount);
+
+/**
+ * Gives back an upload that will not be issued. It may still be being written.
+ */
+void CancelUpload(App* app, Upload* upload);
+
+/**
+ * Once per frame, after everything that uploads: fences the uploads issued this
+ * frame and completes the batches the GPU is done with.
+ */
+void UpdateUploads(App* app);
+
+void UploadManagerGui(App* app);
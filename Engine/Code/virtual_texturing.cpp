@@ -0,0 +1,566 @@
+#include "virtual_texturing.h"
+#include "engine.h"
+#include "job_system.h"
+#include "upload_manager.h"
+#include <imgui.h>
+#include <algorithm>
+
+// Page keys: virtual texture (24 bits), level (8), page y (16), page x (16)
+static u64 MakePageKey(u32 vtIdx, u32 level, u32 x, u32 y)
+{
+    return ((u64)vtIdx << 40) | ((u64)level << 32) | ((u64)y << 16) | (u64)x;
+}
+
+static u32 GetPageTexture(u64 key) { return (u32)(key >> 40); }
+static u32 GetPageLevel(u64 key)   { return (u32)(key >> 32) & 0xFF; }
+static u32 GetPageY(u64 key)       { return (u32)(key >> 16) & 0xFFFF; }
+static u32 GetPageX(u64 key)       { return (u32)key & 0xFFFF; }
+
+static u32 GetPagesX(const VirtualTexture& vt, u32 level)
+{
+    return (vt.width >> level) / VT_PAGE_SIZE;
+}
+
+static u32 GetPagesY(const VirtualTexture& vt, u32 level)
+{
+    return (vt.height >> level) / VT_PAGE_SIZE;
+}
+
+static u32 GetBlockBytes(GLenum glFormat)
+{
+    return glFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || glFormat == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+}
+
+static bool IsPowerOfTwo(u32 value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+// Copies a page and its border out of a compressed level. The border repeats
+// the edge blocks of the texture, like GL_CLAMP_TO_EDGE
+static void CopyPageBlocks(const u8* levelData, u32 blocksWide, u32 blocksHigh, u32 blockBytes, u32 pageX, u32 pageY, u8* dst)
+{
+    const i32 pageBlocks = VT_PAGE_SIZE / 4;
+    const i32 borderBlocks = VT_PAGE_BORDER / 4;
+    const i32 physicalBlocks = VT_PHYSICAL_PAGE_SIZE / 4;
+
+    for (i32 by = 0; by < physicalBlocks; ++by)
+    {
+        i32 srcY = glm::clamp((i32)pageY * pageBlocks - borderBlocks + by, 0, (i32)blocksHigh - 1);
+        for (i32 bx = 0; bx < physicalBlocks; ++bx)
+        {
+            i32 srcX = glm::clamp((i32)pageX * pageBlocks - borderBlocks + bx, 0, (i32)blocksWide - 1);
+            memcpy(dst, levelData + ((size_t)srcY * blocksWide + srcX) * blockBytes, blockBytes);
+            dst += blockBytes;
+        }
+    }
+}
+
+// Returns false if there is no staging memory left for the page
+static bool StartPageLoad(App* app, u64 key)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+    const VirtualTexture& vt = vtSystem.textures[GetPageTexture(key)];
+    const CookedTexture& cooked = app->textureStreaming.textures[vt.streamedIdx].cooked;
+    u32 level = GetPageLevel(key);
+
+    const u32 physicalBlocks = VT_PHYSICAL_PAGE_SIZE / 4;
+    u32 blockBytes = GetBlockBytes(cooked.glFormat);
+
+    Upload* upload = BeginUpload(app, physicalBlocks * physicalBlocks * blockBytes);
+    if (!upload)
+        return false;
+
+    VirtualPageLoad* load = new VirtualPageLoad;
+    load->key = key;
+    load->upload = upload;
+    vtSystem.loads.push_back(load);
+
+    // The mapping outlives the load, the streamed texture keeps it until shutdown
+    const u8* levelData = cooked.levelData[level];
+    u32 blocksWide = (vt.width >> level) / 4;
+    u32 blocksHigh = (vt.height >> level) / 4;
+
+    SubmitJob([upload, key, levelData, blocksWide, blocksHigh, blockBytes]
+    {
+        CopyPageBlocks(levelData, blocksWide, blocksHigh, blockBytes, GetPageX(key), GetPageY(key), upload->data);
+        upload->written = true;
+    });
+    return true;
+}
+
+static bool IsPageLoading(const VirtualTexturing& vtSystem, u64 key)
+{
+    for (const VirtualPageLoad* load : vtSystem.loads)
+        if (load->key == key)
+            return true;
+    return false;
+}
+
+static u32& GetPageSlot(VirtualTexture& vt, u64 key)
+{
+    u32 level = GetPageLevel(key);
+    return vt.pageSlots[level][GetPageY(key) * GetPagesX(vt, level) + GetPageX(key)];
+}
+
+// A free slot, or the least recently used one not needed this frame. The
+// coarsest pages are never evicted, they are the fallback of everything else
+static u32 AllocatePageSlot(App* app, PhysicalPageCache& cache)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+
+    u32 best = UINT32_MAX;
+    for (u32 slot = 0; slot < cache.slotPages.size(); ++slot)
+    {
+        u64 key = cache.slotPages[slot];
+        if (key == VT_NO_PAGE)
+            return slot;
+
+        const VirtualTexture& vt = vtSystem.textures[GetPageTexture(key)];
+        if (GetPageLevel(key) + 1 == vt.levelCount || cache.slotLastUsed[slot] >= vtSystem.frame)
+            continue;
+
+        if (best == UINT32_MAX || cache.slotLastUsed[slot] < cache.slotLastUsed[best])
+            best = slot;
+    }
+
+    if (best != UINT32_MAX)
+    {
+        u64 evicted = cache.slotPages[best];
+        VirtualTexture& vt = vtSystem.textures[GetPageTexture(evicted)];
+        GetPageSlot(vt, evicted) = UINT32_MAX;
+        vt.indirectionDirty = true;
+
+        cache.slotPages[best] = VT_NO_PAGE;
+        cache.usedSlots--;
+        vtSystem.evictedPages++;
+    }
+
+    return best;
+}
+
+static void CreatePhysicalPageCache(App* app, PhysicalPageCache& cache)
+{
+    u32 size = app->virtualTexturing.pagesPerSide * VT_PHYSICAL_PAGE_SIZE;
+
+    glGenTextures(1, &cache.handle);
+    glBindTexture(GL_TEXTURE_2D, cache.handle);
+    glTexStorage2D(GL_TEXTURE_2D, 1, cache.glFormat, size, size);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// The upload of the load is issued or canceled
+static bool UploadPage(App* app, const VirtualPageLoad& load)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+    VirtualTexture& vt = vtSystem.textures[GetPageTexture(load.key)];
+    PhysicalPageCache& cache = vtSystem.caches[vt.cacheIdx];
+
+    if (GetPageSlot(vt, load.key) != UINT32_MAX)
+    {
+        CancelUpload(app, load.upload);
+        return true;
+    }
+
+    if (cache.handle == 0)
+        CreatePhysicalPageCache(app, cache);
+
+    u32 slot = AllocatePageSlot(app, cache);
+    if (slot == UINT32_MAX)
+    {
+        CancelUpload(app, load.upload);
+        return false; // everything resident is in use, it will be requested again
+    }
+
+    u32 pagesPerSide = vtSystem.pagesPerSide;
+    IssueTextureUpload(app, load.upload, cache.handle, (slot % pagesPerSide) * VT_PHYSICAL_PAGE_SIZE, (slot / pagesPerSide) * VT_PHYSICAL_PAGE_SIZE,
+                       VT_PHYSICAL_PAGE_SIZE, VT_PHYSICAL_PAGE_SIZE, cache.glFormat);
+
+    cache.slotPages[slot] = load.key;
+    cache.slotLastUsed[slot] = vtSystem.frame;
+    cache.usedSlots++;
+
+    GetPageSlot(vt, load.key) = slot;
+    vt.indirectionDirty = true;
+    vtSystem.uploadedPages++;
+    return true;
+}
+
+// Every page points to itself if resident, or to what its parent points to
+static void UpdateIndirection(App* app, VirtualTexture& vt)
+{
+    u32 pagesPerSide = app->virtualTexturing.pagesPerSide;
+
+    std::vector<u8> coarser;
+    std::vector<u8> entries;
+
+    glBindTexture(GL_TEXTURE_2D, vt.indirection);
+    for (i32 level = (i32)vt.levelCount - 1; level >= 0; --level)
+    {
+        u32 pagesX = GetPagesX(vt, level);
+        u32 pagesY = GetPagesY(vt, level);
+        entries.assign(pagesX * pagesY * 4, 0);
+
+        for (u32 y = 0; y < pagesY; ++y)
+        {
+            for (u32 x = 0; x < pagesX; ++x)
+            {
+                u8* entry = &entries[(y * pagesX + x) * 4];
+                u32 slot = vt.pageSlots[level][y * pagesX + x];
+
+                if (slot != UINT32_MAX)
+                {
+                    entry[0] = (u8)(slot % pagesPerSide);
+                    entry[1] = (u8)(slot / pagesPerSide);
+                    entry[2] = (u8)level;
+                    entry[3] = 1;
+                }
+                else if (!coarser.empty())
+                {
+                    memcpy(entry, &coarser[((y / 2) * (pagesX / 2) + (x / 2)) * 4], 4);
+                }
+            }
+        }
+
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pagesX, pagesY, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries.data());
+        coarser.swap(entries);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    vt.indirectionDirty = false;
+}
+
+// Appends the pages found in the readbacks that are ready, oldest first
+static void ReadFeedback(App* app, std::vector<u64>& requests)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+    u32 texelCount = vtSystem.feedbackSize.x * vtSystem.feedbackSize.y;
+
+    for (u32 i = 0; i < VT_FEEDBACK_FRAMES; ++i)
+    {
+        u32 readback = (vtSystem.readbackHead + i) % VT_FEEDBACK_FRAMES;
+        GLsync fence = vtSystem.readbackFences[readback];
+        if (!fence)
+            continue;
+
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break; // the newer ones are not done either
+
+        glDeleteSync(fence);
+        vtSystem.readbackFences[readback] = 0;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vtSystem.readbackBuffers[readback]);
+        const u16* texels = (const u16*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, texelCount * 4 * sizeof(u16), GL_MAP_READ_BIT);
+        if (texels)
+        {
+            for (u32 t = 0; t < texelCount; ++t)
+            {
+                const u16* texel = texels + t * 4;
+                if (texel[3] == 0 || texel[3] > vtSystem.textures.size())
+                    continue;
+
+                const VirtualTexture& vt = vtSystem.textures[texel[3] - 1];
+                u32 level = texel[2];
+                if (level < vt.levelCount && texel[0] < GetPagesX(vt, level) && texel[1] < GetPagesY(vt, level))
+                    requests.push_back(MakePageKey(texel[3] - 1, level, texel[0], texel[1]));
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void InitVirtualTexturing(App* app)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+    vtSystem.feedbackSize = glm::max(app->displaySize / VT_FEEDBACK_SCALE, ivec2(1));
+
+    glGenTextures(1, &vtSystem.feedbackTexture);
+    glBindTexture(GL_TEXTURE_2D, vtSystem.feedbackTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16UI, vtSystem.feedbackSize.x, vtSystem.feedbackSize.y);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Only used to clear it
+    glGenFramebuffers(1, &vtSystem.feedbackFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, vtSystem.feedbackFbo);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, vtSystem.feedbackTexture, 0);
+    CheckFBOStatus();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(VT_FEEDBACK_FRAMES, vtSystem.readbackBuffers);
+    for (u32 i = 0; i < VT_FEEDBACK_FRAMES; ++i)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, vtSystem.readbackBuffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, vtSystem.feedbackSize.x * vtSystem.feedbackSize.y * 4 * sizeof(u16), NULL, GL_STREAM_READ);
+        vtSystem.readbackFences[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void RegisterVirtualTexture(App* app, u32 texIdx)
+{
+    Texture& tex = app->textures[texIdx];
+    if (tex.streamedIdx == UINT32_MAX || tex.virtualIdx != UINT32_MAX)
+        return;
+
+    const CookedTexture& cooked = app->textureStreaming.textures[tex.streamedIdx].cooked;
+    if (!IsPowerOfTwo(cooked.width) || !IsPowerOfTwo(cooked.height) || glm::min(cooked.width, cooked.height) < VT_PAGE_SIZE)
+        return;
+
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+
+    VirtualTexture vt = {};
+    vt.texIdx = texIdx;
+    vt.streamedIdx = tex.streamedIdx;
+    vt.width = cooked.width;
+    vt.height = cooked.height;
+    while (vt.levelCount < cooked.levelCount && (glm::min(vt.width, vt.height) >> vt.levelCount) >= VT_PAGE_SIZE)
+        vt.levelCount++;
+
+    vt.pageSlots.resize(vt.levelCount);
+    for (u32 level = 0; level < vt.levelCount; ++level)
+        vt.pageSlots[level].assign(GetPagesX(vt, level) * GetPagesY(vt, level), UINT32_MAX);
+
+    vt.cacheIdx = UINT32_MAX;
+    for (u32 i = 0; i < vtSystem.caches.size(); ++i)
+        if (vtSystem.caches[i].glFormat == cooked.glFormat)
+            vt.cacheIdx = i;
+
+    if (vt.cacheIdx == UINT32_MAX)
+    {
+        u32 slotCount = vtSystem.pagesPerSide * vtSystem.pagesPerSide;
+
+        PhysicalPageCache cache = {};
+        cache.glFormat = cooked.glFormat;
+        cache.slotPages.assign(slotCount, VT_NO_PAGE);
+        cache.slotLastUsed.assign(slotCount, 0);
+        vt.cacheIdx = (u32)vtSystem.caches.size();
+        vtSystem.caches.push_back(cache);
+    }
+
+    glGenTextures(1, &vt.indirection);
+    glBindTexture(GL_TEXTURE_2D, vt.indirection);
+    glTexStorage2D(GL_TEXTURE_2D, vt.levelCount, GL_RGBA8UI, GetPagesX(vt, 0), GetPagesY(vt, 0));
+    glBindTexture(GL_TEXTURE_2D, 0);
+    vt.indirectionDirty = true;
+
+    tex.virtualIdx = (u32)vtSystem.textures.size();
+    vtSystem.textures.push_back(vt);
+}
+
+void BeginVirtualTextureFeedback(App* app)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+    vtSystem.feedbackActive = vtSystem.enabled;
+    if (!vtSystem.feedbackActive)
+        return;
+
+    const GLuint clearValue[4] = { 0, 0, 0, 0 };
+    glBindFramebuffer(GL_FRAMEBUFFER, vtSystem.feedbackFbo);
+    glClearBufferuiv(GL_COLOR, 0, clearValue);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glBindImageTexture(0, vtSystem.feedbackTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16UI);
+}
+
+bool BindVirtualTexture(App* app, const Program& program, u32 texIdx)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+
+    GLint location = program.uniformVirtualTexture;
+    if (location == -1)
+        return false;
+
+    if (!vtSystem.feedbackActive || texIdx >= app->textures.size() || app->textures[texIdx].virtualIdx == UINT32_MAX)
+    {
+        glUniform4f(location, 0.0f, 0.0f, 0.0f, 0.0f);
+        return false;
+    }
+
+    u32 vtIdx = app->textures[texIdx].virtualIdx;
+    const VirtualTexture& vt = vtSystem.textures[vtIdx];
+
+    // The units the shaders declare for uIndirection and uPhysicalPages
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, vt.indirection);
+    BindSampler(app, 3, Sampler_NearestMip);
+
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, vtSystem.caches[vt.cacheIdx].handle);
+    BindSampler(app, 4, Sampler_Linear);
+
+    glUniform4f(location, (f32)vt.width, (f32)vt.height, (f32)vt.levelCount, (f32)(vtIdx + 1));
+
+    // A different pixel of every 8x8 block writes the feedback each frame (29 is
+    // coprime with 64, so all of them take their turn)
+    u32 jitter = (u32)(vtSystem.frame * 29 % (VT_FEEDBACK_SCALE * VT_FEEDBACK_SCALE));
+    glUniform2i(program.uniformFeedbackOffset, jitter % VT_FEEDBACK_SCALE, jitter / VT_FEEDBACK_SCALE);
+
+    return true;
+}
+
+void EndVirtualTextureFeedback(App* app)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+    if (!vtSystem.feedbackActive)
+        return;
+
+    // The previous readback in this buffer has not been read yet, skip a frame
+    u32 readback = vtSystem.readbackHead;
+    if (vtSystem.readbackFences[readback])
+        return;
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, vtSystem.readbackBuffers[readback]);
+    glBindTexture(GL_TEXTURE_2D, vtSystem.feedbackTexture);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    vtSystem.readbackFences[readback] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    vtSystem.readbackHead = (readback + 1) % VT_FEEDBACK_FRAMES;
+}
+
+void UpdateVirtualTexturing(App* app)
+{
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+    if (!vtSystem.enabled)
+        return;
+
+    std::vector<u64> feedback;
+    ReadFeedback(app, feedback);
+    std::sort(feedback.begin(), feedback.end());
+    feedback.erase(std::unique(feedback.begin(), feedback.end()), feedback.end());
+    if (!feedback.empty())
+        vtSystem.requestedPages = (u32)feedback.size();
+
+    // Every requested page brings its parents, so the fallbacks get refined
+    // first, and the coarsest pages of every texture are always wanted
+    std::vector<u64> requests;
+    for (u64 key : feedback)
+    {
+        const VirtualTexture& vt = vtSystem.textures[GetPageTexture(key)];
+        for (u32 level = GetPageLevel(key); level < vt.levelCount; ++level)
+        {
+            u32 shift = level - GetPageLevel(key);
+            requests.push_back(MakePageKey(GetPageTexture(key), level, GetPageX(key) >> shift, GetPageY(key) >> shift));
+        }
+    }
+
+    for (u32 vtIdx = 0; vtIdx < vtSystem.textures.size(); ++vtIdx)
+    {
+        const VirtualTexture& vt = vtSystem.textures[vtIdx];
+        u32 level = vt.levelCount - 1;
+        for (u32 y = 0; y < GetPagesY(vt, level); ++y)
+            for (u32 x = 0; x < GetPagesX(vt, level); ++x)
+                requests.push_back(MakePageKey(vtIdx, level, x, y));
+    }
+
+    std::sort(requests.begin(), requests.end());
+    requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+
+    // Coarse pages first
+    std::stable_sort(requests.begin(), requests.end(), [](u64 a, u64 b)
+    {
+        return GetPageLevel(a) > GetPageLevel(b);
+    });
+
+    bool stagingFull = false;
+    for (u64 key : requests)
+    {
+        VirtualTexture& vt = vtSystem.textures[GetPageTexture(key)];
+        u32 slot = GetPageSlot(vt, key);
+
+        if (slot != UINT32_MAX)
+            vtSystem.caches[vt.cacheIdx].slotLastUsed[slot] = vtSystem.frame;
+        else if (!stagingFull && vtSystem.loads.size() < VT_MAX_LOADS && !IsPageLoading(vtSystem, key))
+            stagingFull = !StartPageLoad(app, key);
+    }
+
+    // Finished loads, in the order they were started, within the upload budget
+    u32 uploads = 0;
+    for (u32 i = 0; i < vtSystem.loads.size() && uploads < vtSystem.uploadsPerFrame; )
+    {
+        VirtualPageLoad* load = vtSystem.loads[i];
+        if (!load->upload->written)
+        {
+            ++i;
+            continue;
+        }
+
+        if (!CanIssueUpload(app, load->upload->size))
+            break;
+
+        UploadPage(app, *load);
+        uploads++;
+
+        delete load;
+        vtSystem.loads.erase(vtSystem.loads.begin() + i);
+    }
+
+    for (VirtualTexture& vt : vtSystem.textures)
+        if (vt.indirectionDirty)
+            UpdateIndirection(app, vt);
+
+    vtSystem.frame++;
+}
+
+void VirtualTexturingGui(App* app)
+{
+    if (!ImGui::CollapsingHeader("Virtual texturing"))
+        return;
+
+    VirtualTexturing& vtSystem = app->virtualTexturing;
+
+    ImGui::Checkbox("Enabled##vt", &vtSystem.enabled);
+
+    int uploadsPerFrame = (int)vtSystem.uploadsPerFrame;
+    if (ImGui::DragInt("Page uploads per frame", &uploadsPerFrame, 1.0f, 1, 256))
+        vtSystem.uploadsPerFrame = (u32)uploadsPerFrame;
+
+    ImGui::Text("Pages requested: %u   Loading: %u", vtSystem.requestedPages, (u32)vtSystem.loads.size());
+    ImGui::Text("Uploaded: %u   Evicted: %u", vtSystem.uploadedPages, vtSystem.evictedPages);
+
+    for (const PhysicalPageCache& cache : vtSystem.caches)
+    {
+        u32 slotCount = (u32)cache.slotPages.size();
+        u32 size = vtSystem.pagesPerSide * VT_PHYSICAL_PAGE_SIZE;
+        f32 megabytes = cache.handle ? (f32)(size / 4) * (size / 4) * GetBlockBytes(cache.glFormat) / MB(1) : 0.0f;
+        ImGui::Text("Cache 0x%04X: %u / %u pages, %.1f MB", cache.glFormat, cache.usedSlots, slotCount, megabytes);
+    }
+
+    if (ImGui::BeginTable("##virtualTextures", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+    {
+        ImGui::TableSetupColumn("Texture");
+        ImGui::TableSetupColumn("Size");
+        ImGui::TableSetupColumn("Resident pages");
+        ImGui::TableHeadersRow();
+
+        for (const VirtualTexture& vt : vtSystem.textures)
+        {
+            u32 resident = 0;
+            u32 total = 0;
+            for (const std::vector<u32>& slots : vt.pageSlots)
+            {
+                total += (u32)slots.size();
+                for (u32 slot : slots)
+                    resident += slot != UINT32_MAX;
+            }
+
+            ImGui::TableNextRow();
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", app->textures[vt.texIdx].filepath.c_str());
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%ux%u", vt.width, vt.height);
+
+            ImGui::TableNextColumn();
+            ImGui::Text("%u / %u", resident, total);
+        }
+
+        ImGui::EndTable();
+    }
+}
@@ -0,0 +1,126 @@
+//
+// virtual_texturing.h: Sparse virtual texturing for the albedo textures. The
+// cooked mips are split into 128x128 pages and only the pages that are visible
+// live on the GPU, in a fixed size atlas (the physical page cache), so the VRAM
+// used does not depend on how much texture data the scene has.
+//
+// The geometry pass writes the page every pixel needs into a small feedback
+// buffer, which is read back a few frames later without stalling. Requested
+// pages are copied out of the cooked file by the workers and uploaded a few per
+// frame, evicting the least recently seen ones. An indirection texture per
+// virtual texture maps its pages to the atlas; pages not loaded yet point to
+// the closest coarser page that is.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+struct App;
+struct Program;
+struct Upload;
+
+#define VT_PAGE_SIZE          128
+#define VT_PAGE_BORDER        4   // one compressed block, pages are copied block by block
+#define VT_PHYSICAL_PAGE_SIZE (VT_PAGE_SIZE + 2 * VT_PAGE_BORDER)
+#define VT_FEEDBACK_SCALE     8   // the feedback buffer is 1/8 of the screen on each axis
+#define VT_FEEDBACK_FRAMES    3   // readbacks in flight
+#define VT_MAX_LOADS          64  // pages being read at once
+#define VT_NO_PAGE            UINT64_MAX
+
+// Atlas with the resident pages, one per block format
+struct PhysicalPageCache
+{
+    GLenum           glFormat;
+    GLuint           handle;    // created with the first page
+    std::vector<u64> slotPages; // page key in each slot, VT_NO_PAGE if free
+    std::vector<u64> slotLastUsed;
+    u32              usedSlots;
+};
+
+struct VirtualTexture
+{
+    u32    texIdx;      // first texture using it, for the debug window
+    u32    streamedIdx; // in app->textureStreaming, it holds the cooked levels
+    u32    cacheIdx;
+    u32    width;       // level 0
+    u32    height;
+    u32    levelCount;  // levels of at least one page
+    GLuint indirection; // RGBA8UI: atlas slot x, y, level of the page, valid
+
+    std::vector<std::vector<u32>> pageSlots; // per level, slot of every page or UINT32_MAX
+    bool                          indirectionDirty;
+};
+
+// Page being copied out of the cooked file by a worker, into staging memory
+struct VirtualPageLoad
+{
+    u64     key;
+    Upload* upload;
+};
+
+struct VirtualTexturing
+{
+    bool enabled = false;
+    u32  pagesPerSide = 30;   // of each atlas, 30 * 136 = 4080 texels
+    u32  uploadsPerFrame = 16;
+
+    std::vector<VirtualTexture>    textures;
+    std::vector<PhysicalPageCache> caches;
+
+    // Feedback: RGBA16UI with page x, y, level and virtual texture + 1 (0 = nothing)
+    GLuint     feedbackTexture;
+    GLuint     feedbackFbo;
+    glm::ivec2 feedbackSize;
+    GLuint     readbackBuffers[VT_FEEDBACK_FRAMES];
+    GLsync     readbackFences[VT_FEEDBACK_FRAMES];
+    u32        readbackHead;
+    bool       feedbackActive;
+
+    std::vector<VirtualPageLoad*> loads;
+    u64                           frame;
+
+    // last feedback
+    u32 requestedPages;
+
+    // since startup
+    u32 uploadedPages;
+    u32 evictedPages;
+};
+
+/**
+ * Creates the feedback buffer and its readback buffers. Called once from Init.
+ */
+void InitVirtualTexturing(App* app);
+
+/**
+ * Makes a streamed texture also available as a virtual texture. Only textures
+ * with power of two sizes of at least one page qualify, the rest are ignored.
+ */
+void RegisterVirtualTexture(App* app, u32 texIdx);
+
+/**
+ * Clears the feedback buffer and binds it for the geometry pass.
+ */
+void BeginVirtualTextureFeedback(App* app);
+
+/**
+ * Binds the virtual texture of texIdx (indirection and atlas) for the next draw
+ * and returns true, or returns false and disables it in the shader when the
+ * texture is not virtual or virtual texturing is off.
+ */
+bool BindVirtualTexture(App* app, const Program& program, u32 texIdx);
+
+/**
+ * Queues the readback of the feedback buffer. Called after the geometry pass.
+ */
+void EndVirtualTextureFeedback(App* app);
+
+/**
+ * Once per frame: reads the feedback that is ready, starts page loads, uploads
+ * the loaded pages and updates the indirection textures.
+ */
+void UpdateVirtualTexturing(App* app);
+
+void VirtualTexturingGui(App* app);
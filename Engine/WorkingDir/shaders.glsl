@@ -100,13 +100,72 @@ in vec3 vViewDir;		// in worldspace
 in vec3 vTangent;		// in worldspace
 in vec3 vBitangent;		// in worldspace
 
-uniform sampler2D uTexture;
-uniform sampler2D uNormalMap;
-uniform sampler2D uBumpTexture;
+// Material textures (see texture_arrays.h)
+struct Material
+{
+	vec4 albedo;	// color and smoothness
+	uvec4 layers;	// albedo, normal and bump map layers, flags
+	uvec2 handles[3];	// of the arrays holding them, BINDLESS_TEXTURES only
+};
+
+#define MATERIAL_ALBEDO_MAP 1u
+#define MATERIAL_NORMAL_MAP 2u
+#define MATERIAL_BUMP_MAP   4u
+#define MATERIAL_PACKED_NORMAL_HEIGHT 8u
+
+// Values whose channel is in the material swizzle (MATERIAL_SWIZZLE in engine.cpp)
+#define SWIZZLE_NORMAL_X 0u
+#define SWIZZLE_NORMAL_Y 1u
+#define SWIZZLE_HEIGHT   2u
+
+layout(binding = 0, std430) readonly buffer Materials
+{
+	Material uMaterials[];
+};
+
+uniform uint uMaterialIdx;
+#ifndef BINDLESS_TEXTURES
+layout(binding = 16) uniform sampler2DArray uTextureArrays[12];
+uniform ivec3 uTextureSlots;	// array holding the albedo, normal and bump maps
+#endif
 uniform float uBumpiness;
-uniform int noTexture;
-uniform int noNormal;
-uniform int noBump;
+
+// Permutations (see programs.h), chosen per material by Render
+//   NORMAL_MAP:     the material has a normal map and normal mapping is on
+//   RELIEF_MAP:     the material has a bump map and relief mapping is on
+//   NO_TEXTURE:     the material has no albedo map, its color is used instead
+//   BINDLESS_TEXTURES: the maps are sampled through the handles of the material
+//                   table (ARB_bindless_texture), not through the array slots
+//   RELIEF_STEPS=N: linear search steps of the relief mapping, 8, 16, 32 or 64
+//                   (see QuantizeReliefSteps)
+// The code tests the constants below rather than the defines. The GLSL compiler
+// folds them, and a module cooked to SPIR-V gets them as specialization
+// constants (SHADER_SPEC_*), so one module serves every permutation
+#if defined(GL_SPIRV)
+layout(constant_id = 0) const int RELIEF_STEPS = 32;
+layout(constant_id = 1) const bool USE_NORMAL_MAP = false;
+layout(constant_id = 2) const bool USE_RELIEF_MAP = false;
+layout(constant_id = 3) const bool USE_NO_TEXTURE = false;
+#else
+#ifndef RELIEF_STEPS
+#define RELIEF_STEPS 32
+#endif
+#ifdef NORMAL_MAP
+const bool USE_NORMAL_MAP = true;
+#else
+const bool USE_NORMAL_MAP = false;
+#endif
+#ifdef RELIEF_MAP
+const bool USE_RELIEF_MAP = true;
+#else
+const bool USE_RELIEF_MAP = false;
+#endif
+#ifdef NO_TEXTURE
+const bool USE_NO_TEXTURE = true;
+#else
+const bool USE_NO_TEXTURE = false;
+#endif
+#endif
 
 layout(binding = 0, std140) uniform GlobalParams
 {
@@ -130,10 +189,39 @@ float LinearizeDepth(float depth)
     return (2.0 * near * far) / (far + near - z * (far - near));	
 }
 
-vec2 ReliefMapping(vec2 texCoords, mat3 TBN)
+// map: 0 albedo, 1 normal, 2 bump
+vec4 SampleMaterialTexture(int map, vec2 texCoords)
 {
-	int numSteps = 30;
+	float layer = float(uMaterials[uMaterialIdx].layers[map]);
+#ifdef BINDLESS_TEXTURES
+	return texture(sampler2DArray(uMaterials[uMaterialIdx].handles[map]), vec3(texCoords, layer));
+#else
+	return texture(uTextureArrays[uTextureSlots[map]], vec3(texCoords, layer));
+#endif
+}
 
+bool HasMaterialTexture(uint flag)
+{
+	return (uMaterials[uMaterialIdx].layers.w & flag) != 0u;
+}
+
+// Channel of the material textures holding a SWIZZLE_* value
+uint MaterialChannel(uint value)
+{
+	return (uMaterials[uMaterialIdx].layers.w >> (8u + 4u * value)) & 0xFu;
+}
+
+// The material color when it has no albedo map
+vec4 SampleAlbedo(vec2 texCoords)
+{
+	if (USE_NO_TEXTURE)
+		return vec4(uMaterials[uMaterialIdx].albedo.rgb, 1.0);
+	return SampleMaterialTexture(0, texCoords);
+}
+
+// Also returns the bump map texel at the coordinates found
+vec2 ReliefMapping(vec2 texCoords, mat3 TBN, out vec4 bumpTexel)
+{
 	// Compute the view ray in texture space
 	vec3 rayTexSpace = transpose(TBN) * normalize(vViewDir.xyz);
 
@@ -141,17 +229,20 @@ vec2 ReliefMapping(vec2 texCoords, mat3 TBN)
 	float texSize = 256;
 	vec3 rayIncrementTexSpace;
 	rayIncrementTexSpace.xy = -1 * uBumpiness * rayTexSpace.xy / abs(rayTexSpace.z * texSize);
-	rayIncrementTexSpace.z = 1.0 / numSteps;
+	rayIncrementTexSpace.z = 1.0 / float(RELIEF_STEPS);
 
 	// Sampling state
+	uint heightChannel = MaterialChannel(SWIZZLE_HEIGHT);
 	vec3 samplePositionTexspace = vec3(texCoords, 0.0);
-	float sampledDepth = texture(uBumpTexture, samplePositionTexspace.xy).r;
+	bumpTexel = SampleMaterialTexture(2, samplePositionTexspace.xy);
+	float sampledDepth = bumpTexel[heightChannel];
 
 	// Linear search
-	for (int i = 0; i < numSteps && samplePositionTexspace.z < sampledDepth; ++i)
+	for (int i = 0; i < RELIEF_STEPS && samplePositionTexspace.z < sampledDepth; ++i)
 	{
 		samplePositionTexspace += rayIncrementTexSpace;
-		sampledDepth = texture(uBumpTexture, samplePositionTexspace.xy).r;
+		bumpTexel = SampleMaterialTexture(2, samplePositionTexspace.xy);
+		sampledDepth = bumpTexel[heightChannel];
 	}
 
 	return samplePositionTexspace.xy;
@@ -173,18 +264,21 @@ void main()
 	vec2 texCoords = vTexCoord;
 
 	// Relief map
-	if (noBump == 0.0)
-		texCoords = ReliefMapping(vTexCoord, TBN);
+	vec4 bumpTexel = vec4(0.0);
+	if (USE_RELIEF_MAP)
+		texCoords = ReliefMapping(vTexCoord, TBN, bumpTexel);
 
-	vec3 albedo = texture(uTexture, texCoords).rgb;	
-
-	if (noTexture == 1)
-		oAlbedo = vec4(0.5);
+	vec3 albedo = SampleAlbedo(texCoords).rgb;
 
 	// Normal map
-	if (noNormal == 0.0)
+	if (USE_NORMAL_MAP)
 	{
-		vec3 tangentSpaceNormal = texture(uNormalMap, texCoords).xyz * 2.0 - vec3(1.0);
+		// Packed with the height, the last relief mapping fetch has it already
+		vec4 normalTexel = USE_RELIEF_MAP && HasMaterialTexture(MATERIAL_PACKED_NORMAL_HEIGHT) ? bumpTexel : SampleMaterialTexture(1, texCoords);
+
+		// Only XY are stored (BC5 or BC7 when cooked), Z is always positive in tangent space
+		vec2 normalXY = vec2(normalTexel[MaterialChannel(SWIZZLE_NORMAL_X)], normalTexel[MaterialChannel(SWIZZLE_NORMAL_Y)]) * 2.0 - vec2(1.0);
+		vec3 tangentSpaceNormal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
 		N = TBN * tangentSpaceNormal;
 	}
 	
@@ -236,7 +330,7 @@ void main()
     oColor = vec4(ambientColor + finalDiffuse + finalSpecular, 1.0);
 
     oNormals = vec4(normalize(vNormal), 1.0); 
-	oAlbedo = texture(uTexture, vTexCoord);
+	oAlbedo = SampleAlbedo(vTexCoord);
 
 	float depth = LinearizeDepth(gl_FragCoord.z) / far; // divide by far for demonstration
 	oDepth = vec4(vec3(depth), 1.0);
@@ -304,6 +398,9 @@ void main()
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
+// The feedback must only come from the visible surfaces
+layout(early_fragment_tests) in;
+
 struct Light
 {
 	unsigned int type;
@@ -319,13 +416,84 @@ in vec3 vViewDir;		// in worldspace
 in vec3 vTangent;		// in worldspace
 in vec3 vBitangent;		// in worldspace
 
-uniform sampler2D uTexture;
-uniform sampler2D uNormalMap;
-uniform sampler2D uBumpTexture;
+// Material textures (see texture_arrays.h)
+struct Material
+{
+	vec4 albedo;	// color and smoothness
+	uvec4 layers;	// albedo, normal and bump map layers, flags
+	uvec2 handles[3];	// of the arrays holding them, BINDLESS_TEXTURES only
+};
+
+#define MATERIAL_ALBEDO_MAP 1u
+#define MATERIAL_NORMAL_MAP 2u
+#define MATERIAL_BUMP_MAP   4u
+#define MATERIAL_PACKED_NORMAL_HEIGHT 8u
+
+// Values whose channel is in the material swizzle (MATERIAL_SWIZZLE in engine.cpp)
+#define SWIZZLE_NORMAL_X 0u
+#define SWIZZLE_NORMAL_Y 1u
+#define SWIZZLE_HEIGHT   2u
+
+layout(binding = 0, std430) readonly buffer Materials
+{
+	Material uMaterials[];
+};
+
+uniform uint uMaterialIdx;
+#ifndef BINDLESS_TEXTURES
+layout(binding = 16) uniform sampler2DArray uTextureArrays[12];
+uniform ivec3 uTextureSlots;	// array holding the albedo, normal and bump maps
+#endif
 uniform float uBumpiness;
-uniform int noTexture;
-uniform int noNormal;
-uniform int noBump;
+
+// Permutations (see programs.h), chosen per material by Render
+//   NORMAL_MAP:     the material has a normal map and normal mapping is on
+//   RELIEF_MAP:     the material has a bump map and relief mapping is on
+//   NO_TEXTURE:     the material has no albedo map, its color is used instead
+//   BINDLESS_TEXTURES: the maps are sampled through the handles of the material
+//                   table (ARB_bindless_texture), not through the array slots
+//   RELIEF_STEPS=N: linear search steps of the relief mapping, 8, 16, 32 or 64
+//                   (see QuantizeReliefSteps)
+// The code tests the constants below rather than the defines. The GLSL compiler
+// folds them, and a module cooked to SPIR-V gets them as specialization
+// constants (SHADER_SPEC_*), so one module serves every permutation
+#if defined(GL_SPIRV)
+layout(constant_id = 0) const int RELIEF_STEPS = 32;
+layout(constant_id = 1) const bool USE_NORMAL_MAP = false;
+layout(constant_id = 2) const bool USE_RELIEF_MAP = false;
+layout(constant_id = 3) const bool USE_NO_TEXTURE = false;
+#else
+#ifndef RELIEF_STEPS
+#define RELIEF_STEPS 32
+#endif
+#ifdef NORMAL_MAP
+const bool USE_NORMAL_MAP = true;
+#else
+const bool USE_NORMAL_MAP = false;
+#endif
+#ifdef RELIEF_MAP
+const bool USE_RELIEF_MAP = true;
+#else
+const bool USE_RELIEF_MAP = false;
+#endif
+#ifdef NO_TEXTURE
+const bool USE_NO_TEXTURE = true;
+#else
+const bool USE_NO_TEXTURE = false;
+#endif
+#endif
+
+// Virtual texturing (see virtual_texturing.h)
+#define VT_PAGE_SIZE          128.0
+#define VT_PAGE_BORDER        4.0
+#define VT_PHYSICAL_PAGE_SIZE 136.0
+#define VT_FEEDBACK_SCALE     8
+
+layout(binding = 3) uniform usampler2D uIndirection; // per page: atlas slot x, y, level of the page, valid
+layout(binding = 4) uniform sampler2D uPhysicalPages;
+uniform vec4 uVirtualTexture;       // level 0 size, level count, id + 1 (0 when not virtual)
+uniform ivec2 uFeedbackOffset;      // pixel of every block that writes the feedback this frame
+layout(binding = 0, rgba16ui) uniform writeonly uimage2D uFeedback;
 
 layout(binding = 0, std140) uniform GlobalParams
 {
@@ -349,10 +517,39 @@ float LinearizeDepth(float depth)
     return (2.0 * near * far) / (far + near - z * (far - near));	
 }
 
-vec2 ReliefMapping(vec2 texCoords, mat3 TBN)
+// map: 0 albedo, 1 normal, 2 bump
+vec4 SampleMaterialTexture(int map, vec2 texCoords)
+{
+	float layer = float(uMaterials[uMaterialIdx].layers[map]);
+#ifdef BINDLESS_TEXTURES
+	return texture(sampler2DArray(uMaterials[uMaterialIdx].handles[map]), vec3(texCoords, layer));
+#else
+	return texture(uTextureArrays[uTextureSlots[map]], vec3(texCoords, layer));
+#endif
+}
+
+bool HasMaterialTexture(uint flag)
+{
+	return (uMaterials[uMaterialIdx].layers.w & flag) != 0u;
+}
+
+// Channel of the material textures holding a SWIZZLE_* value
+uint MaterialChannel(uint value)
 {
-	int numSteps = 30;
+	return (uMaterials[uMaterialIdx].layers.w >> (8u + 4u * value)) & 0xFu;
+}
+
+// The material color when it has no albedo map
+vec4 SampleAlbedo(vec2 texCoords)
+{
+	if (USE_NO_TEXTURE)
+		return vec4(uMaterials[uMaterialIdx].albedo.rgb, 1.0);
+	return SampleMaterialTexture(0, texCoords);
+}
 
+// Also returns the bump map texel at the coordinates found
+vec2 ReliefMapping(vec2 texCoords, mat3 TBN, out vec4 bumpTexel)
+{
 	// Compute the view ray in texture space
 	vec3 rayTexSpace = transpose(TBN) * normalize(vViewDir.xyz);
 
@@ -360,22 +557,61 @@ vec2 ReliefMapping(vec2 texCoords, mat3 TBN)
 	float texSize = 256;
 	vec3 rayIncrementTexSpace;
 	rayIncrementTexSpace.xy = -1 * uBumpiness * rayTexSpace.xy / abs(rayTexSpace.z * texSize);
-	rayIncrementTexSpace.z = 1.0 / numSteps;
+	rayIncrementTexSpace.z = 1.0 / float(RELIEF_STEPS);
 
 	// Sampling state
+	uint heightChannel = MaterialChannel(SWIZZLE_HEIGHT);
 	vec3 samplePositionTexspace = vec3(texCoords, 0.0);
-	float sampledDepth = texture(uBumpTexture, samplePositionTexspace.xy).r;
+	bumpTexel = SampleMaterialTexture(2, samplePositionTexspace.xy);
+	float sampledDepth = bumpTexel[heightChannel];
 
 	// Linear search
-	for (int i = 0; i < numSteps && samplePositionTexspace.z < sampledDepth; ++i)
+	for (int i = 0; i < RELIEF_STEPS && samplePositionTexspace.z < sampledDepth; ++i)
 	{
 		samplePositionTexspace += rayIncrementTexSpace;
-		sampledDepth = texture(uBumpTexture, samplePositionTexspace.xy).r;
+		bumpTexel = SampleMaterialTexture(2, samplePositionTexspace.xy);
+		sampledDepth = bumpTexel[heightChannel];
 	}
 
 	return samplePositionTexspace.xy;
 }
 
+vec4 SampleVirtualTexture(vec2 texCoords)
+{
+	vec2 size = uVirtualTexture.xy;
+	int levelCount = int(uVirtualTexture.z);
+
+	// Same level the hardware would pick (without anisotropy)
+	vec2 dx = dFdx(texCoords * size);
+	vec2 dy = dFdy(texCoords * size);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+
+	// Smaller than a page: the regular texture has those mips
+	if (lod >= float(levelCount) - 0.5)
+		return SampleAlbedo(texCoords);
+
+	int level = clamp(int(lod + 0.5), 0, levelCount - 1);
+	vec2 texels = clamp(texCoords, 0.0, 1.0) * size;
+	ivec2 page = min(ivec2(texels / (VT_PAGE_SIZE * exp2(float(level)))), textureSize(uIndirection, level) - 1);
+
+	ivec2 feedbackPixel = ivec2(gl_FragCoord.xy);
+	if (feedbackPixel % VT_FEEDBACK_SCALE == uFeedbackOffset)
+		imageStore(uFeedback, feedbackPixel / VT_FEEDBACK_SCALE, uvec4(page, level, uint(uVirtualTexture.w)));
+
+	// Not resident: the indirection points to the closest coarser page that is
+	uvec4 entry = texelFetch(uIndirection, page, level);
+	if (entry.w == 0u)
+		return SampleAlbedo(texCoords);
+
+	// Clamped like GL_CLAMP_TO_EDGE at the level of the page found
+	float scale = exp2(float(entry.z));
+	vec2 levelTexels = clamp(texels / scale, vec2(0.5), size / scale - vec2(0.5));
+	vec2 inPage = levelTexels - vec2(page >> (int(entry.z) - level)) * VT_PAGE_SIZE;
+
+	vec2 physical = vec2(entry.xy) * VT_PHYSICAL_PAGE_SIZE + VT_PAGE_BORDER + inPage;
+	return textureLod(uPhysicalPages, physical / vec2(textureSize(uPhysicalPages, 0)), 0.0);
+}
+
 void main()
 {
 	vec3 T = normalize(vTangent);		// tangent
@@ -387,21 +623,27 @@ void main()
 	vec2 texCoords = vTexCoord;
 
 	// Relief map
-	if (noBump == 0.0)
-		texCoords = ReliefMapping(vTexCoord, TBN);
+	vec4 bumpTexel = vec4(0.0);
+	if (USE_RELIEF_MAP)
+		texCoords = ReliefMapping(vTexCoord, TBN, bumpTexel);
 
 	// Normal map
-	if (noNormal == 0.0)
+	if (USE_NORMAL_MAP)
 	{
-		vec3 tangentSpaceNormal = texture(uNormalMap, texCoords).xyz * 2.0 - vec3(1.0);
+		// Packed with the height, the last relief mapping fetch has it already
+		vec4 normalTexel = USE_RELIEF_MAP && HasMaterialTexture(MATERIAL_PACKED_NORMAL_HEIGHT) ? bumpTexel : SampleMaterialTexture(1, texCoords);
+
+		// Only XY are stored (BC5 or BC7 when cooked), Z is always positive in tangent space
+		vec2 normalXY = vec2(normalTexel[MaterialChannel(SWIZZLE_NORMAL_X)], normalTexel[MaterialChannel(SWIZZLE_NORMAL_Y)]) * 2.0 - vec2(1.0);
+		vec3 tangentSpaceNormal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
 		N = TBN * tangentSpaceNormal;
 	}
 
 	oNormals = vec4(N, 1.0);
-	oAlbedo = texture(uTexture, texCoords);
-
-	if(noTexture == 1.0)
-		oAlbedo = vec4(0.5);
+	if (uVirtualTexture.w > 0.0)
+		oAlbedo = SampleVirtualTexture(texCoords);
+	else
+		oAlbedo = SampleAlbedo(texCoords);
 
 	float depth = LinearizeDepth(gl_FragCoord.z) / far; // divide by far for demonstration
 	oDepth = vec4(vec3(depth), 1.0);